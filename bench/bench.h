@@ -0,0 +1,27 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Helpers shared by the benchmarks. Each benchmark is its own program that
+// prints its timings; none of them are run by ctest, as the numbers depend
+// on the machine. Take the best of several runs, and compare builds on the
+// same machine only.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_RUNS 5
+
+// Wall clock time in seconds.
+static inline double bench_now(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+// Keep the compiler from optimising a result away.
+static volatile unsigned bench_sink;
@@ -0,0 +1,79 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Composing CGA frames: full redraws in 80x25 text, 320x200 (2 bits per
+// pixel) and 640x200 (1 bit per pixel), a frame after a single VRAM write,
+// and a frame with no writes at all.
+
+#include "bench.h"
+#include "bus.h"
+#include "cga.h"
+
+#define BENCH_FRAMES    2000
+
+enum redraw
+{
+    REDRAW_FULL,
+    REDRAW_ONE_WRITE,
+    REDRAW_NONE
+};
+
+// Returns us per frame.
+static double run(struct bus* bus, struct cga* cga, uint8_t mode, enum redraw redraw)
+{
+    bus_out_byte(bus, CGA_PORTS + 0x8, mode);
+    double best = 1e30;
+    for (unsigned run = 0; run < BENCH_RUNS; run++)
+    {
+        double start = bench_now();
+        for (unsigned frame = 0; frame < BENCH_FRAMES; frame++)
+        {
+            if (redraw == REDRAW_FULL)
+                cga->redraw = true;
+            else if (redraw == REDRAW_ONE_WRITE)
+                bus_write_byte(bus, CGA_VRAM + frame * 13 % 8000, (uint8_t)frame);
+
+            // Keep the cursor and blink phases from changing.
+            cga->frames = 0;
+            cga_compose(bus, cga);
+        }
+        double elapsed = bench_now() - start;
+        if (elapsed < best)
+            best = elapsed;
+    }
+    bench_sink = cga->pixels[12345];
+    return best / BENCH_FRAMES * 1e6;
+}
+
+int main(void)
+{
+    struct bus* bus = bus_new(0x100000, false);
+    struct cga* cga = cga_new(bus, NULL);
+    uint32_t seed = 1;
+    for (unsigned i = 0; i < CGA_VRAM_SIZE; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        bus->memory[CGA_VRAM + i] = (uint8_t)(seed >> 16);
+    }
+
+    static const struct
+    {
+        const char* name;
+        uint8_t mode;
+    } modes[] =
+    {
+        { "80x25 text", CGA_MODE_HIRES_TEXT | CGA_MODE_ENABLE },
+        { "320x200", CGA_MODE_GRAPHICS | CGA_MODE_ENABLE },
+        { "640x200", CGA_MODE_GRAPHICS | CGA_MODE_ENABLE | CGA_MODE_HIRES_GRAPHICS },
+    };
+    printf("us/frame      full redraw  one write  no writes\n");
+    for (unsigned i = 0; i < sizeof(modes) / sizeof(*modes); i++)
+    {
+        double full = run(bus, cga, modes[i].mode, REDRAW_FULL);
+        double one = run(bus, cga, modes[i].mode, REDRAW_ONE_WRITE);
+        double none = run(bus, cga, modes[i].mode, REDRAW_NONE);
+        printf("%-12s %12.2f %10.2f %10.3f\n", modes[i].name, full, one, none);
+    }
+    bus_free(bus);
+    return 0;
+}
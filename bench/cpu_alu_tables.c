@@ -0,0 +1,63 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Byte ALU tables against computing the flags: a long run of byte ALU and
+// decimal adjust instructions on registers, clocked with and without them.
+
+#include "bench.h"
+#include "bus.h"
+#include "cpu8086.h"
+
+// ADD AL, BL / SUB BL, AL / ADC AH, AL / CMP AL, CL / AND CL, BL / XOR CL, AL /
+// SBB DL, BL / ADD CL, 7 / DAA.
+static const uint8_t block[] =
+{
+    0x00, 0xD8, 0x28, 0xC3, 0x10, 0xE0, 0x38, 0xC8, 0x20, 0xD9,
+    0x30, 0xC1, 0x18, 0xDA, 0x80, 0xC1, 0x07, 0x27
+};
+
+#define BENCH_CODE  0x7F00
+
+static double run(bool tables, unsigned long* clocks)
+{
+    double best = 1e30;
+    struct bus* bus = bus_new(0x100000, false);
+    struct cpu8086* cpu = bus->cpu;
+    for (unsigned i = 0; i + sizeof(block) <= BENCH_CODE; i += sizeof(block))
+        memcpy(&bus->memory[0x10000 + i], block, sizeof(block));
+    cpu8086_set_alu_tables(cpu, tables);
+
+    for (unsigned run = 0; run < BENCH_RUNS; run++)
+    {
+        *clocks = 0;
+        double start = bench_now();
+        for (unsigned pass = 0; pass < 20; pass++)
+        {
+            cpu8086_reset(cpu);
+            cpu->cs = 0x1000;
+            cpu8086_update_segments(cpu);
+            while (cpu->current_ip < BENCH_CODE - sizeof(block))
+            {
+                cpu8086_clock(cpu);
+                ++*clocks;
+            }
+        }
+        double elapsed = bench_now() - start;
+        if (elapsed < best)
+            best = elapsed;
+    }
+    bench_sink = cpu->ax;
+    bus_free(bus);
+    return best;
+}
+
+int main(void)
+{
+    unsigned long clocks;
+    double computed = run(false, &clocks);
+    printf("computed flags:   %6.2f ns/clock\n", computed / clocks * 1e9);
+    double tables = run(true, &clocks);
+    printf("byte ALU tables:  %6.2f ns/clock (%+.1f%%)\n", tables / clocks * 1e9,
+           (tables / computed - 1.0) * 100.0);
+    return 0;
+}
@@ -0,0 +1,55 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// How much bus micro-op mode costs: the same loop of memory-operand
+// instructions, clocked with and without arbitrating their bus cycles
+// against prefetches.
+
+#include "bench.h"
+#include "bus.h"
+#include "cpu8086.h"
+
+#define BENCH_CLOCKS 20000000
+
+// ADD [BX+SI], AX / MOV AX, [BX+SI] / PUSH AX / POP DX / MOVSW /
+// XOR DX, DX / JZ back to the start.
+static const uint8_t loop[] = { 0x01, 0x00, 0x8B, 0x00, 0x50, 0x5A, 0xA5, 0x31, 0xD2, 0x74, 0xF5 };
+
+static double run(bool bus_uops)
+{
+    double best = 0.0;
+    for (unsigned i = 0; i < BENCH_RUNS; i++)
+    {
+        struct bus* bus = bus_new(0x100000, false);
+        struct cpu8086* cpu = bus->cpu;
+        memcpy(&bus->memory[0x100], loop, sizeof(loop));
+        cpu->cs = 0;
+        cpu->ip = cpu->current_ip = 0x100;
+        cpu->sp = 0x8000;
+        cpu->ds = 0x1000;       // Keep the data away from the code.
+        cpu->es = 0x2000;
+        cpu8086_update_segments(cpu);
+        cpu8086_set_bus_uops(cpu, bus_uops);
+
+        double start = bench_now();
+        for (unsigned clock = 0; clock < BENCH_CLOCKS; clock++)
+            cpu8086_clock(cpu);
+        double elapsed = bench_now() - start;
+        bench_sink = cpu->ax;
+        bus_free(bus);
+
+        double rate = BENCH_CLOCKS / elapsed / 1e6;
+        if (rate > best)
+            best = rate;
+    }
+    return best;
+}
+
+int main(void)
+{
+    double countdown = run(false);
+    double uops = run(true);
+    printf("cycle countdown:  %8.1f Mclocks/s\n", countdown);
+    printf("bus micro-ops:    %8.1f Mclocks/s (%+.1f%%)\n", uops, (uops / countdown - 1.0) * 100.0);
+    return 0;
+}
@@ -0,0 +1,79 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Instructions per second through cpu8086_clock, for a few instruction mixes
+// laid out as straight-line code, with and without bus micro-ops.
+
+#include "bench.h"
+#include "bus.h"
+#include "cpu8086.h"
+
+#define BENCH_CODE      0x7F00
+#define BENCH_PASSES    40
+
+struct mix
+{
+    const char* name;
+    unsigned instructions;          // In each block.
+    uint8_t block[24];
+    unsigned length;
+};
+
+static const struct mix mixes[] =
+{
+    // ADD AX, BX / SUB CX, AX / ADC DX, CX / CMP AX, DX / AND BX, CX /
+    // XOR SI, AX / OR DI, SI / INC AX.
+    { "ALU reg/reg", 8,
+      { 0x01, 0xD8, 0x29, 0xC1, 0x11, 0xCA, 0x39, 0xD0, 0x21, 0xCB, 0x31, 0xC6, 0x09, 0xF7, 0x40 }, 15 },
+
+    // MOV AX, [BX+SI] / ADD [BX+SI+2], AX / PUSH AX / POP CX / MOV [DI], CX /
+    // ADD AX, 1234h.
+    { "memory and stack", 6,
+      { 0x8B, 0x00, 0x01, 0x40, 0x02, 0x50, 0x59, 0x89, 0x0D, 0x05, 0x34, 0x12 }, 12 },
+
+    // JZ +0 / JNZ +0 / LAHF / SAHF / PUSHF / POPF.
+    { "flags and branches", 6,
+      { 0x74, 0x00, 0x75, 0x00, 0x9F, 0x9E, 0x9C, 0x9D }, 8 },
+};
+
+static double run(const struct mix* mix, bool bus_uops)
+{
+    struct bus* bus = bus_new(0x100000, false);
+    struct cpu8086* cpu = bus->cpu;
+    unsigned blocks = BENCH_CODE / mix->length;
+    for (unsigned i = 0; i < blocks; i++)
+        memcpy(&bus->memory[0x10000 + i * mix->length], mix->block, mix->length);
+    unsigned end = (blocks - 1) * mix->length;
+
+    double best = 1e30;
+    for (unsigned run = 0; run < BENCH_RUNS; run++)
+    {
+        double start = bench_now();
+        for (unsigned pass = 0; pass < BENCH_PASSES; pass++)
+        {
+            cpu8086_reset(cpu);
+            cpu->cs = 0x1000;
+            cpu->ds = cpu->ss = 0x3000;
+            cpu->bx = 0x100;
+            cpu->sp = 0x8000;
+            cpu8086_update_segments(cpu);
+            cpu8086_set_bus_uops(cpu, bus_uops);
+            while (cpu->current_ip < end)
+                cpu8086_clock(cpu);
+        }
+        double elapsed = bench_now() - start;
+        if (elapsed < best)
+            best = elapsed;
+    }
+    bench_sink = cpu->ax;
+    bus_free(bus);
+    return (double)(blocks - 1) * mix->instructions * BENCH_PASSES / best / 1e6;
+}
+
+int main(void)
+{
+    printf("M instructions/s     countdown  bus micro-ops\n");
+    for (unsigned i = 0; i < sizeof(mixes) / sizeof(*mixes); i++)
+        printf("%-20s %9.1f  %13.1f\n", mixes[i].name, run(&mixes[i], false), run(&mixes[i], true));
+    return 0;
+}
@@ -0,0 +1,109 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Huge-page backing: many machines with 1 MB of RAM each, clocked
+// round-robin in short slices while their guest code walks data spread over
+// every segment, with plain and with huge-page arenas.
+//
+//   bench_huge_pages [machines slice]
+
+#include "bench.h"
+#include "arena.h"
+#include "bus.h"
+#include "cpu8086.h"
+
+#define BENCH_CLOCKS    40000000
+
+// MOV AX, [BX] / ADD [BX+DI], AX / ADD BX, SI / ADD DI, BP.
+static const uint8_t block[] = { 0x8B, 0x07, 0x01, 0x01, 0x01, 0xF3, 0x01, 0xEF };
+
+static void restart(struct cpu8086* cpu, unsigned i)
+{
+    cpu8086_reset(cpu);
+    cpu->cs = 0xE000;
+    cpu->ds = (uint16_t)(0x1000 * (i % 12));
+    cpu8086_update_segments(cpu);
+}
+
+// Returns ns per clock, after a warm-up.
+static double run(bool huge_pages, unsigned machines, unsigned slice, bool report)
+{
+    struct bus** buses = malloc(sizeof(*buses) * machines);
+    if (!buses)
+        abort();
+    unsigned pages[3] = { 0 };
+    for (unsigned i = 0; i < machines; i++)
+    {
+        struct bus* bus = buses[i] = bus_new(0x100000, huge_pages);
+        pages[bus->arena->pages]++;
+        for (unsigned j = 0; j + sizeof(block) <= 0x10000; j += sizeof(block))
+            memcpy(&bus->memory[0xE0000 + j], block, sizeof(block));
+        struct cpu8086* cpu = bus->cpu;
+        restart(cpu, i);
+        cpu->si = (uint16_t)(0x1234 + 0x402 * (i & 7));
+        cpu->bp = 0x3456;
+        cpu->bx = (uint16_t)(i * 64);
+    }
+
+    unsigned rounds = BENCH_CLOCKS / slice / machines;
+    unsigned long clocks = 0;
+    double start = 0.0;
+    for (unsigned round = 0; round < rounds; round++)
+    {
+        if (round == rounds / 10)
+        {
+            clocks = 0;
+            start = bench_now();
+        }
+        for (unsigned i = 0; i < machines; i++)
+        {
+            struct cpu8086* cpu = buses[i]->cpu;
+            for (unsigned j = 0; j < slice; j++)
+                cpu8086_clock(cpu);
+            if (cpu->current_ip > 0xF000)
+                restart(cpu, i);
+            clocks += slice;
+        }
+    }
+    double elapsed = bench_now() - start;
+
+    if (report)
+        printf("  %s: %u plain, %u transparent, %u hugetlb\n", huge_pages ? "huge " : "plain",
+               pages[ARENA_PAGES_NORMAL], pages[ARENA_PAGES_TRANSPARENT], pages[ARENA_PAGES_HUGETLB]);
+    for (unsigned i = 0; i < machines; i++)
+        bus_free(buses[i]);
+    free(buses);
+    return elapsed / clocks * 1e9;
+}
+
+int main(int argc, char** argv)
+{
+    static const unsigned configs[][2] = { { 256, 32 }, { 64, 64 }, { 16, 256 } };
+    unsigned count = sizeof(configs) / sizeof(*configs);
+    unsigned custom[1][2];
+    const unsigned (*list)[2] = configs;
+    if (argc == 3)
+    {
+        custom[0][0] = (unsigned)strtoul(argv[1], NULL, 10);
+        custom[0][1] = (unsigned)strtoul(argv[2], NULL, 10);
+        if (!custom[0][0] || !custom[0][1])
+            return 1;
+        list = (const unsigned (*)[2])custom;
+        count = 1;
+    }
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        double plain = 1e30, huge = 1e30;
+        printf("%u machines, %u clock slices\n", list[i][0], list[i][1]);
+        for (unsigned j = 0; j < BENCH_RUNS; j++)
+        {
+            double t = run(false, list[i][0], list[i][1], j == 0);
+            plain = t < plain ? t : plain;
+            t = run(true, list[i][0], list[i][1], j == 0);
+            huge = t < huge ? t : huge;
+        }
+        printf("  plain %.2f ns/clock, huge %.2f ns/clock\n", plain, huge);
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// What the speaker costs: host time to synthesise an emulated second of a
+// 1 kHz beep, read at 60 Hz, against the time to emulate that second.
+
+#include "bench.h"
+#include "bus.h"
+#include "cpu8086.h"
+#include "pit.h"
+
+#define BENCH_RATE      48000
+#define BENCH_SECONDS   4
+
+static int16_t samples[BENCH_RATE];
+
+// Seconds of host time per emulated second, rendering the speaker only.
+static double speaker(void)
+{
+    double best = 1e9;
+    for (unsigned i = 0; i < BENCH_RUNS; i++)
+    {
+        struct bus* bus = bus_new(0x100000, false);
+        struct pit* pit = pit_new(bus, BENCH_RATE);
+        bus_out_byte(bus, 0x43, 0xB6);
+        bus_out_byte(bus, 0x42, 1193 & 0xFF);
+        bus_out_byte(bus, 0x42, 1193 >> 8);
+        bus_out_byte(bus, PIT_PPI_PORT, 3);
+
+        double start = bench_now();
+        for (unsigned frame = 0; frame < BENCH_SECONDS * 60; frame++)
+        {
+            bus->clock += BUS_MASTER_CLOCK / 60;
+            bench_sink += (unsigned)pit_audio(bus, pit, samples, BENCH_RATE);
+        }
+        double elapsed = (bench_now() - start) / BENCH_SECONDS;
+        bus_free(bus);
+        if (elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+// Seconds of host time per emulated second, running a NOP loop.
+static double emulation(void)
+{
+    double best = 1e9;
+    for (unsigned i = 0; i < BENCH_RUNS; i++)
+    {
+        struct bus* bus = bus_new(0x100000, false);
+        struct cpu8086* cpu = bus->cpu;
+        // 64 NOPs / XOR AX, AX / JZ back to the start.
+        memset(&bus->memory[0x100], 0x90, 64);
+        memcpy(&bus->memory[0x140], (const uint8_t[]){ 0x31, 0xC0, 0x74, 0xBC }, 4);
+        cpu->cs = 0;
+        cpu->ip = cpu->current_ip = 0x100;
+        cpu8086_update_segments(cpu);
+
+        uint64_t end = bus->clock + BUS_MASTER_CLOCK;
+        double start = bench_now();
+        while (bus->clock < end)
+            bus_clock(bus);
+        double elapsed = bench_now() - start;
+        bench_sink += cpu->ax;
+        bus_free(bus);
+        if (elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+int main(void)
+{
+    double audio = speaker();
+    double cpu = emulation();
+    printf("speaker:    %8.3f ms per emulated second\n", audio * 1e3);
+    printf("emulation:  %8.3f ms per emulated second (speaker %.2f%% of it)\n", cpu * 1e3,
+           audio / cpu * 100.0);
+    return 0;
+}
@@ -0,0 +1,571 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <assert.h>
+#include <math.h>
+
+#include "adlib.h"
+#include "audio.h"
+
+// Defining ADLIB_SCALAR builds the fallback on SSE2 hosts too, for comparison.
+#if !defined(ADLIB_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#   define ADLIB_SSE2
+#   include <emmintrin.h>
+#endif
+
+// The chip's own sample rate (its 3.58 MHz clock / 72), which its frequency
+// numbers are relative to.
+#define ADLIB_NATIVE_RATE       (3579545.0f / 72.0f)
+
+// Envelope levels, in dB.
+#define ADLIB_SILENT            96.0f   // Quietest level the envelope generator reaches.
+#define ADLIB_SILENCE           128.0f  // Level of operators that are off.
+#define ADLIB_ATTACK_DONE       0.1f    // Attack switches to decay below this.
+
+// Operator slot of each channel's modulator. Its carrier is 3 slots on.
+static const uint8_t adlib_channel_slot[ADLIB_CHANNELS] = { 0, 1, 2, 8, 9, 10, 16, 17, 18 };
+
+// Channel of each operator slot (0x20-0x35 and so on), or -1 for the gaps.
+static const int8_t adlib_slot_channel[0x16] =
+{
+    0, 1, 2, 0, 1, 2, -1, -1, 3, 4, 5, 3, 4, 5, -1, -1, 6, 7, 8, 6, 7, 8
+};
+
+// Frequency multiples, doubled.
+static const uint8_t adlib_multiple[16] = { 1, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 20, 24, 24, 30, 30 };
+
+// Key scaling: attenuation by the top 4 bits of the frequency number, in
+// 0.75 dB units at the top octave, and the shift for each KSL setting (off,
+// 3, 1.5 and 6 dB per octave).
+static const uint8_t adlib_ksl[16] = { 0, 32, 40, 45, 48, 51, 53, 55, 56, 58, 59, 60, 61, 62, 63, 64 };
+static const uint8_t adlib_ksl_shift[4] = { 8, 1, 2, 0 };
+
+// Four lanes of floats, as SSE2 vectors or as plain arrays.
+#define ADLIB_WIDTH             4
+
+#ifdef ADLIB_SSE2
+typedef __m128 adlib_vec;
+
+static inline adlib_vec adlib_load(const float* p) { return _mm_loadu_ps(p); }
+static inline void adlib_store(float* p, adlib_vec a) { _mm_storeu_ps(p, a); }
+static inline adlib_vec adlib_set(float x) { return _mm_set1_ps(x); }
+static inline adlib_vec adlib_add(adlib_vec a, adlib_vec b) { return _mm_add_ps(a, b); }
+static inline adlib_vec adlib_sub(adlib_vec a, adlib_vec b) { return _mm_sub_ps(a, b); }
+static inline adlib_vec adlib_mul(adlib_vec a, adlib_vec b) { return _mm_mul_ps(a, b); }
+static inline adlib_vec adlib_min(adlib_vec a, adlib_vec b) { return _mm_min_ps(a, b); }
+static inline adlib_vec adlib_abs(adlib_vec a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+
+// 1 in the lanes where a < b, else 0.
+static inline adlib_vec adlib_less(adlib_vec a, adlib_vec b)
+{
+    return _mm_and_ps(_mm_cmplt_ps(a, b), _mm_set1_ps(1.0f));
+}
+
+static inline adlib_vec adlib_floor(adlib_vec a)
+{
+    // Truncation rounds negative fractions up.
+    adlib_vec t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+}
+
+// 2^a, for a <= 0: the integer part goes straight into the exponent bits and
+// a cubic covers the fraction (to within 0.001 dB).
+static inline adlib_vec adlib_exp2(adlib_vec a)
+{
+    a = _mm_max_ps(a, _mm_set1_ps(-126.0f));
+    adlib_vec whole = adlib_floor(a);
+    adlib_vec f = _mm_sub_ps(a, whole);
+    adlib_vec p = _mm_add_ps(_mm_set1_ps(0.2262208f), _mm_mul_ps(f, _mm_set1_ps(0.0782318f)));
+    p = _mm_add_ps(_mm_set1_ps(0.6951786f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(f, p));
+    __m128i exponent = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(whole), _mm_set1_epi32(127)), 23);
+    return _mm_mul_ps(p, _mm_castsi128_ps(exponent));
+}
+
+static inline float adlib_sum(adlib_vec a)
+{
+    a = _mm_add_ps(a, _mm_movehl_ps(a, a));
+    a = _mm_add_ss(a, _mm_shuffle_ps(a, a, 1));
+    return _mm_cvtss_f32(a);
+}
+#else
+typedef struct { float f[ADLIB_WIDTH]; } adlib_vec;
+
+#define ADLIB_LANEWISE(expression) \
+    adlib_vec r; \
+    for (unsigned i = 0; i < ADLIB_WIDTH; i++) \
+        r.f[i] = (expression); \
+    return r;
+
+static inline adlib_vec adlib_load(const float* p) { ADLIB_LANEWISE(p[i]) }
+static inline void adlib_store(float* p, adlib_vec a) { for (unsigned i = 0; i < ADLIB_WIDTH; i++) p[i] = a.f[i]; }
+static inline adlib_vec adlib_set(float x) { ADLIB_LANEWISE(x) }
+static inline adlib_vec adlib_add(adlib_vec a, adlib_vec b) { ADLIB_LANEWISE(a.f[i] + b.f[i]) }
+static inline adlib_vec adlib_sub(adlib_vec a, adlib_vec b) { ADLIB_LANEWISE(a.f[i] - b.f[i]) }
+static inline adlib_vec adlib_mul(adlib_vec a, adlib_vec b) { ADLIB_LANEWISE(a.f[i] * b.f[i]) }
+static inline adlib_vec adlib_min(adlib_vec a, adlib_vec b) { ADLIB_LANEWISE(a.f[i] < b.f[i] ? a.f[i] : b.f[i]) }
+static inline adlib_vec adlib_abs(adlib_vec a) { ADLIB_LANEWISE(fabsf(a.f[i])) }
+static inline adlib_vec adlib_less(adlib_vec a, adlib_vec b) { ADLIB_LANEWISE(a.f[i] < b.f[i] ? 1.0f : 0.0f) }
+static inline adlib_vec adlib_floor(adlib_vec a) { ADLIB_LANEWISE(floorf(a.f[i])) }
+static inline adlib_vec adlib_exp2(adlib_vec a) { ADLIB_LANEWISE(exp2f(a.f[i])) }
+
+static inline float adlib_sum(adlib_vec a)
+{
+    return (a.f[0] + a.f[1]) + (a.f[2] + a.f[3]);
+}
+#endif
+
+static inline adlib_vec adlib_fraction(adlib_vec a)
+{
+    return adlib_sub(a, adlib_floor(a));
+}
+
+// sin(2 pi f) for f in [0, 1), by a corrected parabola (to within 0.001).
+static inline adlib_vec adlib_sine(adlib_vec f)
+{
+    adlib_vec u = adlib_sub(adlib_add(f, f), adlib_set(1.0f));
+    adlib_vec y = adlib_mul(adlib_mul(adlib_set(-4.0f), u), adlib_sub(adlib_set(1.0f), adlib_abs(u)));
+    return adlib_add(y, adlib_mul(adlib_set(0.225f), adlib_sub(adlib_mul(y, adlib_abs(y)), y)));
+}
+
+// One of the OPL2's four waveforms at a phase in cycles, each lane weighing
+// them by wave (one of which is 1): sine, half sine, absolute sine, and the
+// first quarter of each half of an absolute sine.
+static inline adlib_vec adlib_wave(adlib_vec phase, const adlib_vec wave[4])
+{
+    adlib_vec f = adlib_fraction(phase);
+    adlib_vec s = adlib_sine(f);
+    adlib_vec a = adlib_abs(s);
+    adlib_vec first_half = adlib_less(f, adlib_set(0.5f));
+    adlib_vec first_quarter = adlib_less(adlib_fraction(adlib_add(f, f)), adlib_set(0.5f));
+    adlib_vec signed_part = adlib_mul(s, adlib_add(wave[0], adlib_mul(wave[1], first_half)));
+    adlib_vec absolute_part = adlib_mul(a, adlib_add(wave[2], adlib_mul(wave[3], first_quarter)));
+    return adlib_add(signed_part, absolute_part);
+}
+
+// Attack rate to the per-sample multiplier on the attenuation. Rate 1 takes
+// 2.8 seconds, every 4 steps of effective rate halve that, and rates from 60
+// are instant.
+static float adlib_attack(const struct adlib* adlib, unsigned rate, unsigned ksr)
+{
+    if (!rate)
+        return 1.0f;
+    unsigned effective = rate * 4 + ksr;
+    if (effective >= 60)
+        return 0.0f;
+    float seconds = 2.82624f * exp2f(-(float)(effective - 4) / 4.0f);
+    float k = logf(ADLIB_SILENT / ADLIB_ATTACK_DONE) / (seconds * adlib->rate);
+    return (k >= 1.0f) ? 0.0f : 1.0f - k;
+}
+
+// Decay or release rate to dB per sample. Rate 1 takes 39 seconds to fall
+// 96 dB, and every 4 steps of effective rate halve that.
+static float adlib_decay(const struct adlib* adlib, unsigned rate, unsigned ksr)
+{
+    if (!rate)
+        return 0.0f;
+    unsigned effective = rate * 4 + ksr;
+    if (effective > 63)
+        effective = 63;
+    float seconds = 39.28f * exp2f(-(float)(effective - 4) / 4.0f);
+    return ADLIB_SILENT / (seconds * adlib->rate);
+}
+
+// Decode a channel's registers into its lanes.
+static void adlib_refresh(struct adlib* adlib, unsigned channel)
+{
+    const uint8_t* regs = adlib->regs;
+    unsigned fnum = regs[0xA0 + channel] | (regs[0xB0 + channel] & 3) << 8;
+    unsigned block = (regs[0xB0 + channel] >> 2) & 7;
+    float frequency = (float)fnum * ADLIB_NATIVE_RATE / (float)(1 << (20 - block));
+    int ksl = adlib_ksl[fnum >> 6] * 4 - (int)(8 - block) * 32;
+    if (ksl < 0)
+        ksl = 0;
+
+    // Key scale rate: the note select bit (register 0x08) picks which bit of
+    // the frequency number counts.
+    unsigned ksr = block * 2 + ((fnum >> ((regs[0x08] & 0x40) ? 8 : 9)) & 1);
+
+    for (unsigned n = 0; n < 2; n++)
+    {
+        struct adlib_operators* op = &adlib->ops[n];
+        unsigned slot = adlib_channel_slot[channel] + 3 * n;
+        uint8_t r20 = regs[0x20 + slot], r40 = regs[0x40 + slot];
+        uint8_t r60 = regs[0x60 + slot], r80 = regs[0x80 + slot];
+        unsigned scale = (r20 & 0x10) ? ksr : ksr >> 2;
+
+        op->increment[channel] = frequency * adlib_multiple[r20 & 15] / 2.0f / (float)adlib->rate;
+        op->tremolo[channel] = (r20 & 0x80) ? 1.0f : 0.0f;
+        op->vibrato[channel] = (r20 & 0x40) ? 1.0f : 0.0f;
+        op->hold[channel] = r20 & 0x20;
+        op->level[channel] = (float)(r40 & 0x3F) * 0.75f + (float)(ksl >> adlib_ksl_shift[r40 >> 6]) * 0.1875f;
+        op->attack[channel] = adlib_attack(adlib, r60 >> 4, scale);
+        op->decay[channel] = adlib_decay(adlib, r60 & 15, scale);
+        op->sustain[channel] = ((r80 >> 4) == 15) ? 93.0f : (float)(r80 >> 4) * 3.0f;
+        op->release[channel] = adlib_decay(adlib, r80 & 15, scale);
+
+        unsigned wave = (regs[0x01] & 0x20) ? regs[0xE0 + slot] & 3 : 0;
+        for (unsigned w = 0; w < 4; w++)
+            op->wave[w][channel] = (w == wave) ? 1.0f : 0.0f;
+    }
+
+    // Feedback and modulation are in cycles of phase per unit of output.
+    unsigned feedback = (regs[0xC0 + channel] >> 1) & 7;
+    bool additive = regs[0xC0 + channel] & 1;
+    adlib->feedback[channel] = feedback ? 4.0f / (float)(1 << (9 - feedback)) : 0.0f;
+    adlib->modulation[channel] = additive ? 0.0f : 4.0f;
+    adlib->additive[channel] = additive ? 1.0f : 0.0f;
+}
+
+static void adlib_key(struct adlib* adlib, unsigned channel, bool on)
+{
+    for (unsigned n = 0; n < 2; n++)
+    {
+        struct adlib_operators* op = &adlib->ops[n];
+        if (on)
+        {
+            op->stage[channel] = ADLIB_STAGE_ATTACK;
+            op->phase[channel] = 0.0f;
+            if (op->attenuation[channel] > ADLIB_SILENT)
+                op->attenuation[channel] = ADLIB_SILENT;
+        }
+        else if (op->stage[channel] != ADLIB_STAGE_OFF)
+            op->stage[channel] = ADLIB_STAGE_RELEASE;
+    }
+}
+
+// Apply a register write to the synthesiser.
+static void adlib_apply(struct adlib* adlib, uint8_t reg, uint8_t data)
+{
+    uint8_t old = adlib->regs[reg];
+    adlib->regs[reg] = data;
+    switch (reg & 0xF0)
+    {
+        case 0x00:
+        {
+            // Waveform select enable, and note select.
+            if (reg == 0x01 || reg == 0x08)
+                for (unsigned channel = 0; channel < ADLIB_CHANNELS; channel++)
+                    adlib_refresh(adlib, channel);
+            break;
+        }
+        case 0x20: case 0x30: case 0x40: case 0x50: case 0x60:
+        case 0x70: case 0x80: case 0x90: case 0xE0: case 0xF0:
+        {
+            unsigned slot = reg & 0x1F;
+            if (slot < sizeof(adlib_slot_channel) && adlib_slot_channel[slot] >= 0)
+                adlib_refresh(adlib, (unsigned)adlib_slot_channel[slot]);
+            break;
+        }
+        case 0xA0: case 0xB0: case 0xC0:
+        {
+            unsigned channel = reg & 0x0F;
+            if (reg == 0xBD || channel >= ADLIB_CHANNELS)
+                break;
+            adlib_refresh(adlib, channel);
+            if ((reg & 0xF0) == 0xB0 && ((old ^ data) & 0x20))
+                adlib_key(adlib, channel, data & 0x20);
+            break;
+        }
+    }
+}
+
+// Move an operator lane to the envelope stage it should render the next
+// block in, and set up its envelope step for it.
+static void adlib_envelope(struct adlib_operators* op, unsigned lane)
+{
+    float* attenuation = &op->attenuation[lane];
+    float multiply = 1.0f, add = 0.0f, limit = ADLIB_SILENCE;
+    for (bool settled = false; !settled; )
+    {
+        settled = true;
+        switch (op->stage[lane])
+        {
+            case ADLIB_STAGE_OFF:
+                *attenuation = ADLIB_SILENCE;
+                break;
+            case ADLIB_STAGE_ATTACK:
+                if (*attenuation <= ADLIB_ATTACK_DONE)
+                {
+                    *attenuation = 0.0f;
+                    op->stage[lane] = ADLIB_STAGE_DECAY;
+                    settled = false;
+                    break;
+                }
+                multiply = op->attack[lane];
+                break;
+            case ADLIB_STAGE_DECAY:
+                if (*attenuation >= op->sustain[lane])
+                {
+                    // Percussive envelopes go on to release with the key held.
+                    op->stage[lane] = op->hold[lane] ? ADLIB_STAGE_SUSTAIN : ADLIB_STAGE_RELEASE;
+                    settled = false;
+                    break;
+                }
+                add = op->decay[lane];
+                limit = op->sustain[lane];
+                break;
+            case ADLIB_STAGE_SUSTAIN:
+                break;
+            case ADLIB_STAGE_RELEASE:
+                if (*attenuation >= ADLIB_SILENT)
+                {
+                    op->stage[lane] = ADLIB_STAGE_OFF;
+                    settled = false;
+                    break;
+                }
+                add = op->release[lane];
+                break;
+        }
+    }
+    op->multiply[lane] = multiply;
+    op->add[lane] = add;
+    op->limit[lane] = limit;
+}
+
+// Render a block of at most ADLIB_BLOCK samples with the current registers.
+static void adlib_render(struct adlib* adlib, int16_t* samples, size_t count)
+{
+    assert(count <= ADLIB_BLOCK);
+
+    // Envelope stages and the LFOs move once per block. Tremolo is a 3.7 Hz
+    // triangle of 1 or 4.8 dB, vibrato a 6.1 Hz sine of 7 or 14 cents.
+    float tremolo = (adlib->regs[0xBD] & 0x80) ? 4.8f : 1.0f;
+    tremolo *= 1.0f - fabsf(2.0f * adlib->tremolo_phase - 1.0f);
+    float vibrato = exp2f(((adlib->regs[0xBD] & 0x40) ? 14.0f : 7.0f) / 1200.0f) - 1.0f;
+    vibrato *= sinf(2.0f * 3.14159265f * adlib->vibrato_phase);
+    adlib->tremolo_phase = fmodf(adlib->tremolo_phase + 3.7f * (float)count / (float)adlib->rate, 1.0f);
+    adlib->vibrato_phase = fmodf(adlib->vibrato_phase + 6.1f * (float)count / (float)adlib->rate, 1.0f);
+
+    float increment[2][ADLIB_LANES], level[2][ADLIB_LANES];
+    for (unsigned n = 0; n < 2; n++)
+    {
+        struct adlib_operators* op = &adlib->ops[n];
+        for (unsigned lane = 0; lane < ADLIB_LANES; lane++)
+        {
+            adlib_envelope(op, lane);
+            increment[n][lane] = op->increment[lane] * (1.0f + op->vibrato[lane] * vibrato);
+            level[n][lane] = op->level[lane] + op->tremolo[lane] * tremolo;
+        }
+    }
+
+    // Each pass renders the block for four channels, both operators.
+    adlib_vec mix[ADLIB_BLOCK];
+    for (size_t i = 0; i < count; i++)
+        mix[i] = adlib_set(0.0f);
+    const adlib_vec decibels = adlib_set(-1.0f / 6.0206f);
+    for (unsigned lane = 0; lane < ADLIB_LANES; lane += ADLIB_WIDTH)
+    {
+        struct adlib_operators* mod = &adlib->ops[0];
+        struct adlib_operators* car = &adlib->ops[1];
+        adlib_vec mod_phase = adlib_load(mod->phase + lane), car_phase = adlib_load(car->phase + lane);
+        adlib_vec mod_att = adlib_load(mod->attenuation + lane), car_att = adlib_load(car->attenuation + lane);
+        adlib_vec mod_inc = adlib_load(increment[0] + lane), car_inc = adlib_load(increment[1] + lane);
+        adlib_vec mod_level = adlib_load(level[0] + lane), car_level = adlib_load(level[1] + lane);
+        adlib_vec mod_mul = adlib_load(mod->multiply + lane), car_mul = adlib_load(car->multiply + lane);
+        adlib_vec mod_add = adlib_load(mod->add + lane), car_add = adlib_load(car->add + lane);
+        adlib_vec mod_limit = adlib_load(mod->limit + lane), car_limit = adlib_load(car->limit + lane);
+        adlib_vec mod_wave[4], car_wave[4];
+        for (unsigned w = 0; w < 4; w++)
+        {
+            mod_wave[w] = adlib_load(mod->wave[w] + lane);
+            car_wave[w] = adlib_load(car->wave[w] + lane);
+        }
+        adlib_vec feedback = adlib_load(adlib->feedback + lane);
+        adlib_vec modulation = adlib_load(adlib->modulation + lane);
+        adlib_vec additive = adlib_load(adlib->additive + lane);
+        adlib_vec previous0 = adlib_load(adlib->previous[0] + lane);
+        adlib_vec previous1 = adlib_load(adlib->previous[1] + lane);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            mod_att = adlib_min(adlib_add(adlib_mul(mod_att, mod_mul), mod_add), mod_limit);
+            mod_phase = adlib_fraction(adlib_add(mod_phase, mod_inc));
+            adlib_vec mod_gain = adlib_exp2(adlib_mul(adlib_add(mod_att, mod_level), decibels));
+            adlib_vec mod_in = adlib_add(mod_phase, adlib_mul(feedback, adlib_add(previous0, previous1)));
+            adlib_vec mod_out = adlib_mul(adlib_wave(mod_in, mod_wave), mod_gain);
+            previous1 = previous0;
+            previous0 = mod_out;
+
+            car_att = adlib_min(adlib_add(adlib_mul(car_att, car_mul), car_add), car_limit);
+            car_phase = adlib_fraction(adlib_add(car_phase, car_inc));
+            adlib_vec car_gain = adlib_exp2(adlib_mul(adlib_add(car_att, car_level), decibels));
+            adlib_vec car_in = adlib_add(car_phase, adlib_mul(modulation, mod_out));
+            adlib_vec car_out = adlib_mul(adlib_wave(car_in, car_wave), car_gain);
+
+            mix[i] = adlib_add(mix[i], adlib_add(car_out, adlib_mul(additive, mod_out)));
+        }
+
+        adlib_store(mod->phase + lane, mod_phase);
+        adlib_store(car->phase + lane, car_phase);
+        adlib_store(mod->attenuation + lane, mod_att);
+        adlib_store(car->attenuation + lane, car_att);
+        adlib_store(adlib->previous[0] + lane, previous0);
+        adlib_store(adlib->previous[1] + lane, previous1);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        float value = adlib_sum(mix[i]) * ADLIB_CHANNEL_VOLUME * 32767.0f;
+        samples[i] = (int16_t)(value > 32767.0f ? 32767 : value < -32768.0f ? -32768 : (int)value);
+    }
+}
+
+static void adlib_dequeue(struct adlib* adlib)
+{
+    const struct adlib_write* write = &adlib->queue[adlib->queue_head];
+    adlib_apply(adlib, write->reg, write->data);
+    adlib->queue_head = (adlib->queue_head + 1) % ADLIB_QUEUE;
+    adlib->queue_count--;
+}
+
+// Latch timer expiries into the status register. The timers count in steps
+// of 80 us (timer 1) and 320 us (timer 2), and reload when they overflow.
+static void adlib_timers(struct bus* bus, struct adlib* adlib)
+{
+    for (unsigned t = 0; t < 2; t++)
+    {
+        uint8_t control = adlib->regs[0x04];
+        if (!(control & (1 << t)) || (control & (0x40 >> t)))
+            continue;
+        uint64_t period = (uint64_t)(256 - adlib->regs[0x02 + t]) * BUS_MASTER_CLOCK / (t ? 3125 : 12500);
+        if (bus->clock >= adlib->timer_start[t] + period)
+            adlib->status |= ADLIB_STATUS_IRQ | (ADLIB_STATUS_TIMER1 >> t);
+    }
+}
+
+static uint8_t adlib_in(struct bus* bus, void* device, uint16_t port)
+{
+    struct adlib* adlib = device;
+    if (port != ADLIB_PORTS)
+        return 0xFF;
+
+    // The low bits of an OPL2's status always read as 0x06.
+    adlib_timers(bus, adlib);
+    return adlib->status | 0x06;
+}
+
+static void adlib_out(struct bus* bus, void* device, uint16_t port, uint8_t data)
+{
+    struct adlib* adlib = device;
+    if (port == ADLIB_PORTS)
+    {
+        adlib->index = data;
+        return;
+    }
+
+    switch (adlib->index)
+    {
+        case 0x02:
+        case 0x03:
+        {
+            adlib->regs[adlib->index] = data;
+            break;
+        }
+        case 0x04:
+        {
+            // Resetting the flags leaves the timers running, but their next
+            // expiry is a whole period away.
+            if (data & 0x80)
+            {
+                adlib->status = 0;
+                for (unsigned t = 0; t < 2; t++)
+                {
+                    uint64_t period = (uint64_t)(256 - adlib->regs[0x02 + t]) * BUS_MASTER_CLOCK / (t ? 3125 : 12500);
+                    adlib->timer_start[t] += (bus->clock - adlib->timer_start[t]) / period * period;
+                }
+                break;
+            }
+            for (unsigned t = 0; t < 2; t++)
+                if ((data & (1 << t)) && !(adlib->regs[0x04] & (1 << t)))
+                    adlib->timer_start[t] = bus->clock;
+            adlib->regs[0x04] = data;
+            break;
+        }
+        default:
+        {
+            if (!adlib->rate)
+            {
+                adlib_apply(adlib, adlib->index, data);
+                break;
+            }
+
+            // A full queue means the host is not reading audio; the oldest
+            // write is applied early rather than lost.
+            if (adlib->queue_count == ADLIB_QUEUE)
+                adlib_dequeue(adlib);
+            struct adlib_write* write = &adlib->queue[(adlib->queue_head + adlib->queue_count) % ADLIB_QUEUE];
+            write->clock = bus->clock;
+            write->reg = adlib->index;
+            write->data = data;
+            adlib->queue_count++;
+            break;
+        }
+    }
+}
+
+// Attach an AdLib to the bus, rendering at rate samples per second (none if
+// 0).
+// Returns NULL if its ports cannot be mapped (see bus_map_ports()).
+struct adlib* adlib_new(struct bus* bus, unsigned rate)
+{
+    assert(bus);
+
+    struct adlib* adlib = arena_alloc(bus->arena, sizeof(struct adlib));
+    adlib->rate = rate;
+    adlib->generated = audio_sample(rate, bus->clock, NULL);
+    for (unsigned n = 0; n < 2; n++)
+        for (unsigned lane = 0; lane < ADLIB_LANES; lane++)
+            adlib->ops[n].attenuation[lane] = ADLIB_SILENCE;
+    if (rate)
+        for (unsigned channel = 0; channel < ADLIB_CHANNELS; channel++)
+            adlib_refresh(adlib, channel);
+
+    if (!bus_map_ports(bus, ADLIB_PORTS, 2, adlib, adlib_in, adlib_out))
+        return NULL;
+    return adlib;
+}
+
+// Render up to max samples, up to the bus's clock, applying the register
+// writes queued before each sample. Meant to be called at frame or buffer
+// boundaries; if the host falls more than AUDIO_BLIP_SIZE samples behind,
+// that stretch is skipped.
+size_t adlib_audio(struct bus* bus, struct adlib* adlib, int16_t* samples, size_t max)
+{
+    if (!adlib->rate)
+        return 0;
+
+    uint64_t end = audio_sample(adlib->rate, bus->clock, NULL);
+    if (end - adlib->generated > AUDIO_BLIP_SIZE)
+    {
+        while (adlib->queue_count)
+            adlib_dequeue(adlib);
+        adlib->generated = end;
+        return 0;
+    }
+
+    size_t count = (size_t)(end - adlib->generated);
+    if (count > max)
+        count = max;
+    for (size_t done = 0; done < count; )
+    {
+        while (adlib->queue_count
+               && audio_sample(adlib->rate, adlib->queue[adlib->queue_head].clock, NULL) <= adlib->generated)
+            adlib_dequeue(adlib);
+
+        size_t length = count - done;
+        if (length > ADLIB_BLOCK)
+            length = ADLIB_BLOCK;
+        if (adlib->queue_count)
+        {
+            uint64_t due = audio_sample(adlib->rate, adlib->queue[adlib->queue_head].clock, NULL);
+            if (due - adlib->generated < length)
+                length = (size_t)(due - adlib->generated);
+        }
+
+        adlib_render(adlib, samples + done, length);
+        adlib->generated += length;
+        done += length;
+    }
+    return count;
+}
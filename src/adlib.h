@@ -0,0 +1,120 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// AdLib music card (Yamaha YM3812, "OPL2").
+//
+// The synthesiser renders blocks of samples at the host's rate, and all nine
+// channels are processed together. Each operator parameter lives in an array
+// with one lane per channel, padded to whole SSE2 vectors (a portable
+// four-wide fallback is used elsewhere). So one pass through the operator
+// code computes the sine, envelope and output of four channels at once.
+// Per-operator state changes (envelope stages, LFOs, key on/off) are handled
+// between blocks, in scalar code that runs once per block, not once per
+// sample.
+//
+// Register writes are queued with the master clock they were made at, and
+// applied when rendering reaches the sample they fall on, with blocks split
+// at those samples. Nothing is rendered until the host asks for audio
+// (adlib_audio()), so music costs the emulation thread a queue push per
+// write. The timer registers take effect immediately, since guests poll the
+// status port to detect the card.
+//
+// The synthesis follows the chip's documented behaviour rather than its
+// exact log-sine and exponent tables. Rhythm mode is not implemented (its
+// channels keep playing as melodic ones), and the timers only show in the
+// status register, without raising an IRQ.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "bus.h"
+
+#define ADLIB_PORTS             0x388
+
+#define ADLIB_CHANNELS          9
+#define ADLIB_LANES             12      // Channels, padded to whole vectors.
+#define ADLIB_BLOCK             32      // Most samples rendered between envelope updates.
+#define ADLIB_QUEUE             1024    // Register writes that can wait to be rendered.
+
+// Status register.
+#define ADLIB_STATUS_IRQ        (1 << 7)
+#define ADLIB_STATUS_TIMER1     (1 << 6)
+#define ADLIB_STATUS_TIMER2     (1 << 5)
+
+// Mix level of one channel at full volume, as a fraction of the output's.
+#define ADLIB_CHANNEL_VOLUME    0.2f
+
+enum adlib_stage
+{
+    ADLIB_STAGE_OFF,
+    ADLIB_STAGE_ATTACK,
+    ADLIB_STAGE_DECAY,
+    ADLIB_STAGE_SUSTAIN,
+    ADLIB_STAGE_RELEASE
+};
+
+struct adlib_write
+{
+    uint64_t clock;
+    uint8_t reg;
+    uint8_t data;
+};
+
+// One of the two operators of every channel, a lane per channel. Operator 0
+// is the modulator, operator 1 the carrier.
+struct adlib_operators
+{
+    // Rendering state.
+    float phase[ADLIB_LANES];           // In cycles, from 0 to 1.
+    float attenuation[ADLIB_LANES];     // Envelope, in dB.
+
+    // Decoded from the registers.
+    float increment[ADLIB_LANES];       // Cycles per sample.
+    float level[ADLIB_LANES];           // Total level and key scaling, in dB.
+    float tremolo[ADLIB_LANES];         // 1 if tremolo applies, else 0.
+    float vibrato[ADLIB_LANES];         // 1 if vibrato applies, else 0.
+    float wave[4][ADLIB_LANES];         // 1 in the row of the selected waveform, else 0.
+    float attack[ADLIB_LANES];          // Envelope multiplier per sample while attacking.
+    float decay[ADLIB_LANES];           // dB per sample.
+    float release[ADLIB_LANES];         // dB per sample.
+    float sustain[ADLIB_LANES];         // dB.
+    bool hold[ADLIB_LANES];             // Hold the sustain level until key off?
+    uint8_t stage[ADLIB_LANES];         // enum adlib_stage.
+
+    // Envelope step for the block being rendered:
+    // attenuation = min(attenuation * multiply + add, limit).
+    float multiply[ADLIB_LANES];
+    float add[ADLIB_LANES];
+    float limit[ADLIB_LANES];
+};
+
+struct adlib
+{
+    // Registers.
+    uint8_t index;                      // Selected register.
+    uint8_t regs[256];                  // As last applied (timer registers as last written).
+    uint8_t status;
+    uint64_t timer_start[2];            // Master clock each timer was started at.
+
+    // Rendering.
+    unsigned rate;                      // Samples per second, or 0 to render nothing.
+    uint64_t generated;                 // Next sample to be rendered.
+    float tremolo_phase;                // LFO phases, in cycles.
+    float vibrato_phase;
+    struct adlib_operators ops[2];
+    float feedback[ADLIB_LANES];        // Modulator feedback scale.
+    float modulation[ADLIB_LANES];      // Carrier modulation by the modulator (FM).
+    float additive[ADLIB_LANES];        // Modulator mixed into the output (AM).
+    float previous[2][ADLIB_LANES];     // Last two modulator outputs, for feedback.
+
+    // Register writes waiting to be rendered.
+    struct adlib_write queue[ADLIB_QUEUE];
+    unsigned queue_head;
+    unsigned queue_count;
+};
+
+struct adlib* adlib_new(struct bus* bus, unsigned rate);
+size_t adlib_audio(struct bus* bus, struct adlib* adlib, int16_t* samples, size_t max);
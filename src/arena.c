@@ -0,0 +1,127 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#   include <sys/mman.h>
+#endif
+
+#include "arena.h"
+
+// Map a zeroed, ARENA_GRANULE-aligned region of size bytes (a multiple of
+// ARENA_GRANULE). With huge pages requested, explicit huge pages are tried
+// first, then transparent huge pages, then plain pages.
+static uint8_t* arena_map(size_t size, bool huge_pages, enum arena_pages* pages)
+{
+    *pages = ARENA_PAGES_NORMAL;
+
+#ifdef _WIN32
+    // Large pages need a privilege on Windows, so always use plain pages.
+    (void)huge_pages;
+    uint8_t* region = _aligned_malloc(size, ARENA_GRANULE);
+    if (!region)
+        abort();
+    memset(region, 0, size);
+    return region;
+#else
+#   ifdef MAP_HUGETLB
+    if (huge_pages)
+    {
+        void* region = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (region != MAP_FAILED)
+        {
+            *pages = ARENA_PAGES_HUGETLB;
+            return region;
+        }
+    }
+#   endif
+
+    // mmap() only guarantees page alignment, so over-allocate by a granule
+    // and trim either end.
+    uint8_t* region = mmap(NULL, size + ARENA_GRANULE, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+        abort();
+    size_t head = (ARENA_GRANULE - ((uintptr_t)region & (ARENA_GRANULE - 1))) & (ARENA_GRANULE - 1);
+    if (head)
+        munmap(region, head);
+    if (ARENA_GRANULE - head)
+        munmap(region + head + size, ARENA_GRANULE - head);
+    region += head;
+
+#   ifdef MADV_HUGEPAGE
+    if (huge_pages && madvise(region, size, MADV_HUGEPAGE) == 0)
+        *pages = ARENA_PAGES_TRANSPARENT;
+#   endif
+    return region;
+#endif
+}
+
+static void arena_unmap(uint8_t* region, size_t size)
+{
+#ifdef _WIN32
+    (void)size;
+    _aligned_free(region);
+#else
+    munmap(region, size);
+#endif
+}
+
+// Create an arena with room for at least size bytes of allocations. If
+// huge_pages is set, the region is backed by huge pages where the host
+// allows it (check arena->pages), and by plain pages otherwise.
+struct arena* arena_new(size_t size, bool huge_pages)
+{
+    size = arena_align(sizeof(struct arena)) + (ARENA_COLOURS - 1) * ARENA_ALIGNMENT + size;
+    size = (size + ARENA_GRANULE - 1) & ~(size_t)(ARENA_GRANULE - 1);
+
+    enum arena_pages pages;
+    uint8_t* region = arena_map(size, huge_pages, &pages);
+    struct arena* arena = (struct arena*)region;
+    arena->base = region;
+    arena->size = size;
+
+    // Neighbouring regions get different colours, without any shared state.
+    size_t colour = ((uintptr_t)region / ARENA_GRANULE) % ARENA_COLOURS;
+    arena->used = arena_align(sizeof(struct arena)) + colour * ARENA_ALIGNMENT;
+    arena->huge_pages = huge_pages;
+    arena->pages = pages;
+    return arena;
+}
+
+// Carve a zeroed, cache-line aligned block out of the arena. Running out of
+// space is a sizing bug in the caller, so this aborts like quick_malloc.
+void* arena_alloc(struct arena* arena, size_t size)
+{
+    assert(arena);
+    size = arena_align(size);
+    if (size > arena->size - arena->used)
+        abort();
+    void* ptr = arena->base + arena->used;
+    arena->used += size;
+    return ptr;
+}
+
+// Copy the arena and everything allocated from it. Pointers stored inside
+// the copy still point into the original; use arena_relocate() to fix them.
+struct arena* arena_clone(struct arena* arena)
+{
+    assert(arena);
+    enum arena_pages pages;
+    uint8_t* region = arena_map(arena->size, arena->huge_pages, &pages);
+    memcpy(region, arena->base, arena->used);
+    struct arena* clone = (struct arena*)region;
+    clone->base = region;
+    clone->pages = pages;
+    return clone;
+}
+
+void arena_free(struct arena* arena)
+{
+    assert(arena);
+    arena_unmap(arena->base, arena->size);
+}
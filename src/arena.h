@@ -0,0 +1,62 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Per-machine memory arena.
+//
+// Everything belonging to one emulated machine (the bus, the CPU, device
+// state and guest RAM) is carved out of a single zeroed region, so it sits
+// together in memory, is released in one go, and can be cloned with a single
+// copy. Allocations are cache-line aligned and are never freed individually.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Allocations are aligned to a cache line.
+#define ARENA_ALIGNMENT     64
+
+// The region itself is aligned to, and sized in multiples of, a 2 MB huge
+// page, so the host can back it with as few TLB entries as possible.
+#define ARENA_GRANULE       (2 * 1024 * 1024)
+
+// Since every region starts on a 2 MB boundary, the first allocation in each
+// arena is offset by a varying number of cache lines ("colour"). Otherwise,
+// with huge pages, the same state of every machine would land in the same
+// cache sets.
+#define ARENA_COLOURS       256
+
+// How an arena's region ended up being backed.
+enum arena_pages
+{
+    ARENA_PAGES_NORMAL,             // Plain host pages.
+    ARENA_PAGES_TRANSPARENT,        // Transparent huge pages (madvise), as the kernel sees fit.
+    ARENA_PAGES_HUGETLB             // Explicit huge pages (MAP_HUGETLB).
+};
+
+struct arena
+{
+    uint8_t* base;                  // Start of the region (the arena itself lives here).
+    size_t size;                    // Size of the region.
+    size_t used;                    // Bytes carved out so far.
+    bool huge_pages;                // Were huge pages requested?
+    enum arena_pages pages;         // What the region is actually backed by.
+};
+
+struct arena* arena_new(size_t size, bool huge_pages);
+void* arena_alloc(struct arena* arena, size_t size);
+struct arena* arena_clone(struct arena* arena);
+void arena_free(struct arena* arena);
+
+// Round a size up to the arena's allocation alignment.
+static inline size_t arena_align(size_t size)
+{
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+// Translate a pointer into one arena to the same place in its clone.
+static inline void* arena_relocate(struct arena* clone, struct arena* arena, void* ptr)
+{
+    return clone->base + ((uint8_t*)ptr - arena->base);
+}
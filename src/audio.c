@@ -0,0 +1,247 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#   include <io.h>
+#   include <fcntl.h>
+#endif
+
+#include "audio.h"
+#include "bus.h"
+#include "util.h"
+
+#define AUDIO_PI            3.14159265358979f
+
+// Below this, the high-pass takes out DC from sources that idle high.
+#define AUDIO_HIGHPASS_HZ   16.0f
+
+// Start a synthesiser producing rate samples per second, from the given
+// master clock on. The impulse for each phase is a Blackman-windowed sinc,
+// cut off a little below Nyquist and normalised to unit area, so that
+// integrating it gives a clean step.
+void audio_blip_init(struct audio_blip* blip, unsigned rate, uint64_t clock)
+{
+    assert(blip && rate);
+    memset(blip, 0, sizeof(*blip));
+    blip->rate = rate;
+    blip->read = audio_sample(rate, clock, NULL);
+    blip->dc_coefficient = 2.0f * AUDIO_PI * AUDIO_HIGHPASS_HZ / (float)rate;
+
+    const float cutoff = 0.45f;
+    for (unsigned phase = 0; phase < AUDIO_BLIP_PHASES; phase++)
+    {
+        float sum = 0.0f;
+        for (unsigned tap = 0; tap < AUDIO_BLIP_TAPS; tap++)
+        {
+            float x = (float)tap - AUDIO_BLIP_TAPS / 2 + 1 - (float)phase / AUDIO_BLIP_PHASES;
+            float sinc = (x == 0.0f) ? 1.0f : sinf(2.0f * AUDIO_PI * cutoff * x) / (2.0f * AUDIO_PI * cutoff * x);
+            float w = (x + AUDIO_BLIP_TAPS / 2) / AUDIO_BLIP_TAPS;
+            float window = 0.42f - 0.5f * cosf(2.0f * AUDIO_PI * w) + 0.08f * cosf(4.0f * AUDIO_PI * w);
+            blip->kernel[phase][tap] = sinc * window;
+            sum += sinc * window;
+        }
+        for (unsigned tap = 0; tap < AUDIO_BLIP_TAPS; tap++)
+            blip->kernel[phase][tap] /= sum;
+    }
+}
+
+// Integrate the next sample's impulses and take out the DC, returning the
+// sample at full scale 1.
+static inline float audio_blip_next(struct audio_blip* blip)
+{
+    float* delta = &blip->deltas[blip->read++ & (AUDIO_BLIP_SIZE - 1)];
+    blip->integrator += *delta;
+    *delta = 0.0f;
+
+    float value = blip->integrator - blip->dc;
+    blip->dc += value * blip->dc_coefficient;
+    return value;
+}
+
+// Let the samples before end go by unheard. Their steps still count towards
+// the level, so that what is heard afterwards is not offset by the ones
+// that were missed.
+static void audio_blip_skip(struct audio_blip* blip, uint64_t end)
+{
+    uint64_t count = end - blip->read;
+    uint64_t buffered = (count < AUDIO_BLIP_SIZE) ? count : AUDIO_BLIP_SIZE;
+    for (uint64_t i = 0; i < buffered; i++)
+        audio_blip_next(blip);
+
+    // Past the buffer there are no steps, and the high-pass just decays
+    // towards the level.
+    if (count > buffered)
+    {
+        float decay = powf(1.0f - blip->dc_coefficient, (float)(count - buffered));
+        blip->dc = blip->integrator - (blip->integrator - blip->dc) * decay;
+    }
+    blip->read = end;
+}
+
+// Add a step of delta (full scale being 1) at the given master clock. Steps
+// before the samples already read are moved up to them. A step beyond the
+// buffer (the host not having read for a while) skips the oldest samples to
+// make room for it.
+void audio_blip_step(struct audio_blip* blip, uint64_t clock, float delta)
+{
+    unsigned phase;
+    uint64_t sample = audio_sample(blip->rate, clock, &phase);
+    if (sample < blip->read)
+    {
+        sample = blip->read;
+        phase = 0;
+    }
+    if (sample + AUDIO_BLIP_TAPS > blip->read + AUDIO_BLIP_SIZE)
+        audio_blip_skip(blip, sample + AUDIO_BLIP_TAPS - AUDIO_BLIP_SIZE);
+
+    const float* kernel = blip->kernel[phase];
+    for (unsigned tap = 0; tap < AUDIO_BLIP_TAPS; tap++)
+        blip->deltas[(sample + tap) & (AUDIO_BLIP_SIZE - 1)] += delta * kernel[tap];
+}
+
+// Read the samples that are complete at the given master clock, up to max.
+// Returns how many were read.
+size_t audio_blip_read(struct audio_blip* blip, uint64_t clock, int16_t* samples, size_t max)
+{
+    uint64_t end = audio_sample(blip->rate, clock, NULL);
+    if (end < blip->read + AUDIO_BLIP_TAPS)
+        return 0;
+    end -= AUDIO_BLIP_TAPS;
+
+    // Anything the host left unread for longer than the buffer is skipped.
+    if (end - blip->read > AUDIO_BLIP_SIZE - AUDIO_BLIP_TAPS)
+        audio_blip_skip(blip, end - (AUDIO_BLIP_SIZE - AUDIO_BLIP_TAPS));
+
+    size_t count = (size_t)(end - blip->read);
+    if (count > max)
+        count = max;
+    for (size_t i = 0; i < count; i++)
+    {
+        float value = audio_blip_next(blip) * 32767.0f;
+        samples[i] = (int16_t)(value > 32767.0f ? 32767 : value < -32768.0f ? -32768 : (int)value);
+    }
+    return count;
+}
+
+struct audio_output
+{
+    FILE* file;
+    bool close_file;                    // Did we open the file (rather than use stdout)?
+    enum audio_format format;
+    unsigned channels;
+    uint64_t bytes;                     // Sample data written so far.
+    bool failed;
+};
+
+static void audio_put16(uint8_t* p, uint16_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static void audio_put32(uint8_t* p, uint32_t value)
+{
+    audio_put16(p, (uint16_t)value);
+    audio_put16(p + 2, (uint16_t)(value >> 16));
+}
+
+// Write a RIFF/WAVE header for 16-bit PCM. Streams whose length is not known
+// yet say they are as long as possible, which players treat as "until EOF".
+static bool audio_wav_header(FILE* file, unsigned rate, unsigned channels, uint32_t bytes)
+{
+    uint8_t header[44];
+    memcpy(header, "RIFF", 4);
+    audio_put32(header + 4, bytes > 0xFFFFFFFF - 36 ? 0xFFFFFFFF : bytes + 36);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    audio_put32(header + 16, 16);
+    audio_put16(header + 20, 1);
+    audio_put16(header + 22, (uint16_t)channels);
+    audio_put32(header + 24, rate);
+    audio_put32(header + 28, rate * channels * 2);
+    audio_put16(header + 32, (uint16_t)(channels * 2));
+    audio_put16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    audio_put32(header + 40, bytes);
+    return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+// Open path ("-" or NULL for stdout) for 16-bit audio. Returns NULL if the
+// file cannot be opened.
+struct audio_output* audio_open(const char* path, enum audio_format format, unsigned rate, unsigned channels)
+{
+    assert(rate && channels);
+
+    FILE* file;
+    bool close_file = path && strcmp(path, "-") != 0;
+    if (close_file)
+    {
+        file = fopen(path, "wb");
+        if (!file)
+            return NULL;
+    }
+    else
+    {
+        file = stdout;
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    }
+
+    struct audio_output* output = quick_malloc(sizeof(struct audio_output));
+    output->file = file;
+    output->close_file = close_file;
+    output->format = format;
+    output->channels = channels;
+    if (format == AUDIO_FORMAT_WAV && !audio_wav_header(file, rate, channels, 0xFFFFFFFF))
+        output->failed = true;
+    return output;
+}
+
+// Write frames of interleaved samples.
+bool audio_write(struct audio_output* output, const int16_t* samples, size_t frames)
+{
+    uint8_t buffer[4096];
+    size_t count = frames * output->channels;
+    while (count && !output->failed)
+    {
+        size_t chunk = (count < sizeof(buffer) / 2) ? count : sizeof(buffer) / 2;
+        for (size_t i = 0; i < chunk; i++)
+            audio_put16(buffer + i * 2, (uint16_t)samples[i]);
+        if (fwrite(buffer, 2, chunk, output->file) != chunk)
+            output->failed = true;
+        output->bytes += chunk * 2;
+        samples += chunk;
+        count -= chunk;
+    }
+    return !output->failed;
+}
+
+// Finish the stream, filling in the WAV header's lengths if the file can be
+// rewound. Returns false if any of it could not be written.
+bool audio_close(struct audio_output* output)
+{
+    assert(output);
+    bool ok = !output->failed;
+    if (output->format == AUDIO_FORMAT_WAV && output->bytes <= 0xFFFFFFFF - 36
+        && fseek(output->file, 4, SEEK_SET) == 0)
+    {
+        uint8_t size[4];
+        audio_put32(size, (uint32_t)output->bytes + 36);
+        ok = fwrite(size, 1, 4, output->file) == 4 && ok;
+        audio_put32(size, (uint32_t)output->bytes);
+        ok = fseek(output->file, 40, SEEK_SET) == 0 && fwrite(size, 1, 4, output->file) == 4 && ok;
+    }
+
+    if (output->close_file)
+        ok = (fclose(output->file) == 0) && ok;
+    else
+        ok = (fflush(output->file) == 0) && ok;
+    free(output);
+    return ok;
+}
@@ -0,0 +1,64 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Audio synthesis and output shared by the sound devices.
+//
+// Devices do not produce a sample per emulated cycle. They describe their
+// output as steps (a change in level at a given master clock), which a
+// band-limited step synthesiser ("blip") turns into samples when the host
+// asks for a batch of them. Each step deposits a windowed sinc impulse,
+// picked from a table by its sub-sample phase, and reading integrates the
+// impulses back into steps, minus a gentle DC-blocking high-pass. Square
+// waves come out without aliasing, and the cost scales with the number of
+// edges and samples, not with the emulated clock.
+//
+// The blip holds no pointers, so it can live in device state. Output files
+// (WAV or raw 16-bit PCM) belong to the host.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "bus.h"
+
+#define AUDIO_BLIP_TAPS     16
+#define AUDIO_BLIP_PHASES   64
+#define AUDIO_BLIP_SIZE     8192        // Samples buffered (a power of two).
+
+// Sample position of a master clock, in whole samples and in phases of one.
+static inline uint64_t audio_sample(unsigned rate, uint64_t clock, unsigned* phase)
+{
+    uint64_t scaled = clock * rate;
+    if (phase)
+        *phase = (unsigned)((scaled % BUS_MASTER_CLOCK) * AUDIO_BLIP_PHASES / BUS_MASTER_CLOCK);
+    return scaled / BUS_MASTER_CLOCK;
+}
+
+struct audio_blip
+{
+    unsigned rate;                      // Samples per second.
+    uint64_t read;                      // Next sample to be read.
+    float integrator;                   // Running sum of the impulses read so far.
+    float dc;                           // DC level tracked by the high-pass.
+    float dc_coefficient;
+    float kernel[AUDIO_BLIP_PHASES][AUDIO_BLIP_TAPS];
+    float deltas[AUDIO_BLIP_SIZE];
+};
+
+void audio_blip_init(struct audio_blip* blip, unsigned rate, uint64_t clock);
+void audio_blip_step(struct audio_blip* blip, uint64_t clock, float delta);
+size_t audio_blip_read(struct audio_blip* blip, uint64_t clock, int16_t* samples, size_t max);
+
+enum audio_format
+{
+    AUDIO_FORMAT_WAV,
+    AUDIO_FORMAT_RAW                    // Headerless signed 16-bit little-endian.
+};
+
+struct audio_output;
+
+struct audio_output* audio_open(const char* path, enum audio_format format, unsigned rate, unsigned channels);
+bool audio_write(struct audio_output* output, const int16_t* samples, size_t frames);
+bool audio_close(struct audio_output* output);
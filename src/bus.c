@@ -4,36 +4,300 @@
 #include <assert.h>
 
 #include "bus.h"
-#include "util.h"
+#include "pic.h"
 
-struct bus* bus_new(size_t memory)
+// The whole machine is allocated from one arena: the bus, then the CPU, then
+// guest RAM, with device state following later on. With huge_pages set, the
+// arena is backed by 2 MB pages if the host has them to give, which saves
+// TLB misses on guest memory when many machines run side by side.
+struct bus* bus_new(size_t memory, bool huge_pages)
 {
-    struct bus* bus = (struct bus*)quick_malloc(sizeof(struct bus));
+    struct arena* arena = arena_new(arena_align(sizeof(struct bus))
+                                  + arena_align(sizeof(struct cpu8086))
+                                  + arena_align(memory)
+                                  + BUS_DEVICE_RESERVE,
+                                  huge_pages);
+    struct bus* bus = (struct bus*)arena_alloc(arena, sizeof(struct bus));
+    bus->arena = arena;
     bus->cpu = cpu8086_new(bus);
-    bus->memory = (uint8_t*)quick_malloc(memory);
+    bus->memory = (uint8_t*)arena_alloc(arena, memory);
     bus->memory_size = memory;
+    bus->next_deadline = BUS_NEVER;
     return bus;
 }
 
+// Clone a machine in its current state, by copying its arena. The clone is
+// fully independent of the original.
+struct bus* bus_clone(struct bus* bus)
+{
+    assert(bus);
+    struct arena* arena = arena_clone(bus->arena);
+    struct bus* clone = (struct bus*)arena_relocate(arena, bus->arena, bus);
+    clone->arena = arena;
+    clone->cpu = (struct cpu8086*)arena_relocate(arena, bus->arena, bus->cpu);
+    clone->memory = (uint8_t*)arena_relocate(arena, bus->arena, bus->memory);
+    if (bus->dma)
+        clone->dma = (struct dma*)arena_relocate(arena, bus->arena, bus->dma);
+    if (bus->pic)
+        clone->pic = (struct pic*)arena_relocate(arena, bus->arena, bus->pic);
+    for (unsigned i = 0; i < clone->port_count; i++)
+        clone->ports[i].device = arena_relocate(arena, bus->arena, bus->ports[i].device);
+    for (unsigned i = 0; i < clone->mapping_count; i++)
+        clone->mappings[i].device = arena_relocate(arena, bus->arena, bus->mappings[i].device);
+    for (unsigned i = 0; i < clone->watch_count; i++)
+        clone->watches[i].device = arena_relocate(arena, bus->arena, bus->watches[i].device);
+    for (unsigned i = 0; i < clone->timer_count; i++)
+        clone->timers[i].device = arena_relocate(arena, bus->arena, bus->timers[i].device);
+    cpu8086_rebind(clone->cpu, clone);
+    return clone;
+}
+
 uint8_t bus_read_byte(struct bus* bus, uintptr_t address)
 {
-    return bus->memory[address & 0xFFFFF];
+    address &= 0xFFFFF;
+    uint8_t mapping = bus->mapping_page[address >> BUS_PAGE_SHIFT];
+    if (mapping)
+    {
+        struct bus_mapping* m = &bus->mappings[mapping - 1];
+        return m->read(bus, m->device, (uint32_t)address);
+    }
+    return bus->memory[address];
 }
 
 uint16_t bus_read_short(struct bus* bus, uintptr_t address)
 {
-    return bus->memory[address & 0xFFFFF] | (bus->memory[(address + 1) & 0xFFFFF] << 8);
+    return bus_read_byte(bus, address) | (bus_read_byte(bus, address + 1) << 8);
 }
 
 void bus_write_byte(struct bus* bus, uintptr_t address, uint8_t data)
 {
-    bus->memory[address & 0xFFFFF] = data;
+    address &= 0xFFFFF;
+    uint8_t mapping = bus->mapping_page[address >> BUS_PAGE_SHIFT];
+    if (mapping)
+    {
+        struct bus_mapping* m = &bus->mappings[mapping - 1];
+        m->write(bus, m->device, (uint32_t)address, data);
+        return;
+    }
+    bus->memory[address] = data;
+    if (bus->watch_page[address >> BUS_PAGE_SHIFT])
+        bus_written(bus, address, 1);
 }
 
 void bus_write_short(struct bus* bus, uintptr_t address, uint16_t data)
 {
-    bus->memory[address & 0xFFFFF] = data & 0xFF;
-    bus->memory[(address + 1) & 0xFFFFF] = data >> 8;
+    bus_write_byte(bus, address, data & 0xFF);
+    bus_write_byte(bus, address + 1, data >> 8);
+}
+
+// Get direct access to a span of plain RAM, for bulk transfers. NULL is
+// returned if the span wraps around the address space, leaves RAM or touches
+// memory a device decodes, in which case the caller has to go through the
+// byte/short accessors instead. Callers that write through the pointer must
+// call bus_written() afterwards.
+uint8_t* bus_ram(struct bus* bus, uintptr_t address, size_t length)
+{
+    if (address > bus->memory_size || length > bus->memory_size - address)
+        return NULL;
+    if (bus->mapping_count && length)
+    {
+        for (uintptr_t page = address >> BUS_PAGE_SHIFT; page <= (address + length - 1) >> BUS_PAGE_SHIFT; page++)
+            if (bus->mapping_page[page % BUS_PAGES])
+                return NULL;
+    }
+    return &bus->memory[address];
+}
+
+// Let any device watching [address, address + length) know that it was
+// written to.
+void bus_written(struct bus* bus, uintptr_t address, size_t length)
+{
+    uintptr_t end = address + length;
+    while (address < end)
+    {
+        uintptr_t page_end = ((address >> BUS_PAGE_SHIFT) + 1) << BUS_PAGE_SHIFT;
+        uintptr_t chunk_end = (end < page_end) ? end : page_end;
+        uint8_t watch = bus->watch_page[(address >> BUS_PAGE_SHIFT) % BUS_PAGES];
+        if (watch)
+        {
+            struct bus_watch* w = &bus->watches[watch - 1];
+            uintptr_t from = (address > w->base) ? address : w->base;
+            uintptr_t to = (chunk_end < w->base + w->size) ? chunk_end : w->base + w->size;
+            if (from < to)
+                w->written(bus, w->device, (uint32_t)from, to - from);
+        }
+        address = chunk_end;
+    }
+}
+
+// Ports nobody answers read back as all ones, as on a floating bus.
+uint8_t bus_in_byte(struct bus* bus, uint16_t port)
+{
+    for (unsigned i = 0; i < bus->port_count; i++)
+    {
+        struct bus_ports* p = &bus->ports[i];
+        if ((uint16_t)(port - p->base) < p->count)
+            return p->in ? p->in(bus, p->device, port) : 0xFF;
+    }
+    return 0xFF;
+}
+
+// Word I/O is split into two byte accesses to consecutive ports, as devices
+// on the PC's 8-bit I/O bus see it.
+uint16_t bus_in_short(struct bus* bus, uint16_t port)
+{
+    return bus_in_byte(bus, port) | (bus_in_byte(bus, port + 1) << 8);
+}
+
+void bus_out_byte(struct bus* bus, uint16_t port, uint8_t data)
+{
+    for (unsigned i = 0; i < bus->port_count; i++)
+    {
+        struct bus_ports* p = &bus->ports[i];
+        if ((uint16_t)(port - p->base) < p->count)
+        {
+            if (p->out)
+                p->out(bus, p->device, port, data);
+            return;
+        }
+    }
+}
+
+void bus_out_short(struct bus* bus, uint16_t port, uint16_t data)
+{
+    bus_out_byte(bus, port, data & 0xFF);
+    bus_out_byte(bus, port + 1, data >> 8);
+}
+
+// Route the I/O ports [base, base + count) to a device. Either handler may be
+// NULL for write-only or read-only ports. Returns false, mapping nothing, if
+// any of the ports already belong to a device or the table is full.
+bool bus_map_ports(struct bus* bus, uint16_t base, uint16_t count, void* device,
+                   uint8_t (*in)(struct bus*, void*, uint16_t),
+                   void (*out)(struct bus*, void*, uint16_t, uint8_t))
+{
+    assert(count && base + count <= 0x10000);
+    if (bus->port_count == BUS_MAX_PORTS)
+        return false;
+    for (unsigned i = 0; i < bus->port_count; i++)
+    {
+        const struct bus_ports* p = &bus->ports[i];
+        if (base < p->base + p->count && p->base < base + count)
+            return false;
+    }
+    bus->ports[bus->port_count++] = (struct bus_ports){ base, count, device, in, out };
+    return true;
+}
+
+// Remove every port range routed to a device, for a device that failed to
+// map all of its ports.
+void bus_unmap_ports(struct bus* bus, void* device)
+{
+    unsigned kept = 0;
+    for (unsigned i = 0; i < bus->port_count; i++)
+    {
+        if (bus->ports[i].device != device)
+            bus->ports[kept++] = bus->ports[i];
+    }
+    bus->port_count = kept;
+}
+
+// Are none of the pages in [base, base + size) mapped or watched?
+static bool bus_pages_free(struct bus* bus, uint32_t base, uint32_t size)
+{
+    for (uint32_t page = base >> BUS_PAGE_SHIFT; page < (base + size) >> BUS_PAGE_SHIFT; page++)
+        if (bus->mapping_page[page] || bus->watch_page[page])
+            return false;
+    return true;
+}
+
+// Have a device decode [base, base + size) in place of RAM. The range must be
+// page aligned. Returns false, mapping nothing, if it overlaps another mapping
+// or a watch, or the table is full.
+bool bus_map_memory(struct bus* bus, uint32_t base, uint32_t size, void* device,
+                    uint8_t (*read)(struct bus*, void*, uint32_t),
+                    void (*write)(struct bus*, void*, uint32_t, uint8_t))
+{
+    assert(((base | size) & ((1 << BUS_PAGE_SHIFT) - 1)) == 0);
+    assert(base + size <= 0x100000);
+    if (bus->mapping_count == BUS_MAX_MAPPINGS || !bus_pages_free(bus, base, size))
+        return false;
+
+    bus->mappings[bus->mapping_count++] = (struct bus_mapping){ base, size, device, read, write };
+    for (uint32_t page = base >> BUS_PAGE_SHIFT; page < (base + size) >> BUS_PAGE_SHIFT; page++)
+        bus->mapping_page[page] = (uint8_t)bus->mapping_count;
+    return true;
+}
+
+// Have a device told about writes to the RAM at [base, base + size). The
+// range must be page aligned. Returns false, watching nothing, if it overlaps
+// a mapping or another watch, or the table is full.
+bool bus_watch(struct bus* bus, uint32_t base, uint32_t size, void* device,
+               void (*written)(struct bus*, void*, uint32_t, size_t))
+{
+    assert(((base | size) & ((1 << BUS_PAGE_SHIFT) - 1)) == 0);
+    assert(base + size <= 0x100000);
+    if (bus->watch_count == BUS_MAX_WATCHES || !bus_pages_free(bus, base, size))
+        return false;
+
+    bus->watches[bus->watch_count++] = (struct bus_watch){ base, size, device, written };
+    for (uint32_t page = base >> BUS_PAGE_SHIFT; page < (base + size) >> BUS_PAGE_SHIFT; page++)
+        bus->watch_page[page] = (uint8_t)bus->watch_count;
+    return true;
+}
+
+// Add a timer for a device, initially not scheduled.
+unsigned bus_add_timer(struct bus* bus, void* device, void (*expire)(struct bus*, void*))
+{
+    assert(bus->timer_count < BUS_MAX_TIMERS);
+    bus->timers[bus->timer_count] = (struct bus_timer){ BUS_NEVER, device, expire };
+    return bus->timer_count++;
+}
+
+// Schedule a timer to expire at the given master clock (BUS_NEVER to cancel).
+void bus_schedule(struct bus* bus, unsigned timer, uint64_t deadline)
+{
+    assert(timer < bus->timer_count);
+    bus->timers[timer].deadline = deadline;
+    if (deadline < bus->next_deadline)
+        bus->next_deadline = deadline;
+}
+
+// Run every timer that is due, then work out when the next one is (the
+// callbacks may have rescheduled any of them).
+static void bus_run_timers(struct bus* bus)
+{
+    for (unsigned i = 0; i < bus->timer_count; i++)
+    {
+        struct bus_timer* t = &bus->timers[i];
+        if (t->deadline <= bus->clock)
+        {
+            t->deadline = BUS_NEVER;
+            t->expire(bus, t->device);
+        }
+    }
+
+    uint64_t next = BUS_NEVER;
+    for (unsigned i = 0; i < bus->timer_count; i++)
+        if (bus->timers[i].deadline < next)
+            next = bus->timers[i].deadline;
+    bus->next_deadline = next;
+}
+
+// Raise an interrupt request line. The request goes through the interrupt
+// controller (see pic.h); without one on the bus, the line is not connected.
+void bus_irq(struct bus* bus, unsigned line)
+{
+    assert(line < 8);
+    if (bus->pic)
+        pic_request(bus, line);
+}
+
+// The CPU's interrupt acknowledge cycle. Returns the vector to take, from the
+// interrupt controller if there is one, or else the one on cpu->intr_vector.
+uint8_t bus_acknowledge(struct bus* bus)
+{
+    return bus->pic ? pic_acknowledge(bus) : bus->cpu->intr_vector;
 }
 
 void bus_clock(struct bus* bus)
@@ -42,12 +306,14 @@ void bus_clock(struct bus* bus)
     if (bus->cpu_clock == 0)
         cpu8086_clock(bus->cpu);
     bus->cpu_clock = (bus->cpu_clock - 1) % 3;
+
+    if (++bus->clock >= bus->next_deadline)
+        bus_run_timers(bus);
 }
 
 void bus_free(struct bus* bus)
 {
     assert(bus);
     cpu8086_free(bus->cpu);
-    free(bus->memory);
-    free(bus);
+    arena_free(bus->arena);
 }
\ No newline at end of file
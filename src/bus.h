@@ -5,24 +5,129 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
+#include "arena.h"
 #include "cpu8086.h"
 
+// Room left in a machine's arena for device state, beyond the bus, the CPU
+// and guest RAM. Only what devices actually use is ever touched.
+#define BUS_DEVICE_RESERVE  (8 * 1024 * 1024)
+
+// Frequency of the master clock (the IBM PC's 14.31818 MHz crystal).
+#define BUS_MASTER_CLOCK    14318180
+
+// RAM write watches are resolved per page of this size.
+#define BUS_PAGE_SHIFT      12
+#define BUS_PAGES           (0x100000 >> BUS_PAGE_SHIFT)
+
+#define BUS_MAX_PORTS       16
+#define BUS_MAX_MAPPINGS    4
+#define BUS_MAX_WATCHES     8
+#define BUS_MAX_TIMERS      8
+
+// No timer is due.
+#define BUS_NEVER           UINT64_MAX
+
+struct bus;
+struct dma;
+struct pic;
+
+// A range of I/O ports handled by a device.
+struct bus_ports
+{
+    uint16_t base;
+    uint16_t count;
+    void* device;
+    uint8_t (*in)(struct bus* bus, void* device, uint16_t port);
+    void (*out)(struct bus* bus, void* device, uint16_t port, uint8_t data);
+};
+
+// A range of the address space decoded by a device instead of RAM, e.g. video
+// memory that is not simply a frame buffer.
+struct bus_mapping
+{
+    uint32_t base;
+    uint32_t size;
+    void* device;
+    uint8_t (*read)(struct bus* bus, void* device, uint32_t address);
+    void (*write)(struct bus* bus, void* device, uint32_t address, uint8_t data);
+};
+
+// A range of RAM a device wants to hear about writes to, e.g. video memory.
+// The RAM itself is written as usual.
+struct bus_watch
+{
+    uint32_t base;
+    uint32_t size;
+    void* device;
+    void (*written)(struct bus* bus, void* device, uint32_t address, size_t length);
+};
+
+// A device callback that is due at a given master clock. The callback is
+// expected to reschedule the timer if it wants to run again.
+struct bus_timer
+{
+    uint64_t deadline;
+    void* device;
+    void (*expire)(struct bus* bus, void* device);
+};
+
+// Device state is allocated from the bus's arena and must not hold pointers
+// into it (callbacks are handed the bus instead), so that bus_clone() only
+// has to relocate the device pointers in the tables below.
 struct bus
 {
+    struct arena* arena;            // Everything belonging to this machine is allocated from here.
     struct cpu8086* cpu;
+    struct dma* dma;                // DMA controller, if any (see dma.h).
+    struct pic* pic;                // Interrupt controller, if any (see pic.h).
     uint8_t* memory;
     size_t memory_size;
     bool memory_ready;
 
     // Master clock division.
     int cpu_clock;
+    uint64_t clock;                 // Master clocks elapsed.
+    uint64_t next_deadline;         // Earliest timer deadline.
+
+    // Devices.
+    struct bus_ports ports[BUS_MAX_PORTS];
+    struct bus_mapping mappings[BUS_MAX_MAPPINGS];
+    struct bus_watch watches[BUS_MAX_WATCHES];
+    struct bus_timer timers[BUS_MAX_TIMERS];
+    unsigned port_count;
+    unsigned mapping_count;
+    unsigned watch_count;
+    unsigned timer_count;
+    uint8_t mapping_page[BUS_PAGES]; // Index + 1 of the mapping covering each page, or 0.
+    uint8_t watch_page[BUS_PAGES];  // Index + 1 of the watch covering each page, or 0.
 };
 
-struct bus* bus_new(size_t memory);
+struct bus* bus_new(size_t memory, bool huge_pages);
+struct bus* bus_clone(struct bus* bus);
 uint8_t bus_read_byte(struct bus* bus, uintptr_t address);
 uint16_t bus_read_short(struct bus* bus, uintptr_t address);
 void bus_write_byte(struct bus* bus, uintptr_t address, uint8_t data);
 void bus_write_short(struct bus* bus, uintptr_t address, uint16_t data);
+uint8_t* bus_ram(struct bus* bus, uintptr_t address, size_t length);
+void bus_written(struct bus* bus, uintptr_t address, size_t length);
+uint8_t bus_in_byte(struct bus* bus, uint16_t port);
+uint16_t bus_in_short(struct bus* bus, uint16_t port);
+void bus_out_byte(struct bus* bus, uint16_t port, uint8_t data);
+void bus_out_short(struct bus* bus, uint16_t port, uint16_t data);
+bool bus_map_ports(struct bus* bus, uint16_t base, uint16_t count, void* device,
+                   uint8_t (*in)(struct bus*, void*, uint16_t),
+                   void (*out)(struct bus*, void*, uint16_t, uint8_t));
+void bus_unmap_ports(struct bus* bus, void* device);
+bool bus_map_memory(struct bus* bus, uint32_t base, uint32_t size, void* device,
+                    uint8_t (*read)(struct bus*, void*, uint32_t),
+                    void (*write)(struct bus*, void*, uint32_t, uint8_t));
+bool bus_watch(struct bus* bus, uint32_t base, uint32_t size, void* device,
+               void (*written)(struct bus*, void*, uint32_t, size_t));
+unsigned bus_add_timer(struct bus* bus, void* device, void (*expire)(struct bus*, void*));
+void bus_schedule(struct bus* bus, unsigned timer, uint64_t deadline);
+void bus_irq(struct bus* bus, unsigned line);
+uint8_t bus_acknowledge(struct bus* bus);
 void bus_clock(struct bus* bus);
-void bus_free(struct bus* bus);
\ No newline at end of file
+void bus_free(struct bus* bus);
@@ -0,0 +1,406 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#   include <windows.h>
+#   include <io.h>
+#   include <fcntl.h>
+#else
+#   include <pthread.h>
+#endif
+
+#include "bus.h"
+#include "capture.h"
+#include "util.h"
+
+// Queued in place of a slot to write the previous frame again.
+#define CAPTURE_REPEAT      (-1)
+
+struct capture_entry
+{
+    int slot;
+    uint64_t frame;
+};
+
+struct capture
+{
+    FILE* file;
+    bool close_file;                // Did we open the file (rather than use stdout)?
+    enum capture_format format;
+    unsigned width;
+    unsigned height;
+    unsigned rate;                  // Frames per second of emulated time.
+
+    // Only touched by the emulation thread.
+    bool started;
+    bool has_frame;                 // Has a frame been handed over yet?
+    uint64_t origin;                // Master clock of the first frame.
+    uint64_t frame;                 // Number of the next frame.
+    uint64_t next_clock;            // Master clock the next frame is due at.
+    uint64_t updates;               // The caller's update count for the last frame handed over.
+
+    // Shared with the writer, under the lock.
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE work;
+    HANDLE thread;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_t thread;
+#endif
+    bool stop;
+    bool failed;
+    bool busy[CAPTURE_SLOTS];
+    struct capture_entry queue[CAPTURE_QUEUE];
+    unsigned head;
+    unsigned count;
+    uint64_t dropped;
+
+    // Owned by whoever holds the slot, and by the writer respectively.
+    uint32_t* slots[CAPTURE_SLOTS];
+    uint8_t* output;                // The last frame, converted for the stream.
+    size_t output_size;
+};
+
+static inline void capture_lock(struct capture* capture)
+{
+#ifdef _WIN32
+    EnterCriticalSection(&capture->lock);
+#else
+    pthread_mutex_lock(&capture->lock);
+#endif
+}
+
+static inline void capture_unlock(struct capture* capture)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(&capture->lock);
+#else
+    pthread_mutex_unlock(&capture->lock);
+#endif
+}
+
+static inline void capture_wait(struct capture* capture)
+{
+#ifdef _WIN32
+    SleepConditionVariableCS(&capture->work, &capture->lock, INFINITE);
+#else
+    pthread_cond_wait(&capture->work, &capture->lock);
+#endif
+}
+
+static inline void capture_signal(struct capture* capture)
+{
+#ifdef _WIN32
+    WakeConditionVariable(&capture->work);
+#else
+    pthread_cond_signal(&capture->work);
+#endif
+}
+
+// Convert a frame to 4:2:0 YCbCr (BT.601, studio range), each chroma
+// sample averaging a 2x2 block.
+static void capture_convert_y4m(struct capture* capture, const uint32_t* pixels)
+{
+    unsigned width = capture->width;
+    unsigned height = capture->height;
+    uint8_t* y_plane = capture->output;
+    uint8_t* u_plane = y_plane + width * height;
+    uint8_t* v_plane = u_plane + (width / 2) * (height / 2);
+
+    for (unsigned y = 0; y < height; y += 2)
+    {
+        for (unsigned x = 0; x < width; x += 2)
+        {
+            int r_sum = 0, g_sum = 0, b_sum = 0;
+            for (unsigned i = 0; i < 4; i++)
+            {
+                unsigned offset = (y + i / 2) * width + x + i % 2;
+                int r = (pixels[offset] >> 16) & 0xFF;
+                int g = (pixels[offset] >> 8) & 0xFF;
+                int b = pixels[offset] & 0xFF;
+                y_plane[offset] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+                r_sum += r;
+                g_sum += g;
+                b_sum += b;
+            }
+            unsigned chroma = (y / 2) * (width / 2) + x / 2;
+            u_plane[chroma] = (uint8_t)(((-38 * r_sum - 74 * g_sum + 112 * b_sum + 512) >> 10) + 128);
+            v_plane[chroma] = (uint8_t)(((112 * r_sum - 94 * g_sum - 18 * b_sum + 512) >> 10) + 128);
+        }
+    }
+}
+
+static void capture_convert_ppm(struct capture* capture, const uint32_t* pixels)
+{
+    uint8_t* dst = capture->output;
+    for (size_t i = 0; i < (size_t)capture->width * capture->height; i++, dst += 3)
+    {
+        dst[0] = (uint8_t)(pixels[i] >> 16);
+        dst[1] = (uint8_t)(pixels[i] >> 8);
+        dst[2] = (uint8_t)pixels[i];
+    }
+}
+
+static bool capture_write(struct capture* capture, struct capture_entry* entry)
+{
+    if (capture->format == CAPTURE_FORMAT_Y4M)
+    {
+        return fputs("FRAME\n", capture->file) >= 0
+            && fwrite(capture->output, 1, capture->output_size, capture->file) == capture->output_size;
+    }
+
+    // A PPM image is only written when the frame changed.
+    if (entry->slot == CAPTURE_REPEAT)
+        return true;
+    return fprintf(capture->file, "P6\n# frame %llu\n%u %u\n255\n", (unsigned long long)entry->frame,
+                   capture->width, capture->height) > 0
+        && fwrite(capture->output, 1, capture->output_size, capture->file) == capture->output_size;
+}
+
+// The writer thread: convert and write queued frames until told to stop, and
+// the queue is empty. After a write error, frames are still taken off the
+// queue (so slots are freed) but go nowhere.
+#ifdef _WIN32
+static DWORD WINAPI capture_writer(LPVOID arg)
+#else
+static void* capture_writer(void* arg)
+#endif
+{
+    struct capture* capture = arg;
+    bool failed = false;
+
+    capture_lock(capture);
+    for (;;)
+    {
+        while (!capture->count && !capture->stop)
+            capture_wait(capture);
+        if (!capture->count)
+            break;
+        struct capture_entry entry = capture->queue[capture->head];
+        capture->head = (capture->head + 1) % CAPTURE_QUEUE;
+        capture->count--;
+        capture_unlock(capture);
+
+        if (entry.slot != CAPTURE_REPEAT)
+        {
+            if (capture->format == CAPTURE_FORMAT_Y4M)
+                capture_convert_y4m(capture, capture->slots[entry.slot]);
+            else
+                capture_convert_ppm(capture, capture->slots[entry.slot]);
+        }
+        if (!failed && !capture_write(capture, &entry))
+            failed = true;
+
+        capture_lock(capture);
+        if (entry.slot != CAPTURE_REPEAT)
+            capture->busy[entry.slot] = false;
+    }
+    capture->failed = failed;
+    capture_unlock(capture);
+    return 0;
+}
+
+// Start capturing to path ("-" or NULL for stdout) at rate frames per second.
+// Frames of a different size than width x height (which must be even) are
+// centred, cropped or bordered in black. Returns NULL if the file cannot be
+// opened.
+struct capture* capture_open(const char* path, enum capture_format format,
+                             unsigned width, unsigned height, unsigned rate)
+{
+    assert(width && height && rate);
+    assert(width % 2 == 0 && height % 2 == 0);
+
+    FILE* file;
+    bool close_file = path && strcmp(path, "-") != 0;
+    if (close_file)
+    {
+        file = fopen(path, "wb");
+        if (!file)
+            return NULL;
+    }
+    else
+    {
+        file = stdout;
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    }
+
+    struct capture* capture = quick_malloc(sizeof(struct capture));
+    capture->file = file;
+    capture->close_file = close_file;
+    capture->format = format;
+    capture->width = width;
+    capture->height = height;
+    capture->rate = rate;
+    for (unsigned i = 0; i < CAPTURE_SLOTS; i++)
+        capture->slots[i] = quick_calloc((size_t)width * height, sizeof(uint32_t));
+
+    // Until the first frame arrives, repeats write black.
+    if (format == CAPTURE_FORMAT_Y4M)
+    {
+        capture->output_size = (size_t)width * height * 3 / 2;
+        capture->output = quick_malloc(capture->output_size);
+        memset(capture->output, 16, (size_t)width * height);
+        memset(capture->output + (size_t)width * height, 128, (size_t)width * height / 2);
+        fprintf(file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", width, height, rate);
+    }
+    else
+    {
+        capture->output_size = (size_t)width * height * 3;
+        capture->output = quick_malloc(capture->output_size);
+    }
+
+#ifdef _WIN32
+    InitializeCriticalSection(&capture->lock);
+    InitializeConditionVariable(&capture->work);
+    capture->thread = CreateThread(NULL, 0, capture_writer, capture, 0, NULL);
+    if (!capture->thread)
+        abort();
+#else
+    pthread_mutex_init(&capture->lock, NULL);
+    pthread_cond_init(&capture->work, NULL);
+    if (pthread_create(&capture->thread, NULL, capture_writer, capture) != 0)
+        abort();
+#endif
+    return capture;
+}
+
+// Queue a frame for the writer (with the lock held). Returns false if the
+// queue is full.
+static bool capture_push(struct capture* capture, int slot, uint64_t frame)
+{
+    if (capture->count == CAPTURE_QUEUE)
+        return false;
+    capture->queue[(capture->head + capture->count) % CAPTURE_QUEUE] = (struct capture_entry){ slot, frame };
+    capture->count++;
+    return true;
+}
+
+// Copy a frame into a slot, centred.
+static void capture_copy(struct capture* capture, uint32_t* dst, const uint32_t* pixels,
+                         unsigned width, unsigned height)
+{
+    unsigned copy_width = (width < capture->width) ? width : capture->width;
+    unsigned copy_height = (height < capture->height) ? height : capture->height;
+    if (copy_width != capture->width || copy_height != capture->height)
+        memset(dst, 0, (size_t)capture->width * capture->height * sizeof(uint32_t));
+
+    dst += ((capture->height - copy_height) / 2) * capture->width + (capture->width - copy_width) / 2;
+    pixels += ((height - copy_height) / 2) * width + (width - copy_width) / 2;
+    for (unsigned y = 0; y < copy_height; y++)
+        memcpy(dst + (size_t)y * capture->width, pixels + (size_t)y * width, copy_width * sizeof(uint32_t));
+}
+
+// Offer the capture the current frame, at the given master clock. Call this
+// at least as often as the capture rate, e.g. after every vertical sync;
+// calls before the next frame is due return straight away. updates is the
+// adapter's count of changed frames, which tells whether the frame needs
+// copying at all.
+void capture_frame(struct capture* capture, uint64_t clock, const uint32_t* pixels,
+                   unsigned width, unsigned height, uint64_t updates)
+{
+    assert(capture);
+    if (!capture->started)
+    {
+        capture->started = true;
+        capture->origin = clock;
+        capture->next_clock = clock;
+    }
+    if (clock < capture->next_clock)
+        return;
+
+    uint64_t frame = (clock - capture->origin) * capture->rate / BUS_MASTER_CLOCK;
+    bool changed = !capture->has_frame || updates != capture->updates;
+
+    // Frames the caller was too late for show what was there before.
+    capture_lock(capture);
+    for (; capture->frame < frame; capture->frame++)
+        if (!capture_push(capture, CAPTURE_REPEAT, capture->frame))
+            capture->dropped++;
+    int slot = CAPTURE_REPEAT;
+    if (changed)
+    {
+        for (unsigned i = 0; i < CAPTURE_SLOTS && slot == CAPTURE_REPEAT; i++)
+            if (!capture->busy[i])
+                slot = (int)i;
+        if (slot != CAPTURE_REPEAT)
+            capture->busy[slot] = true;
+    }
+    capture_unlock(capture);
+
+    if (slot != CAPTURE_REPEAT)
+        capture_copy(capture, capture->slots[slot], pixels, width, height);
+
+    // A change that could not be handed over is retried at the next
+    // interval, with a repeat standing in for it.
+    capture_lock(capture);
+    bool pushed = capture_push(capture, slot, frame);
+    if (changed && pushed && slot != CAPTURE_REPEAT)
+    {
+        capture->has_frame = true;
+        capture->updates = updates;
+    }
+    else
+    {
+        if (slot != CAPTURE_REPEAT)
+            capture->busy[slot] = false;
+        if (changed || !pushed)
+            capture->dropped++;
+    }
+    capture_signal(capture);
+    capture_unlock(capture);
+
+    capture->frame = frame + 1;
+    capture->next_clock = capture->origin
+                        + ((frame + 1) * BUS_MASTER_CLOCK + capture->rate - 1) / capture->rate;
+}
+
+// Frames (or changes) that were lost because the writer fell behind.
+uint64_t capture_dropped(struct capture* capture)
+{
+    capture_lock(capture);
+    uint64_t dropped = capture->dropped;
+    capture_unlock(capture);
+    return dropped;
+}
+
+// Write out everything queued and stop. Returns false if any of the stream
+// could not be written.
+bool capture_close(struct capture* capture)
+{
+    assert(capture);
+    capture_lock(capture);
+    capture->stop = true;
+    capture_signal(capture);
+    capture_unlock(capture);
+
+#ifdef _WIN32
+    WaitForSingleObject(capture->thread, INFINITE);
+    CloseHandle(capture->thread);
+    DeleteCriticalSection(&capture->lock);
+#else
+    pthread_join(capture->thread, NULL);
+    pthread_cond_destroy(&capture->work);
+    pthread_mutex_destroy(&capture->lock);
+#endif
+
+    bool ok = !capture->failed;
+    if (capture->close_file)
+        ok = (fclose(capture->file) == 0) && ok;
+    else
+        ok = (fflush(capture->file) == 0) && ok;
+
+    for (unsigned i = 0; i < CAPTURE_SLOTS; i++)
+        free(capture->slots[i]);
+    free(capture->output);
+    free(capture);
+    return ok;
+}
@@ -0,0 +1,39 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Headless video capture to a raw YUV4MPEG2 (Y4M) or PPM stream.
+//
+// The emulation thread hands frames over at most once per capture interval
+// (measured on the bus's master clock, not the host's), and a thread of the
+// capture's own converts and writes them. The only cost to emulation is a
+// copy of each frame that changed into one of a few buffers allocated up
+// front. If the writer falls behind, emulation carries on and frames are
+// repeated or dropped rather than waited for.
+//
+// Unchanged frames are never copied or converted. In Y4M, which has a fixed
+// frame rate, they are written again from the last converted frame. In PPM
+// they are skipped, and each image carries its frame number in a header
+// comment ("# frame N") so the timing can be reconstructed.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CAPTURE_SLOTS       4       // Frame buffers handed to the writer.
+#define CAPTURE_QUEUE       64      // Frames (or repeats) waiting to be written.
+
+enum capture_format
+{
+    CAPTURE_FORMAT_Y4M,             // 4:2:0 YCbCr, one stream header.
+    CAPTURE_FORMAT_PPM              // RGB, a header per image.
+};
+
+struct capture;
+
+struct capture* capture_open(const char* path, enum capture_format format,
+                             unsigned width, unsigned height, unsigned rate);
+void capture_frame(struct capture* capture, uint64_t clock, const uint32_t* pixels,
+                   unsigned width, unsigned height, uint64_t updates);
+uint64_t capture_dropped(struct capture* capture);
+bool capture_close(struct capture* capture);
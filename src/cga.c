@@ -0,0 +1,334 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <assert.h>
+#include <string.h>
+
+#include "cga.h"
+#include "util.h"
+#include "video.h"
+
+// CRTC values for 80x25 text, as the BIOS programs them for mode 3.
+static const uint8_t cga_crtc_default[16] =
+{
+    0x71, 0x50, 0x5A, 0x0A, 0x1F, 0x06, 0x19, 0x1C,
+    0x02, 0x07, 0x06, 0x07, 0x00, 0x00, 0x00, 0x00
+};
+
+static inline void cga_mark(struct cga* cga, unsigned word)
+{
+    video_mark(cga->dirty, word & (CGA_VRAM_SIZE / 2 - 1));
+    cga->dirty_any = true;
+}
+
+// Rebuild the 320x200 lookup table from the colour select register: each
+// byte holds four 2-bit pixels, which are doubled horizontally.
+static void cga_palette(struct cga* cga)
+{
+    static const uint8_t sets[3][3] = { { 2, 4, 6 }, { 3, 5, 7 }, { 3, 4, 7 } };
+    const uint8_t* set = sets[(cga->mode & CGA_MODE_BW) ? 2 : (cga->colour >> 5) & 1];
+    unsigned intensity = (cga->colour & 0x10) ? 8 : 0;
+
+    uint32_t palette[4];
+    palette[0] = video_rgbi[cga->colour & 0xF];
+    for (unsigned i = 0; i < 3; i++)
+        palette[i + 1] = video_rgbi[set[i] | intensity];
+
+    for (unsigned byte = 0; byte < 256; byte++)
+        for (unsigned pixel = 0; pixel < 4; pixel++)
+            cga->lut[byte][pixel * 2] = cga->lut[byte][pixel * 2 + 1]
+                = palette[(byte >> (6 - pixel * 2)) & 3];
+}
+
+// Rebuild the attribute tables for the current mode and blink phase.
+static void cga_attributes(struct cga* cga)
+{
+    for (unsigned attr = 0; attr < 256; attr++)
+    {
+        uint32_t fg = video_rgbi[attr & 0xF];
+        uint32_t bg;
+        if (cga->mode & CGA_MODE_BLINK)
+        {
+            bg = video_rgbi[(attr >> 4) & 7];
+            if ((attr & 0x80) && !cga->blink_on)
+                fg = bg;
+        }
+        else
+            bg = video_rgbi[attr >> 4];
+        cga->attributes.fg[attr] = fg;
+        cga->attributes.bg[attr] = bg;
+    }
+}
+
+// Re-expand the font for the cell width of the current text mode.
+static void cga_atlas(struct cga* cga)
+{
+    video_atlas_build(&cga->atlas, cga->font, 8, 8, (cga->mode & CGA_MODE_HIRES_TEXT) ? 8 : 16);
+}
+
+// Describe the text screen as the CRTC has it set up, for reading it back.
+// Returns false when the adapter is not showing text.
+bool cga_text(struct bus* bus, struct cga* cga, struct video_text* text)
+{
+    text->vram = &bus->memory[CGA_VRAM];
+    text->words = CGA_VRAM_SIZE / 2;
+    text->cols = (cga->mode & CGA_MODE_HIRES_TEXT) ? 80 : 40;
+    text->height = (cga->crtc[9] & 0x1F) + 1;
+    text->rows = cga->crtc[6] & 0x7F;
+    if (text->rows * text->height > CGA_HEIGHT)
+        text->rows = (CGA_HEIGHT + text->height - 1) / text->height;
+    text->start = ((cga->crtc[12] << 8) | cga->crtc[13]) & (CGA_VRAM_SIZE / 2 - 1);
+    text->cursor_lines = 0;
+    text->cursor = ((cga->crtc[14] << 8) | cga->crtc[15]) & (CGA_VRAM_SIZE / 2 - 1);
+    text->atlas = &cga->atlas;
+    text->attributes = &cga->attributes;
+    text->pixels = cga->pixels;
+    text->pitch = CGA_WIDTH;
+    text->lines = CGA_HEIGHT;
+    text->underline_lines = 0;
+    text->matches = &cga->matches;
+    return (cga->mode & CGA_MODE_ENABLE) && !(cga->mode & CGA_MODE_GRAPHICS);
+}
+
+static void cga_compose_text(struct bus* bus, struct cga* cga, bool cursor_phase, bool blink_phase)
+{
+    struct video_text text;
+    cga_text(bus, cga, &text);
+    text.cursor_lines = cursor_phase ? video_cursor_lines(cga->crtc[10], cga->crtc[11]) : 0;
+
+    // The cursor and blinking characters change with the blink phases, so
+    // only the rows involved are redrawn when they do.
+    if (text.cursor_lines != cga->cursor_lines || text.cursor != cga->cursor_at)
+    {
+        cga_mark(cga, cga->cursor_at);
+        cga_mark(cga, text.cursor);
+    }
+    cga->cursor_lines = text.cursor_lines;
+    cga->cursor_at = text.cursor;
+
+    bool blink_on = (cga->mode & CGA_MODE_BLINK) ? blink_phase : true;
+    if (blink_on != cga->blink_on)
+    {
+        cga->blink_on = blink_on;
+        cga_attributes(cga);
+        video_text_blinking(&text, cga->dirty);
+        cga->dirty_any = true;
+    }
+
+    if (cga->redraw)
+        video_fill(cga->pixels, CGA_WIDTH * CGA_HEIGHT, 0);
+    else if (!cga->dirty_any && !cga->matches.rescan)
+        return;
+    if (video_text_compose(&text, cga->dirty, cga->redraw))
+        cga->changed = true;
+}
+
+static void cga_draw_line(struct cga* cga, const uint8_t* vram, unsigned start, unsigned y)
+{
+    // Even scanlines are in the first 8 KB, odd ones in the second.
+    const uint8_t* bank = vram + ((y & 1) << 13);
+    unsigned offset = start + (y >> 1) * 80;
+    uint32_t* dst = &cga->pixels[y * CGA_WIDTH];
+    if (cga->mode & CGA_MODE_HIRES_GRAPHICS)
+    {
+        uint32_t fg = video_rgbi[cga->colour & 0xF];
+        for (unsigned i = 0; i < 80; i++)
+            video_expand8(dst + i * 8, bank[(offset + i) & 0x1FFF], fg, 0);
+    }
+    else
+    {
+        // Copying from the table beats selecting from the palette with SSE2
+        // like above, which needs three selects per vector and came out
+        // about 2.8 times slower (see bench/cga_compose.c).
+        for (unsigned i = 0; i < 80; i++)
+            memcpy(dst + i * 8, cga->lut[bank[(offset + i) & 0x1FFF]], sizeof(cga->lut[0]));
+    }
+}
+
+static void cga_compose_graphics(struct bus* bus, struct cga* cga)
+{
+    const uint8_t* vram = &bus->memory[CGA_VRAM];
+    unsigned start = (((cga->crtc[12] << 8) | cga->crtc[13]) * 2) & 0x1FFF;
+    if (cga->redraw)
+    {
+        for (unsigned y = 0; y < CGA_HEIGHT; y++)
+            cga_draw_line(cga, vram, start, y);
+    }
+    else
+    {
+        if (!cga->dirty_any)
+            return;
+
+        // Work out which scanlines the written words belong to.
+        bool lines[CGA_HEIGHT] = { false };
+        for (unsigned i = 0; i < CGA_VRAM_SIZE / 2 / 64; i++)
+        {
+            for (uint64_t bits = cga->dirty[i]; bits; bits &= bits - 1)
+            {
+                unsigned address = (i * 64 + quick_ctz64(bits)) * 2;
+                for (unsigned byte = address; byte < address + 2; byte++)
+                {
+                    unsigned row = (((byte & 0x1FFF) - start) & 0x1FFF) / 80;
+                    if (row < CGA_HEIGHT / 2)
+                        lines[row * 2 + (byte >> 13)] = true;
+                }
+            }
+        }
+        for (unsigned y = 0; y < CGA_HEIGHT; y++)
+            if (lines[y])
+                cga_draw_line(cga, vram, start, y);
+    }
+    cga->changed = true;
+}
+
+// Compose a frame from whatever changed since the last one. This normally
+// runs at the start of every vertical sync.
+void cga_compose(struct bus* bus, struct cga* cga)
+{
+    bool cursor_phase = !((cga->frames >> 3) & 1);    // 8 frames on, 8 off.
+    bool blink_phase = !((cga->frames >> 4) & 1);     // 16 frames on, 16 off.
+    cga->frames++;
+    cga->changed = false;
+
+    if (!(cga->mode & CGA_MODE_ENABLE))
+    {
+        if (cga->redraw)
+        {
+            video_fill(cga->pixels, CGA_WIDTH * CGA_HEIGHT, 0);
+            cga->changed = true;
+        }
+    }
+    else if (cga->mode & CGA_MODE_GRAPHICS)
+        cga_compose_graphics(bus, cga);
+    else
+        cga_compose_text(bus, cga, cursor_phase, blink_phase);
+
+    if (cga->changed)
+        cga->updates++;
+    if (cga->dirty_any)
+        memset(cga->dirty, 0, sizeof(cga->dirty));
+    cga->dirty_any = false;
+    cga->redraw = false;
+}
+
+static void cga_written(struct bus* bus, void* device, uint32_t address, size_t length)
+{
+    struct cga* cga = device;
+    unsigned first = (address - CGA_VRAM) / 2;
+    unsigned last = (address + length - 1 - CGA_VRAM) / 2;
+    for (unsigned word = first; word <= last; word++)
+        cga_mark(cga, word);
+}
+
+static uint8_t cga_in(struct bus* bus, void* device, uint16_t port)
+{
+    struct cga* cga = device;
+    switch (port - CGA_PORTS)
+    {
+        // Only the cursor and light pen registers can be read back.
+        case 0x1: case 0x3: case 0x5: case 0x7:
+            return (cga->crtc_index >= 14 && cga->crtc_index < 18) ? cga->crtc[cga->crtc_index] : 0x00;
+        case 0xA:
+        {
+            unsigned position = bus->clock % CGA_FRAME_CLOCKS;
+            unsigned line = position / CGA_LINE_CLOCKS;
+            unsigned dot = position % CGA_LINE_CLOCKS;
+            uint8_t status = 0xF0;
+            if (line >= CGA_HEIGHT || dot >= CGA_WIDTH)
+                status |= CGA_STATUS_DISPLAY_OFF;
+            if (line >= CGA_VSYNC_LINE && line < CGA_VSYNC_LINE + CGA_VSYNC_LINES)
+                status |= CGA_STATUS_VSYNC;
+            return status;
+        }
+        default:
+            return 0xFF;
+    }
+}
+
+static void cga_out(struct bus* bus, void* device, uint16_t port, uint8_t data)
+{
+    struct cga* cga = device;
+    switch (port - CGA_PORTS)
+    {
+        case 0x0: case 0x2: case 0x4: case 0x6:
+        {
+            cga->crtc_index = data & 0x1F;
+            break;
+        }
+        case 0x1: case 0x3: case 0x5: case 0x7:
+        {
+            // R16/R17 (light pen) are read-only. The cursor registers are
+            // picked up by the next frame without a full redraw.
+            if (cga->crtc_index >= 16 || cga->crtc[cga->crtc_index] == data)
+                break;
+            cga->crtc[cga->crtc_index] = data;
+            if (cga->crtc_index != 10 && cga->crtc_index != 11
+                && cga->crtc_index != 14 && cga->crtc_index != 15)
+                cga->redraw = true;
+            break;
+        }
+        case 0x8:
+        case 0x9:
+        {
+            uint8_t* reg = (port - CGA_PORTS == 0x8) ? &cga->mode : &cga->colour;
+            if (*reg == data)
+                break;
+            bool width_changed = reg == &cga->mode && ((*reg ^ data) & CGA_MODE_HIRES_TEXT);
+            *reg = data;
+            if (width_changed)
+                cga_atlas(cga);
+            cga_palette(cga);
+            cga_attributes(cga);
+            cga->redraw = true;
+            break;
+        }
+    }
+}
+
+static void cga_schedule(struct bus* bus, struct cga* cga)
+{
+    uint64_t deadline = bus->clock / CGA_FRAME_CLOCKS * CGA_FRAME_CLOCKS
+                      + CGA_VSYNC_LINE * CGA_LINE_CLOCKS;
+    if (deadline <= bus->clock)
+        deadline += CGA_FRAME_CLOCKS;
+    bus_schedule(bus, cga->timer, deadline);
+}
+
+static void cga_vsync(struct bus* bus, void* device)
+{
+    struct cga* cga = device;
+    cga_compose(bus, cga);
+    cga_schedule(bus, cga);
+}
+
+// Attach a CGA to the bus. The font is the 8x8 half of the card's character
+// generator ROM (CGA_FONT_SIZE bytes); without one, text is drawn blank.
+// Returns NULL if its ports or VRAM cannot be mapped (see bus_map_ports() and
+// bus_watch()).
+struct cga* cga_new(struct bus* bus, const uint8_t* font)
+{
+    assert(bus);
+    assert(bus->memory_size >= CGA_VRAM + CGA_VRAM_SIZE);
+
+    struct cga* cga = arena_alloc(bus->arena, sizeof(struct cga));
+    memcpy(cga->crtc, cga_crtc_default, sizeof(cga_crtc_default));
+    cga->mode = CGA_MODE_HIRES_TEXT | CGA_MODE_ENABLE | CGA_MODE_BLINK;
+    cga->redraw = true;
+    cga->blink_on = true;
+    if (font)
+        memcpy(cga->font, font, CGA_FONT_SIZE);
+    cga_palette(cga);
+    cga_attributes(cga);
+    cga_atlas(cga);
+
+    if (!bus_map_ports(bus, CGA_PORTS, 16, cga, cga_in, cga_out))
+        return NULL;
+    if (!bus_watch(bus, CGA_VRAM, CGA_VRAM_SIZE, cga, cga_written))
+    {
+        bus_unmap_ports(bus, cga);
+        return NULL;
+    }
+    cga->timer = bus_add_timer(bus, cga, cga_vsync);
+    cga_schedule(bus, cga);
+    return cga;
+}
@@ -0,0 +1,83 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// IBM Color Graphics Adapter.
+//
+// Video memory is plain RAM at 0xB8000 that the bus watches for writes, so
+// the CPU (and its bulk string paths) write it at full speed while the
+// adapter keeps a bitmap of the words that changed. A frame is composed once
+// per vertical sync, and only the character rows (text modes, through the
+// shared renderer in video.h) or scanlines (graphics modes) that were dirtied
+// since the last frame are redrawn. A frame without any VRAM writes costs
+// next to nothing.
+//
+// Frames are always 640x200. 40-column text and 320x200 graphics are
+// doubled horizontally. The border is not drawn, and the 16 KB of VRAM is not
+// mirrored at 0xBC000.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bus.h"
+#include "video.h"
+
+#define CGA_VRAM                0xB8000
+#define CGA_VRAM_SIZE           0x4000
+#define CGA_PORTS               0x3D0
+#define CGA_WIDTH               640
+#define CGA_HEIGHT              200
+#define CGA_FONT_SIZE           (256 * 8)
+
+// The CGA is clocked from the master clock: 912 dots per scanline and 262
+// scanlines per frame, with vertical sync starting at scanline 224.
+#define CGA_LINE_CLOCKS         912
+#define CGA_FRAME_LINES         262
+#define CGA_FRAME_CLOCKS        (CGA_LINE_CLOCKS * CGA_FRAME_LINES)
+#define CGA_VSYNC_LINE          224
+#define CGA_VSYNC_LINES         16
+
+// Mode control register (0x3D8).
+#define CGA_MODE_HIRES_TEXT     (1 << 0)
+#define CGA_MODE_GRAPHICS       (1 << 1)
+#define CGA_MODE_BW             (1 << 2)
+#define CGA_MODE_ENABLE         (1 << 3)
+#define CGA_MODE_HIRES_GRAPHICS (1 << 4)
+#define CGA_MODE_BLINK          (1 << 5)
+
+// Status register (0x3DA).
+#define CGA_STATUS_DISPLAY_OFF  (1 << 0)
+#define CGA_STATUS_VSYNC        (1 << 3)
+
+struct cga
+{
+    // Registers.
+    uint8_t crtc[18];               // 6845 CRTC registers R0-R17.
+    uint8_t crtc_index;             // Selected CRTC register.
+    uint8_t mode;                   // Mode control register.
+    uint8_t colour;                 // Colour select register.
+
+    // Composition state.
+    unsigned timer;                 // Vertical sync timer.
+    uint64_t frames;                // Frames composed so far.
+    bool changed;                   // Did the last frame differ from the one before?
+    uint64_t updates;               // Frames composed that differed from the one before.
+    bool redraw;                    // Must the next frame be composed in full?
+    bool dirty_any;                 // Is any bit in dirty set?
+    bool blink_on;                  // Blinking characters shown in the last frame?
+    uint32_t cursor_lines;          // Cursor scanlines shown in the last frame.
+    uint16_t cursor_at;             // Word the cursor was last drawn at.
+    uint64_t dirty[CGA_VRAM_SIZE / 2 / 64]; // One bit per VRAM word written since the last frame.
+
+    uint8_t font[CGA_FONT_SIZE];    // Character generator ROM (8x8 glyphs).
+    struct video_attributes attributes;
+    struct video_matches matches;   // Text automation is waiting for.
+    struct video_atlas atlas;       // The font, expanded for the current text mode.
+    uint32_t lut[256][8];           // 320x200 graphics bytes to (doubled) pixels.
+    uint32_t pixels[CGA_WIDTH * CGA_HEIGHT];
+};
+
+struct cga* cga_new(struct bus* bus, const uint8_t* font);
+void cga_compose(struct bus* bus, struct cga* cga);
+bool cga_text(struct bus* bus, struct cga* cga, struct video_text* text);
@@ -9,14 +9,35 @@
 // with how undefined behaviour operates on flags.
 
 // Future references:
-// . MUL/DIV/IDIV will use transpiled Intel microcode (if I can understand it),
-//   because the timings for those fluctuate. 8086s aren't fast anyway.
+// . MUL/IMUL/DIV/IDIV timings fluctuate with the data, because the microcode
+//   loops (CORX/CORD) take a different number of cycles per bit. Rather than
+//   stepping through the microcode, the results are computed natively and the
+//   cycle count is derived in closed form from the operands' bit patterns.
+// . Repeated string instructions are done in bulk on plain RAM outside of
+//   bus micro-op mode: up to the next segment wrap, the elements are copied
+//   or filled with the C library, or searched 16 bytes at a time with SSE2,
+//   and the registers, flags and cycle count are updated in closed form.
+//   Overlapping copies replicate a pattern just like the real thing, since
+//   each element is read after the elements before it have been written.
 
 #include <assert.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
 
+#include "arena.h"
 #include "cpu8086.h"
 #include "util.h"
 
+// Defining CPU8086_SCALAR builds the fallback on SSE2 hosts too, for comparison.
+#if !defined(CPU8086_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#   define CPU8086_SSE2
+#   include <emmintrin.h>
+#endif
+
+// Everything up to the micro-op queue is touched on every instruction.
+static_assert(offsetof(struct cpu8086, uops) <= 128, "hot CPU state should fit in two cache lines");
+
 static const unsigned mask_buffer[2]    = { 0xFF, 0xFFFF };
 static const unsigned sign_bit[2]       = { 7, 15 };
 
@@ -30,12 +51,91 @@ static const bool parity_table[256] =
     P6(1), P6(0), P6(0), P6(1)
 };
 
-static inline bool calculate_parity(unsigned value, bool is_word)
+// PF only ever reflects the low byte of the result, even for words.
+static inline bool calculate_parity(unsigned value)
+{
+    return parity_table[value & 0xFF];
+}
+
+// Branch conditions, indexed by the packed flags (see op_jcc).
+// Bit n of each entry is whether condition n holds:
+// - 0x0 to 0xF: Jcc (opcodes 0x70 to 0x7F), in opcode order.
+// - 0x10 to 0x13: LOOPNZ/LOOPZ/LOOP/JCXZ (opcodes 0xE0 to 0xE3).
+// The LOOP conditions use a sixth "CX != 0" pseudo-flag.
+#define JCC_C(i) (((i) >> 0) & 1)
+#define JCC_P(i) (((i) >> 1) & 1)
+#define JCC_Z(i) (((i) >> 2) & 1)
+#define JCC_S(i) (((i) >> 3) & 1)
+#define JCC_O(i) (((i) >> 4) & 1)
+#define JCC_N(i) (((i) >> 5) & 1)
+#define JCC_L(i) (JCC_S(i) ^ JCC_O(i))
+#define JCC_ENTRY(i) \
+    ( (uint32_t)JCC_O(i) << 0x00 | (uint32_t)!JCC_O(i) << 0x01 \
+    | (uint32_t)JCC_C(i) << 0x02 | (uint32_t)!JCC_C(i) << 0x03 \
+    | (uint32_t)JCC_Z(i) << 0x04 | (uint32_t)!JCC_Z(i) << 0x05 \
+    | (uint32_t)(JCC_C(i) | JCC_Z(i)) << 0x06 | (uint32_t)!(JCC_C(i) | JCC_Z(i)) << 0x07 \
+    | (uint32_t)JCC_S(i) << 0x08 | (uint32_t)!JCC_S(i) << 0x09 \
+    | (uint32_t)JCC_P(i) << 0x0A | (uint32_t)!JCC_P(i) << 0x0B \
+    | (uint32_t)JCC_L(i) << 0x0C | (uint32_t)!JCC_L(i) << 0x0D \
+    | (uint32_t)(JCC_L(i) | JCC_Z(i)) << 0x0E | (uint32_t)!(JCC_L(i) | JCC_Z(i)) << 0x0F \
+    | (uint32_t)(JCC_N(i) & !JCC_Z(i)) << 0x10 | (uint32_t)(JCC_N(i) & JCC_Z(i)) << 0x11 \
+    | (uint32_t)JCC_N(i) << 0x12 | (uint32_t)!JCC_N(i) << 0x13 )
+static const uint32_t jcc_table[64] =
+{
+#   define J4(i) JCC_ENTRY(i), JCC_ENTRY(i + 1), JCC_ENTRY(i + 2), JCC_ENTRY(i + 3)
+#   define J16(i) J4(i), J4(i + 4), J4(i + 8), J4(i + 12)
+    J16(0), J16(16), J16(32), J16(48)
+};
+
+// Cycles for each branch condition when not taken/taken.
+static const uint8_t jcc_cycles[2][20] =
 {
-    if (is_word)
-        return parity_table[value & 0xFF] ^ parity_table[(value >> 8) & 0xFF];
-    else
-        return parity_table[value & 0xFF];
+    { 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 5, 6, 5, 6 },
+    { 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 19, 18, 17, 18 }
+};
+
+// Byte ALU results and flags, precomputed for every pair of operands and
+// carry-in by running the handlers below once (see cpu8086_alu_build). The
+// binary tables are indexed by (carry << 16) | (a << 8) | b, and the decimal
+// adjust tables by (AF << 9) | (CF << 8) | AL.
+struct alu_entry
+{
+    uint8_t result;
+    uint8_t flags[6];               // CF, PF, AF, ZF, SF, OF (see struct cpu8086).
+};
+
+enum alu_table
+{
+    ALU_ADC         = 0x00000,
+    ALU_SBB         = 0x20000,
+    ALU_AND         = 0x40000,
+    ALU_OR          = 0x50000,
+    ALU_XOR         = 0x60000,
+    ALU_DAA         = 0x70000,
+    ALU_DAS         = 0x70400,
+    ALU_AAA         = 0x70800,
+    ALU_AAS         = 0x70C00,
+    ALU_TABLE_SIZE  = 0x71000
+};
+
+// The tables are looked up at random, so they are backed by huge pages where
+// the host allows it. Machines can be created and freed on different
+// threads, so the reference count, and building or freeing the tables, is
+// done under alu_table_lock. A CPU that holds a reference sees the finished
+// tables, as it took the lock after they were built.
+static struct arena* alu_arena;
+static struct alu_entry* alu_table;
+static unsigned alu_table_users;
+static atomic_flag alu_table_lock = ATOMIC_FLAG_INIT;
+
+// https://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+static inline unsigned calculate_popcount(uint16_t value)
+{
+    unsigned v = value;
+    v = v - ((v >> 1) & 0x5555);
+    v = (v & 0x3333) + ((v >> 2) & 0x3333);
+    v = (v + (v >> 4)) & 0x0F0F;
+    return (v + (v >> 8)) & 0x1F;
 }
 
 struct opcode;
@@ -47,43 +147,53 @@ static void op_add(struct opcode* op, struct cpu8086* cpu);
 static void op_and(struct opcode* op, struct cpu8086* cpu);
 static void op_callfar(struct opcode* op, struct cpu8086* cpu);
 static void op_cbw(struct opcode* op, struct cpu8086* cpu);
+static void op_clc(struct opcode* op, struct cpu8086* cpu);
+static void op_cld(struct opcode* op, struct cpu8086* cpu);
+static void op_cli(struct opcode* op, struct cpu8086* cpu);
 static void op_cmp(struct opcode* op, struct cpu8086* cpu);
 static void op_cwd(struct opcode* op, struct cpu8086* cpu);
 static void op_daa(struct opcode* op, struct cpu8086* cpu);
 static void op_das(struct opcode* op, struct cpu8086* cpu);
 static void op_dec(struct opcode* op, struct cpu8086* cpu);
+static void op_div(struct opcode* op, struct cpu8086* cpu);
+static void op_grp3(struct opcode* op, struct cpu8086* cpu);
+static void op_idiv(struct opcode* op, struct cpu8086* cpu);
 static void op_imm(struct opcode* op, struct cpu8086* cpu);
+static void op_imul(struct opcode* op, struct cpu8086* cpu);
+static void op_in(struct opcode* op, struct cpu8086* cpu);
 static void op_inc(struct opcode* op, struct cpu8086* cpu);
-static void op_ja(struct opcode* op, struct cpu8086* cpu);
-static void op_jae(struct opcode* op, struct cpu8086* cpu);
-static void op_jb(struct opcode* op, struct cpu8086* cpu);
-static void op_jbe(struct opcode* op, struct cpu8086* cpu);
-static void op_je(struct opcode* op, struct cpu8086* cpu);
-static void op_jg(struct opcode* op, struct cpu8086* cpu);
-static void op_jge(struct opcode* op, struct cpu8086* cpu);
-static void op_jl(struct opcode* op, struct cpu8086* cpu);
-static void op_jle(struct opcode* op, struct cpu8086* cpu);
-static void op_jne(struct opcode* op, struct cpu8086* cpu);
-static void op_jno(struct opcode* op, struct cpu8086* cpu);
-static void op_jnp(struct opcode* op, struct cpu8086* cpu);
-static void op_jns(struct opcode* op, struct cpu8086* cpu);
-static void op_jo(struct opcode* op, struct cpu8086* cpu);
-static void op_jp(struct opcode* op, struct cpu8086* cpu);
-static void op_js(struct opcode* op, struct cpu8086* cpu);
+static void op_iret(struct opcode* op, struct cpu8086* cpu);
+static void op_jcc(struct opcode* op, struct cpu8086* cpu);
 static void op_lahf(struct opcode* op, struct cpu8086* cpu);
 static void op_lea(struct opcode* op, struct cpu8086* cpu);
 static void op_lds(struct opcode* op, struct cpu8086* cpu);
 static void op_les(struct opcode* op, struct cpu8086* cpu);
 static void op_mov(struct opcode* op, struct cpu8086* cpu);
+static void op_mul(struct opcode* op, struct cpu8086* cpu);
+static void op_neg(struct opcode* op, struct cpu8086* cpu);
+static void op_not(struct opcode* op, struct cpu8086* cpu);
 static void op_or(struct opcode* op, struct cpu8086* cpu);
+static void op_out(struct opcode* op, struct cpu8086* cpu);
 static void op_pop(struct opcode* op, struct cpu8086* cpu);
 static void op_popf(struct opcode* op, struct cpu8086* cpu);
 static void op_push(struct opcode* op, struct cpu8086* cpu);
 static void op_pushf(struct opcode* op, struct cpu8086* cpu);
+static void op_rcl(struct opcode* op, struct cpu8086* cpu);
+static void op_rcr(struct opcode* op, struct cpu8086* cpu);
 static void op_retnear(struct opcode* op, struct cpu8086* cpu);
 static void op_retfar(struct opcode* op, struct cpu8086* cpu);
+static void op_rol(struct opcode* op, struct cpu8086* cpu);
+static void op_ror(struct opcode* op, struct cpu8086* cpu);
 static void op_sahf(struct opcode* op, struct cpu8086* cpu);
+static void op_sar(struct opcode* op, struct cpu8086* cpu);
 static void op_sbb(struct opcode* op, struct cpu8086* cpu);
+static void op_setmo(struct opcode* op, struct cpu8086* cpu);
+static void op_shift(struct opcode* op, struct cpu8086* cpu);
+static void op_shl(struct opcode* op, struct cpu8086* cpu);
+static void op_shr(struct opcode* op, struct cpu8086* cpu);
+static void op_stc(struct opcode* op, struct cpu8086* cpu);
+static void op_std(struct opcode* op, struct cpu8086* cpu);
+static void op_sti(struct opcode* op, struct cpu8086* cpu);
 static void op_sub(struct opcode* op, struct cpu8086* cpu);
 static void op_test(struct opcode* op, struct cpu8086* cpu);
 static void op_wait(struct opcode* op, struct cpu8086* cpu);
@@ -123,6 +233,7 @@ enum opcode_location
     // immed
     LOC_IMM,
     LOC_IMM8,   // unique solely to opcode 0x83 (group IMM)
+    LOC_IMM3,   // unique solely to opcodes 0xF6/0xF7 (group 3), only read by TEST
 
     // ModRM
     LOC_RM,
@@ -282,22 +393,22 @@ static struct opcode op_table[] =
     { "ILLEG.", LOC_NULL,   LOC_NULL,   true,   false,  NULL },
 
     // 0x70 to 0x7F
-    { "JO",     LOC_NULL,   LOC_IMM,    false,  false,  op_jo },
-    { "JNO",    LOC_NULL,   LOC_IMM,    false,  false,  op_jno },
-    { "JB",     LOC_NULL,   LOC_IMM,    false,  false,  op_jb },
-    { "JAE",    LOC_NULL,   LOC_IMM,    false,  false,  op_jae },
-    { "JE",     LOC_NULL,   LOC_IMM,    false,  false,  op_je },
-    { "JNE",    LOC_NULL,   LOC_IMM,    false,  false,  op_jne },
-    { "JBE",    LOC_NULL,   LOC_IMM,    false,  false,  op_jbe },
-    { "JA",     LOC_NULL,   LOC_IMM,    false,  false,  op_ja },
-    { "JS",     LOC_NULL,   LOC_IMM,    false,  false,  op_js },
-    { "JNS",    LOC_NULL,   LOC_IMM,    false,  false,  op_jns },
-    { "JP",     LOC_NULL,   LOC_IMM,    false,  false,  op_jp },
-    { "JNP",    LOC_NULL,   LOC_IMM,    false,  false,  op_jnp },
-    { "JL",     LOC_NULL,   LOC_IMM,    false,  false,  op_jl },
-    { "JGE",    LOC_NULL,   LOC_IMM,    false,  false,  op_jge },
-    { "JLE",    LOC_NULL,   LOC_IMM,    false,  false,  op_jle },
-    { "JG",     LOC_NULL,   LOC_IMM,    false,  false,  op_jg },
+    { "JO",     LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "JNO",    LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "JB",     LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "JAE",    LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "JE",     LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "JNE",    LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "JBE",    LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "JA",     LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "JS",     LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "JNS",    LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "JP",     LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "JNP",    LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "JL",     LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "JGE",    LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "JLE",    LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "JG",     LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
 
     // 0x80 to 0x8F
     { "IMM",    LOC_RM,     LOC_IMM,    false,  false,  op_imm },
@@ -351,7 +462,7 @@ static struct opcode op_table[] =
     { "LODSB",  LOC_AL,     LOC_STRSRC, false,  true,   op_mov },
     { "LODSW",  LOC_AX,     LOC_STRSRC, true,   true,   op_mov },
     { "SCASB",  LOC_AL,     LOC_STRDST, false,  true,   op_cmp },
-    { "SCASB",  LOC_AL,     LOC_STRDST, true,   true,   op_cmp },
+    { "SCASW",  LOC_AX,     LOC_STRDST, true,   true,   op_cmp },
 
     // 0xB0 to 0xBF
     { "MOV",    LOC_AL,     LOC_IMM,    false,  false,  op_mov },
@@ -384,8 +495,68 @@ static struct opcode op_table[] =
     { "ILLEG.", LOC_NULL,   LOC_NULL,   true,   false,  NULL },         // Nor this.
     { "RET",    LOC_NULL,   LOC_IMM,    true,   false,  op_retfar },
     { "RET",    LOC_NULL,   LOC_NULL,   true,   false,  op_retfar },
-    
+    { "INT3",   LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // Not implemented yet.
+    { "INT",    LOC_NULL,   LOC_IMM,    false,  false,  NULL },         // Not implemented yet.
+    { "INTO",   LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // Not implemented yet.
+    { "IRET",   LOC_NULL,   LOC_NULL,   false,  false,  op_iret },
+
+    // 0xD0 to 0xDF
+    { "SHIFT",  LOC_RM,     LOC_NULL,   false,  false,  op_shift },
+    { "SHIFT",  LOC_RM,     LOC_NULL,   true,   false,  op_shift },
+    { "SHIFT",  LOC_RM,     LOC_CL,     false,  false,  op_shift },
+    { "SHIFT",  LOC_RM,     LOC_CL,     true,   false,  op_shift },
+    { "AAM",    LOC_NULL,   LOC_IMM,    false,  false,  NULL },         // Not implemented yet.
+    { "AAD",    LOC_NULL,   LOC_IMM,    false,  false,  NULL },         // Not implemented yet.
+    { "ILLEG.", LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // SALC, undocumented.
+    { "XLAT",   LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // Not implemented yet.
+    { "ESC",    LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // Not implemented yet.
+    { "ESC",    LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // Not implemented yet.
+    { "ESC",    LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // Not implemented yet.
+    { "ESC",    LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // Not implemented yet.
+    { "ESC",    LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // Not implemented yet.
+    { "ESC",    LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // Not implemented yet.
+    { "ESC",    LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // Not implemented yet.
+    { "ESC",    LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // Not implemented yet.
+
+    // 0xE0 to 0xEF
+    { "LOOPNZ", LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "LOOPZ",  LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "LOOP",   LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "JCXZ",   LOC_NULL,   LOC_IMM,    false,  false,  op_jcc },
+    { "IN",     LOC_AL,     LOC_IMM8,   false,  false,  op_in },
+    { "IN",     LOC_AX,     LOC_IMM8,   true,   false,  op_in },
+    { "OUT",    LOC_AL,     LOC_IMM8,   false,  false,  op_out },       // The port is decoded as the source.
+    { "OUT",    LOC_AX,     LOC_IMM8,   true,   false,  op_out },
+    { "CALL",   LOC_NULL,   LOC_NULL,   true,   false,  NULL },         // Not implemented yet.
+    { "JMP",    LOC_NULL,   LOC_NULL,   true,   false,  NULL },         // Not implemented yet.
+    { "JMP",    LOC_NULL,   LOC_NULL,   true,   false,  NULL },         // Not implemented yet.
+    { "JMP",    LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // Not implemented yet.
+    { "IN",     LOC_AL,     LOC_NULL,   false,  false,  op_in },        // Port in DX.
+    { "IN",     LOC_AX,     LOC_NULL,   true,   false,  op_in },
+    { "OUT",    LOC_AL,     LOC_NULL,   false,  false,  op_out },
+    { "OUT",    LOC_AX,     LOC_NULL,   true,   false,  op_out },
+
+    // 0xF0 to 0xF7
+    { "LOCK",   LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // PREFIX LOCK
+    { "ILLEG.", LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // Should be LOCK?
+    { "REPNZ",  LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // PREFIX REPNZ
+    { "REPZ",   LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // PREFIX REPZ
+    { "HLT",    LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // Not implemented yet.
+    { "CMC",    LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // Not implemented yet.
+    { "GRP3",   LOC_RM,     LOC_IMM3,   false,  false,  op_grp3 },
+    { "GRP3",   LOC_RM,     LOC_IMM3,   true,   false,  op_grp3 },
+
+    // 0xF8 to 0xFF
+    { "CLC",    LOC_NULL,   LOC_NULL,   false,  false,  op_clc },
+    { "STC",    LOC_NULL,   LOC_NULL,   false,  false,  op_stc },
+    { "CLI",    LOC_NULL,   LOC_NULL,   false,  false,  op_cli },
+    { "STI",    LOC_NULL,   LOC_NULL,   false,  false,  op_sti },
+    { "CLD",    LOC_NULL,   LOC_NULL,   false,  false,  op_cld },
+    { "STD",    LOC_NULL,   LOC_NULL,   false,  false,  op_std },
+    { "GRP4",   LOC_NULL,   LOC_NULL,   false,  false,  NULL },         // Not implemented yet.
+    { "GRP5",   LOC_NULL,   LOC_NULL,   true,   false,  NULL },         // Not implemented yet.
 };
+static_assert(sizeof(op_table) / sizeof(*op_table) == 256, "every opcode byte needs an op_table entry");
 
 // IMM group opcode table.
 // Since the locations and word types are already decoded, they are
@@ -405,44 +576,223 @@ static struct opcode imm_table[] =
     { "CMP",    LOC_NULL,   LOC_NULL,   false,  false,  op_cmp },
 };
 
-static inline uint8_t loc_read_byte(struct cpu8086* cpu, struct location* loc)
+// Shift/rotate group opcode table (opcodes 0xD0 to 0xD3).
+// The count is either 1 or CL, depending on the source of the root opcode.
+static struct opcode shift_table[] =
+{
+    // 0x00 to 0x07
+    { "ROL",    LOC_NULL,   LOC_NULL,   false,  false,  op_rol },
+    { "ROR",    LOC_NULL,   LOC_NULL,   false,  false,  op_ror },
+    { "RCL",    LOC_NULL,   LOC_NULL,   false,  false,  op_rcl },
+    { "RCR",    LOC_NULL,   LOC_NULL,   false,  false,  op_rcr },
+    { "SHL",    LOC_NULL,   LOC_NULL,   false,  false,  op_shl },
+    { "SHR",    LOC_NULL,   LOC_NULL,   false,  false,  op_shr },
+    { "SETMO",  LOC_NULL,   LOC_NULL,   false,  false,  op_setmo },     // Undocumented.
+    { "SAR",    LOC_NULL,   LOC_NULL,   false,  false,  op_sar },
+};
+
+// Group 3 opcode table (opcodes 0xF6 and 0xF7).
+// Only TEST reads an immediate; the rest operate on the ModRM operand alone.
+static struct opcode grp3_table[] =
+{
+    // 0x00 to 0x07
+    { "TEST",   LOC_NULL,   LOC_NULL,   false,  false,  op_test },
+    { "TEST",   LOC_NULL,   LOC_NULL,   false,  false,  op_test },      // Undocumented.
+    { "NOT",    LOC_NULL,   LOC_NULL,   false,  false,  op_not },
+    { "NEG",    LOC_NULL,   LOC_NULL,   false,  false,  op_neg },
+    { "MUL",    LOC_NULL,   LOC_NULL,   false,  false,  op_mul },
+    { "IMUL",   LOC_NULL,   LOC_NULL,   false,  false,  op_imul },
+    { "DIV",    LOC_NULL,   LOC_NULL,   false,  false,  op_div },
+    { "IDIV",   LOC_NULL,   LOC_NULL,   false,  false,  op_idiv },
+};
+
+// Queue a micro-op for the current instruction.
+static inline void cpu8086_ucode_uop(struct cpu8086* cpu, uint8_t uop)
 {
-    if (loc->virtual)
-        return bus_read_byte(cpu->bus, loc->address);
+    assert(cpu->uop_w < UOP_QUEUE_SIZE);
+    cpu->uops[cpu->uop_w++] = uop;
+}
+
+// Outside of bus micro-op mode, only the precomputed total matters. Otherwise,
+// the micro-ops are queued and stepped through by cpu8086_ucode_step().
+static inline void cpu8086_ucode(struct cpu8086* cpu, const struct ucode* seq)
+{
+    if (!cpu->bus_uops)
+    {
+        cpu->cycles += seq->cycles;
+        return;
+    }
+
+    for (const uint8_t* uop = seq->uops; *uop != UOP_END; uop++)
+        cpu8086_ucode_uop(cpu, *uop);
+}
+
+// Queue cycles that depend on the data, such as the per-bit loops of shifts
+// and MUL/DIV or whether a branch is taken. They are folded into the last
+// idle micro-op queued if that has not started yet.
+static inline void cpu8086_ucode_idle(struct cpu8086* cpu, unsigned cycles)
+{
+    if (!cpu->bus_uops)
+    {
+        cpu->cycles += cycles;
+        return;
+    }
+
+    uint8_t last = cpu->uop_w - 1;
+    if (cpu->uop_w > cpu->uop_r && !(last == cpu->uop_r && cpu->uop_t)
+        && UOP_KIND(cpu->uops[last]) == UOP_IDLE)
+    {
+        unsigned room = UOP_MAX_IDLE - UOP_ARG(cpu->uops[last]);
+        unsigned n = (cycles < room) ? cycles : room;
+        cpu->uops[last] += n;
+        cycles -= n;
+    }
+    for (; cycles > UOP_MAX_IDLE; cycles -= UOP_MAX_IDLE)
+        cpu8086_ucode_uop(cpu, U_IDLE(UOP_MAX_IDLE));
+    if (cycles)
+        cpu8086_ucode_uop(cpu, U_IDLE(cycles));
+}
+
+// Queue a sequence whose internal loop runs for a data-dependent number of
+// cycles. These are spent in its last idle micro-op, i.e. between reading the
+// operand and writing back the result.
+static inline void cpu8086_ucode_loop(struct cpu8086* cpu, const struct ucode* seq, unsigned cycles)
+{
+    if (!cpu->bus_uops)
+    {
+        cpu->cycles += seq->cycles + cycles;
+        return;
+    }
+
+    const uint8_t* loop = NULL;
+    for (const uint8_t* uop = seq->uops; *uop != UOP_END; uop++)
+    {
+        if (UOP_KIND(*uop) == UOP_IDLE)
+            loop = uop;
+    }
+    for (const uint8_t* uop = seq->uops; *uop != UOP_END; uop++)
+    {
+        cpu8086_ucode_uop(cpu, *uop);
+        if (uop == loop)
+            cpu8086_ucode_idle(cpu, cycles);
+    }
+    if (!loop)
+        cpu8086_ucode_idle(cpu, cycles);
+}
+
+// Words at odd addresses take an extra bus cycle.
+static inline void cpu8086_ucode_bus(struct cpu8086* cpu, uint8_t uop)
+{
+    if (!cpu->bus_uops)
+        cpu->cycles += UOP_BUS_CYCLES;
     else
-        return *(uint8_t*)loc->address;
+        cpu8086_ucode_uop(cpu, uop);
+}
+
+// Is the BIU in the middle of a prefetch bus cycle?
+static inline bool cpu8086_biu_busy(struct cpu8086* cpu)
+{
+    return (cpu->mt || cpu->q_w != cpu->q_r) && cpu->biu_prefetch_cycles != 3;
+}
+
+// Spend this cycle on the current micro-op, if there is one. Bus micro-ops
+// can only start once the BIU has finished the prefetch it is working on;
+// the BIU then stays off the bus until the EU has finished with it.
+static inline bool cpu8086_ucode_step(struct cpu8086* cpu)
+{
+    if (cpu->uop_r == cpu->uop_w)
+        return false;
+
+    uint8_t uop = cpu->uops[cpu->uop_r];
+    if (cpu->uop_t == 0)
+    {
+        if (UOP_KIND(uop) == UOP_IDLE)
+            cpu->uop_t = UOP_ARG(uop);
+        else
+        {
+            cpu->eu_bus = true;
+            if (cpu8086_biu_busy(cpu))
+                return true;
+            cpu->uop_t = UOP_BUS_CYCLES;
+        }
+    }
+
+    if (--cpu->uop_t == 0)
+    {
+        if (++cpu->uop_r == cpu->uop_w)
+            cpu->uop_r = cpu->uop_w = 0;
+
+        // Hold onto the bus for back-to-back bus cycles.
+        cpu->eu_bus = cpu->uop_r != cpu->uop_w 
+                   && UOP_KIND(cpu->uops[cpu->uop_r]) != UOP_IDLE;
+    }
+    return true;
+}
+
+static inline uint8_t loc_read_byte(struct cpu8086* cpu, struct location* loc)
+{
+    switch (loc->type)
+    {
+        case DECODED_MEMORY:
+        case DECODED_STRING:
+            return bus_read_byte(cpu->bus, loc->address);
+        case DECODED_IMMEDIATE:
+            return (uint8_t)(cpu->immediate >> (loc->address * 8));
+        default:
+            return cpu->regs8[loc->address];
+    }
 }
 
 static inline uint16_t loc_read_word(struct cpu8086* cpu, struct location* loc)
 {
-    if (loc->virtual)
+    switch (loc->type)
     {
-        if (loc->address & 1)
-            cpu->cycles += 4;
-        return bus_read_short(cpu->bus, loc->address);
+        case DECODED_MEMORY:
+        case DECODED_STRING:
+        {
+            if (loc->address & 1)
+                cpu8086_ucode_bus(cpu, UOP_READ);
+            return bus_read_short(cpu->bus, loc->address);
+        }
+        case DECODED_IMMEDIATE:
+            return (uint16_t)(cpu->immediate >> (loc->address * 8));
+        default:
+            return cpu->regs[loc->address >> 1];
     }
-    else
-        return *(uint16_t*)loc->address;
 }
 
 static inline void loc_write_byte(struct cpu8086* cpu, struct location* loc, uint8_t data)
 {
-    if (loc->virtual)
-        bus_write_byte(cpu->bus, loc->address, data);
-    else
-        *(uint8_t*)loc->address = data;
+    switch (loc->type)
+    {
+        case DECODED_MEMORY:
+        case DECODED_STRING:
+            bus_write_byte(cpu->bus, loc->address, data);
+            break;
+        default:
+            assert(loc->type != DECODED_IMMEDIATE);
+            cpu->regs8[loc->address] = data;
+            break;
+    }
 }
 
 static inline void loc_write_word(struct cpu8086* cpu, struct location* loc, uint16_t data)
 {
-    if (loc->virtual)
+    switch (loc->type)
     {
-        if (loc->address & 1)
-            cpu->cycles += 4;
-        bus_write_short(cpu->bus, loc->address, data);
+        case DECODED_MEMORY:
+        case DECODED_STRING:
+        {
+            if (loc->address & 1)
+                cpu8086_ucode_bus(cpu, UOP_WRITE);
+            bus_write_short(cpu->bus, loc->address, data);
+            break;
+        }
+        default:
+            assert(loc->type != DECODED_IMMEDIATE);
+            cpu->regs[loc->address >> 1] = data;
+            break;
     }
-    else
-        *(uint16_t*)loc->address = data;
 }
 
 static inline uint16_t loc_read(struct cpu8086* cpu, struct location* loc)
@@ -461,33 +811,44 @@ static inline void loc_write(struct cpu8086* cpu, struct location* loc, uint16_t
         loc_write_byte(cpu, loc, data);
 }
 
+// A word at SP=FFFF has its high byte at the start of the stack segment,
+// not past its end.
 static inline void cpu8086_push(struct cpu8086* cpu, uint16_t word)
 {
     cpu->sp -= 2;
-    bus_write_short(cpu->bus, (cpu->ss << 4) + cpu->sp, word);
+    if (cpu->sp != 0xFFFF)
+        bus_write_short(cpu->bus, cpu->ss_base + cpu->sp, word);
+    else
+    {
+        bus_write_byte(cpu->bus, cpu->ss_base + 0xFFFF, (uint8_t)word);
+        bus_write_byte(cpu->bus, cpu->ss_base, (uint8_t)(word >> 8));
+    }
 }
 
 static inline uint16_t cpu8086_pop(struct cpu8086* cpu)
 {
-    uint16_t word = bus_read_short(cpu->bus, (cpu->ss << 4) + cpu->sp);;
+    uint16_t word = (cpu->sp != 0xFFFF)
+                  ? bus_read_short(cpu->bus, cpu->ss_base + cpu->sp)
+                  : bus_read_byte(cpu->bus, cpu->ss_base + 0xFFFF)
+                    | (bus_read_byte(cpu->bus, cpu->ss_base) << 8);
     cpu->sp += 2;
     return word;
 }
 
-static inline uint16_t* cpu8086_reg_word(struct cpu8086* cpu, unsigned reg)
+// Byte offset of a word register within the register file. This also
+// covers the segment registers, which follow the general purpose ones.
+static inline uint32_t cpu8086_reg_word(unsigned reg)
 {
-    // This works because the registers are organised in the cpu8086 struct
-    // in the same order as the reg section of the ModR/M byte.
-    assert(reg < (1 << REGISTER_COUNT)); // This function is used or seg-reg too.
-    return (uint16_t*)(&cpu->ax) + reg;
+    assert(reg < REGISTER_COUNT);
+    return reg * 2;
 }
 
-static inline uint8_t* cpu8086_reg_byte(struct cpu8086* cpu, unsigned reg)
+// Byte offset of a byte register (AL-BH, as encoded in ModR/M) within the
+// register file.
+static inline uint32_t cpu8086_reg_byte(unsigned reg)
 {
-    // This works because the registers are organised in the cpu8086 struct
-    // in the same order as the reg section of the ModR/M byte.
     assert(reg < (1 << REG_FIELD));
-    return (uint8_t*)(&cpu->ax) + (reg & 0b11) * 2 + (reg & 0b100);
+    return (reg & 0b11) * 2 + (reg >> 2);
 }
 
 static inline uint8_t cpu8086_prefetch_dequeue(struct cpu8086* cpu)
@@ -507,16 +868,27 @@ static inline void cpu8086_jump(struct cpu8086* cpu, uint16_t cs, uint16_t ip)
 {
     // Clear the prefetch queue.
     cpu->hl = false;
-    cpu->mt = false;
+    cpu->mt = true;
     cpu->q_r = cpu->q_w;
     if (cpu->biu_prefetch_cycles != 3)
         cpu->biu_prefetch_cycles += 4;
     
     // Set new CS:IP.
     cpu->cs = cs;
+    cpu->cs_base = cs << 4;
     cpu->ip = cpu->current_ip = ip;
 }
 
+// Select the segment for a memory operand: the segment override prefix if
+// there is one, else the default.
+static inline unsigned cpu8086_segment(struct cpu8086* cpu, unsigned segment)
+{
+    // This math should select between ES/CS/SS/DS.
+    if (cpu->prefix_g2 != PREFIX_G2_NONE)
+        return ES + (cpu->prefix_g2 - PREFIX_G2_ES) / 8;
+    return segment;
+}
+
 static inline void loc_set(struct cpu8086* cpu, 
                            struct location* loc, 
                            enum opcode_location type)
@@ -535,8 +907,7 @@ static inline void loc_set(struct cpu8086* cpu,
             loc->type = (type == LOC_AX)
                       ? DECODED_ACCUMULATOR
                       : DECODED_REGISTER;
-            loc->address = (uintptr_t)cpu8086_reg_word(cpu, (unsigned)type);
-            loc->virtual = false;
+            loc->address = cpu8086_reg_word((unsigned)type);
             break;
         }
         case LOC_ES:
@@ -545,8 +916,7 @@ static inline void loc_set(struct cpu8086* cpu,
         case LOC_DS:
         {
             loc->type = DECODED_SEGREG;
-            loc->address = (uintptr_t)cpu8086_reg_word(cpu, (unsigned)type);
-            loc->virtual = false;
+            loc->address = cpu8086_reg_word((unsigned)type);
             break;
         }
         case LOC_AL:
@@ -561,12 +931,27 @@ static inline void loc_set(struct cpu8086* cpu,
             loc->type = (type == LOC_AL || type == LOC_AH) 
                       ? DECODED_ACCUMULATOR
                       : DECODED_REGISTER;
-            loc->address = (uintptr_t)cpu8086_reg_byte(cpu, (unsigned)type - (unsigned)LOC_AL);
-            loc->virtual = false;
+            loc->address = cpu8086_reg_byte((unsigned)type - (unsigned)LOC_AL);
             break;
         }
+        case LOC_IMM3:
+        {
+            // Only TEST (/0 and /1) in group 3 reads an immediate.
+            if (cpu->modrm_byte.fields.reg >= 2)
+            {
+                loc->type = DECODED_NULL;
+                loc->address = 0;
+                break;
+            }
+        }
+            // Fall through.
         case LOC_IMM:
         case LOC_IMM8:
+        {
+            loc->type = DECODED_IMMEDIATE;
+            loc->address = 0;
+            break;
+        }
         case LOC_RM:
         {
             loc->type = (cpu->modrm_byte.fields.mod != MOD_REG)
@@ -575,7 +960,6 @@ static inline void loc_set(struct cpu8086* cpu,
                       ? DECODED_SEGREG
                       : DECODED_REGISTER;
             loc->address = cpu->rm;
-            loc->virtual = cpu->modrm_byte.fields.mod != MOD_REG;
             break;
         }
         case LOC_REG:
@@ -583,86 +967,552 @@ static inline void loc_set(struct cpu8086* cpu,
         {
             loc->type = DECODED_REGISTER;
             loc->address = cpu->reg;
-            loc->virtual = false;
             break;
         }
         case LOC_ADDR:
         {
             loc->type = DECODED_MEMORY;
-            loc->address = cpu->immediate;
-            loc->virtual = true;
+            loc->address = (cpu->segment_base[cpu8086_segment(cpu, DS) - ES] + cpu->immediate) & 0xFFFFF;
             break;
         }
         case LOC_SEGOFF:
         {
             loc->type = DECODED_IMMEDIATE;
-            loc->address = (uintptr_t)&cpu->immediate;
-            loc->virtual = false;
+            loc->address = 0;
             break;
         }
         case LOC_STRSRC:
         {
-            unsigned prefix = DS;
-            if (cpu->prefix_g2 != PREFIX_G2_NONE)
-                prefix = ES + (cpu->prefix_g2 - PREFIX_G2_ES) / 8;
             loc->type = DECODED_STRING;
-            loc->address = ((*cpu8086_reg_word(cpu, prefix) << 4) + cpu->si) & 0xFFFFF;
-            loc->virtual = true;
+            loc->address = (cpu->segment_base[cpu8086_segment(cpu, DS) - ES] + cpu->si) & 0xFFFFF;
+            break;
         }
         case LOC_STRDST:
         {
             loc->type = DECODED_STRING;
-            loc->address = (cpu->es << 4) + cpu->di;
-            loc->virtual = true;
+            loc->address = (cpu->es_base + cpu->di) & 0xFFFFF;
+            break;
         }
         case LOC_NULL:
         {
             loc->type = DECODED_NULL;
+            loc->address = 0;
             break;
         }
     }
 }
 
+// Flags are stored unpacked (see struct cpu8086). With a constant flag, this
+// compiles down to a plain byte access.
+static inline uint8_t* cpu8086_flag(struct cpu8086* cpu, unsigned flag)
+{
+    switch (flag)
+    {
+        case FLAG_CARRY:        return &cpu->cf;
+        case FLAG_PARITY:       return &cpu->pf;
+        case FLAG_AUXILIARY:    return &cpu->af;
+        case FLAG_ZERO:         return &cpu->zf;
+        case FLAG_SIGN:         return &cpu->sf;
+        case FLAG_OVERFLOW:     return &cpu->of;
+        case FLAG_TRAP:         return &cpu->tf;
+        case FLAG_INTENABLE:    return &cpu->ief;
+        case FLAG_DIRECTION:    return &cpu->df;
+    }
+    assert(false);
+    return NULL;
+}
+
 static inline bool cpu8086_getflag(struct cpu8086* cpu, unsigned flag)
 {
-    return !!(cpu->flags & flag);
+    return *cpu8086_flag(cpu, flag);
 }
 
 static inline void cpu8086_setflag(struct cpu8086* cpu, unsigned flag, bool toggle)
 {
-    if (toggle)
-        cpu->flags |= flag;
-    else
-        cpu->flags &= ~flag;
+    *cpu8086_flag(cpu, flag) = toggle;
 }
 
 static inline void cpu8086_setpzs_flags(struct cpu8086* cpu, uint16_t result, bool is_word)
 {
-    cpu8086_setflag(cpu, FLAG_PARITY, calculate_parity(result, is_word));
+    cpu8086_setflag(cpu, FLAG_PARITY, calculate_parity(result));
     cpu8086_setflag(cpu, FLAG_ZERO, (result & mask_buffer[is_word]) == 0);
     cpu8086_setflag(cpu, FLAG_SIGN, (result >> sign_bit[is_word]) & 1);
 }
 
+// Flags for dest + src (+ carry); result must not be masked beforehand.
+static inline void cpu8086_add_flags(struct cpu8086* cpu, unsigned dest, unsigned src, 
+                                     unsigned result, bool is_word)
+{
+    cpu8086_setpzs_flags(cpu, result, is_word);
+    cpu8086_setflag(cpu, FLAG_CARRY, result > mask_buffer[is_word]);
+    cpu8086_setflag(cpu, FLAG_AUXILIARY, (dest ^ src ^ result) & 0x10);
+    cpu8086_setflag(cpu, FLAG_OVERFLOW, 
+        (result ^ dest) & (result ^ src) & (1 << sign_bit[is_word]));
+}
+
+// Flags for dest - src (- borrow); result must not be masked beforehand.
+static inline void cpu8086_sub_flags(struct cpu8086* cpu, unsigned dest, unsigned src, 
+                                     unsigned result, bool is_word)
+{
+    cpu8086_setpzs_flags(cpu, result, is_word);
+    cpu8086_setflag(cpu, FLAG_CARRY, result > mask_buffer[is_word]);
+    cpu8086_setflag(cpu, FLAG_AUXILIARY, (dest ^ src ^ result) & 0x10);
+    cpu8086_setflag(cpu, FLAG_OVERFLOW, 
+        (dest ^ src) & (dest ^ result) & (1 << sign_bit[is_word]));
+}
+
+// How many elements of a repeated string instruction fit into what is left of
+// this chunk, given what each one costs. At least one always does.
+static inline unsigned cpu8086_rep_chunk(struct cpu8086* cpu, unsigned cycles)
+{
+    if (cpu->rep_quantum == 0)
+        return cpu->cx;
+    unsigned count = (cpu->cycles < cpu->rep_quantum) 
+                   ? (cpu->rep_quantum - cpu->cycles) / cycles 
+                   : 0;
+    if (count == 0)
+        count = 1;
+    return (count < cpu->cx) ? count : cpu->cx;
+}
+
+// Look up a byte ALU operation and set its flags. INC and DEC leave CF alone.
+static inline uint8_t cpu8086_alu_lookup(struct cpu8086* cpu, unsigned table, 
+                                         unsigned index, bool keep_carry)
+{
+    const struct alu_entry* entry = &alu_table[table + index];
+    memcpy(&cpu->flag[keep_carry], &entry->flags[keep_carry], 6 - keep_carry);
+    return entry->result;
+}
+
+static inline unsigned cpu8086_alu_decimal_index(struct cpu8086* cpu)
+{
+    return (cpu8086_getflag(cpu, FLAG_AUXILIARY) << 9) 
+         | (cpu8086_getflag(cpu, FLAG_CARRY) << 8) 
+         | cpu->al;
+}
+
+// Step SI and/or DI past the element a string instruction has just processed.
+static inline void cpu8086_string_advance(struct cpu8086* cpu, struct opcode* op)
+{
+    static const int delta_table[2][2] = { { 1, -1 }, { 2, -2 } };
+    int delta = delta_table[op->is_word][cpu8086_getflag(cpu, FLAG_DIRECTION)];
+    if (op->source == LOC_STRSRC || op->destination == LOC_STRSRC)
+        cpu->si += delta;
+    if (op->source == LOC_STRDST || op->destination == LOC_STRDST)
+        cpu->di += delta;
+}
+
+// How many whole elements a string operand can step through from this offset
+// before it wraps around its segment.
+static inline unsigned cpu8086_string_span(uint16_t offset, unsigned size, bool down)
+{
+    if (offset + size > 0x10000)
+        return 0;
+    return down ? offset / size + 1 : (0x10000 - offset) / size;
+}
+
+// Map the bytes a string operand is about to step through onto host memory,
+// from their lowest offset. NULL unless they are all plain RAM.
+static inline uint8_t* cpu8086_string_ram(struct cpu8086* cpu, uint32_t base, uint16_t offset,
+                                          size_t length, unsigned size, bool down)
+{
+    if (down)
+        offset -= length - size;
+    return bus_ram(cpu->bus, base + offset, length);
+}
+
+// Repeat the first (or when going down, the last) period bytes of a buffer
+// across the rest of it. The filled span doubles on each pass.
+static void cpu8086_string_replicate(uint8_t* buffer, size_t length, size_t period, bool down)
+{
+    for (size_t done = period; done < length; done *= 2)
+    {
+        size_t chunk = (length - done < done) ? length - done : done;
+        if (down)
+            memcpy(buffer + length - done - chunk, buffer + length - chunk, chunk);
+        else
+            memcpy(buffer + done, buffer, chunk);
+    }
+}
+
+// REP MOVS: copy as many elements as possible in one go, stopping short of
+// any segment wrap. Returns false if the elements have to be copied one by one
+// instead (not plain RAM, or an overlap narrower than an element).
+static bool cpu8086_rep_movs(struct cpu8086* cpu, struct opcode* op)
+{
+    unsigned size = op->is_word + 1;
+    bool down = cpu8086_getflag(cpu, FLAG_DIRECTION);
+
+    // Misaligned words take an extra bus cycle for every access.
+    unsigned cycles = ucode_rep_movs.cycles;
+    if (op->is_word)
+        cycles += UOP_BUS_CYCLES * ((cpu->si & 1) + (cpu->di & 1));
+
+    unsigned count = cpu8086_rep_chunk(cpu, cycles);
+    unsigned span = cpu8086_string_span(cpu->si, size, down);
+    if (span < count)
+        count = span;
+    span = cpu8086_string_span(cpu->di, size, down);
+    if (span < count)
+        count = span;
+    if (count == 0)
+        return false;
+
+    size_t length = (size_t)count * size;
+    uint8_t* src = cpu8086_string_ram(cpu, cpu->segment_base[cpu8086_segment(cpu, DS) - ES], 
+                                      cpu->si, length, size, down);
+    uint8_t* dst = cpu8086_string_ram(cpu, cpu->es_base, cpu->di, length, size, down);
+    if (!src || !dst)
+        return false;
+
+    // If the destination overlaps the part of the source that is still to be
+    // read, the elements already copied get copied again, repeating a
+    // pattern as wide as the gap between the two.
+    ptrdiff_t gap = down ? src - dst : dst - src;
+    if (gap > 0 && (size_t)gap < length)
+    {
+        if ((size_t)gap < size)
+            return false;
+        if (down)
+            memcpy(dst + length - gap, src + length - gap, gap);
+        else
+            memcpy(dst, src, gap);
+        cpu8086_string_replicate(dst, length, gap, down);
+    }
+    else
+        memmove(dst, src, length);
+    bus_written(cpu->bus, dst - cpu->bus->memory, length);
+    cpu->cycles += cycles * count;
+
+    int delta = down ? -(int)length : (int)length;
+    cpu->cx -= count;
+    cpu->si += delta;
+    cpu->di += delta;
+    return true;
+}
+
+// REP STOS: fill as many elements as possible in one go, stopping short of a
+// segment wrap. STOSW fills with the AL/AH byte pattern.
+static bool cpu8086_rep_stos(struct cpu8086* cpu, struct opcode* op)
+{
+    unsigned size = op->is_word + 1;
+    bool down = cpu8086_getflag(cpu, FLAG_DIRECTION);
+
+    unsigned cycles = ucode_rep_stos.cycles;
+    if (op->is_word)
+        cycles += UOP_BUS_CYCLES * (cpu->di & 1);
+
+    unsigned count = cpu8086_rep_chunk(cpu, cycles);
+    unsigned span = cpu8086_string_span(cpu->di, size, down);
+    if (span < count)
+        count = span;
+    if (count == 0)
+        return false;
+
+    size_t length = (size_t)count * size;
+    uint8_t* dst = cpu8086_string_ram(cpu, cpu->es_base, cpu->di, length, size, down);
+    if (!dst)
+        return false;
+
+    if (op->is_word)
+    {
+        dst[0] = cpu->al;
+        dst[1] = cpu->ah;
+        cpu8086_string_replicate(dst, length, 2, false);
+    }
+    else
+        memset(dst, cpu->al, length);
+    bus_written(cpu->bus, dst - cpu->bus->memory, length);
+    cpu->cycles += cycles * count;
+
+    cpu->cx -= count;
+    cpu->di += down ? -(int)length : (int)length;
+    return true;
+}
+
+static inline uint16_t cpu8086_string_element(const uint8_t* p, unsigned size)
+{
+    return (size == 2) ? (p[0] | (p[1] << 8)) : p[0];
+}
+
+// Find the element a REPZ (stop on a difference) or REPNZ (stop on a match)
+// scan ends on, counting in the order the elements are processed. b is the
+// second operand for CMPS; SCAS passes NULL and compares against value.
+// Returns count if no element ends the scan.
+static size_t cpu8086_string_search(const uint8_t* a, const uint8_t* b, uint16_t value,
+                                    size_t count, unsigned size, bool repz, bool down)
+{
+    size_t length = count * size;
+    size_t i = 0;
+
+#ifdef CPU8086_SSE2
+    // 16 bytes are compared at a time, from whichever end the scan starts at.
+    // Words compare equal as pairs of bits in the mask, so the element is
+    // half the bit index.
+    __m128i pattern = (size == 2) ? _mm_set1_epi16((short)value) : _mm_set1_epi8((char)value);
+    unsigned flip = repz ? 0xFFFF : 0;
+    for (; length - i * size >= 16; i += 16 / size)
+    {
+        size_t offset = down ? length - i * size - 16 : i * size;
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + offset));
+        __m128i y = b ? _mm_loadu_si128((const __m128i*)(b + offset)) : pattern;
+        __m128i equal = (size == 2) ? _mm_cmpeq_epi16(x, y) : _mm_cmpeq_epi8(x, y);
+        unsigned stop = (unsigned)_mm_movemask_epi8(equal) ^ flip;
+        if (stop)
+        {
+            // Going down, the last element in memory is processed first.
+            if (down)
+                return i + (15 - (63 - quick_clz64(stop))) / size;
+            return i + quick_ctz64(stop) / size;
+        }
+    }
+#else
+    // Runs of equal elements are skipped 8 bytes at a time.
+    if (repz)
+    {
+        uint64_t pattern = (size == 2)
+                         ? 0x0001000100010001ull * value
+                         : 0x0101010101010101ull * (value & 0xFF);
+        while (length - i * size >= 8)
+        {
+            size_t offset = down ? length - i * size - 8 : i * size;
+            uint64_t x, y = pattern;
+            memcpy(&x, a + offset, 8);
+            if (b)
+                memcpy(&y, b + offset, 8);
+            if (x != y)
+                break;
+            i += 8 / size;
+        }
+    }
+
+    // REPNZ SCASB going up is exactly memchr.
+    else if (!b && size == 1 && !down)
+    {
+        const uint8_t* found = memchr(a, value & 0xFF, count);
+        return found ? (size_t)(found - a) : count;
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        size_t offset = (down ? count - 1 - i : i) * size;
+        uint16_t x = cpu8086_string_element(a + offset, size);
+        uint16_t y = b ? cpu8086_string_element(b + offset, size) : value;
+        if ((x == y) != repz)
+            return i;
+    }
+    return count;
+}
+
+// REPZ/REPNZ CMPS and SCAS: find the element the instruction stops on (or the
+// last one before a segment wrap) in one go, then redo that comparison for
+// the flags.
+static bool cpu8086_rep_compare(struct cpu8086* cpu, struct opcode* op, bool scas)
+{
+    unsigned size = op->is_word + 1;
+    bool down = cpu8086_getflag(cpu, FLAG_DIRECTION);
+
+    unsigned cycles = scas ? ucode_scas.cycles : ucode_cmps.cycles;
+    if (op->is_word)
+        cycles += UOP_BUS_CYCLES * ((cpu->di & 1) + (!scas && (cpu->si & 1)));
+
+    unsigned count = cpu8086_rep_chunk(cpu, cycles);
+    unsigned span = cpu8086_string_span(cpu->di, size, down);
+    if (span < count)
+        count = span;
+    span = scas ? count : cpu8086_string_span(cpu->si, size, down);
+    if (span < count)
+        count = span;
+    if (count == 0)
+        return false;
+
+    size_t length = (size_t)count * size;
+    uint8_t* dst = cpu8086_string_ram(cpu, cpu->es_base, cpu->di, length, size, down);
+    uint8_t* src = scas ? NULL : cpu8086_string_ram(cpu, cpu->segment_base[cpu8086_segment(cpu, DS) - ES],
+                                                    cpu->si, length, size, down);
+    if (!dst || (!scas && !src))
+        return false;
+
+    uint16_t value = cpu->ax & mask_buffer[op->is_word];
+    size_t n = scas
+             ? cpu8086_string_search(dst, NULL, value, count, size, cpu->prefix_g1 == PREFIX_G1_REPZ, down)
+             : cpu8086_string_search(src, dst, value, count, size, cpu->prefix_g1 == PREFIX_G1_REPZ, down);
+    if (n < count)
+        n++;
+
+    // SCAS compares the accumulator with ES:DI, CMPS compares DS:SI with ES:DI.
+    size_t last = (down ? count - n : n - 1) * size;
+    uint16_t dest = scas ? value : cpu8086_string_element(src + last, size);
+    uint16_t other = cpu8086_string_element(dst + last, size);
+    cpu8086_sub_flags(cpu, dest, other, dest - other, op->is_word);
+    cpu->cycles += cycles * n;
+
+    int delta = down ? -(int)(n * size) : (int)(n * size);
+    cpu->cx -= n;
+    cpu->di += delta;
+    if (!scas)
+        cpu->si += delta;
+    return true;
+}
+
+// Run a repeated string instruction in bulk where there is a fast path for
+// it. Returns false if the next element has to be run the normal way.
+static inline bool cpu8086_rep_bulk(struct cpu8086* cpu, struct opcode* op)
+{
+    switch (cpu->opcode_byte & 0xFE)
+    {
+        case 0xA4:
+            return cpu8086_rep_movs(cpu, op);
+        case 0xA6:
+            return cpu8086_rep_compare(cpu, op, false);
+        case 0xAA:
+            return cpu8086_rep_stos(cpu, op);
+        case 0xAE:
+            return cpu8086_rep_compare(cpu, op, true);
+        default:
+            return false;
+    }
+}
+
+// Push FLAGS, CS and IP, then vector through the interrupt vector table.
+static inline void cpu8086_interrupt(struct cpu8086* cpu, uint8_t vector)
+{
+    cpu8086_push(cpu, cpu8086_get_flags(cpu));
+    cpu8086_setflag(cpu, FLAG_INTENABLE, false);
+    cpu8086_setflag(cpu, FLAG_TRAP, false);
+    cpu8086_push(cpu, cpu->cs);
+    cpu8086_push(cpu, cpu->current_ip);
+
+    uint16_t ip = bus_read_short(cpu->bus, vector * 4);
+    uint16_t cs = bus_read_short(cpu->bus, vector * 4 + 2);
+    cpu8086_jump(cpu, cs, ip);
+}
+
+// Take a maskable interrupt, acknowledging the request.
+static inline void cpu8086_intr_acknowledge(struct cpu8086* cpu)
+{
+    cpu->intr = false;
+    cpu8086_interrupt(cpu, bus_acknowledge(cpu->bus));
+    cpu8086_ucode(cpu, &ucode_interrupt);
+}
+
 static inline void cpu8086_reset_execution_regs(struct cpu8086* cpu)
 {
     cpu->repeat = false;
     cpu->prefix_g1 = PREFIX_G1_NONE;
     cpu->prefix_g2 = PREFIX_G1_NONE;
-    cpu->opcode_byte = OPCODE_NONE;
-    cpu->disp8_byte = DISP8_NONE;
-    cpu->disp16_byte = DISP16_NONE;
-    cpu->imm8_byte = IMM8_NONE;
-    cpu->imm16_byte = IMM16_NONE;
-    cpu->lo_segment = LO_SEGMENT_NONE;
-    cpu->hi_segment = HI_SEGMENT_NONE;
+    cpu->fetched = 0;
     cpu->stage = CPU8086_READY;
-    cpu->modrm_byte.value = MODRM_NONE;
+}
+
+// Shifts and rotates by CL are not looped CL times. Every count is resolved
+// in a single step below, so the host cost is the same for a count of 1 or 255.
+// The 8086 does not mask the count, so cycles still grow by 4 per bit.
+static inline unsigned cpu8086_shift_count(struct cpu8086* cpu)
+{
+    if (cpu->source.type == DECODED_NULL)
+        return 1;
+    return loc_read_byte(cpu, &cpu->source);
+}
+
+static inline void cpu8086_shift_cycles(struct cpu8086* cpu, unsigned count)
+{
+    switch ((cpu->destination.type << 3) | cpu->source.type)
+    {
+        case (DECODED_REGISTER << 3) | DECODED_NULL:
+        {
+            cpu8086_ucode(cpu, &ucode_shift_reg);
+            break;
+        }
+        case (DECODED_MEMORY << 3) | DECODED_NULL:
+        {
+            cpu8086_ucode(cpu, &ucode_shift_mem);
+            break;
+        }
+        case (DECODED_REGISTER << 3) | DECODED_REGISTER:
+        {
+            cpu8086_ucode_loop(cpu, &ucode_shift_reg_cl, UCODE_SHIFT_BIT_CYCLES * count);
+            break;
+        }
+        case (DECODED_MEMORY << 3) | DECODED_REGISTER:
+        {
+            cpu8086_ucode_loop(cpu, &ucode_shift_mem_cl, UCODE_SHIFT_BIT_CYCLES * count);
+            break;
+        }
+        default:
+            assert(false);
+    }
+}
+
+// The 8086 computes OF from the final result regardless of the count.
+// Left shifts/rotates: OF = MSB(result) ^ CF.
+// Right shifts/rotates: OF = MSB(result) ^ (MSB - 1)(result).
+static inline void cpu8086_shift_left_flags(struct cpu8086* cpu, 
+                                            uint16_t result, 
+                                            bool carry, 
+                                            bool is_word)
+{
+    cpu8086_setflag(cpu, FLAG_CARRY, carry);
+    cpu8086_setflag(cpu, FLAG_OVERFLOW, ((result >> sign_bit[is_word]) & 1) ^ carry);
+}
+
+static inline void cpu8086_shift_right_flags(struct cpu8086* cpu, 
+                                             uint16_t result, 
+                                             bool carry, 
+                                             bool is_word)
+{
+    cpu8086_setflag(cpu, FLAG_CARRY, carry);
+    cpu8086_setflag(cpu, FLAG_OVERFLOW, 
+        ((result >> sign_bit[is_word]) ^ (result >> (sign_bit[is_word] - 1))) & 1);
+}
+
+// Base cycle counts for register operands (memory operands take 6 more, plus EA).
+// The microcode multiply loop (CORX) takes one more cycle for every set bit
+// of the multiplier bar the last, which is folded into the write-back, and the
+// divide loop (CORD) takes one more cycle for every set quotient bit, plus two
+// if there is a remainder to correct. IMUL/IDIV go through the same loops on
+// the operands' magnitudes, but pay for the extra negations on either side.
+static const unsigned mul_cycles[2]     = { 70, 118 };
+static const unsigned div_cycles[2]     = { 80, 144 };
+#define IMUL_EXTRA_CYCLES       10
+#define IMUL_NEG_OPERAND_CYCLES 4
+#define IMUL_NEG_RESULT_CYCLES  7
+#define IDIV_EXTRA_CYCLES       21
+#define IDIV_NEG_RESULT_CYCLES  2
+#define DIV_REMAINDER_CYCLES    2
+
+static inline void cpu8086_muldiv_cycles(struct cpu8086* cpu, unsigned cycles)
+{
+    switch (cpu->destination.type)
+    {
+        case DECODED_REGISTER:
+        {
+            cpu8086_ucode_idle(cpu, cycles);
+            break;
+        }
+        case DECODED_MEMORY:
+        {
+            cpu8086_ucode_loop(cpu, &ucode_muldiv_mem, cycles);
+            break;
+        }
+        default:
+            assert(false);
+    }
 }
 
 // AAA: ascii adjust for addition
 // https://c9x.me/x86/html/file_module_x86_id_1.html
 static void op_aaa(struct opcode* op, struct cpu8086* cpu)
 {
+    if (cpu->alu_tables)
+    {
+        cpu->al = cpu8086_alu_lookup(cpu, ALU_AAA, cpu8086_alu_decimal_index(cpu), false);
+        cpu->ah += cpu8086_getflag(cpu, FLAG_CARRY);
+        cpu8086_ucode(cpu, &ucode_decimal);
+        return;
+    }
+
     uint16_t old_al = cpu->al;
     uint16_t added = 0;
     if ((cpu->al & 0xF) > 9 || cpu8086_getflag(cpu, FLAG_AUXILIARY))
@@ -682,13 +1532,21 @@ static void op_aaa(struct opcode* op, struct cpu8086* cpu)
     cpu8086_setpzs_flags(cpu, cpu->al, false); // U
     cpu8086_setflag(cpu, FLAG_OVERFLOW, (cpu->al ^ old_al) & (cpu->al ^ added) & 0x80); // U
 
-    cpu->cycles += 4;
+    cpu8086_ucode(cpu, &ucode_decimal);
 }
 
 // AAA: ascii adjust for subtraction
 // https://c9x.me/x86/html/file_module_x86_id_1.html
 static void op_aas(struct opcode* op, struct cpu8086* cpu)
 {
+    if (cpu->alu_tables)
+    {
+        cpu->al = cpu8086_alu_lookup(cpu, ALU_AAS, cpu8086_alu_decimal_index(cpu), false);
+        cpu->ah -= cpu8086_getflag(cpu, FLAG_CARRY);
+        cpu8086_ucode(cpu, &ucode_decimal);
+        return;
+    }
+
     uint16_t old_al = cpu->al;
     uint16_t added = 0;
     if ((cpu->al & 0xF) > 9 || cpu8086_getflag(cpu, FLAG_AUXILIARY))
@@ -708,22 +1566,24 @@ static void op_aas(struct opcode* op, struct cpu8086* cpu)
     cpu8086_setpzs_flags(cpu, cpu->al, false); // U
     cpu8086_setflag(cpu, FLAG_OVERFLOW, (cpu->al ^ old_al) & (cpu->al ^ added) & 0x80); // U
 
-    cpu->cycles += 4;
+    cpu8086_ucode(cpu, &ucode_decimal);
 }
 
 // ADC: add two operands + the carry flag
 static void op_adc(struct opcode* op, struct cpu8086* cpu)
 {
     uint16_t dest = loc_read(cpu, &cpu->destination);
-    uint16_t src = loc_read(cpu, &cpu->source) + cpu8086_getflag(cpu, FLAG_CARRY);
-    unsigned result = dest + src;
-
-    loc_write(cpu, &cpu->destination, result);
-    cpu8086_setpzs_flags(cpu, result, op->is_word);
-    cpu8086_setflag(cpu, FLAG_CARRY, result > mask_buffer[op->is_word]);
-    cpu8086_setflag(cpu, FLAG_AUXILIARY, (dest & 0xF) + (src & 0xF) > 0xF);
-    cpu8086_setflag(cpu, FLAG_OVERFLOW, 
-        (result ^ dest) & (result ^ src) & (1 << sign_bit[op->is_word]));
+    uint16_t src = loc_read(cpu, &cpu->source);
+    bool carry = cpu8086_getflag(cpu, FLAG_CARRY);
+    if (cpu->alu_tables && !op->is_word)
+        loc_write(cpu, &cpu->destination, 
+            cpu8086_alu_lookup(cpu, ALU_ADC, (carry << 16) | (dest << 8) | src, false));
+    else
+    {
+        unsigned result = dest + src + carry;
+        loc_write(cpu, &cpu->destination, result);
+        cpu8086_add_flags(cpu, dest, src, result, op->is_word);
+    }
     
     // This looks ridiculous, but switch tables are faster than constantly doing
     // if-else if-else if-else if, etc.
@@ -731,28 +1591,28 @@ static void op_adc(struct opcode* op, struct cpu8086* cpu)
     {
         case (DECODED_REGISTER << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 3;
+            cpu8086_ucode(cpu, &ucode_alu_reg_reg);
             break;
         }
         case (DECODED_REGISTER << 3) | DECODED_MEMORY:
         {
-            cpu->cycles += 9;
+            cpu8086_ucode(cpu, &ucode_alu_reg_mem);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 16;
+            cpu8086_ucode(cpu, &ucode_alu_mem_reg);
             break;
         }
         case (DECODED_ACCUMULATOR << 3) | DECODED_IMMEDIATE:
         case (DECODED_REGISTER << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 4;
+            cpu8086_ucode(cpu, &ucode_alu_reg_imm);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 17;
+            cpu8086_ucode(cpu, &ucode_alu_mem_imm);
             break;
         }
         default:
@@ -765,41 +1625,42 @@ static void op_add(struct opcode* op, struct cpu8086* cpu)
 {
     uint16_t dest = loc_read(cpu, &cpu->destination);
     uint16_t src = loc_read(cpu, &cpu->source);
-    unsigned result = dest + src;
-    loc_write(cpu, &cpu->destination, result);
-    
-    cpu8086_setpzs_flags(cpu, result, op->is_word);
-    cpu8086_setflag(cpu, FLAG_CARRY, result > mask_buffer[op->is_word]);
-    cpu8086_setflag(cpu, FLAG_AUXILIARY, (dest & 0xF) + (src & 0xF) > 0xF);
-    cpu8086_setflag(cpu, FLAG_OVERFLOW, 
-        (result ^ dest) & (result ^ src) & (1 << sign_bit[op->is_word]));
+    if (cpu->alu_tables && !op->is_word)
+        loc_write(cpu, &cpu->destination, 
+            cpu8086_alu_lookup(cpu, ALU_ADC, (dest << 8) | src, false));
+    else
+    {
+        unsigned result = dest + src;
+        loc_write(cpu, &cpu->destination, result);
+        cpu8086_add_flags(cpu, dest, src, result, op->is_word);
+    }
     
     switch ((cpu->destination.type << 3) | cpu->source.type)
     {
         case (DECODED_REGISTER << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 3;
+            cpu8086_ucode(cpu, &ucode_alu_reg_reg);
             break;
         }
         case (DECODED_REGISTER << 3) | DECODED_MEMORY:
         {
-            cpu->cycles += 9;
+            cpu8086_ucode(cpu, &ucode_alu_reg_mem);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 16;
+            cpu8086_ucode(cpu, &ucode_alu_mem_reg);
             break;
         }
         case (DECODED_ACCUMULATOR << 3) | DECODED_IMMEDIATE:
         case (DECODED_REGISTER << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 4;
+            cpu8086_ucode(cpu, &ucode_alu_reg_imm);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 17;
+            cpu8086_ucode(cpu, &ucode_alu_mem_imm);
             break;
         }
         default:
@@ -812,40 +1673,46 @@ static void op_and(struct opcode* op, struct cpu8086* cpu)
 {
     uint16_t dest = loc_read(cpu, &cpu->destination);
     uint16_t src = loc_read(cpu, &cpu->source);
-    uint16_t result = dest & src;
-    loc_write(cpu, &cpu->destination, result);
+    if (cpu->alu_tables && !op->is_word)
+        loc_write(cpu, &cpu->destination, 
+            cpu8086_alu_lookup(cpu, ALU_AND, (dest << 8) | src, false));
+    else
+    {
+        uint16_t result = dest & src;
+        loc_write(cpu, &cpu->destination, result);
 
-    cpu8086_setpzs_flags(cpu, result, op->is_word);
-    cpu8086_setflag(cpu, FLAG_CARRY, false);
-    cpu8086_setflag(cpu, FLAG_AUXILIARY, false); // U
-    cpu8086_setflag(cpu, FLAG_OVERFLOW, false);
+        cpu8086_setpzs_flags(cpu, result, op->is_word);
+        cpu8086_setflag(cpu, FLAG_CARRY, false);
+        cpu8086_setflag(cpu, FLAG_AUXILIARY, false); // U
+        cpu8086_setflag(cpu, FLAG_OVERFLOW, false);
+    }
 
     switch ((cpu->destination.type << 3) | cpu->source.type)
     {
         case (DECODED_REGISTER << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 3;
+            cpu8086_ucode(cpu, &ucode_alu_reg_reg);
             break;
         }
         case (DECODED_REGISTER << 3) | DECODED_MEMORY:
         {
-            cpu->cycles += 9;
+            cpu8086_ucode(cpu, &ucode_alu_reg_mem);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 16;
+            cpu8086_ucode(cpu, &ucode_alu_mem_reg);
             break;
         }
         case (DECODED_ACCUMULATOR << 3) | DECODED_IMMEDIATE:
         case (DECODED_REGISTER << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 4;
+            cpu8086_ucode(cpu, &ucode_alu_reg_imm);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 17;
+            cpu8086_ucode(cpu, &ucode_alu_mem_imm);
             break;
         }
         default:
@@ -869,7 +1736,7 @@ static void op_callfar(struct opcode* op, struct cpu8086* cpu)
     {
         case DECODED_IMMEDIATE:
         {
-            cpu->cycles += 28;
+            cpu8086_ucode(cpu, &ucode_callfar);
             break;
         }
         default:
@@ -881,63 +1748,81 @@ static void op_callfar(struct opcode* op, struct cpu8086* cpu)
 static void op_cbw(struct opcode* op, struct cpu8086* cpu)
 {
     cpu->ah = 0xFF * ((cpu->al >> 7) & 1);
-    cpu->cycles += 2;
+    cpu8086_ucode(cpu, &ucode_cbw);
+}
+
+// CLC: clear the carry flag
+static void op_clc(struct opcode* op, struct cpu8086* cpu)
+{
+    cpu8086_setflag(cpu, FLAG_CARRY, false);
+    cpu8086_ucode(cpu, &ucode_flag);
+}
+
+// CLD: clear the direction flag, so string instructions count up
+static void op_cld(struct opcode* op, struct cpu8086* cpu)
+{
+    cpu8086_setflag(cpu, FLAG_DIRECTION, false);
+    cpu8086_ucode(cpu, &ucode_flag);
+}
+
+// CLI: clear the interrupt enable flag
+static void op_cli(struct opcode* op, struct cpu8086* cpu)
+{
+    cpu8086_setflag(cpu, FLAG_INTENABLE, false);
+    cpu8086_ucode(cpu, &ucode_flag);
 }
 
 // CMP: subtract src from dest without storing, but still set flags
 static void op_cmp(struct opcode* op, struct cpu8086* cpu)
 {
-    // It's easier to just use two's complement here.
     uint16_t dest = loc_read(cpu, &cpu->destination);
-    uint16_t src = ~loc_read(cpu, &cpu->source) + 1;
-    unsigned result = dest + src;
-    
-    cpu8086_setpzs_flags(cpu, result, op->is_word);
-    cpu8086_setflag(cpu, FLAG_CARRY, result > mask_buffer[op->is_word]);
-    cpu8086_setflag(cpu, FLAG_AUXILIARY, (dest & 0xF) < ((~src + 1) & 0xF));
-    cpu8086_setflag(cpu, FLAG_OVERFLOW, 
-        (result ^ dest) & (result ^ src) & (1 << sign_bit[op->is_word]));
+    uint16_t src = loc_read(cpu, &cpu->source);
+    if (cpu->alu_tables && !op->is_word)
+        cpu8086_alu_lookup(cpu, ALU_SBB, (dest << 8) | src, false);
+    else
+        cpu8086_sub_flags(cpu, dest, src, dest - src, op->is_word);
     
     switch ((cpu->destination.type << 3) | cpu->source.type)
     {
         case (DECODED_REGISTER << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 3;
+            cpu8086_ucode(cpu, &ucode_alu_reg_reg);
             break;
         }
         case (DECODED_REGISTER << 3) | DECODED_MEMORY:
         {
-            cpu->cycles += 9;
+            cpu8086_ucode(cpu, &ucode_alu_reg_mem);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 9;
+            cpu8086_ucode(cpu, &ucode_alu_reg_mem);
             break;
         }
         case (DECODED_ACCUMULATOR << 3) | DECODED_IMMEDIATE:
         case (DECODED_REGISTER << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 4;
+            cpu8086_ucode(cpu, &ucode_alu_reg_imm);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 10;
+            cpu8086_ucode(cpu, &ucode_cmp_mem_imm);
             break;
         }
 
         // CMPS
         case (DECODED_STRING << 3) | DECODED_STRING:
         {
-            cpu->cycles += 22;
+            cpu8086_ucode(cpu, &ucode_cmps);
             break;
         }
 
         // SCAS
         case (DECODED_ACCUMULATOR << 3) | DECODED_STRING:
         {
-            cpu->cycles += 15;
+            cpu8086_ucode(cpu, &ucode_scas);
+            break;
         }
 
         default:
@@ -949,13 +1834,20 @@ static void op_cmp(struct opcode* op, struct cpu8086* cpu)
 static void op_cwd(struct opcode* op, struct cpu8086* cpu)
 {
     cpu->dx = 0xFFFF * ((cpu->ax >> 15) & 1);
-    cpu->cycles += 5;
+    cpu8086_ucode(cpu, &ucode_cwd);
 }
 
 // DAA: "decimal adjust for addition"
 // https://www.righto.com/2023/01/understanding-x86s-decimal-adjust-after.html
 static void op_daa(struct opcode* op, struct cpu8086* cpu)
 {
+    if (cpu->alu_tables)
+    {
+        cpu->al = cpu8086_alu_lookup(cpu, ALU_DAA, cpu8086_alu_decimal_index(cpu), false);
+        cpu8086_ucode(cpu, &ucode_decimal);
+        return;
+    }
+
     uint8_t old_al = cpu->al;
     uint8_t added = 0;
     bool old_af = cpu8086_getflag(cpu, FLAG_AUXILIARY);
@@ -984,13 +1876,20 @@ static void op_daa(struct opcode* op, struct cpu8086* cpu)
     cpu8086_setpzs_flags(cpu, cpu->al, false);
     cpu8086_setflag(cpu, FLAG_OVERFLOW, (cpu->al ^ old_al) & (cpu->al ^ added) & 0x80); // U
 
-    cpu->cycles += 4;
+    cpu8086_ucode(cpu, &ucode_decimal);
 }
 
 // DAS: "decimal adjust for subtraction"
 // https://c9x.me/x86/html/file_module_x86_id_70.html
 static void op_das(struct opcode* op, struct cpu8086* cpu)
 {
+    if (cpu->alu_tables)
+    {
+        cpu->al = cpu8086_alu_lookup(cpu, ALU_DAS, cpu8086_alu_decimal_index(cpu), false);
+        cpu8086_ucode(cpu, &ucode_decimal);
+        return;
+    }
+
     uint8_t old_al = cpu->al;
     uint8_t added = 0;
     bool old_af = cpu8086_getflag(cpu, FLAG_AUXILIARY);
@@ -1017,76 +1916,68 @@ static void op_das(struct opcode* op, struct cpu8086* cpu)
     cpu8086_setpzs_flags(cpu, cpu->al, false);
     cpu8086_setflag(cpu, FLAG_OVERFLOW, (cpu->al ^ old_al) & (cpu->al ^ added) & 0x80); // U
 
-    cpu->cycles += 4;
+    cpu8086_ucode(cpu, &ucode_decimal);
 }
 
-// DEC: decrement by 1
-static void op_dec(struct opcode* op, struct cpu8086* cpu)
+// DIV: unsigned divide AX by r/m8 or DX:AX by r/m16
+static void op_div(struct opcode* op, struct cpu8086* cpu)
 {
-    uint16_t dest = loc_read(cpu, &cpu->destination);
-    unsigned result = dest - 1;
-    loc_write(cpu, &cpu->destination, result);
-    
-    cpu8086_setpzs_flags(cpu, result, op->is_word);
-    cpu8086_setflag(cpu, FLAG_AUXILIARY, (dest & 0xF) < 1);
-    cpu8086_setflag(cpu, FLAG_OVERFLOW, 
-        (result ^ dest) & (result ^ 0xFFFF) & (1 << sign_bit[op->is_word]));
+    uint32_t dividend = op->is_word ? ((uint32_t)cpu->dx << 16) | cpu->ax : cpu->ax;
+    uint16_t divisor = loc_read(cpu, &cpu->destination);
+    if (divisor == 0 || dividend / divisor > mask_buffer[op->is_word])
+    {
+        cpu8086_interrupt(cpu, 0);
+        cpu8086_ucode(cpu, &ucode_interrupt);
+        return;
+    }
 
-    switch (cpu->destination.type)
+    uint16_t quotient = dividend / divisor;
+    uint16_t remainder = dividend % divisor;
+    if (op->is_word)
     {
-        case DECODED_ACCUMULATOR:
-        case DECODED_REGISTER:
-        {
-            cpu->cycles += (op->is_word ? 2 : 3);
-            break;
-        }
-        case DECODED_MEMORY:
-        {
-            cpu->cycles += 15;
-            break;
-        }
-        default:
-            assert(false);
+        cpu->ax = quotient;
+        cpu->dx = remainder;
+    }
+    else
+    {
+        cpu->al = quotient;
+        cpu->ah = remainder;
     }
-}
 
-// Group IMM:
-// - ADD
-// - OR
-// - ADC
-// - SBB
-// - AND
-// - SUB
-// - XOR
-// - CMP
-static void op_imm(struct opcode* op, struct cpu8086* cpu)
-{
-    imm_table[cpu->modrm_byte.fields.reg].func(op, cpu);
+    cpu8086_muldiv_cycles(cpu, div_cycles[op->is_word] 
+        + calculate_popcount(quotient)
+        + (remainder ? DIV_REMAINDER_CYCLES : 0));
 }
 
-// INC: increment by 1
-static void op_inc(struct opcode* op, struct cpu8086* cpu)
+// DEC: decrement by 1
+static void op_dec(struct opcode* op, struct cpu8086* cpu)
 {
     uint16_t dest = loc_read(cpu, &cpu->destination);
-    unsigned result = dest + 1;
-    loc_write(cpu, &cpu->destination, result);
-    
-    cpu8086_setpzs_flags(cpu, result, op->is_word);
-    cpu8086_setflag(cpu, FLAG_AUXILIARY, (dest & 0xF) + 1 > 0xF);
-    cpu8086_setflag(cpu, FLAG_OVERFLOW, 
-        (result ^ dest) & (result ^ 1) & (1 << sign_bit[op->is_word]));
+    if (cpu->alu_tables && !op->is_word)
+        loc_write(cpu, &cpu->destination, 
+            cpu8086_alu_lookup(cpu, ALU_SBB, (dest << 8) | 1, true));
+    else
+    {
+        unsigned result = dest - 1;
+        loc_write(cpu, &cpu->destination, result);
+        
+        cpu8086_setpzs_flags(cpu, result, op->is_word);
+        cpu8086_setflag(cpu, FLAG_AUXILIARY, (dest & 0xF) < 1);
+        cpu8086_setflag(cpu, FLAG_OVERFLOW, 
+            (result ^ dest) & (result ^ 0xFFFF) & (1 << sign_bit[op->is_word]));
+    }
 
     switch (cpu->destination.type)
     {
         case DECODED_ACCUMULATOR:
         case DECODED_REGISTER:
         {
-            cpu->cycles += (op->is_word ? 2 : 3);
+            cpu8086_ucode(cpu, op->is_word ? &ucode_incdec_reg16 : &ucode_incdec_reg8);
             break;
         }
         case DECODED_MEMORY:
         {
-            cpu->cycles += 15;
+            cpu8086_ucode(cpu, &ucode_incdec_mem);
             break;
         }
         default:
@@ -1094,251 +1985,233 @@ static void op_inc(struct opcode* op, struct cpu8086* cpu)
     }
 }
 
-// JA: jump if above
-static void op_ja(struct opcode* op, struct cpu8086* cpu)
+// Group 3:
+// - TEST
+// - TEST (undocumented)
+// - NOT
+// - NEG
+// - MUL
+// - IMUL
+// - DIV
+// - IDIV
+static void op_grp3(struct opcode* op, struct cpu8086* cpu)
 {
-    int8_t offset = loc_read(cpu, &cpu->source);
-    if (!cpu8086_getflag(cpu, FLAG_CARRY) && !cpu8086_getflag(cpu, FLAG_ZERO))
-    {
-        cpu8086_jump(cpu, cpu->cs, cpu->current_ip + offset);
-        cpu->cycles += 12;
-    }
-
-    cpu->cycles += 4;
+    grp3_table[cpu->modrm_byte.fields.reg].func(op, cpu);
 }
 
-// JAE: jump if above or equal
-static void op_jae(struct opcode* op, struct cpu8086* cpu)
+// IDIV: signed divide AX by r/m8 or DX:AX by r/m16
+static void op_idiv(struct opcode* op, struct cpu8086* cpu)
 {
-    int8_t offset = loc_read(cpu, &cpu->source);
-    if (!cpu8086_getflag(cpu, FLAG_CARRY))
-    {
-        cpu8086_jump(cpu, cpu->cs, cpu->current_ip + offset);
-        cpu->cycles += 12;
-    }
-
-    cpu->cycles += 4;
-}
+    int32_t dividend = op->is_word ? (int32_t)(((uint32_t)cpu->dx << 16) | cpu->ax) : (int16_t)cpu->ax;
+    uint16_t operand = loc_read(cpu, &cpu->destination);
+    int32_t divisor = op->is_word ? (int16_t)operand : (int8_t)operand;
 
-// JB: jump if below
-static void op_jb(struct opcode* op, struct cpu8086* cpu)
-{
-    int8_t offset = loc_read(cpu, &cpu->source);
-    if (cpu8086_getflag(cpu, FLAG_CARRY))
+    // Unlike later processors, the 8086 can't produce the most negative quotient
+    // (-128 or -32768); those raise a divide error too.
+    int32_t limit = mask_buffer[op->is_word] >> 1;
+    if (divisor == 0 
+        || (dividend == INT32_MIN && divisor == -1)
+        || dividend / divisor > limit 
+        || dividend / divisor < -limit)
     {
-        cpu8086_jump(cpu, cpu->cs, cpu->current_ip + offset);
-        cpu->cycles += 12;
-    }
-
-    cpu->cycles += 4;
-}
-
-// JBE: jump if below or equal to
-static void op_jbe(struct opcode* op, struct cpu8086* cpu)
-{
-    int8_t offset = loc_read(cpu, &cpu->source);
-    if (cpu8086_getflag(cpu, FLAG_CARRY) || cpu8086_getflag(cpu, FLAG_ZERO))
-    {
-        cpu8086_jump(cpu, cpu->cs, cpu->current_ip + offset);
-        cpu->cycles += 12;
+        cpu8086_interrupt(cpu, 0);
+        cpu8086_ucode(cpu, &ucode_interrupt);
+        return;
     }
 
-    cpu->cycles += 4;
-}
-
-// JE: jump if equal
-static void op_je(struct opcode* op, struct cpu8086* cpu)
-{
-    int8_t offset = loc_read(cpu, &cpu->source);
-    if (cpu8086_getflag(cpu, FLAG_ZERO))
+    int32_t quotient = dividend / divisor;
+    int32_t remainder = dividend % divisor;
+    if (op->is_word)
     {
-        cpu8086_jump(cpu, cpu->cs, cpu->current_ip + offset);
-        cpu->cycles += 12;
+        cpu->ax = quotient;
+        cpu->dx = remainder;
     }
-
-    cpu->cycles += 4;
-}
-
-// JG: jump if greater
-static void op_jg(struct opcode* op, struct cpu8086* cpu)
-{
-    int8_t offset = loc_read(cpu, &cpu->source);
-    if (cpu8086_getflag(cpu, FLAG_SIGN) == cpu8086_getflag(cpu, FLAG_OVERFLOW)
-        && !cpu8086_getflag(cpu, FLAG_ZERO))
+    else
     {
-        cpu8086_jump(cpu, cpu->cs, cpu->current_ip + offset);
-        cpu->cycles += 12;
+        cpu->al = quotient;
+        cpu->ah = remainder;
     }
 
-    cpu->cycles += 4;
+    cpu8086_muldiv_cycles(cpu, div_cycles[op->is_word] + IDIV_EXTRA_CYCLES
+        + calculate_popcount(quotient < 0 ? -quotient : quotient)
+        + (remainder ? DIV_REMAINDER_CYCLES : 0)
+        + (quotient < 0 ? IDIV_NEG_RESULT_CYCLES : 0));
 }
 
-// JGE: jump if greater or equal
-static void op_jge(struct opcode* op, struct cpu8086* cpu)
+// Group IMM:
+// - ADD
+// - OR
+// - ADC
+// - SBB
+// - AND
+// - SUB
+// - XOR
+// - CMP
+static void op_imm(struct opcode* op, struct cpu8086* cpu)
 {
-    int8_t offset = loc_read(cpu, &cpu->source);
-    if (cpu8086_getflag(cpu, FLAG_SIGN) == cpu8086_getflag(cpu, FLAG_OVERFLOW))
-    {
-        cpu8086_jump(cpu, cpu->cs, cpu->current_ip + offset);
-        cpu->cycles += 12;
-    }
-
-    cpu->cycles += 4;
+    imm_table[cpu->modrm_byte.fields.reg].func(op, cpu);
 }
 
-// JL: jump if less
-static void op_jl(struct opcode* op, struct cpu8086* cpu)
+// IMUL: signed multiply AL by r/m8 into AX, or AX by r/m16 into DX:AX
+static void op_imul(struct opcode* op, struct cpu8086* cpu)
 {
-    int8_t offset = loc_read(cpu, &cpu->source);
-    if (cpu8086_getflag(cpu, FLAG_SIGN) != cpu8086_getflag(cpu, FLAG_OVERFLOW))
-    {
-        cpu8086_jump(cpu, cpu->cs, cpu->current_ip + offset);
-        cpu->cycles += 12;
-    }
-
-    cpu->cycles += 4;
-}
+    uint16_t operand = loc_read(cpu, &cpu->destination);
+    int32_t multiplicand = op->is_word ? (int16_t)cpu->ax : (int8_t)cpu->al;
+    int32_t multiplier = op->is_word ? (int16_t)operand : (int8_t)operand;
+    int32_t result = multiplicand * multiplier;
 
-// JLE: jump if less or equal
-static void op_jle(struct opcode* op, struct cpu8086* cpu)
-{
-    int8_t offset = loc_read(cpu, &cpu->source);
-    if (cpu8086_getflag(cpu, FLAG_SIGN) != cpu8086_getflag(cpu, FLAG_OVERFLOW)
-        || cpu8086_getflag(cpu, FLAG_ZERO))
+    // CF and OF are set if the upper half is not just a sign extension.
+    bool extended;
+    if (op->is_word)
     {
-        cpu8086_jump(cpu, cpu->cs, cpu->current_ip + offset);
-        cpu->cycles += 12;
+        cpu->ax = result & 0xFFFF;
+        cpu->dx = (result >> 16) & 0xFFFF;
+        extended = result != (int16_t)result;
     }
-
-    cpu->cycles += 4;
-}
-
-// JNE: jump if not equal
-static void op_jne(struct opcode* op, struct cpu8086* cpu)
-{
-    int8_t offset = loc_read(cpu, &cpu->source);
-    if (!cpu8086_getflag(cpu, FLAG_ZERO))
+    else
     {
-        cpu8086_jump(cpu, cpu->cs, cpu->current_ip + offset);
-        cpu->cycles += 12;
+        cpu->ax = result & 0xFFFF;
+        extended = result != (int8_t)result;
     }
+    cpu8086_setflag(cpu, FLAG_CARRY, extended);
+    cpu8086_setflag(cpu, FLAG_OVERFLOW, extended);
 
-    cpu->cycles += 4;
+    uint16_t magnitude = multiplicand < 0 ? -multiplicand : multiplicand;
+    cpu8086_muldiv_cycles(cpu, mul_cycles[op->is_word] + IMUL_EXTRA_CYCLES
+        + calculate_popcount(magnitude & (mask_buffer[op->is_word] >> 1))
+        + (multiplicand < 0 ? IMUL_NEG_OPERAND_CYCLES : 0)
+        + (multiplier < 0 ? IMUL_NEG_OPERAND_CYCLES : 0)
+        + ((multiplicand < 0) != (multiplier < 0) ? IMUL_NEG_RESULT_CYCLES : 0));
 }
 
-// JNO: jump if not overflow
-static void op_jno(struct opcode* op, struct cpu8086* cpu)
+// The port of IN/OUT: either the immediate byte, or DX (0xEC-0xEF).
+static inline uint16_t cpu8086_port(struct cpu8086* cpu)
 {
-    int8_t offset = loc_read(cpu, &cpu->source);
-    if (!cpu8086_getflag(cpu, FLAG_OVERFLOW))
-    {
-        cpu8086_jump(cpu, cpu->cs, cpu->current_ip + offset);
-        cpu->cycles += 12;
-    }
-
-    cpu->cycles += 4;
+    return (cpu->opcode_byte & 0x08) ? cpu->dx : (cpu->immediate & 0xFF);
 }
 
-// JNS: jump if not parity
-static void op_jnp(struct opcode* op, struct cpu8086* cpu)
+// IN: read a byte or word from an I/O port into the accumulator
+static void op_in(struct opcode* op, struct cpu8086* cpu)
 {
-    int8_t offset = loc_read(cpu, &cpu->source);
-    if (!cpu8086_getflag(cpu, FLAG_PARITY))
+    uint16_t port = cpu8086_port(cpu);
+    if (op->is_word)
     {
-        cpu8086_jump(cpu, cpu->cs, cpu->current_ip + offset);
-        cpu->cycles += 12;
+        if (port & 1)
+            cpu8086_ucode_bus(cpu, UOP_READ);
+        cpu->ax = bus_in_short(cpu->bus, port);
     }
+    else
+        cpu->al = bus_in_byte(cpu->bus, port);
 
-    cpu->cycles += 4;
+    cpu8086_ucode(cpu, (cpu->opcode_byte & 0x08) ? &ucode_in_dx : &ucode_in_imm);
 }
 
-// JNS: jump if not sign
-static void op_jns(struct opcode* op, struct cpu8086* cpu)
+// INC: increment by 1
+static void op_inc(struct opcode* op, struct cpu8086* cpu)
 {
-    int8_t offset = loc_read(cpu, &cpu->source);
-    if (!cpu8086_getflag(cpu, FLAG_SIGN))
+    uint16_t dest = loc_read(cpu, &cpu->destination);
+    if (cpu->alu_tables && !op->is_word)
+        loc_write(cpu, &cpu->destination, 
+            cpu8086_alu_lookup(cpu, ALU_ADC, (dest << 8) | 1, true));
+    else
     {
-        cpu8086_jump(cpu, cpu->cs, cpu->current_ip + offset);
-        cpu->cycles += 12;
+        unsigned result = dest + 1;
+        loc_write(cpu, &cpu->destination, result);
+        
+        cpu8086_setpzs_flags(cpu, result, op->is_word);
+        cpu8086_setflag(cpu, FLAG_AUXILIARY, (dest & 0xF) + 1 > 0xF);
+        cpu8086_setflag(cpu, FLAG_OVERFLOW, 
+            (result ^ dest) & (result ^ 1) & (1 << sign_bit[op->is_word]));
     }
 
-    cpu->cycles += 4;
-}
-
-// JO: jump if overflow
-static void op_jo(struct opcode* op, struct cpu8086* cpu)
-{
-    int8_t offset = loc_read(cpu, &cpu->source);
-    if (cpu8086_getflag(cpu, FLAG_OVERFLOW))
+    switch (cpu->destination.type)
     {
-        cpu8086_jump(cpu, cpu->cs, cpu->current_ip + offset);
-        cpu->cycles += 12;
+        case DECODED_ACCUMULATOR:
+        case DECODED_REGISTER:
+        {
+            cpu8086_ucode(cpu, op->is_word ? &ucode_incdec_reg16 : &ucode_incdec_reg8);
+            break;
+        }
+        case DECODED_MEMORY:
+        {
+            cpu8086_ucode(cpu, &ucode_incdec_mem);
+            break;
+        }
+        default:
+            assert(false);
     }
-
-    cpu->cycles += 4;
 }
 
-// JP: jump if parity
-static void op_jp(struct opcode* op, struct cpu8086* cpu)
+// IRET: pop IP, CS and FLAGS off the stack, returning from an interrupt
+static void op_iret(struct opcode* op, struct cpu8086* cpu)
 {
-    int8_t offset = loc_read(cpu, &cpu->source);
-    if (cpu8086_getflag(cpu, FLAG_PARITY))
-    {
-        cpu8086_jump(cpu, cpu->cs, cpu->current_ip + offset);
-        cpu->cycles += 12;
-    }
-
-    cpu->cycles += 4;
+    uint16_t ip = cpu8086_pop(cpu);
+    uint16_t cs = cpu8086_pop(cpu);
+    cpu8086_set_flags(cpu, cpu8086_pop(cpu));
+    cpu8086_jump(cpu, cs, ip);
+    cpu8086_ucode(cpu, &ucode_iret);
 }
 
-// JS: jump if sign
-static void op_js(struct opcode* op, struct cpu8086* cpu)
+// Jcc/LOOP/JCXZ: jump if the condition for the opcode holds
+static void op_jcc(struct opcode* op, struct cpu8086* cpu)
 {
+    // 0x70-0x7F map onto conditions 0x0-0xF, 0xE0-0xE3 onto 0x10-0x13.
+    unsigned condition = (cpu->opcode_byte & 0xF) | ((cpu->opcode_byte & 0x80) >> 3);
+
+    // LOOPNZ/LOOPZ/LOOP decrement CX first; JCXZ doesn't.
+    cpu->cx -= (condition >= 0x10) & (condition != 0x13);
+
+    unsigned packed = cpu->cf
+                    | (cpu->pf << 1)
+                    | (cpu->zf << 2)
+                    | (cpu->sf << 3)
+                    | (cpu->of << 4)
+                    | ((cpu->cx != 0) << 5);
+    bool taken = (jcc_table[packed] >> condition) & 1;
+
     int8_t offset = loc_read(cpu, &cpu->source);
-    if (cpu8086_getflag(cpu, FLAG_SIGN))
-    {
+    if (taken)
         cpu8086_jump(cpu, cpu->cs, cpu->current_ip + offset);
-        cpu->cycles += 12;
-    }
 
-    cpu->cycles += 4;
+    cpu8086_ucode_idle(cpu, jcc_cycles[taken][condition]);
 }
 
 // LAHF: load AH from FLAGS
 static void op_lahf(struct opcode* op, struct cpu8086* cpu)
 {
-    cpu->ah = cpu->flags;
-    cpu->cycles += 4;
+    cpu->ah = cpu8086_get_flags(cpu);
+    cpu8086_ucode(cpu, &ucode_lahf);
 }
 
 // LEA: load effective address into register destination
 static void op_lea(struct opcode* op, struct cpu8086* cpu)
 {
-    assert(cpu->source.virtual); // TODO: how does this actually work?
+    assert(cpu->source.type == DECODED_MEMORY); // TODO: how does this actually work?
 
     loc_write(cpu, &cpu->destination, cpu->source.address);
-    cpu->cycles += 2;
+    cpu8086_ucode(cpu, &ucode_lea);
 }
 
-// LDS: load [mem32] into reg16 and [mem32 + 2] into ES
+// LDS: load [mem32] into reg16 and [mem32 + 2] into DS
 static void op_lds(struct opcode* op, struct cpu8086* cpu)
 {
-    assert(cpu->source.virtual); // TODO: how does this actually work?
+    assert(cpu->source.type == DECODED_MEMORY); // TODO: how does this actually work?
 
     uint16_t offset = loc_read(cpu, &cpu->source);
     cpu->source.address += 2;
     uint16_t segment = loc_read(cpu, &cpu->source);
 
     loc_write(cpu, &cpu->destination, offset);
-    cpu->es = segment;
+    cpu->ds = segment;
+    cpu->ds_base = segment << 4;
 
-    cpu->cycles += 16;
+    cpu8086_ucode(cpu, &ucode_lds);
 }
 
 // LES: load [mem32] into reg16 and [mem32 + 2] into ES
 static void op_les(struct opcode* op, struct cpu8086* cpu)
 {
-    assert(cpu->source.virtual); // TODO: how does this actually work?
+    assert(cpu->source.type == DECODED_MEMORY); // TODO: how does this actually work?
 
     uint16_t offset = loc_read(cpu, &cpu->source);
     cpu->source.address += 2;
@@ -1346,8 +2219,9 @@ static void op_les(struct opcode* op, struct cpu8086* cpu)
 
     loc_write(cpu, &cpu->destination, offset);
     cpu->es = segment;
+    cpu->es_base = segment << 4;
 
-    cpu->cycles += 16;
+    cpu8086_ucode(cpu, &ucode_lds);
 }
 
 // MOV: copy from source to destination
@@ -1355,67 +2229,150 @@ static void op_mov(struct opcode* op, struct cpu8086* cpu)
 {
     uint16_t src = loc_read(cpu, &cpu->source);
     loc_write(cpu, &cpu->destination, src);
+    if (op->destination == LOC_SREG)
+        cpu8086_update_segments(cpu);
 
     switch ((cpu->destination.type << 3) | cpu->source.type)
     {
         case (DECODED_MEMORY << 3) | DECODED_ACCUMULATOR:
+        {
+            cpu8086_ucode(cpu, &ucode_mov_mem_acc);
+            break;
+        }
         case (DECODED_ACCUMULATOR << 3) | DECODED_MEMORY:
         {
-            cpu->cycles += 10;
+            cpu8086_ucode(cpu, &ucode_mov_acc_mem);
             break;
         }
         case (DECODED_REGISTER << 3) | DECODED_REGISTER:
         case (DECODED_SEGREG << 3) | DECODED_REGISTER:
         case (DECODED_REGISTER << 3) | DECODED_SEGREG:
         {
-            cpu->cycles += 2;
+            cpu8086_ucode(cpu, &ucode_mov_reg_reg);
             break;
         }
         case (DECODED_REGISTER << 3) | DECODED_MEMORY:
         case (DECODED_SEGREG << 3) | DECODED_MEMORY:
         {
-            cpu->cycles += 8;
+            cpu8086_ucode(cpu, &ucode_mov_reg_mem);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_REGISTER:
         case (DECODED_MEMORY << 3) | DECODED_SEGREG:
         {
-            cpu->cycles += 9;
+            cpu8086_ucode(cpu, &ucode_mov_mem_reg);
             break;
         }
         case (DECODED_REGISTER << 3) | DECODED_IMMEDIATE:
         case (DECODED_ACCUMULATOR << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 4;
+            cpu8086_ucode(cpu, &ucode_mov_reg_imm);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 10;
+            cpu8086_ucode(cpu, &ucode_mov_mem_imm);
             break;
         }
 
         // MOVS
         case (DECODED_STRING << 3) | DECODED_STRING:
         {
-            cpu->cycles += cpu->repeat ? 17 : 18;
+            cpu8086_ucode(cpu, cpu->repeat ? &ucode_rep_movs : &ucode_movs);
             break;
         }
         
         // STOS
         case (DECODED_STRING << 3) | DECODED_ACCUMULATOR:
         {
-            cpu->cycles += cpu->repeat ? 10 : 11;
+            cpu8086_ucode(cpu, cpu->repeat ? &ucode_rep_stos : &ucode_stos);
             break;
         }
 
         // LODS
         case (DECODED_ACCUMULATOR << 3) | DECODED_STRING:
         {
-            cpu->cycles += cpu->repeat ? 13 : 12;
+            cpu8086_ucode(cpu, cpu->repeat ? &ucode_rep_lods : &ucode_lods);
+            break;
+        }
+
+        default:
+            assert(false);
+    }
+}
+
+// MUL: unsigned multiply AL by r/m8 into AX, or AX by r/m16 into DX:AX
+static void op_mul(struct opcode* op, struct cpu8086* cpu)
+{
+    uint16_t multiplicand = op->is_word ? cpu->ax : cpu->al;
+    uint32_t result = (uint32_t)multiplicand * loc_read(cpu, &cpu->destination);
+
+    bool upper;
+    if (op->is_word)
+    {
+        cpu->ax = result & 0xFFFF;
+        cpu->dx = result >> 16;
+        upper = cpu->dx != 0;
+    }
+    else
+    {
+        cpu->ax = result;
+        upper = cpu->ah != 0;
+    }
+    cpu8086_setflag(cpu, FLAG_CARRY, upper);
+    cpu8086_setflag(cpu, FLAG_OVERFLOW, upper);
+
+    cpu8086_muldiv_cycles(cpu, mul_cycles[op->is_word] 
+        + calculate_popcount(multiplicand & (mask_buffer[op->is_word] >> 1)));
+}
+
+// NEG: two's complement negation
+static void op_neg(struct opcode* op, struct cpu8086* cpu)
+{
+    uint16_t dest = loc_read(cpu, &cpu->destination);
+    uint16_t result = (~dest + 1) & mask_buffer[op->is_word];
+    loc_write(cpu, &cpu->destination, result);
+
+    cpu8086_setpzs_flags(cpu, result, op->is_word);
+    cpu8086_setflag(cpu, FLAG_CARRY, dest != 0);
+    cpu8086_setflag(cpu, FLAG_AUXILIARY, (dest & 0xF) != 0);
+    cpu8086_setflag(cpu, FLAG_OVERFLOW, result & dest & (1 << sign_bit[op->is_word]));
+
+    switch (cpu->destination.type)
+    {
+        case DECODED_REGISTER:
+        {
+            cpu8086_ucode(cpu, &ucode_alu_reg_reg);
+            break;
+        }
+        case DECODED_MEMORY:
+        {
+            cpu8086_ucode(cpu, &ucode_alu_mem_reg);
             break;
         }
+        default:
+            assert(false);
+    }
+}
+
+// NOT: one's complement negation
+static void op_not(struct opcode* op, struct cpu8086* cpu)
+{
+    uint16_t dest = loc_read(cpu, &cpu->destination);
+    loc_write(cpu, &cpu->destination, ~dest);
 
+    switch (cpu->destination.type)
+    {
+        case DECODED_REGISTER:
+        {
+            cpu8086_ucode(cpu, &ucode_alu_reg_reg);
+            break;
+        }
+        case DECODED_MEMORY:
+        {
+            cpu8086_ucode(cpu, &ucode_alu_mem_reg);
+            break;
+        }
         default:
             assert(false);
     }
@@ -1426,40 +2383,46 @@ static void op_or(struct opcode* op, struct cpu8086* cpu)
 {
     uint16_t dest = loc_read(cpu, &cpu->destination);
     uint16_t src = loc_read(cpu, &cpu->source);
-    uint16_t result = dest | src;
-    loc_write(cpu, &cpu->destination, result);
+    if (cpu->alu_tables && !op->is_word)
+        loc_write(cpu, &cpu->destination, 
+            cpu8086_alu_lookup(cpu, ALU_OR, (dest << 8) | src, false));
+    else
+    {
+        uint16_t result = dest | src;
+        loc_write(cpu, &cpu->destination, result);
 
-    cpu8086_setpzs_flags(cpu, result, op->is_word);
-    cpu8086_setflag(cpu, FLAG_CARRY, false);
-    cpu8086_setflag(cpu, FLAG_AUXILIARY, false); // U
-    cpu8086_setflag(cpu, FLAG_OVERFLOW, false);
+        cpu8086_setpzs_flags(cpu, result, op->is_word);
+        cpu8086_setflag(cpu, FLAG_CARRY, false);
+        cpu8086_setflag(cpu, FLAG_AUXILIARY, false); // U
+        cpu8086_setflag(cpu, FLAG_OVERFLOW, false);
+    }
 
     switch ((cpu->destination.type << 3) | cpu->source.type)
     {
         case (DECODED_REGISTER << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 3;
+            cpu8086_ucode(cpu, &ucode_alu_reg_reg);
             break;
         }
         case (DECODED_REGISTER << 3) | DECODED_MEMORY:
         {
-            cpu->cycles += 9;
+            cpu8086_ucode(cpu, &ucode_alu_reg_mem);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 16;
+            cpu8086_ucode(cpu, &ucode_alu_mem_reg);
             break;
         }
         case (DECODED_ACCUMULATOR << 3) | DECODED_IMMEDIATE:
         case (DECODED_REGISTER << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 4;
+            cpu8086_ucode(cpu, &ucode_alu_reg_imm);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 17;
+            cpu8086_ucode(cpu, &ucode_alu_mem_imm);
             break;
         }
         default:
@@ -1467,11 +2430,29 @@ static void op_or(struct opcode* op, struct cpu8086* cpu)
     }
 }
 
+// OUT: write the accumulator to an I/O port
+static void op_out(struct opcode* op, struct cpu8086* cpu)
+{
+    uint16_t port = cpu8086_port(cpu);
+    if (op->is_word)
+    {
+        if (port & 1)
+            cpu8086_ucode_bus(cpu, UOP_WRITE);
+        bus_out_short(cpu->bus, port, cpu->ax);
+    }
+    else
+        bus_out_byte(cpu->bus, port, cpu->al);
+
+    cpu8086_ucode(cpu, (cpu->opcode_byte & 0x08) ? &ucode_out_dx : &ucode_out_imm);
+}
+
 // POP: pop a word from the stack into a location
 static void op_pop(struct opcode* op, struct cpu8086* cpu)
 {
     uint16_t result = cpu8086_pop(cpu);
     loc_write(cpu, &cpu->destination, result);
+    if (cpu->destination.type == DECODED_SEGREG)
+        cpu8086_update_segments(cpu);
 
     switch (cpu->destination.type)
     {
@@ -1479,12 +2460,12 @@ static void op_pop(struct opcode* op, struct cpu8086* cpu)
         case DECODED_REGISTER:
         case DECODED_SEGREG:
         {
-            cpu->cycles += 8;
+            cpu8086_ucode(cpu, &ucode_pop_reg);
             break;
         }
         case DECODED_MEMORY:
         {
-            cpu->cycles += 17;
+            cpu8086_ucode(cpu, &ucode_pop_mem);
             break;
         }
         default:
@@ -1495,8 +2476,8 @@ static void op_pop(struct opcode* op, struct cpu8086* cpu)
 // POPF: pop FLGAS off the stack
 static void op_popf(struct opcode* op, struct cpu8086* cpu)
 {
-    cpu->flags = cpu8086_pop(cpu);
-    cpu->cycles += 8;
+    cpu8086_set_flags(cpu, cpu8086_pop(cpu));
+    cpu8086_ucode(cpu, &ucode_pop_reg);
 }
 
 // PUSH: push a word from a location onto the stack
@@ -1510,17 +2491,17 @@ static void op_push(struct opcode* op, struct cpu8086* cpu)
         case DECODED_ACCUMULATOR:
         case DECODED_REGISTER:
         {
-            cpu->cycles += 11;
+            cpu8086_ucode(cpu, &ucode_push_reg);
             break;
         }
         case DECODED_SEGREG:
         {
-            cpu->cycles += 10;
+            cpu8086_ucode(cpu, &ucode_push_seg);
             break;
         }
         case DECODED_MEMORY:
         {
-            cpu->cycles += 16;
+            cpu8086_ucode(cpu, &ucode_push_mem);
             break;
         }
         default:
@@ -1531,8 +2512,50 @@ static void op_push(struct opcode* op, struct cpu8086* cpu)
 // PUHSF: push FLAGS onto the stack
 static void op_pushf(struct opcode* op, struct cpu8086* cpu)
 {
-    cpu8086_push(cpu, cpu->flags);
-    cpu->cycles += 10;
+    cpu8086_push(cpu, cpu8086_get_flags(cpu));
+    cpu8086_ucode(cpu, &ucode_push_seg);
+}
+
+// RCL: rotate left through the carry flag
+static void op_rcl(struct opcode* op, struct cpu8086* cpu)
+{
+    unsigned count = cpu8086_shift_count(cpu);
+    if (count > 0)
+    {
+        // CF is treated as the top bit of a 9/17-bit value, so the rotation
+        // repeats every width + 1 bits.
+        unsigned width = sign_bit[op->is_word] + 1;
+        unsigned n = count % (width + 1);
+        uint32_t value = ((uint32_t)cpu8086_getflag(cpu, FLAG_CARRY) << width) 
+                       | loc_read(cpu, &cpu->destination);
+        value = ((value << n) | (value >> (width + 1 - n))) & ((1u << (width + 1)) - 1);
+
+        uint16_t result = value & mask_buffer[op->is_word];
+        loc_write(cpu, &cpu->destination, result);
+        cpu8086_shift_left_flags(cpu, result, value >> width, op->is_word);
+    }
+
+    cpu8086_shift_cycles(cpu, count);
+}
+
+// RCR: rotate right through the carry flag
+static void op_rcr(struct opcode* op, struct cpu8086* cpu)
+{
+    unsigned count = cpu8086_shift_count(cpu);
+    if (count > 0)
+    {
+        unsigned width = sign_bit[op->is_word] + 1;
+        unsigned n = count % (width + 1);
+        uint32_t value = ((uint32_t)cpu8086_getflag(cpu, FLAG_CARRY) << width) 
+                       | loc_read(cpu, &cpu->destination);
+        value = ((value >> n) | (value << (width + 1 - n))) & ((1u << (width + 1)) - 1);
+
+        uint16_t result = value & mask_buffer[op->is_word];
+        loc_write(cpu, &cpu->destination, result);
+        cpu8086_shift_right_flags(cpu, result, value >> width, op->is_word);
+    }
+
+    cpu8086_shift_cycles(cpu, count);
 }
 
 // RET (near): pop the IP off the stack and release parameters off the stack
@@ -1546,12 +2569,12 @@ static void op_retnear(struct opcode* op, struct cpu8086* cpu)
     {
         case DECODED_NULL:
         {
-            cpu->cycles += 8;
+            cpu8086_ucode(cpu, &ucode_retnear);
             break;
         }
         case DECODED_IMMEDIATE:
         {
-            cpu->cycles += 12;
+            cpu8086_ucode(cpu, &ucode_retnear_imm);
             cpu->sp += loc_read(cpu, &cpu->source);
             break;
         }
@@ -1572,12 +2595,12 @@ static void op_retfar(struct opcode* op, struct cpu8086* cpu)
     {
         case DECODED_NULL:
         {
-            cpu->cycles += 18;
+            cpu8086_ucode(cpu, &ucode_retfar);
             break;
         }
         case DECODED_IMMEDIATE:
         {
-            cpu->cycles += 17;
+            cpu8086_ucode(cpu, &ucode_retfar_imm);
             cpu->sp += loc_read(cpu, &cpu->source);
             break;
         }
@@ -1586,6 +2609,42 @@ static void op_retfar(struct opcode* op, struct cpu8086* cpu)
     }
 }
 
+// ROL: rotate left
+static void op_rol(struct opcode* op, struct cpu8086* cpu)
+{
+    unsigned count = cpu8086_shift_count(cpu);
+    if (count > 0)
+    {
+        unsigned width = sign_bit[op->is_word] + 1;
+        unsigned n = count % width;
+        uint16_t dest = loc_read(cpu, &cpu->destination);
+        uint16_t result = ((dest << n) | (dest >> (width - n))) & mask_buffer[op->is_word];
+
+        loc_write(cpu, &cpu->destination, result);
+        cpu8086_shift_left_flags(cpu, result, result & 1, op->is_word);
+    }
+
+    cpu8086_shift_cycles(cpu, count);
+}
+
+// ROR: rotate right
+static void op_ror(struct opcode* op, struct cpu8086* cpu)
+{
+    unsigned count = cpu8086_shift_count(cpu);
+    if (count > 0)
+    {
+        unsigned width = sign_bit[op->is_word] + 1;
+        unsigned n = count % width;
+        uint16_t dest = loc_read(cpu, &cpu->destination);
+        uint16_t result = ((dest >> n) | (dest << (width - n))) & mask_buffer[op->is_word];
+
+        loc_write(cpu, &cpu->destination, result);
+        cpu8086_shift_right_flags(cpu, result, (result >> sign_bit[op->is_word]) & 1, op->is_word);
+    }
+
+    cpu8086_shift_cycles(cpu, count);
+}
+
 // SAHF: store AH into FLAGS
 static void op_sahf(struct opcode* op, struct cpu8086* cpu)
 {
@@ -1594,49 +2653,73 @@ static void op_sahf(struct opcode* op, struct cpu8086* cpu)
     cpu8086_setflag(cpu, FLAG_AUXILIARY, cpu->ah & FLAG_AUXILIARY);
     cpu8086_setflag(cpu, FLAG_ZERO, cpu->ah & FLAG_ZERO);
     cpu8086_setflag(cpu, FLAG_SIGN, cpu->ah & FLAG_SIGN);
-    cpu->cycles += 4;
+    cpu8086_ucode(cpu, &ucode_lahf);
+}
+
+// SAR: arithmetic shift right
+static void op_sar(struct opcode* op, struct cpu8086* cpu)
+{
+    unsigned count = cpu8086_shift_count(cpu);
+    if (count > 0)
+    {
+        // Shifting by the operand width or more just smears the sign bit.
+        unsigned width = sign_bit[op->is_word] + 1;
+        unsigned n = (count > width) ? width : count;
+        uint16_t dest = loc_read(cpu, &cpu->destination);
+        int32_t value = op->is_word ? (int16_t)dest : (int8_t)dest;
+        uint16_t result = (value >> n) & mask_buffer[op->is_word];
+
+        loc_write(cpu, &cpu->destination, result);
+        cpu8086_setpzs_flags(cpu, result, op->is_word);
+        cpu8086_setflag(cpu, FLAG_AUXILIARY, false); // U
+        cpu8086_shift_right_flags(cpu, result, (value >> (n - 1)) & 1, op->is_word);
+    }
+
+    cpu8086_shift_cycles(cpu, count);
 }
 
 // SBB: subtract src from dest, also subtract the carry flag
 static void op_sbb(struct opcode* op, struct cpu8086* cpu)
 {
     uint16_t dest = loc_read(cpu, &cpu->destination);
-    uint16_t src = ~(loc_read(cpu, &cpu->source) + cpu8086_getflag(cpu, FLAG_CARRY)) + 1;
-    unsigned result = dest + src;
-    loc_write(cpu, &cpu->destination, result);
-    
-    cpu8086_setpzs_flags(cpu, result, op->is_word);
-    cpu8086_setflag(cpu, FLAG_CARRY, result > mask_buffer[op->is_word]);
-    cpu8086_setflag(cpu, FLAG_AUXILIARY, (dest & 0xF) < ((~src + 1) & 0xF));
-    cpu8086_setflag(cpu, FLAG_OVERFLOW, 
-        (result ^ dest) & (result ^ src) & (1 << sign_bit[op->is_word]));
+    uint16_t src = loc_read(cpu, &cpu->source);
+    bool borrow = cpu8086_getflag(cpu, FLAG_CARRY);
+    if (cpu->alu_tables && !op->is_word)
+        loc_write(cpu, &cpu->destination, 
+            cpu8086_alu_lookup(cpu, ALU_SBB, (borrow << 16) | (dest << 8) | src, false));
+    else
+    {
+        unsigned result = dest - src - borrow;
+        loc_write(cpu, &cpu->destination, result);
+        cpu8086_sub_flags(cpu, dest, src, result, op->is_word);
+    }
     
     switch ((cpu->destination.type << 3) | cpu->source.type)
     {
         case (DECODED_REGISTER << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 3;
+            cpu8086_ucode(cpu, &ucode_alu_reg_reg);
             break;
         }
         case (DECODED_REGISTER << 3) | DECODED_MEMORY:
         {
-            cpu->cycles += 9;
+            cpu8086_ucode(cpu, &ucode_alu_reg_mem);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 16;
+            cpu8086_ucode(cpu, &ucode_alu_mem_reg);
             break;
         }
         case (DECODED_ACCUMULATOR << 3) | DECODED_IMMEDIATE:
         case (DECODED_REGISTER << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 4;
+            cpu8086_ucode(cpu, &ucode_alu_reg_imm);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 17;
+            cpu8086_ucode(cpu, &ucode_alu_mem_imm);
             break;
         }
         default:
@@ -1644,46 +2727,142 @@ static void op_sbb(struct opcode* op, struct cpu8086* cpu)
     }
 }
 
+// SETMO: undocumented; sets the destination to all ones
+static void op_setmo(struct opcode* op, struct cpu8086* cpu)
+{
+    unsigned count = cpu8086_shift_count(cpu);
+    if (count > 0)
+    {
+        uint16_t result = mask_buffer[op->is_word];
+        loc_write(cpu, &cpu->destination, result);
+        cpu8086_setpzs_flags(cpu, result, op->is_word);
+        cpu8086_setflag(cpu, FLAG_CARRY, false);
+        cpu8086_setflag(cpu, FLAG_AUXILIARY, false);
+        cpu8086_setflag(cpu, FLAG_OVERFLOW, false);
+    }
+
+    cpu8086_shift_cycles(cpu, count);
+}
+
+// Group SHIFT:
+// - ROL
+// - ROR
+// - RCL
+// - RCR
+// - SHL
+// - SHR
+// - SETMO
+// - SAR
+static void op_shift(struct opcode* op, struct cpu8086* cpu)
+{
+    shift_table[cpu->modrm_byte.fields.reg].func(op, cpu);
+}
+
+// SHL: shift left
+static void op_shl(struct opcode* op, struct cpu8086* cpu)
+{
+    unsigned count = cpu8086_shift_count(cpu);
+    if (count > 0)
+    {
+        // Anything shifted by more than the operand width is just 0.
+        unsigned width = sign_bit[op->is_word] + 1;
+        uint32_t value = (count > width) ? 0 : (uint32_t)loc_read(cpu, &cpu->destination) << count;
+        uint16_t result = value & mask_buffer[op->is_word];
+
+        loc_write(cpu, &cpu->destination, result);
+        cpu8086_setpzs_flags(cpu, result, op->is_word);
+        cpu8086_setflag(cpu, FLAG_AUXILIARY, result & 0x10); // U
+        cpu8086_shift_left_flags(cpu, result, (value >> width) & 1, op->is_word);
+    }
+
+    cpu8086_shift_cycles(cpu, count);
+}
+
+// SHR: logical shift right
+static void op_shr(struct opcode* op, struct cpu8086* cpu)
+{
+    unsigned count = cpu8086_shift_count(cpu);
+    if (count > 0)
+    {
+        unsigned width = sign_bit[op->is_word] + 1;
+        uint16_t dest = loc_read(cpu, &cpu->destination);
+        uint16_t result = (count >= width) ? 0 : dest >> count;
+        bool carry = (count > width) ? false : (dest >> (count - 1)) & 1;
+
+        loc_write(cpu, &cpu->destination, result);
+        cpu8086_setpzs_flags(cpu, result, op->is_word);
+        cpu8086_setflag(cpu, FLAG_AUXILIARY, false); // U
+        cpu8086_shift_right_flags(cpu, result, carry, op->is_word);
+    }
+
+    cpu8086_shift_cycles(cpu, count);
+}
+
+// STC: set the carry flag
+static void op_stc(struct opcode* op, struct cpu8086* cpu)
+{
+    cpu8086_setflag(cpu, FLAG_CARRY, true);
+    cpu8086_ucode(cpu, &ucode_flag);
+}
+
+// STD: set the direction flag, so string instructions count down
+static void op_std(struct opcode* op, struct cpu8086* cpu)
+{
+    cpu8086_setflag(cpu, FLAG_DIRECTION, true);
+    cpu8086_ucode(cpu, &ucode_flag);
+}
+
+// STI: set the interrupt enable flag. Interrupts are not recognised until
+// the instruction after this one has run, so that STI followed by RET
+// returns before a pending interrupt is taken.
+static void op_sti(struct opcode* op, struct cpu8086* cpu)
+{
+    cpu8086_setflag(cpu, FLAG_INTENABLE, true);
+    cpu->intr_shadow = true;
+    cpu8086_ucode(cpu, &ucode_flag);
+}
+
 // SUB: subtract src from dest
 static void op_sub(struct opcode* op, struct cpu8086* cpu)
 {
     uint16_t dest = loc_read(cpu, &cpu->destination);
-    uint16_t src = ~loc_read(cpu, &cpu->source) + 1;
-    unsigned result = dest + src;
-    loc_write(cpu, &cpu->destination, result);
-    
-    cpu8086_setpzs_flags(cpu, result, op->is_word);
-    cpu8086_setflag(cpu, FLAG_CARRY, result > mask_buffer[op->is_word]);
-    cpu8086_setflag(cpu, FLAG_AUXILIARY, (dest & 0xF) < ((~src + 1) & 0xF));
-    cpu8086_setflag(cpu, FLAG_OVERFLOW, 
-        (result ^ dest) & (result ^ src) & (1 << sign_bit[op->is_word]));
+    uint16_t src = loc_read(cpu, &cpu->source);
+    if (cpu->alu_tables && !op->is_word)
+        loc_write(cpu, &cpu->destination, 
+            cpu8086_alu_lookup(cpu, ALU_SBB, (dest << 8) | src, false));
+    else
+    {
+        unsigned result = dest - src;
+        loc_write(cpu, &cpu->destination, result);
+        cpu8086_sub_flags(cpu, dest, src, result, op->is_word);
+    }
     
     switch ((cpu->destination.type << 3) | cpu->source.type)
     {
         case (DECODED_REGISTER << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 3;
+            cpu8086_ucode(cpu, &ucode_alu_reg_reg);
             break;
         }
         case (DECODED_REGISTER << 3) | DECODED_MEMORY:
         {
-            cpu->cycles += 9;
+            cpu8086_ucode(cpu, &ucode_alu_reg_mem);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 16;
+            cpu8086_ucode(cpu, &ucode_alu_mem_reg);
             break;
         }
         case (DECODED_ACCUMULATOR << 3) | DECODED_IMMEDIATE:
         case (DECODED_REGISTER << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 4;
+            cpu8086_ucode(cpu, &ucode_alu_reg_imm);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 17;
+            cpu8086_ucode(cpu, &ucode_alu_mem_imm);
             break;
         }
         default:
@@ -1707,27 +2886,27 @@ static void op_test(struct opcode* op, struct cpu8086* cpu)
     {
         case (DECODED_REGISTER << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 3;
+            cpu8086_ucode(cpu, &ucode_alu_reg_reg);
             break;
         }
         case (DECODED_REGISTER << 3) | DECODED_MEMORY:
         {
-            cpu->cycles += 9;
+            cpu8086_ucode(cpu, &ucode_alu_reg_mem);
             break;
         }
         case (DECODED_ACCUMULATOR << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 4;
+            cpu8086_ucode(cpu, &ucode_alu_reg_imm);
             break;
         }
         case (DECODED_REGISTER << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 5;
+            cpu8086_ucode(cpu, &ucode_test_reg_imm);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 11;
+            cpu8086_ucode(cpu, &ucode_test_mem_imm);
             break;
         }
         default:
@@ -1739,7 +2918,7 @@ static void op_test(struct opcode* op, struct cpu8086* cpu)
 static void op_wait(struct opcode* op, struct cpu8086* cpu)
 {
     // Handled in cpu8086_clock().
-    cpu->cycles += 3;
+    cpu8086_ucode(cpu, &ucode_wait);
 }
 
 // XCHG: exchange between destination/source
@@ -1752,19 +2931,22 @@ static void op_xchg(struct opcode* op, struct cpu8086* cpu)
 
     switch ((cpu->destination.type << 3) | cpu->source.type)
     {
+        case (DECODED_ACCUMULATOR << 3) | DECODED_ACCUMULATOR:
         case (DECODED_ACCUMULATOR << 3) | DECODED_REGISTER:
+        case (DECODED_REGISTER << 3) | DECODED_ACCUMULATOR:
         {
-            cpu->cycles += 3;
+            cpu8086_ucode(cpu, &ucode_xchg_acc_reg);
             break;
         }
         case (DECODED_REGISTER << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 4;
+            cpu8086_ucode(cpu, &ucode_xchg_reg_reg);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_REGISTER:
+        case (DECODED_REGISTER << 3) | DECODED_MEMORY:
         {
-            cpu->cycles += 17;
+            cpu8086_ucode(cpu, &ucode_xchg_mem_reg);
             break;
         }
         default:
@@ -1777,40 +2959,46 @@ static void op_xor(struct opcode* op, struct cpu8086* cpu)
 {
     uint16_t dest = loc_read(cpu, &cpu->destination);
     uint16_t src = loc_read(cpu, &cpu->source);
-    uint16_t result = dest ^ src;
-    loc_write(cpu, &cpu->destination, result);
+    if (cpu->alu_tables && !op->is_word)
+        loc_write(cpu, &cpu->destination, 
+            cpu8086_alu_lookup(cpu, ALU_XOR, (dest << 8) | src, false));
+    else
+    {
+        uint16_t result = dest ^ src;
+        loc_write(cpu, &cpu->destination, result);
 
-    cpu8086_setpzs_flags(cpu, result, op->is_word);
-    cpu8086_setflag(cpu, FLAG_CARRY, false);
-    cpu8086_setflag(cpu, FLAG_AUXILIARY, false); // U
-    cpu8086_setflag(cpu, FLAG_OVERFLOW, false);
+        cpu8086_setpzs_flags(cpu, result, op->is_word);
+        cpu8086_setflag(cpu, FLAG_CARRY, false);
+        cpu8086_setflag(cpu, FLAG_AUXILIARY, false); // U
+        cpu8086_setflag(cpu, FLAG_OVERFLOW, false);
+    }
 
     switch ((cpu->destination.type << 3) | cpu->source.type)
     {
         case (DECODED_REGISTER << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 3;
+            cpu8086_ucode(cpu, &ucode_alu_reg_reg);
             break;
         }
         case (DECODED_REGISTER << 3) | DECODED_MEMORY:
         {
-            cpu->cycles += 9;
+            cpu8086_ucode(cpu, &ucode_alu_reg_mem);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_REGISTER:
         {
-            cpu->cycles += 16;
+            cpu8086_ucode(cpu, &ucode_alu_mem_reg);
             break;
         }
         case (DECODED_ACCUMULATOR << 3) | DECODED_IMMEDIATE:
         case (DECODED_REGISTER << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 4;
+            cpu8086_ucode(cpu, &ucode_alu_reg_imm);
             break;
         }
         case (DECODED_MEMORY << 3) | DECODED_IMMEDIATE:
         {
-            cpu->cycles += 17;
+            cpu8086_ucode(cpu, &ucode_alu_mem_imm);
             break;
         }
         default:
@@ -1818,43 +3006,145 @@ static void op_xor(struct opcode* op, struct cpu8086* cpu)
     }
 }
 
+// Fill the byte ALU tables by running the handlers over every input on a
+// scratch CPU, so both modes always agree.
+static void cpu8086_alu_build(void)
+{
+    static const struct
+    {
+        unsigned table;
+        uint8_t opcode;
+        unsigned size;
+    } tables[] =
+    {
+        { ALU_ADC, 0x10, 0x20000 },
+        { ALU_SBB, 0x18, 0x20000 },
+        { ALU_AND, 0x20, 0x10000 },
+        { ALU_OR,  0x08, 0x10000 },
+        { ALU_XOR, 0x30, 0x10000 },
+        { ALU_DAA, 0x27, 0x400 },
+        { ALU_DAS, 0x2F, 0x400 },
+        { ALU_AAA, 0x37, 0x400 },
+        { ALU_AAS, 0x3F, 0x400 }
+    };
+
+    struct cpu8086 scratch = { 0 };
+    scratch.destination = (struct location){ DECODED_REGISTER, cpu8086_reg_byte(AX) };   // AL
+    scratch.source = (struct location){ DECODED_REGISTER, cpu8086_reg_byte(BX) };        // BL
+    for (unsigned i = 0; i < sizeof(tables) / sizeof(tables[0]); i++)
+    {
+        struct opcode* op = &op_table[tables[i].opcode];
+        bool decimal = tables[i].table >= ALU_DAA;
+        scratch.opcode_byte = tables[i].opcode;
+        for (unsigned index = 0; index < tables[i].size; index++)
+        {
+            if (decimal)
+            {
+                scratch.af = (index >> 9) & 1;
+                scratch.cf = (index >> 8) & 1;
+                scratch.al = index & 0xFF;
+            }
+            else
+            {
+                scratch.cf = (index >> 16) & 1;
+                scratch.al = (index >> 8) & 0xFF;
+                scratch.bl = index & 0xFF;
+            }
+            op->func(op, &scratch);
+
+            struct alu_entry* entry = &alu_table[tables[i].table + index];
+            entry->result = scratch.al;
+            memcpy(entry->flags, scratch.flag, sizeof(entry->flags));
+        }
+    }
+}
+
 struct cpu8086* cpu8086_new(struct bus* bus)
 {
     assert(bus);
-    struct cpu8086* cpu = quick_malloc(sizeof(struct cpu8086));
+    assert(ucode_validate());
+    struct cpu8086* cpu = arena_alloc(bus->arena, sizeof(struct cpu8086));
     cpu->bus = bus;
+    cpu->rep_quantum = CPU8086_REP_QUANTUM;
     cpu8086_reset(cpu);
     return cpu;
 }
 
 void cpu8086_reset(struct cpu8086* cpu)
 {
-    cpu->flags = 0x0000;
+    cpu8086_set_flags(cpu, 0x0000);
     cpu->ip = 0x0000;
     cpu->cs = 0xFFFF;
     cpu->ds = 0x0000;
     cpu->ss = 0x0000;
     cpu->es = 0x0000;
+    cpu8086_update_segments(cpu);
     cpu->mt = true;
+    cpu->hl = false;
     cpu->q_r = 0;
-    cpu->q_r = 0;
+    cpu->q_w = 0;
 
     cpu->biu_prefetch_cycles = 3;
     cpu->cycles = 0;
+    cpu->eu_bus = false;
+    cpu->uop_r = cpu->uop_w = cpu->uop_t = 0;
     cpu->current_ip = 0x0000;
+    cpu->intr = false;
+    cpu->intr_shadow = false;
     cpu8086_reset_execution_regs(cpu);
 }
 
+// Pack the flags into the FLAGS layout. The reserved bits 1 and 12-15 always
+// read as set on the 8086.
+uint16_t cpu8086_get_flags(struct cpu8086* cpu)
+{
+    return 0xF002 
+         | (cpu->cf << 0)
+         | (cpu->pf << 2)
+         | (cpu->af << 4)
+         | (cpu->zf << 6)
+         | (cpu->sf << 7)
+         | (cpu->tf << 8)
+         | (cpu->ief << 9)
+         | (cpu->df << 10)
+         | (cpu->of << 11);
+}
+
+void cpu8086_set_flags(struct cpu8086* cpu, uint16_t flags)
+{
+    cpu->cf = (flags >> 0) & 1;
+    cpu->pf = (flags >> 2) & 1;
+    cpu->af = (flags >> 4) & 1;
+    cpu->zf = (flags >> 6) & 1;
+    cpu->sf = (flags >> 7) & 1;
+    cpu->tf = (flags >> 8) & 1;
+    cpu->ief = (flags >> 9) & 1;
+    cpu->df = (flags >> 10) & 1;
+    cpu->of = (flags >> 11) & 1;
+}
+
+// Must be called whenever a segment register is written directly.
+void cpu8086_update_segments(struct cpu8086* cpu)
+{
+    cpu->es_base = cpu->es << 4;
+    cpu->cs_base = cpu->cs << 4;
+    cpu->ss_base = cpu->ss << 4;
+    cpu->ds_base = cpu->ds << 4;
+}
+
 void cpu8086_clock(struct cpu8086* cpu)
 {
     // The BIU, unless idling, is always performing instruction fetches.
     // Assume these take 4 cycles to complete each bus cycle, but Tw wait
     // states can feature in a bus cycle (between T3-T4) in the actual 808x.
-    if (cpu->mt || cpu->q_w != cpu->q_r)
+    // In bus micro-op mode, the BIU yields to the EU at the end of a bus cycle.
+    if ((cpu->mt || cpu->q_w != cpu->q_r)
+        && !(cpu->eu_bus && cpu->biu_prefetch_cycles == 3))
     {
         if (cpu->biu_prefetch_cycles == 0)
         {
-            cpu->q[cpu->q_w] = bus_read_short(cpu->bus, (cpu->cs << 4) + cpu->ip);
+            // An odd IP only needs the high byte of the word it is in.
+            cpu->q[cpu->q_w] = bus_read_short(cpu->bus, cpu->cs_base + (cpu->ip & ~1));
             cpu->q_w = (cpu->q_w + 1) % 3;
             cpu->mt = false;
             if (cpu->ip & 1)
@@ -1865,11 +3155,11 @@ void cpu8086_clock(struct cpu8086* cpu)
             else
                 cpu->ip += 2;
         }
-        cpu->biu_prefetch_cycles = (cpu->biu_prefetch_cycles - 1) % 4;
+        cpu->biu_prefetch_cycles = (cpu->biu_prefetch_cycles + 3) % 4;
     }
 
     // If the last opcode was WAIT and TEST is high, stall for another 5 cycles.
-    if (cpu->opcode_byte == 0x9B && cpu->test)
+    if ((cpu->fetched & FETCHED_OPCODE) && cpu->opcode_byte == 0x9B && cpu->test)
         cpu->cycles += 5;
 
     // Skip if there are remaining cycles of execution.
@@ -1879,23 +3169,41 @@ void cpu8086_clock(struct cpu8086* cpu)
         return;
     }
 
+    // Likewise if there are remaining micro-ops (bus micro-op mode only).
+    if (cpu8086_ucode_step(cpu))
+        return;
+
     // Skip if the prefetch queue is empty. (This is sort of like FC, I supppose.)
-    if (cpu->mt)
+    // Repeated string instructions don't need any more bytes from the queue.
+    if (cpu->mt && cpu->stage != CPU8086_REPEATING)
         return;
 
     if (cpu->stage == CPU8086_EXECUTING)
         cpu8086_reset_execution_regs(cpu);
 
     struct opcode* op;
-    if (cpu->opcode_byte != OPCODE_NONE)
+    if (cpu->fetched & FETCHED_OPCODE)
         op = &op_table[cpu->opcode_byte];
 
+    // Has a repeated string instruction run an element since it started?
+    bool rep_started = true;
+
 next_stage: // oh dear
     switch (cpu->stage)
     {
         // Prepare for reading a new instruction.
         case CPU8086_READY:
         {
+            // Maskable interrupts are taken between instructions, but never
+            // between a prefix and its opcode, or straight after STI.
+            if (cpu->intr && cpu8086_getflag(cpu, FLAG_INTENABLE) && !cpu->intr_shadow
+                && cpu->prefix_g1 == PREFIX_G1_NONE && cpu->prefix_g2 == PREFIX_G2_NONE)
+            {
+                cpu8086_intr_acknowledge(cpu);
+                return;
+            }
+            cpu->intr_shadow = false;
+
             uint8_t byte = cpu8086_prefetch_dequeue(cpu);
 
             // Prefix bytes take 2 cycles as they are just 1BL instructions.
@@ -1904,6 +3212,7 @@ next_stage: // oh dear
             {
                 case PREFIX_G1_LOCK: 
                 {
+                    cpu->prefix_ip = cpu->current_ip - 1;
                     // Currently doesn't do anything here, however it should 
                     // lock the bus after the 2nd cycle and is not unlocked
                     // until the first clock cycle of the next instruction.
@@ -1915,6 +3224,7 @@ next_stage: // oh dear
                 {
                     cpu->repeat = true;
                     cpu->prefix_g1 = byte;
+                    cpu->prefix_ip = cpu->current_ip - 1;
                     cpu->cycles = 1;
                     return;
                 }
@@ -1924,12 +3234,14 @@ next_stage: // oh dear
                 case PREFIX_G2_DS:
                 {
                     cpu->prefix_g2 = byte;
+                    cpu->prefix_ip = cpu->current_ip - 1;
                     cpu->cycles = 1;
                     return;
                 }
             }
 
             cpu->opcode_byte = byte;
+            cpu->fetched |= FETCHED_OPCODE;
             op = &op_table[cpu->opcode_byte];
             if (cpu->repeat && !op->is_string)
                 cpu->repeat = false;
@@ -1951,35 +3263,44 @@ next_stage: // oh dear
             if (cpu->mt)
                 return;
 
-            if (cpu->modrm_byte.value == MODRM_NONE)
+            if (!(cpu->fetched & FETCHED_MODRM))
+            {
                 cpu->modrm_byte.value = cpu8086_prefetch_dequeue(cpu);
+                cpu->fetched |= FETCHED_MODRM;
+            }
             
             bool is_disp16 = (cpu->modrm_byte.fields.mod == 0b00
                            && cpu->modrm_byte.fields.rm == 0b110)
                            || cpu->modrm_byte.fields.mod == MOD_DISP16;
             if ((cpu->modrm_byte.fields.mod == MOD_DISP8 || is_disp16)
-                && cpu->disp8_byte == DISP8_NONE)
+                && !(cpu->fetched & FETCHED_DISP8))
             {
                 if (cpu->mt)
                     return;
                 cpu->disp8_byte = cpu8086_prefetch_dequeue(cpu);
+                cpu->fetched |= FETCHED_DISP8;
             }
-            if (is_disp16 && cpu->disp16_byte == DISP16_NONE)
+            if (is_disp16 && !(cpu->fetched & FETCHED_DISP16))
             {
                 if (cpu->mt)
                     return;
                 cpu->disp16_byte = cpu8086_prefetch_dequeue(cpu);
+                cpu->fetched |= FETCHED_DISP16;
             }
 
+            // The 8086 only decodes the low 2 bits of the reg field when it
+            // names a segment register, so /4-/7 alias ES, CS, SS and DS.
             cpu->modrm_is_segreg = op->destination == LOC_SREG || op->source == LOC_SREG;
-            cpu->reg = op->is_word
-                ? (uintptr_t)cpu8086_reg_word(cpu, cpu->modrm_byte.fields.reg + 8 * cpu->modrm_is_segreg)
-                : (uintptr_t)cpu8086_reg_byte(cpu, cpu->modrm_byte.fields.reg);
+            cpu->reg = !op->is_word
+                ? cpu8086_reg_byte(cpu->modrm_byte.fields.reg)
+                : cpu->modrm_is_segreg
+                ? cpu8086_reg_word((unsigned)LOC_ES + (cpu->modrm_byte.fields.reg & 3))
+                : cpu8086_reg_word(cpu->modrm_byte.fields.reg);
             
             if (cpu->modrm_byte.fields.mod == MOD_REG)
                 cpu->rm = op->is_word
-                   ? (uintptr_t)cpu8086_reg_word(cpu, cpu->modrm_byte.fields.reg)
-                   : (uintptr_t)cpu8086_reg_byte(cpu, cpu->modrm_byte.fields.rm);
+                   ? cpu8086_reg_word(cpu->modrm_byte.fields.rm)
+                   : cpu8086_reg_byte(cpu->modrm_byte.fields.rm);
             else
             {
                 unsigned prefix = DS;
@@ -1988,39 +3309,33 @@ next_stage: // oh dear
                     case 0b000:
                     {
                         cpu->rm = (uint16_t)(cpu->bx + cpu->si);
-                        cpu->cycles += 7;
                         break;
                     }
                     case 0b001:
                     {
                         cpu->rm = (uint16_t)(cpu->bx + cpu->di);
-                        cpu->cycles += 8;
                         break;
                     }
                     case 0b010:
                     {
                         cpu->rm = (uint16_t)(cpu->bp + cpu->si);
                         prefix = SS;
-                        cpu->cycles += 8;
                         break;
                     }
                     case 0b011:
                     {
                         cpu->rm = (uint16_t)(cpu->bp + cpu->di);
                         prefix = SS;
-                        cpu->cycles += 7;
                         break;
                     }
                     case 0b100:
                     {
                         cpu->rm = cpu->si;
-                        cpu->cycles += 5;
                         break;
                     }
                     case 0b101:
                     {
                         cpu->rm = cpu->di;
-                        cpu->cycles += 5;
                         break;
                     }
                     case 0b110:
@@ -2029,42 +3344,40 @@ next_stage: // oh dear
                         {
                             cpu->rm = cpu->bp;
                             prefix = SS;
-                            cpu->cycles += 5;
                         }
                         else
-                        {
                             cpu->rm = (cpu->disp16_byte << 8) | cpu->disp8_byte;
-                            cpu->cycles += 6;
-                        }
                         break;
                     }
                     case 0b111:
                     {
                         cpu->rm = cpu->bx;
-                        cpu->cycles += 5;
                         break;
                     }
                 }
 
-                // This math should select between ES/CS/SS/DS.
-                // The 2 cycle penalty should already be acounted for.
-                if (cpu->prefix_g2 != PREFIX_G2_NONE)
-                    prefix = ES + (cpu->prefix_g2 - PREFIX_G2_ES) / 8;
+                // The EA routine runs before the instruction's own sequence.
+                // The 2 cycle penalty for a segment override should already
+                // be accounted for by the prefix.
+                bool direct = cpu->modrm_byte.fields.mod == 0b00 && cpu->modrm_byte.fields.rm == 0b110;
+                cpu8086_ucode(cpu, direct ? &ucode_ea_direct : &ucode_ea[cpu->modrm_byte.fields.rm]);
+                prefix = cpu8086_segment(cpu, prefix);
                 
                 if (cpu->modrm_byte.fields.mod == MOD_DISP16)
                 {
                     cpu->rm = (uint16_t)(cpu->rm + (int16_t)((cpu->disp16_byte << 8) | cpu->disp8_byte));
-                    cpu->cycles += 4;
+                    cpu8086_ucode(cpu, &ucode_ea_disp);
                 }
                 else if (cpu->modrm_byte.fields.mod == MOD_DISP8)
                 {
                     cpu->rm = (uint16_t)(cpu->rm + (int8_t)cpu->disp8_byte);
-                    cpu->cycles += 4;
+                    cpu8086_ucode(cpu, &ucode_ea_disp);
                 }
-                cpu->rm = ((*cpu8086_reg_word(cpu, prefix) << 4) + cpu->rm) & 0xFFFFF;
+                cpu->rm = (cpu->segment_base[prefix - ES] + cpu->rm) & 0xFFFFF;
             }
 
-            if (op->source == LOC_IMM || op->source == LOC_IMM8)
+            if (op->source == LOC_IMM || op->source == LOC_IMM8
+                || (op->source == LOC_IMM3 && cpu->modrm_byte.fields.reg < 2))
                 cpu->stage = CPU8086_FETCH_IMM;
             else if (op->destination == LOC_ADDR || op->source == LOC_ADDR || op->source == LOC_SEGOFF)
                 cpu->stage = CPU8086_FETCH_ADDRESS;
@@ -2076,14 +3389,15 @@ next_stage: // oh dear
         // Fetch the immediate byte(s).
         case CPU8086_FETCH_IMM:
         {
-            if (cpu->imm8_byte == IMM8_NONE)
+            if (!(cpu->fetched & FETCHED_IMM8))
             {
                 if (cpu->mt)
                     return;
                 cpu->imm8_byte = cpu8086_prefetch_dequeue(cpu);
+                cpu->fetched |= FETCHED_IMM8;
             }
 
-            if (op->is_word && cpu->imm16_byte == IMM16_NONE)
+            if (op->is_word && !(cpu->fetched & FETCHED_IMM16))
             {
                 // Opcode 0x83 works quite differently: despite it being a
                 // word instruction, the immediate value read is only 8-bit.
@@ -2096,10 +3410,11 @@ next_stage: // oh dear
                         return;
                     cpu->imm16_byte = cpu8086_prefetch_dequeue(cpu);
                 }
+                cpu->fetched |= FETCHED_IMM16;
             }
 
             cpu->immediate = op->is_word
-                           ? (cpu->imm16_byte << 8) | cpu->imm8_byte
+                           ? ((uint32_t)cpu->imm16_byte << 8) | cpu->imm8_byte
                            : cpu->imm8_byte;
             cpu->stage = CPU8086_DECODE_LOC;
             goto next_stage;
@@ -2108,41 +3423,47 @@ next_stage: // oh dear
         // Fetch an address. This will re-use the immediate variables.
         case CPU8086_FETCH_ADDRESS:
         {
-            if (cpu->imm8_byte == IMM8_NONE)
+            if (!(cpu->fetched & FETCHED_IMM8))
             {
                 if (cpu->mt)
                     return;
                 cpu->imm8_byte = cpu8086_prefetch_dequeue(cpu);
+                cpu->fetched |= FETCHED_IMM8;
             }
 
-            if (cpu->imm16_byte == IMM16_NONE)
+            if (!(cpu->fetched & FETCHED_IMM16))
             {
                 if (cpu->mt)
                     return;
                 cpu->imm16_byte = cpu8086_prefetch_dequeue(cpu);
+                cpu->fetched |= FETCHED_IMM16;
             }
 
             // This is used only for CALLFAR/JMPFAR (i.e. segment:offset).
             if (op->source == LOC_SEGOFF)
             {
-                if (cpu->lo_segment == LO_SEGMENT_NONE)
+                if (!(cpu->fetched & FETCHED_LO_SEGMENT))
                 {
                     if (cpu->mt)
                         return;
                     cpu->lo_segment = cpu8086_prefetch_dequeue(cpu);
+                    cpu->fetched |= FETCHED_LO_SEGMENT;
                 }
-                if (cpu->hi_segment == HI_SEGMENT_NONE)
+                if (!(cpu->fetched & FETCHED_HI_SEGMENT))
                 {
                     if (cpu->mt)
                         return;
                     cpu->hi_segment = cpu8086_prefetch_dequeue(cpu);
+                    cpu->fetched |= FETCHED_HI_SEGMENT;
                 }
             }
 
+            // The offset comes first, in the low word, and the segment
+            // after it, as in memory.
             cpu->immediate = (op->source == LOC_SEGOFF)
-                           ? (cpu->imm16_byte << 24) | (cpu->imm8_byte << 16)
-                           | (cpu->hi_segment << 8) | cpu->lo_segment
-                           : (cpu->imm16_byte << 8) | cpu->imm8_byte;
+                           ? ((uint32_t)cpu->hi_segment << 24) | ((uint32_t)cpu->lo_segment << 16)
+                           | ((uint32_t)cpu->imm16_byte << 8) | cpu->imm8_byte
+                           : ((uint32_t)cpu->imm16_byte << 8) | cpu->imm8_byte;
 
             cpu->stage = CPU8086_DECODE_LOC;
             goto next_stage;
@@ -2162,49 +3483,151 @@ next_stage: // oh dear
         {
             assert(op->func);
 
-            if (cpu->repeat)
-                cpu->cycles += 9;
-
-exec_op:
             if (cpu->repeat)
             {
-                // No interrupt checks are carried out here (see the manual) because
-                // the string instructions are repeated all in one go and aren't
-                // cycle-accurate, so there's no point constantly checking for
-                // interrupts, especially if this is singlethreaded anyway.
-
-                if (cpu->cx == 0)
-                    return;
-                cpu->cx--;
+                cpu8086_ucode(cpu, &ucode_rep);
+                cpu->stage = CPU8086_REPEATING;
+                rep_started = false;
+                goto next_stage;
             }
 
             op->func(op, cpu);
+            if (op->is_string)
+                cpu8086_string_advance(cpu, op);
+
+            // For simplicity's sake, I decided to just copy the cycles count of
+            // each instruction for all sets of possible operands to each 
+            // instruction. However, this clock cycle would also be included, so 
+            // 1 must be subtracted.
+            if (cpu->cycles > 0)
+                cpu->cycles -= 1;
+            else
+                cpu8086_ucode_step(cpu);
+            return;
+        }
 
-            if (cpu->repeat)
+        // Execute the string opcode once per element.
+        case CPU8086_REPEATING:
+        {
+            if (cpu->cx == 0)
+            {
+                cpu->stage = CPU8086_EXECUTING;
+                return;
+            }
+
+            // Interrupts are checked for between chunks, once at least one
+            // element has run, so that an instruction straight after STI gets
+            // that far. Like the real thing, the return address is the last
+            // prefix rather than the first, so an instruction with several
+            // prefixes resumes without the others.
+            if (rep_started && cpu->intr && cpu8086_getflag(cpu, FLAG_INTENABLE) && !cpu->intr_shadow)
+            {
+                cpu->current_ip = cpu->prefix_ip;
+                cpu8086_intr_acknowledge(cpu);
+                cpu->stage = CPU8086_EXECUTING;
+                return;
+            }
+
+            // String instructions on plain RAM are done in bulk where possible.
+            if (cpu->bus_uops || !cpu8086_rep_bulk(cpu, op))
             {
-                static const int delta_table[2][2] = { { 1, -1 }, { 2, -2 } };
-                int delta = delta_table[op->is_word][cpu8086_getflag(cpu, FLAG_DIRECTION)];
-                cpu->si += delta;
-                cpu->di += delta;
+                cpu->cx--;
 
-                // TODO: check for CMPS/SCAS
-                // const bool z = (cpu->prefix_g1 == PREFIX_G1_REPZ) ? true : false;
+                // SI/DI have moved on since the last element.
+                loc_set(cpu, &cpu->destination, op->destination);
+                loc_set(cpu, &cpu->source, op->source);
+                op->func(op, cpu);
+                cpu8086_string_advance(cpu, op);
+            }
+            rep_started = true;
 
-                goto exec_op; 
+            // CMPS and SCAS also stop once ZF no longer matches the prefix.
+            if ((cpu->opcode_byte & 0xF6) == 0xA6
+                && cpu8086_getflag(cpu, FLAG_ZERO) != (cpu->prefix_g1 == PREFIX_G1_REPZ))
+            {
+                cpu->stage = CPU8086_EXECUTING;
+                return;
             }
 
-            cpu->cycles -= 1;   // For simplicity's sake, I decided to just copy the
-                                // cycles count of each instruction for all sets of
-                                // possible operands to each instruction. However,
-                                // this clock cycle would also be included, so 1 must
-                                // be subtracted.
+            // In bus micro-op mode, each element's micro-ops must run before the
+            // next element is started. Otherwise, carry on until this chunk has
+            // used up its quantum, which includes this clock cycle.
+            if (!cpu->bus_uops
+                && (cpu->rep_quantum == 0 || cpu->cycles < cpu->rep_quantum))
+                goto next_stage;
+            if (cpu->cycles > 0)
+                cpu->cycles -= 1;
             return;
         }
     }
 }
 
+// Switch the byte ALU tables on or off. They are shared by every CPU, and
+// as they take up about 3.2MB, they only exist while something uses them.
+void cpu8086_set_alu_tables(struct cpu8086* cpu, bool enable)
+{
+    if (cpu->alu_tables == enable)
+        return;
+    cpu->alu_tables = enable;
+
+    // Only ever held while switching, so spinning is fine.
+    while (atomic_flag_test_and_set_explicit(&alu_table_lock, memory_order_acquire))
+        ;
+    if (enable && alu_table_users++ == 0)
+    {
+        alu_arena = arena_new(ALU_TABLE_SIZE * sizeof(struct alu_entry), true);
+        alu_table = arena_alloc(alu_arena, ALU_TABLE_SIZE * sizeof(struct alu_entry));
+        cpu8086_alu_build();
+    }
+    else if (!enable && --alu_table_users == 0)
+    {
+        arena_free(alu_arena);
+        alu_arena = NULL;
+        alu_table = NULL;
+    }
+    atomic_flag_clear_explicit(&alu_table_lock, memory_order_release);
+}
+
+// Switch bus micro-op mode on or off: whether the bus cycles of EU memory
+// operands contend with prefetches (see cpu8086_ucode.h). Micro-ops still
+// queued when it is switched off are folded into the cycle countdown.
+void cpu8086_set_bus_uops(struct cpu8086* cpu, bool enable)
+{
+    assert(cpu);
+    if (!enable)
+    {
+        // The current micro-op has uop_t cycles left, if it has started.
+        for (uint8_t i = cpu->uop_r; i < cpu->uop_w; i++)
+        {
+            uint8_t uop = cpu->uops[i];
+            if (i == cpu->uop_r && cpu->uop_t)
+                cpu->cycles += cpu->uop_t;
+            else
+                cpu->cycles += (UOP_KIND(uop) == UOP_IDLE) ? UOP_ARG(uop) : UOP_BUS_CYCLES;
+        }
+        cpu->uop_r = cpu->uop_w = cpu->uop_t = 0;
+        cpu->eu_bus = false;
+    }
+    cpu->bus_uops = enable;
+}
+
+// Re-attach a CPU state that was copied byte for byte (see bus_clone) to its
+// new bus.
+void cpu8086_rebind(struct cpu8086* cpu, struct bus* bus)
+{
+    assert(cpu && bus);
+    cpu->bus = bus;
+
+    // The copy shares the ALU tables as well, so it needs its own reference.
+    bool alu_tables = cpu->alu_tables;
+    cpu->alu_tables = false;
+    cpu8086_set_alu_tables(cpu, alu_tables);
+}
+
+// The CPU itself lives in its bus's arena, so this only releases what it
+// holds onto.
 void cpu8086_free(struct cpu8086* cpu)
 {
     assert(cpu);
-    free(cpu);
+    cpu8086_set_alu_tables(cpu, false);
 }
\ No newline at end of file
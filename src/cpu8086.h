@@ -7,6 +7,7 @@
 #include <stdbool.h>
 
 #include "bus.h"
+#include "cpu8086_ucode.h"
 
 // The following registers are valid for ModRM.
 #define AX              0b000
@@ -55,14 +56,19 @@
 #define PREFIX_G2_SS    0x36
 #define PREFIX_G2_DS    0x3E
 
-#define OPCODE_NONE     0xFFFF
-#define MODRM_NONE      0xFFFF
-#define DISP8_NONE      0xFFFF
-#define DISP16_NONE     0xFFFF
-#define IMM8_NONE       0xFFFF
-#define IMM16_NONE      0xFFFF
-#define LO_SEGMENT_NONE 0xFFFF
-#define HI_SEGMENT_NONE 0xFFFF
+// Instruction bytes fetched so far (see cpu8086.fetched).
+#define FETCHED_OPCODE      (1 << 0)
+#define FETCHED_MODRM       (1 << 1)
+#define FETCHED_DISP8       (1 << 2)
+#define FETCHED_DISP16      (1 << 3)
+#define FETCHED_IMM8        (1 << 4)
+#define FETCHED_IMM16       (1 << 5)
+#define FETCHED_LO_SEGMENT  (1 << 6)
+#define FETCHED_HI_SEGMENT  (1 << 7)
+
+// Default number of cycles a repeated string instruction may run for before
+// it checks for interrupts again (see rep_quantum).
+#define CPU8086_REP_QUANTUM 1024
 
 enum cpu8086_stage
 {
@@ -71,7 +77,8 @@ enum cpu8086_stage
     CPU8086_FETCH_IMM,
     CPU8086_FETCH_ADDRESS,
     CPU8086_DECODE_LOC,
-    CPU8086_EXECUTING
+    CPU8086_EXECUTING,
+    CPU8086_REPEATING
 };
 
 enum location_type
@@ -85,76 +92,141 @@ enum location_type
     DECODED_STRING
 };
 
+// A decoded operand. For register operands, address is a byte offset into
+// the register file (cpu8086.regs8); for immediates, a byte offset into the
+// calculated immediate; otherwise it is a linear memory address. The width
+// comes from the opcode.
 struct location
 {
     enum location_type type;
-    uintptr_t address;
-    bool virtual;
+    uint32_t address;
 };
 
+// The state is laid out hot-first: everything an ordinary instruction
+// touches (registers, segment bases, flags, cycle counter and the decoded
+// instruction) sits in the first two 64-byte cache lines, ahead of the
+// micro-op queue and the configuration that is only read occasionally.
 struct cpu8086
 {
     struct bus* bus;
 
-    // General purpose register - accumulator.
+    // Register file, in the same order as the reg field of the ModR/M byte
+    // (followed by the segment registers) so that decoded operands can refer
+    // to registers by index (see struct location).
     union
     {
         struct
         {
-            uint8_t al;
-            uint8_t ah;
-        };
-        uint16_t ax;
-    };
+            // General purpose register - accumulator.
+            union
+            {
+                struct
+                {
+                    uint8_t al;
+                    uint8_t ah;
+                };
+                uint16_t ax;
+            };
 
-    // General purpose register - count register.
-    union
-    {
-        struct
-        {
-            uint8_t cl;
-            uint8_t ch;
+            // General purpose register - count register.
+            union
+            {
+                struct
+                {
+                    uint8_t cl;
+                    uint8_t ch;
+                };
+                uint16_t cx;
+            };
+
+            // General purpose register - data register.
+            union
+            {
+                struct
+                {
+                    uint8_t dl;
+                    uint8_t dh;
+                };
+                uint16_t dx;
+            };
+
+            // General purpose register - base register.
+            union
+            {
+                struct
+                {
+                    uint8_t bl;
+                    uint8_t bh;
+                };
+                uint16_t bx;
+            };
+
+            // Offset registers.
+            uint16_t sp;            // Stack pointer.
+            uint16_t bp;            // Base pointer.
+            uint16_t si;            // Source index.
+            uint16_t di;            // Destination index.
+
+            // Segment registers.
+            uint16_t es;            // Extra segment.
+            uint16_t cs;            // Code segment.
+            uint16_t ss;            // Stack segment.
+            uint16_t ds;            // Data segment.
         };
-        uint16_t cx;
+        uint16_t regs[REGISTER_COUNT];
+        uint8_t regs8[REGISTER_COUNT * 2];
     };
 
-    // General purpose register - data register.
+    // Linear (20-bit) bases of the segment registers, i.e. segment << 4.
+    // These are refreshed whenever a segment register is written, so
+    // address generation never has to shift the segment again.
     union
     {
         struct
         {
-            uint8_t dl;
-            uint8_t dh;
+            uint32_t es_base;
+            uint32_t cs_base;
+            uint32_t ss_base;
+            uint32_t ds_base;
         };
-        uint16_t dx;
+        uint32_t segment_base[4];
     };
 
-    // General purpose register - base register.
+    // Status register, unpacked into one byte (0 or 1) per flag so that ALU
+    // operations don't have to read-modify-write a packed word for every
+    // flag. The arithmetic flags come first, so they can be copied as a
+    // block. Use cpu8086_get_flags()/cpu8086_set_flags() for the FLAGS
+    // layout.
     union
     {
         struct
         {
-            uint8_t bl;
-            uint8_t bh;
+            uint8_t cf;             // Carry.
+            uint8_t pf;             // Parity.
+            uint8_t af;             // Auxiliary carry.
+            uint8_t zf;             // Zero.
+            uint8_t sf;             // Sign.
+            uint8_t of;             // Overflow.
+            uint8_t tf;             // Trap.
+            uint8_t ief;            // Interrupt enable.
+            uint8_t df;             // Direction.
         };
-        uint16_t bx;
+        uint8_t flag[9];
     };
-    
-    // Offset registers.
-    uint16_t sp;                    // Stack pointer.
-    uint16_t bp;                    // Base pointer.
-    uint16_t si;                    // Source index. 
-    uint16_t di;                    // Destination index.
-
-    // Segment registers.
-    uint16_t es;                    // Extra segment.
-    uint16_t cs;                    // Code segment.
-    uint16_t ss;                    // Stack segment.
-    uint16_t ds;                    // Data segment.
-    
+
     // Other registers.
     uint16_t ip;                    // Instruction pointer.
-    uint16_t flags;                 // Status register.
+
+    // Emulation execution variables.
+    uint16_t current_ip;            // The current instruction pointer, irrespective of the prefetch queue.
+    uint16_t prefix_ip;             // Where the last prefix byte was, for resuming an interrupted string instruction.
+    unsigned cycles;                // How many cycles must the CPU pause for?
+    enum cpu8086_stage stage;       // Current stage of instruction byte fetching.
+    struct location destination;    // Destination of the opcode.
+    struct location source;         // Source of the opcode.
+    uint32_t immediate;             // Calculated immediate.
+    uint32_t rm;                    // Calculated rm during ModRM stage.
+    uint32_t reg;                   // Calculated reg during ModRM stage.
 
     // Prefetch (instruction) queue bus.
     uint16_t q[3];                  // Q0-Q2.
@@ -162,25 +234,12 @@ struct cpu8086
     uint8_t q_w             : 2;    // Used for writing the next word onto the queue.
     uint8_t hl              : 1;    // 0 - lo-byte of word; 1 - hi-byte of word
     uint8_t mt              : 1;    // Is the queue empty?
-
-    // Emulation execution variables.
-    bool repeat;                    // Is this a string instruction that repeats?
-    uint16_t current_ip;            // The current instruction pointer, irrespective of the prefetch queue.
-    uint8_t cycles;                 // How many cycles must the CPU pause for?
     uint8_t biu_prefetch_cycles;    // How many cycles remaining until the prefetch finishes?
-    uint8_t prefix_g1;              // Group 1 prefix (if any).
-    uint8_t prefix_g2;              // Group 2 prefix (if any).
-    uint16_t opcode_byte;           // The actual byte for the opcode itself (this may also be an extension byte).
-    uint16_t disp8_byte;            // Disp8 byte.
-    uint16_t disp16_byte;           // Disp16 byte.
-    uint16_t imm8_byte;             // Imm8 byte or lo segment byte.
-    uint16_t imm16_byte;            // Imm16 byte or hi segment byte.
-    uint16_t lo_segment;            // Lo segment byte.
-    uint16_t hi_segment;            // Hi segment byte.
-    uint32_t immediate;             // Calculated immediate.
-    uintptr_t rm;                   // Calculated rm during ModRM stage.
-    uintptr_t reg;                  // Calculated reg during ModRM stage.
-    enum cpu8086_stage stage;       // Current stage of instruction byte fetching.
+
+    // Decode scratch. Which of these bytes are valid is tracked in fetched
+    // (FETCHED_*), which is cleared before every instruction.
+    uint8_t fetched;                // Instruction bytes fetched so far.
+    uint8_t opcode_byte;            // The actual byte for the opcode itself.
     union
     {
         struct
@@ -188,19 +247,55 @@ struct cpu8086
             uint8_t rm      : 3;
             uint8_t reg     : 3;
             uint8_t mod     : 2;
-            uint8_t padding;
         } fields;
-        uint16_t value;
+        uint8_t value;
     } modrm_byte;                   // ModRM byte.
-    struct location destination;    // Destination of the opcode.
-    struct location source;         // Source of the opcode.
+    uint8_t disp8_byte;             // Disp8 byte.
+    uint8_t disp16_byte;            // Disp16 byte.
+    uint8_t imm8_byte;              // Imm8 byte or lo segment byte.
+    uint8_t imm16_byte;             // Imm16 byte or hi segment byte.
+    uint8_t lo_segment;             // Lo segment byte.
+    uint8_t hi_segment;             // Hi segment byte.
+    uint8_t prefix_g1;              // Group 1 prefix (if any).
+    uint8_t prefix_g2;              // Group 2 prefix (if any).
+    bool repeat;                    // Is this a string instruction that repeats?
     bool modrm_is_segreg;           // Does the ModRM byte use segreg?
 
+    // Bus micro-op mode (see cpu8086_ucode.h and cpu8086_set_bus_uops).
+    bool bus_uops;                  // Arbitrate EU memory bus cycles against the BIU's prefetches?
+    bool eu_bus;                    // Is the EU requesting or holding the bus?
+    uint8_t uop_r;                  // Index of the current micro-op.
+    uint8_t uop_w;                  // Index past the last queued micro-op.
+    uint8_t uop_t;                  // Cycles remaining for the current micro-op.
+
+    // Everything below is cold.
+    uint8_t uops[UOP_QUEUE_SIZE];   // Micro-ops queued by the current instruction.
+
+    // Byte ALU operations can be looked up from precomputed tables instead
+    // (see cpu8086_set_alu_tables).
+    bool alu_tables;
+
+    // Repeated string instructions run in chunks of at most this many cycles
+    // (0 for no limit), checking for interrupts in between. The caller can
+    // lower it before clocking to meet a deadline, e.g. the next timer tick.
+    unsigned rep_quantum;
+
     // 8086 pins.
     bool test               : 1;    // Used with WAIT.
+    bool intr               : 1;    // Maskable interrupt request; cleared once acknowledged.
+    uint8_t intr_vector;            // Vector returned by the interrupt acknowledge cycle.
+
+    // Was the last instruction STI? Interrupts wait for the one after it.
+    bool intr_shadow;
 };
 
 struct cpu8086* cpu8086_new(struct bus* bus);
 void cpu8086_reset(struct cpu8086* cpu);
 void cpu8086_clock(struct cpu8086* cpu);
+void cpu8086_update_segments(struct cpu8086* cpu);
+void cpu8086_set_alu_tables(struct cpu8086* cpu, bool enable);
+void cpu8086_set_bus_uops(struct cpu8086* cpu, bool enable);
+uint16_t cpu8086_get_flags(struct cpu8086* cpu);
+void cpu8086_set_flags(struct cpu8086* cpu, uint16_t flags);
+void cpu8086_rebind(struct cpu8086* cpu, struct bus* bus);
 void cpu8086_free(struct cpu8086* cpu);
\ No newline at end of file
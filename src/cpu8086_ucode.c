@@ -0,0 +1,128 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// The totals are the documented instruction timings (excluding EA and
+// odd-address penalties). Within each one, operands are read up front and
+// results written back last; this is an approximation, not the microcode's
+// own placement. Forms without a memory operand never use the bus, so they
+// are a single run of internal cycles.
+
+#include "cpu8086_ucode.h"
+
+// Effective address calculation.
+const struct ucode ucode_ea[8]              =
+{
+    UCODE(7,  U_IDLE(7)),                   // [BX+SI]
+    UCODE(8,  U_IDLE(8)),                   // [BX+DI]
+    UCODE(8,  U_IDLE(8)),                   // [BP+SI]
+    UCODE(7,  U_IDLE(7)),                   // [BP+DI]
+    UCODE(5,  U_IDLE(5)),                   // [SI]
+    UCODE(5,  U_IDLE(5)),                   // [DI]
+    UCODE(5,  U_IDLE(5)),                   // [BP]
+    UCODE(5,  U_IDLE(5)),                   // [BX]
+};
+const struct ucode ucode_ea_direct          = UCODE(6,  U_IDLE(6));
+const struct ucode ucode_ea_disp            = UCODE(4,  U_IDLE(4));
+
+// ALU.
+const struct ucode ucode_alu_reg_reg        = UCODE(3,  U_IDLE(3));
+const struct ucode ucode_alu_reg_imm        = UCODE(4,  U_IDLE(4));
+const struct ucode ucode_test_reg_imm       = UCODE(5,  U_IDLE(5));
+const struct ucode ucode_incdec_reg8        = UCODE(3,  U_IDLE(3));
+const struct ucode ucode_incdec_reg16       = UCODE(2,  U_IDLE(2));
+const struct ucode ucode_shift_reg          = UCODE(2,  U_IDLE(2));
+const struct ucode ucode_shift_reg_cl       = UCODE(8,  U_IDLE(8));
+const struct ucode ucode_alu_reg_mem        = UCODE(9,  U_READ, U_IDLE(5));
+const struct ucode ucode_alu_mem_reg        = UCODE(16, U_READ, U_IDLE(8), U_WRITE);
+const struct ucode ucode_alu_mem_imm        = UCODE(17, U_READ, U_IDLE(9), U_WRITE);
+const struct ucode ucode_cmp_mem_imm        = UCODE(10, U_READ, U_IDLE(6));
+const struct ucode ucode_test_mem_imm       = UCODE(11, U_READ, U_IDLE(7));
+const struct ucode ucode_incdec_mem         = UCODE(15, U_READ, U_IDLE(7), U_WRITE);
+const struct ucode ucode_shift_mem          = UCODE(15, U_READ, U_IDLE(7), U_WRITE);
+const struct ucode ucode_shift_mem_cl       = UCODE(20, U_READ, U_IDLE(12), U_WRITE);
+const struct ucode ucode_muldiv_mem         = UCODE(6,  U_READ, U_IDLE(2));
+
+// Data transfer.
+const struct ucode ucode_mov_reg_reg        = UCODE(2,  U_IDLE(2));
+const struct ucode ucode_mov_reg_imm        = UCODE(4,  U_IDLE(4));
+const struct ucode ucode_xchg_acc_reg       = UCODE(3,  U_IDLE(3));
+const struct ucode ucode_xchg_reg_reg       = UCODE(4,  U_IDLE(4));
+const struct ucode ucode_mov_acc_mem        = UCODE(10, U_READ, U_IDLE(6));
+const struct ucode ucode_mov_mem_acc        = UCODE(10, U_IDLE(6), U_WRITE);
+const struct ucode ucode_mov_reg_mem        = UCODE(8,  U_READ, U_IDLE(4));
+const struct ucode ucode_mov_mem_reg        = UCODE(9,  U_IDLE(5), U_WRITE);
+const struct ucode ucode_mov_mem_imm        = UCODE(10, U_IDLE(6), U_WRITE);
+const struct ucode ucode_xchg_mem_reg       = UCODE(17, U_READ, U_IDLE(9), U_WRITE);
+const struct ucode ucode_lds                = UCODE(16, U_READ, U_READ, U_IDLE(8));
+const struct ucode ucode_in_imm             = UCODE(10, U_IDLE(6), U_READ);
+const struct ucode ucode_in_dx              = UCODE(8,  U_IDLE(4), U_READ);
+const struct ucode ucode_out_imm            = UCODE(10, U_IDLE(6), U_WRITE);
+const struct ucode ucode_out_dx             = UCODE(8,  U_IDLE(4), U_WRITE);
+
+// Accumulator and flags.
+const struct ucode ucode_cbw                = UCODE(2,  U_IDLE(2));
+const struct ucode ucode_cwd                = UCODE(5,  U_IDLE(5));
+const struct ucode ucode_decimal            = UCODE(4,  U_IDLE(4));
+const struct ucode ucode_lahf               = UCODE(4,  U_IDLE(4));
+const struct ucode ucode_flag               = UCODE(2,  U_IDLE(2));
+const struct ucode ucode_lea                = UCODE(2,  U_IDLE(2));
+const struct ucode ucode_wait               = UCODE(3,  U_IDLE(3));
+
+// Strings.
+const struct ucode ucode_rep                = UCODE(9,  U_IDLE(9));
+const struct ucode ucode_movs               = UCODE(18, U_READ, U_IDLE(10), U_WRITE);
+const struct ucode ucode_rep_movs           = UCODE(17, U_READ, U_IDLE(9), U_WRITE);
+const struct ucode ucode_stos               = UCODE(11, U_IDLE(7), U_WRITE);
+const struct ucode ucode_rep_stos           = UCODE(10, U_IDLE(6), U_WRITE);
+const struct ucode ucode_lods               = UCODE(12, U_READ, U_IDLE(8));
+const struct ucode ucode_rep_lods           = UCODE(13, U_READ, U_IDLE(9));
+const struct ucode ucode_cmps               = UCODE(22, U_READ, U_READ, U_IDLE(14));
+const struct ucode ucode_scas               = UCODE(15, U_READ, U_IDLE(11));
+
+// Stack and control transfer.
+const struct ucode ucode_push_reg           = UCODE(11, U_IDLE(7), U_WRITE);
+const struct ucode ucode_push_seg           = UCODE(10, U_IDLE(6), U_WRITE);
+const struct ucode ucode_push_mem           = UCODE(16, U_READ, U_IDLE(8), U_WRITE);
+const struct ucode ucode_pop_reg            = UCODE(8,  U_READ, U_IDLE(4));
+const struct ucode ucode_pop_mem            = UCODE(17, U_READ, U_IDLE(9), U_WRITE);
+const struct ucode ucode_callfar            = UCODE(28, U_IDLE(16), U_WRITE, U_IDLE(4), U_WRITE);
+const struct ucode ucode_retnear            = UCODE(8,  U_READ, U_IDLE(4));
+const struct ucode ucode_retnear_imm        = UCODE(12, U_READ, U_IDLE(8));
+const struct ucode ucode_retfar             = UCODE(18, U_READ, U_READ, U_IDLE(10));
+const struct ucode ucode_retfar_imm         = UCODE(17, U_READ, U_READ, U_IDLE(9));
+const struct ucode ucode_iret               = UCODE(24, U_READ, U_READ, U_READ, U_IDLE(12));
+const struct ucode ucode_interrupt          = UCODE(51, U_READ, U_READ, U_IDLE(31), U_WRITE, U_WRITE, U_WRITE);
+
+static const struct ucode* ucode_all[] =
+{
+    &ucode_ea[0], &ucode_ea[1], &ucode_ea[2], &ucode_ea[3],
+    &ucode_ea[4], &ucode_ea[5], &ucode_ea[6], &ucode_ea[7],
+    &ucode_ea_direct, &ucode_ea_disp, &ucode_alu_reg_reg, &ucode_alu_reg_imm,
+    &ucode_test_reg_imm, &ucode_incdec_reg8, &ucode_incdec_reg16, &ucode_shift_reg,
+    &ucode_shift_reg_cl, &ucode_mov_reg_reg, &ucode_mov_reg_imm, &ucode_xchg_acc_reg,
+    &ucode_xchg_reg_reg, &ucode_cbw, &ucode_cwd, &ucode_decimal,
+    &ucode_lahf, &ucode_flag, &ucode_lea, &ucode_wait, &ucode_rep,
+    &ucode_alu_reg_mem, &ucode_alu_mem_reg, &ucode_alu_mem_imm, &ucode_cmp_mem_imm,
+    &ucode_test_mem_imm, &ucode_incdec_mem, &ucode_shift_mem, &ucode_shift_mem_cl,
+    &ucode_muldiv_mem, &ucode_mov_acc_mem, &ucode_mov_mem_acc, &ucode_mov_reg_mem,
+    &ucode_mov_mem_reg, &ucode_mov_mem_imm, &ucode_xchg_mem_reg, &ucode_lds,
+    &ucode_in_imm, &ucode_in_dx, &ucode_out_imm, &ucode_out_dx,
+    &ucode_movs, &ucode_rep_movs, &ucode_stos, &ucode_rep_stos, 
+    &ucode_lods, &ucode_rep_lods, &ucode_cmps, &ucode_scas,
+    &ucode_push_reg, &ucode_push_seg, &ucode_push_mem, &ucode_pop_reg, 
+    &ucode_pop_mem, &ucode_callfar, &ucode_retnear, &ucode_retnear_imm, 
+    &ucode_retfar, &ucode_retfar_imm, &ucode_iret, &ucode_interrupt
+};
+
+bool ucode_validate(void)
+{
+    for (unsigned i = 0; i < sizeof(ucode_all) / sizeof(*ucode_all); i++)
+    {
+        unsigned total = 0;
+        for (const uint8_t* uop = ucode_all[i]->uops; *uop != UOP_END; uop++)
+            total += (UOP_KIND(*uop) == UOP_IDLE) ? UOP_ARG(*uop) : UOP_BUS_CYCLES;
+        if (total != ucode_all[i]->cycles)
+            return false;
+    }
+    return true;
+}
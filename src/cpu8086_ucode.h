@@ -0,0 +1,141 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Instruction timings, with the bus cycles of EU memory operands placed
+// within them (see cpu8086_set_bus_uops).
+//
+// Each form's total is its documented timing, which is all the cycle
+// countdown uses. Forms that touch memory (operands, the stack, I/O) split
+// their total into a UOP_READ or UOP_WRITE micro-op per bus cycle and
+// UOP_IDLE runs for the internal cycles around them: reads come as early
+// and writes as late as the form allows. An instruction queues the EA
+// routine for its memory operand, if any, then its form; the per-bit loops
+// of shifts and MUL/DIV and taken branches add idle cycles.
+//
+// In bus micro-op mode, the only thing this adds over the countdown is
+// arbitration: an EU bus cycle waits for the prefetch in progress to finish,
+// and prefetches wait while the EU holds the bus. Register-only forms are a
+// single idle run and take the same time in both modes. Neither mode is
+// cycle-exact. The splits are not derived from Intel's microcode or checked
+// against bus traces, so where a read or write really falls within an
+// instruction is only approximated.
+//
+// Instruction bytes are taken from the prefetch queue by the decode stages
+// before a sequence starts, in both modes, so a starved queue delays an
+// instruction rather than stalling it midway.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Micro-op encoding: the top 2 bits select the kind, the bottom 6 bits are 
+// the argument (the number of cycles for UOP_IDLE).
+#define UOP_END             0x00
+#define UOP_IDLE            0x40
+#define UOP_READ            0x80
+#define UOP_WRITE           0xC0
+
+#define UOP_KIND(uop)       ((uop) & 0xC0)
+#define UOP_ARG(uop)        ((uop) & 0x3F)
+#define UOP_MAX_IDLE        0x3F
+
+#define U_IDLE(n)           (UOP_IDLE | (n))
+#define U_READ              UOP_READ
+#define U_WRITE             UOP_WRITE
+
+// T1-T4, without any wait states.
+#define UOP_BUS_CYCLES      4
+
+// Enough for the longest instruction, plus odd-address bus cycles and 
+// data-dependent idle cycles (a shift of a memory operand by 255 needs 21).
+#define UOP_QUEUE_SIZE      32
+
+struct ucode
+{
+    uint8_t cycles;                 // Total cycles without bus contention.
+    uint8_t uops[7];                // Micro-ops, terminated by UOP_END.
+};
+
+#define UCODE(total, ...)   { total, { __VA_ARGS__, UOP_END } }
+
+// Each bit a shift or rotate by CL moves takes this many cycles.
+#define UCODE_SHIFT_BIT_CYCLES 4
+
+// Effective address calculation, by r/m ([BP] for 0b110), for a direct
+// address, and for adding a displacement.
+extern const struct ucode ucode_ea[8];
+extern const struct ucode ucode_ea_direct;
+extern const struct ucode ucode_ea_disp;
+
+// ALU (ADD/ADC/SUB/SBB/AND/OR/XOR, INC/DEC, NEG/NOT, shifts).
+extern const struct ucode ucode_alu_reg_reg;
+extern const struct ucode ucode_alu_reg_imm;
+extern const struct ucode ucode_test_reg_imm;
+extern const struct ucode ucode_incdec_reg8;
+extern const struct ucode ucode_incdec_reg16;
+extern const struct ucode ucode_shift_reg;
+extern const struct ucode ucode_shift_reg_cl;
+extern const struct ucode ucode_alu_reg_mem;
+extern const struct ucode ucode_alu_mem_reg;
+extern const struct ucode ucode_alu_mem_imm;
+extern const struct ucode ucode_cmp_mem_imm;
+extern const struct ucode ucode_test_mem_imm;
+extern const struct ucode ucode_incdec_mem;
+extern const struct ucode ucode_shift_mem;
+extern const struct ucode ucode_shift_mem_cl;
+extern const struct ucode ucode_muldiv_mem;
+
+// Data transfer.
+extern const struct ucode ucode_mov_reg_reg;
+extern const struct ucode ucode_mov_reg_imm;
+extern const struct ucode ucode_xchg_acc_reg;
+extern const struct ucode ucode_xchg_reg_reg;
+extern const struct ucode ucode_mov_acc_mem;
+extern const struct ucode ucode_mov_mem_acc;
+extern const struct ucode ucode_mov_reg_mem;
+extern const struct ucode ucode_mov_mem_reg;
+extern const struct ucode ucode_mov_mem_imm;
+extern const struct ucode ucode_xchg_mem_reg;
+extern const struct ucode ucode_lds;
+extern const struct ucode ucode_in_imm;
+extern const struct ucode ucode_in_dx;
+extern const struct ucode ucode_out_imm;
+extern const struct ucode ucode_out_dx;
+
+// Accumulator and flags.
+extern const struct ucode ucode_cbw;
+extern const struct ucode ucode_cwd;
+extern const struct ucode ucode_decimal;
+extern const struct ucode ucode_lahf;
+extern const struct ucode ucode_flag;
+extern const struct ucode ucode_lea;
+extern const struct ucode ucode_wait;
+
+// Strings.
+extern const struct ucode ucode_rep;
+extern const struct ucode ucode_movs;
+extern const struct ucode ucode_rep_movs;
+extern const struct ucode ucode_stos;
+extern const struct ucode ucode_rep_stos;
+extern const struct ucode ucode_lods;
+extern const struct ucode ucode_rep_lods;
+extern const struct ucode ucode_cmps;
+extern const struct ucode ucode_scas;
+
+// Stack and control transfer.
+extern const struct ucode ucode_push_reg;
+extern const struct ucode ucode_push_seg;
+extern const struct ucode ucode_push_mem;
+extern const struct ucode ucode_pop_reg;
+extern const struct ucode ucode_pop_mem;
+extern const struct ucode ucode_callfar;
+extern const struct ucode ucode_retnear;
+extern const struct ucode ucode_retnear_imm;
+extern const struct ucode ucode_retfar;
+extern const struct ucode ucode_retfar_imm;
+extern const struct ucode ucode_iret;
+extern const struct ucode ucode_interrupt;
+
+// Check that every sequence adds up to its total (see tests/cpu_ucode.c).
+bool ucode_validate(void);
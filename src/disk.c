@@ -0,0 +1,409 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+#include "disk.h"
+#include "util.h"
+
+// Overlay file header, little-endian, followed by the block map (a uint32_t
+// per block) and then, from the next DISK_BLOCK boundary, the stored blocks.
+#define DISK_OVERLAY_MAGIC      "FLEXCOW"
+#define DISK_OVERLAY_HEADER     32
+
+struct disk_overlay
+{
+    FILE* file;
+    uint32_t blocks;                // Blocks in the base.
+    uint32_t stored;                // Blocks in the file.
+    uint32_t* map;                  // Place + 1 of each block in the file, or 0 if unchanged.
+    uint64_t data;                  // Offset of the first stored block.
+};
+
+struct disk
+{
+    const uint8_t* data;            // The whole image, mapped read-only (the base's, for an overlay).
+    size_t size;
+    struct disk_overlay* overlay;   // NULL unless this is an overlay.
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+static void disk_put32(uint8_t* p, uint32_t value)
+{
+    for (unsigned i = 0; i < 4; i++)
+        p[i] = (uint8_t)(value >> (i * 8));
+}
+
+static uint32_t disk_get32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static bool disk_seek(FILE* file, uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseek(file, (long)offset, SEEK_SET) == 0;
+#endif
+}
+
+// Map an image file read-only. Returns NULL if it cannot be opened or is
+// empty.
+struct disk* disk_open(const char* path)
+{
+    assert(path);
+    struct disk* disk = quick_calloc(1, sizeof(struct disk));
+
+#ifdef _WIN32
+    disk->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+    if (disk->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(disk->file, &size) || !size.QuadPart)
+        goto fail;
+    disk->size = (size_t)size.QuadPart;
+    disk->mapping = CreateFileMappingA(disk->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!disk->mapping)
+        goto fail;
+    disk->data = MapViewOfFile(disk->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!disk->data)
+        goto fail;
+    return disk;
+
+fail:
+    if (disk->mapping)
+        CloseHandle(disk->mapping);
+    if (disk->file != INVALID_HANDLE_VALUE)
+        CloseHandle(disk->file);
+    free(disk);
+    return NULL;
+#else
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        free(disk);
+        return NULL;
+    }
+
+    // The mapping outlives the descriptor.
+    disk->size = (size_t)st.st_size;
+    void* data = mmap(NULL, disk->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        free(disk);
+        return NULL;
+    }
+    disk->data = data;
+    return disk;
+#endif
+}
+
+size_t disk_size(const struct disk* disk)
+{
+    return disk->size;
+}
+
+// Unmap an image, or close an overlay (but not its base). No drive may still
+// have it inserted. Returns false if the overlay's last writes could not be
+// completed, in which case its file cannot be trusted.
+bool disk_close(struct disk* disk)
+{
+    assert(disk);
+    if (disk->overlay)
+    {
+        bool ok = fclose(disk->overlay->file) == 0;
+        free(disk->overlay->map);
+        free(disk->overlay);
+        free(disk);
+        return ok;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(disk->data);
+    CloseHandle(disk->mapping);
+    CloseHandle(disk->file);
+#else
+    munmap((void*)disk->data, disk->size);
+#endif
+    free(disk);
+    return true;
+}
+
+// Open the overlay at path over a base image, creating it if it does not
+// exist. Returns NULL if it cannot be opened or was made over a base of
+// another size.
+struct disk* disk_overlay_open(const struct disk* base, const char* path)
+{
+    assert(base && !base->overlay && path);
+    struct disk_overlay* overlay = quick_calloc(1, sizeof(struct disk_overlay));
+    overlay->blocks = (uint32_t)((base->size + DISK_BLOCK - 1) / DISK_BLOCK);
+    overlay->map = quick_calloc(overlay->blocks, sizeof(uint32_t));
+    overlay->data = ((uint64_t)DISK_OVERLAY_HEADER + (uint64_t)overlay->blocks * 4 + DISK_BLOCK - 1)
+                    / DISK_BLOCK * DISK_BLOCK;
+
+    uint8_t header[DISK_OVERLAY_HEADER] = DISK_OVERLAY_MAGIC;
+    overlay->file = fopen(path, "r+b");
+    if (overlay->file)
+    {
+        if (fread(header, 1, sizeof(header), overlay->file) != sizeof(header)
+            || memcmp(header, DISK_OVERLAY_MAGIC, 8) != 0 || disk_get32(header + 8) != DISK_OVERLAY_VERSION
+            || disk_get32(header + 12) != DISK_BLOCK || disk_get32(header + 16) != (uint32_t)base->size
+            || disk_get32(header + 20) != (uint32_t)((uint64_t)base->size >> 32)
+            || disk_get32(header + 24) != overlay->blocks)
+            goto fail;
+        overlay->stored = disk_get32(header + 28);
+
+        uint8_t* map = quick_malloc((size_t)overlay->blocks * 4);
+        bool ok = fread(map, 4, overlay->blocks, overlay->file) == overlay->blocks;
+        for (uint32_t i = 0; ok && i < overlay->blocks; i++)
+        {
+            overlay->map[i] = disk_get32(map + i * 4);
+            ok = overlay->map[i] <= overlay->stored;
+        }
+        free(map);
+        if (!ok)
+            goto fail;
+    }
+    else
+    {
+        // A new overlay: the header and an empty map.
+        overlay->file = fopen(path, "w+b");
+        if (!overlay->file)
+            goto fail;
+        disk_put32(header + 8, DISK_OVERLAY_VERSION);
+        disk_put32(header + 12, DISK_BLOCK);
+        disk_put32(header + 16, (uint32_t)base->size);
+        disk_put32(header + 20, (uint32_t)((uint64_t)base->size >> 32));
+        disk_put32(header + 24, overlay->blocks);
+        disk_put32(header + 28, 0);
+        uint8_t zero[DISK_BLOCK] = { 0 };
+        bool ok = fwrite(header, 1, sizeof(header), overlay->file) == sizeof(header);
+        for (uint64_t left = overlay->data - DISK_OVERLAY_HEADER; ok && left; )
+        {
+            size_t length = (left < DISK_BLOCK) ? (size_t)left : DISK_BLOCK;
+            ok = fwrite(zero, 1, length, overlay->file) == length;
+            left -= length;
+        }
+        if (!ok || fflush(overlay->file) != 0)
+            goto fail;
+    }
+
+    struct disk* disk = quick_calloc(1, sizeof(struct disk));
+    disk->data = base->data;
+    disk->size = base->size;
+    disk->overlay = overlay;
+    return disk;
+
+fail:
+    if (overlay->file)
+        fclose(overlay->file);
+    free(overlay->map);
+    free(overlay);
+    return NULL;
+}
+
+// Blocks in an image, counting a partial one at the end.
+uint32_t disk_blocks(const struct disk* disk)
+{
+    return (uint32_t)((disk->size + DISK_BLOCK - 1) / DISK_BLOCK);
+}
+
+// Does an overlay hold a block? Always false for a plain image.
+bool disk_block_stored(const struct disk* disk, uint32_t block)
+{
+    assert(block < disk_blocks(disk));
+    return disk->overlay && disk->overlay->map[block];
+}
+
+// Read a block as the image has it: from the overlay if it was changed, and
+// from the mapping otherwise. A partial block at the end is padded with
+// zeroes.
+bool disk_block_load(const struct disk* disk, uint32_t block, uint8_t* data)
+{
+    assert(block < disk_blocks(disk));
+    if (disk_block_stored(disk, block))
+    {
+        struct disk_overlay* overlay = disk->overlay;
+        return disk_seek(overlay->file, overlay->data + (uint64_t)(overlay->map[block] - 1) * DISK_BLOCK)
+               && fread(data, 1, DISK_BLOCK, overlay->file) == DISK_BLOCK;
+    }
+
+    size_t offset = (size_t)block * DISK_BLOCK;
+    size_t length = disk->size - offset;
+    if (length > DISK_BLOCK)
+        length = DISK_BLOCK;
+    memcpy(data, disk->data + offset, length);
+    memset(data + length, 0, DISK_BLOCK - length);
+    return true;
+}
+
+// Write a block to an overlay: over its old copy if it has one, and
+// appended (and then mapped) if not. Fails on a plain image.
+bool disk_block_store(const struct disk* disk, uint32_t block, const uint8_t* data)
+{
+    assert(block < disk_blocks(disk));
+    struct disk_overlay* overlay = disk->overlay;
+    if (!overlay)
+        return false;
+
+    uint32_t place = overlay->map[block] ? overlay->map[block] : overlay->stored + 1;
+    if (!disk_seek(overlay->file, overlay->data + (uint64_t)(place - 1) * DISK_BLOCK)
+        || fwrite(data, 1, DISK_BLOCK, overlay->file) != DISK_BLOCK)
+        return false;
+    if (overlay->map[block])
+        return true;
+
+    // The block is in the file before the map says so, and the map entry
+    // before the count that covers it.
+    uint8_t entry[4];
+    disk_put32(entry, place);
+    if (!disk_seek(overlay->file, DISK_OVERLAY_HEADER + (uint64_t)block * 4)
+        || fwrite(entry, 1, 4, overlay->file) != 4
+        || !disk_seek(overlay->file, 28) || fwrite(entry, 1, 4, overlay->file) != 4)
+        return false;
+    overlay->map[block] = place;
+    overlay->stored = place;
+    return true;
+}
+
+// Put an image in a drive (NULL to empty it). Anything written to the
+// previous one is stored if it was an overlay, and forgotten otherwise.
+// Images larger than DISK_MAX_BLOCKS blocks are cut short.
+void disk_insert(struct disk_drive* drive, const struct disk* image)
+{
+    if (drive->image)
+        disk_flush(drive);
+
+    drive->image = image;
+    drive->sectors = 0;
+    if (image)
+    {
+        size_t sectors = image->size / DISK_SECTOR;
+        drive->sectors = (uint32_t)((sectors < DISK_MAX_BLOCKS * DISK_BLOCK_SECTORS)
+                                    ? sectors : DISK_MAX_BLOCKS * DISK_BLOCK_SECTORS);
+    }
+    drive->cached = 0;
+    drive->hand = 0;
+    memset(drive->slot, 0, sizeof(drive->slot));
+}
+
+// Move a drive onto another view of the same base, such as a copy of its
+// overlay, keeping what it has cached.
+void disk_attach(struct disk_drive* drive, const struct disk* image)
+{
+    assert(drive->image && image && image->data == drive->image->data);
+    drive->image = image;
+}
+
+// Store a drive's dirty blocks in its overlay. Returns false if there is
+// none, or the overlay could not be written. An empty drive has nothing to
+// store.
+bool disk_flush(struct disk_drive* drive)
+{
+    if (!drive->image)
+        return true;
+
+    bool ok = true;
+    for (unsigned slot = 0; slot < drive->cached; slot++)
+    {
+        if (!drive->dirty[slot])
+            continue;
+        if (disk_block_store(drive->image, drive->block[slot], drive->cache[slot]))
+            drive->dirty[slot] = false;
+        else
+            ok = false;
+    }
+    if (ok && drive->image->overlay)
+        ok = fflush(drive->image->overlay->file) == 0;
+    return ok;
+}
+
+// Load a block into the cache, evicting another if it is full: the next
+// clean one round from the hand, or a dirty one once it has been stored in
+// the overlay. Returns its slot, or -1 if nothing could be evicted.
+static int disk_cache(struct disk_drive* drive, uint32_t block)
+{
+    int slot = -1;
+    if (drive->cached < DISK_CACHE_BLOCKS)
+        slot = drive->cached++;
+    else
+    {
+        for (unsigned i = 0; i < DISK_CACHE_BLOCKS && slot < 0; i++)
+        {
+            unsigned victim = drive->hand;
+            drive->hand = (uint16_t)((drive->hand + 1) % DISK_CACHE_BLOCKS);
+            if (!drive->dirty[victim]
+                || disk_block_store(drive->image, drive->block[victim], drive->cache[victim]))
+            {
+                drive->slot[drive->block[victim]] = 0;
+                slot = (int)victim;
+            }
+        }
+        if (slot < 0)
+            return -1;
+    }
+
+    drive->block[slot] = (uint16_t)block;
+    drive->dirty[slot] = false;
+    if (!disk_block_load(drive->image, block, drive->cache[slot]))
+    {
+        // Leave the slot free for the next block.
+        drive->hand = (uint16_t)slot;
+        return -1;
+    }
+    drive->slot[block] = (uint16_t)(slot + 1);
+    return slot;
+}
+
+// A sector's current contents: from the cache, the overlay (through the
+// cache), or the mapping. Returns NULL if the overlay could not be read.
+const uint8_t* disk_read(struct disk_drive* drive, uint32_t sector)
+{
+    assert(sector < drive->sectors);
+    uint32_t block = sector / DISK_BLOCK_SECTORS;
+    int slot = drive->slot[block] - 1;
+    if (slot < 0)
+    {
+        if (!disk_block_stored(drive->image, block))
+            return drive->image->data + (size_t)sector * DISK_SECTOR;
+        slot = disk_cache(drive, block);
+        if (slot < 0)
+            return NULL;
+    }
+    return drive->cache[slot] + (sector % DISK_BLOCK_SECTORS) * DISK_SECTOR;
+}
+
+// Somewhere to write a sector to, bringing its block into the cache first if
+// it is not there already. Returns NULL if the cache is full of dirty blocks
+// with no overlay to store them in.
+uint8_t* disk_write(struct disk_drive* drive, uint32_t sector)
+{
+    assert(sector < drive->sectors);
+    uint32_t block = sector / DISK_BLOCK_SECTORS;
+    int slot = drive->slot[block] - 1;
+    if (slot < 0)
+        slot = disk_cache(drive, block);
+    if (slot < 0)
+        return NULL;
+    drive->dirty[slot] = true;
+    return drive->cache[slot] + (sector % DISK_BLOCK_SECTORS) * DISK_SECTOR;
+}
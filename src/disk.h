@@ -0,0 +1,72 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Disk images shared between machines, and each machine's view of one.
+//
+// An image file is mapped read-only once by the host (disk_open()) and can
+// back drives in any number of machines. Sector reads are served straight
+// from the mapping, so the controllers' DMA copies a sector from the host's
+// page cache into guest memory with no copy of the image per machine, and
+// opening an image costs nothing until its sectors are read.
+//
+// Writes never reach the image. A drive (struct disk_drive, part of its
+// controller's state in the machine's arena) keeps the blocks written to in
+// a small dirty-block cache of its own, which is cloned along with the
+// machine. Once the cache is full, writes to further blocks fail.
+//
+// Unless the image is an overlay (disk_overlay_open()): a per-instance file
+// of the blocks changed from a base image, which is shared and mapped as
+// above. The file holds a header, a block map giving each base block's
+// place among the changed blocks (0 for unchanged), and the changed blocks
+// themselves, appended in the order they were first written. A drive on an
+// overlay evicts dirty blocks from its cache into the file and pulls changed
+// blocks back in when they are read again, so its writes are bounded only by
+// the base's size, and each instance's storage by what it wrote. Thousands of
+// instances can run from one base, each with its own overlay.
+//
+// An overlay belongs to one drive. A machine cloned while it has one still
+// shares it with its clone: flush the drive with disk_flush(), copy the file
+// (flexdisk merge will do), and move the clone's drive onto the copy with
+// disk_attach(), which keeps its cache. flexdisk also merges overlays
+// together and into full images, dropping blocks that match the base.
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DISK_SECTOR             512
+#define DISK_BLOCK              4096    // Unit of the dirty-block cache.
+#define DISK_BLOCK_SECTORS      (DISK_BLOCK / DISK_SECTOR)
+#define DISK_MAX_BLOCKS         8192    // Largest image: 32 MB.
+#define DISK_CACHE_BLOCKS       64      // Blocks each drive can hold written.
+#define DISK_OVERLAY_VERSION    1
+
+struct disk;
+
+// A drive's view of an image.
+struct disk_drive
+{
+    const struct disk* image;       // Shared and host-owned; NULL if empty.
+    uint32_t sectors;
+    uint16_t cached;                // Cache slots in use.
+    uint16_t hand;                  // Next slot to consider evicting.
+    uint16_t slot[DISK_MAX_BLOCKS]; // Cache slot + 1 holding each block, or 0 if not cached.
+    uint16_t block[DISK_CACHE_BLOCKS]; // Block each slot holds.
+    bool dirty[DISK_CACHE_BLOCKS];  // Written since it was last stored in an overlay?
+    uint8_t cache[DISK_CACHE_BLOCKS][DISK_BLOCK];
+};
+
+struct disk* disk_open(const char* path);
+size_t disk_size(const struct disk* disk);
+bool disk_close(struct disk* disk);
+struct disk* disk_overlay_open(const struct disk* base, const char* path);
+uint32_t disk_blocks(const struct disk* disk);
+bool disk_block_stored(const struct disk* disk, uint32_t block);
+bool disk_block_load(const struct disk* disk, uint32_t block, uint8_t* data);
+bool disk_block_store(const struct disk* disk, uint32_t block, const uint8_t* data);
+void disk_insert(struct disk_drive* drive, const struct disk* image);
+void disk_attach(struct disk_drive* drive, const struct disk* image);
+bool disk_flush(struct disk_drive* drive);
+const uint8_t* disk_read(struct disk_drive* drive, uint32_t sector);
+uint8_t* disk_write(struct disk_drive* drive, uint32_t sector);
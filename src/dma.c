@@ -0,0 +1,220 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <assert.h>
+#include <string.h>
+
+#include "dma.h"
+
+// Page register port of each channel.
+static const uint16_t dma_page_port[DMA_CHANNELS] = { 0x87, 0x83, 0x81, 0x82 };
+
+// Move up to length bytes between a device and memory on a channel, in runs
+// that stop where the address or count wraps. Returns how many were moved,
+// which is less than length if the channel is masked, set up for another
+// kind of transfer, or reaches terminal count without auto-initialisation.
+static size_t dma_transfer(struct bus* bus, unsigned channel, uint8_t* read, const uint8_t* write,
+                           size_t length, unsigned type)
+{
+    struct dma* dma = bus->dma;
+    assert(channel < DMA_CHANNELS);
+    if (!dma)
+        return 0;
+
+    struct dma_channel* c = &dma->channels[channel];
+    size_t done = 0;
+    while (done < length && !c->masked && !(dma->command & DMA_COMMAND_DISABLE)
+           && ((c->mode >> 2) & 3) == type)
+    {
+        bool decrement = c->mode & DMA_MODE_DECREMENT;
+        uint32_t remaining = (uint32_t)c->count + 1;
+        uint32_t to_wrap = decrement ? (uint32_t)c->address + 1 : 0x10000u - c->address;
+        size_t run = length - done;
+        if (run > remaining)
+            run = remaining;
+        if (run > to_wrap)
+            run = to_wrap;
+
+        uint32_t address = (uint32_t)c->page << 16 | c->address;
+        uint32_t low = decrement ? address - (uint32_t)(run - 1) : address;
+        uint8_t* ram = decrement ? NULL : bus_ram(bus, low, run);
+        if (ram && read)
+            memcpy(read + done, ram, run);
+        else if (ram)
+        {
+            memcpy(ram, write + done, run);
+            bus_written(bus, low, run);
+        }
+        else
+        {
+            // Device-decoded memory, or a transfer running backwards.
+            for (size_t i = 0; i < run; i++)
+            {
+                uint32_t at = decrement ? address - (uint32_t)i : address + (uint32_t)i;
+                if (read)
+                    read[done + i] = bus_read_byte(bus, at);
+                else
+                    bus_write_byte(bus, at, write[done + i]);
+            }
+        }
+
+        c->address = (uint16_t)(decrement ? c->address - run : c->address + run);
+        c->count = (uint16_t)(c->count - run);
+        done += run;
+        if (run == remaining)
+        {
+            dma->status |= 1 << channel;
+            if (c->mode & DMA_MODE_AUTOINIT)
+            {
+                c->address = c->base_address;
+                c->count = c->base_count;
+            }
+            else
+                c->masked = true;
+        }
+    }
+    return done;
+}
+
+// Would a transfer on the channel move anything? Devices that stop at
+// terminal count check this between blocks.
+bool dma_ready(struct bus* bus, unsigned channel)
+{
+    assert(channel < DMA_CHANNELS);
+    return bus->dma && !bus->dma->channels[channel].masked && !(bus->dma->command & DMA_COMMAND_DISABLE);
+}
+
+// Read up to length bytes from memory for the device on a channel.
+size_t dma_read(struct bus* bus, unsigned channel, uint8_t* data, size_t length)
+{
+    return dma_transfer(bus, channel, data, NULL, length, DMA_TYPE_READ);
+}
+
+// Write up to length bytes from the device on a channel to memory.
+size_t dma_write(struct bus* bus, unsigned channel, const uint8_t* data, size_t length)
+{
+    return dma_transfer(bus, channel, NULL, data, length, DMA_TYPE_WRITE);
+}
+
+static uint8_t dma_in(struct bus* bus, void* device, uint16_t port)
+{
+    struct dma* dma = device;
+    if (port >= 0x80)
+    {
+        for (unsigned i = 0; i < DMA_CHANNELS; i++)
+            if (dma_page_port[i] == port)
+                return dma->channels[i].page;
+        return 0xFF;
+    }
+
+    switch (port)
+    {
+        case 0x0: case 0x1: case 0x2: case 0x3:
+        case 0x4: case 0x5: case 0x6: case 0x7:
+        {
+            struct dma_channel* c = &dma->channels[port / 2];
+            uint16_t value = (port & 1) ? c->count : c->address;
+            dma->flip_flop = !dma->flip_flop;
+            return dma->flip_flop ? (uint8_t)value : (uint8_t)(value >> 8);
+        }
+        case 0x8:
+        {
+            uint8_t status = dma->status;
+            dma->status = 0;
+            return status;
+        }
+        default:
+            return 0xFF;
+    }
+}
+
+static void dma_out(struct bus* bus, void* device, uint16_t port, uint8_t data)
+{
+    struct dma* dma = device;
+    if (port >= 0x80)
+    {
+        for (unsigned i = 0; i < DMA_CHANNELS; i++)
+            if (dma_page_port[i] == port)
+                dma->channels[i].page = data & 0x0F;
+        return;
+    }
+
+    switch (port)
+    {
+        case 0x0: case 0x1: case 0x2: case 0x3:
+        case 0x4: case 0x5: case 0x6: case 0x7:
+        {
+            // Writes set the base and current registers together.
+            struct dma_channel* c = &dma->channels[port / 2];
+            uint16_t* base = (port & 1) ? &c->base_count : &c->base_address;
+            *base = dma->flip_flop ? (uint16_t)((*base & 0x00FF) | data << 8) : (uint16_t)((*base & 0xFF00) | data);
+            *((port & 1) ? &c->count : &c->address) = *base;
+            dma->flip_flop = !dma->flip_flop;
+            break;
+        }
+        case 0x8:
+        {
+            dma->command = data;
+            break;
+        }
+        case 0xA:
+        {
+            dma->channels[data & 3].masked = data & 4;
+            break;
+        }
+        case 0xB:
+        {
+            dma->channels[data & 3].mode = data;
+            break;
+        }
+        case 0xC:
+        {
+            dma->flip_flop = false;
+            break;
+        }
+        case 0xD:
+        {
+            // Master clear.
+            dma->command = 0;
+            dma->status = 0;
+            dma->flip_flop = false;
+            for (unsigned i = 0; i < DMA_CHANNELS; i++)
+                dma->channels[i].masked = true;
+            break;
+        }
+        case 0xE:
+        {
+            for (unsigned i = 0; i < DMA_CHANNELS; i++)
+                dma->channels[i].masked = false;
+            break;
+        }
+        case 0xF:
+        {
+            for (unsigned i = 0; i < DMA_CHANNELS; i++)
+                dma->channels[i].masked = data & (1 << i);
+            break;
+        }
+    }
+}
+
+// Attach the DMA controller to the bus. Channels start masked, as after a
+// master clear.
+// Returns NULL if its ports cannot be mapped (see bus_map_ports()).
+struct dma* dma_new(struct bus* bus)
+{
+    assert(bus && !bus->dma);
+
+    struct dma* dma = arena_alloc(bus->arena, sizeof(struct dma));
+    for (unsigned i = 0; i < DMA_CHANNELS; i++)
+        dma->channels[i].masked = true;
+
+    if (!bus_map_ports(bus, DMA_PORTS, 16, dma, dma_in, dma_out)
+        || !bus_map_ports(bus, 0x81, 3, dma, dma_in, dma_out)
+        || !bus_map_ports(bus, 0x87, 1, dma, dma_in, dma_out))
+    {
+        bus_unmap_ports(bus, dma);
+        return NULL;
+    }
+    bus->dma = dma;
+    return dma;
+}
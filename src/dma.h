@@ -0,0 +1,63 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Intel 8237 DMA controller (the PC/XT's single controller, channels 0-3).
+//
+// Devices do not request transfers a byte at a time. They ask for a block of
+// bytes at once (dma_read() for memory to device, dma_write() for device to
+// memory), and the controller copies each run between wrap points (the end
+// of the count, or of the 64 KB the page register confines the address to)
+// with one memcpy, updating the address and count registers as the bytes
+// would have. Auto-initialising channels reload and carry on, others mask
+// themselves at terminal count.
+//
+// The controller is reached through bus->dma, so devices find it without
+// holding pointers of their own. Memory-to-memory transfers, the cascade
+// and demand modes' handshaking, and DREQ priorities are not modelled.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "bus.h"
+
+#define DMA_PORTS               0x00
+#define DMA_CHANNELS            4
+
+// Mode register transfer types.
+#define DMA_TYPE_VERIFY         0
+#define DMA_TYPE_WRITE          1       // Device to memory.
+#define DMA_TYPE_READ           2       // Memory to device.
+
+// Mode register.
+#define DMA_MODE_AUTOINIT       (1 << 4)
+#define DMA_MODE_DECREMENT      (1 << 5)
+
+// Command register.
+#define DMA_COMMAND_DISABLE     (1 << 2)
+
+struct dma_channel
+{
+    uint16_t base_address;
+    uint16_t base_count;            // Bytes to transfer, minus one.
+    uint16_t address;
+    uint16_t count;
+    uint8_t page;                   // Address bits 16-19.
+    uint8_t mode;
+    bool masked;
+};
+
+struct dma
+{
+    struct dma_channel channels[DMA_CHANNELS];
+    uint8_t command;
+    uint8_t status;                 // Terminal count reached (bits 0-3), since last read.
+    bool flip_flop;                 // Is the next byte of a 16-bit register the high one?
+};
+
+struct dma* dma_new(struct bus* bus);
+bool dma_ready(struct bus* bus, unsigned channel);
+size_t dma_read(struct bus* bus, unsigned channel, uint8_t* data, size_t length);
+size_t dma_write(struct bus* bus, unsigned channel, const uint8_t* data, size_t length);
@@ -0,0 +1,413 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <assert.h>
+#include <string.h>
+
+#include "dma.h"
+#include "fdc.h"
+
+// Status register 0.
+#define FDC_ST0_NOT_READY       0x08
+#define FDC_ST0_SEEK_END        0x20
+#define FDC_ST0_ABNORMAL        0x40
+#define FDC_ST0_INVALID         0x80
+#define FDC_ST0_READY_CHANGED   0xC0
+
+// Status register 1.
+#define FDC_ST1_NOT_WRITABLE    0x02
+#define FDC_ST1_NO_DATA         0x04
+#define FDC_ST1_OVERRUN         0x10
+#define FDC_ST1_DATA_ERROR      0x20
+#define FDC_ST1_END_OF_CYLINDER 0x80
+
+// Standard PC formats, by image size.
+static const struct
+{
+    uint32_t size;
+    uint8_t cylinders, heads, sectors;
+} fdc_formats[] =
+{
+    { 163840, 40, 1, 8 },  { 184320, 40, 1, 9 },  { 327680, 40, 2, 8 },   { 368640, 40, 2, 9 },
+    { 737280, 80, 2, 9 },  { 1228800, 80, 2, 15 }, { 1474560, 80, 2, 18 }, { 2949120, 80, 2, 36 }
+};
+
+// Bytes in each command, by its low 5 bits (0 for invalid commands).
+static unsigned fdc_command_length(uint8_t command)
+{
+    switch (command & 0x1F)
+    {
+        case 0x08:
+            return 1;
+        case 0x04: case 0x07: case 0x0A:
+            return 2;
+        case 0x03: case 0x0F:
+            return 3;
+        case 0x0D:
+            return 6;
+        case 0x05: case 0x06: case 0x09: case 0x0C:
+            return 9;
+        default:
+            return 0;
+    }
+}
+
+static void fdc_irq(struct bus* bus, struct fdc* fdc)
+{
+    if (fdc->dor & FDC_DOR_DMA)
+        bus_irq(bus, FDC_IRQ);
+}
+
+static void fdc_results(struct fdc* fdc, const uint8_t* result, unsigned length)
+{
+    memcpy(fdc->result, result, length);
+    fdc->result_length = length;
+    fdc->result_read = 0;
+    fdc->phase = FDC_PHASE_RESULT;
+}
+
+// The drive a command addresses, or NULL if it has no disk in it.
+static struct fdc_drive* fdc_drive(struct fdc* fdc)
+{
+    unsigned drive = fdc->command[1] & 3;
+    if (drive >= FDC_DRIVES || !fdc->drives[drive].disk.image)
+        return NULL;
+    return &fdc->drives[drive];
+}
+
+// READ DATA and WRITE DATA: sectors R to EOT (and on to head 1 with MT), or
+// until the DMA controller reaches terminal count, one DMA request each.
+static void fdc_transfer(struct bus* bus, struct fdc* fdc, bool write)
+{
+    const uint8_t* command = fdc->command;
+    bool multi_track = command[0] & 0x80;
+    uint8_t cylinder = command[2], head = command[3], sector = command[4], eot = command[6];
+    uint8_t st0 = command[1] & 3, st1 = 0;
+
+    struct fdc_drive* drive = fdc_drive(fdc);
+    if (!drive)
+        st0 |= FDC_ST0_ABNORMAL | FDC_ST0_NOT_READY;
+    else if (command[5] != 2 || !dma_ready(bus, FDC_DMA))
+    {
+        st0 |= FDC_ST0_ABNORMAL;
+        st1 |= (command[5] != 2) ? FDC_ST1_NO_DATA : FDC_ST1_OVERRUN;
+    }
+    else
+    {
+        for (;;)
+        {
+            if (cylinder >= drive->cylinders || head >= drive->heads || sector < 1 || sector > drive->sectors)
+            {
+                st0 |= FDC_ST0_ABNORMAL;
+                st1 |= FDC_ST1_NO_DATA;
+                break;
+            }
+
+            uint32_t lba = ((uint32_t)cylinder * drive->heads + head) * drive->sectors + sector - 1;
+            if (write)
+            {
+                uint8_t* data = disk_write(&drive->disk, lba);
+                if (!data)
+                {
+                    st0 |= FDC_ST0_ABNORMAL;
+                    st1 |= FDC_ST1_NOT_WRITABLE;
+                    break;
+                }
+                dma_read(bus, FDC_DMA, data, DISK_SECTOR);
+            }
+            else
+            {
+                const uint8_t* data = disk_read(&drive->disk, lba);
+                if (!data)
+                {
+                    st0 |= FDC_ST0_ABNORMAL;
+                    st1 |= FDC_ST1_DATA_ERROR;
+                    break;
+                }
+                dma_write(bus, FDC_DMA, data, DISK_SECTOR);
+            }
+
+            // Move on to the next sector. Running off the end of the track
+            // before terminal count is an error, as on the real controller.
+            bool more = dma_ready(bus, FDC_DMA);
+            if (sector < eot)
+                sector++;
+            else if (multi_track && !(head & 1))
+            {
+                head |= 1;
+                sector = 1;
+            }
+            else
+            {
+                sector = 1;
+                cylinder++;
+                if (multi_track)
+                    head &= ~1;
+                if (more)
+                {
+                    st0 |= FDC_ST0_ABNORMAL;
+                    st1 |= FDC_ST1_END_OF_CYLINDER;
+                }
+                break;
+            }
+            if (!more)
+                break;
+        }
+    }
+
+    st0 |= (head & 1) << 2;
+    uint8_t result[7] = { st0, st1, 0, cylinder, head, sector, command[5] };
+    fdc_results(fdc, result, 7);
+}
+
+// FORMAT TRACK: the sector IDs come in by DMA, four bytes each, and every
+// sector is filled with the filler byte.
+static void fdc_format(struct bus* bus, struct fdc* fdc)
+{
+    const uint8_t* command = fdc->command;
+    uint8_t st0 = command[1] & 7, st1 = 0;
+    uint8_t id[4] = { 0, 0, 0, command[2] };
+
+    struct fdc_drive* drive = fdc_drive(fdc);
+    if (!drive)
+        st0 |= FDC_ST0_ABNORMAL | FDC_ST0_NOT_READY;
+    else
+    {
+        for (unsigned i = 0; i < command[3]; i++)
+        {
+            if (dma_read(bus, FDC_DMA, id, 4) < 4)
+                break;
+            if (id[0] >= drive->cylinders || id[1] >= drive->heads || id[2] < 1 || id[2] > drive->sectors || id[3] != 2)
+                continue;
+            uint8_t* data = disk_write(&drive->disk, ((uint32_t)id[0] * drive->heads + id[1]) * drive->sectors + id[2] - 1);
+            if (!data)
+            {
+                st0 |= FDC_ST0_ABNORMAL;
+                st1 |= FDC_ST1_NOT_WRITABLE;
+                break;
+            }
+            memset(data, command[5], DISK_SECTOR);
+        }
+    }
+
+    uint8_t result[7] = { st0, st1, 0, id[0], id[1], id[2], id[3] };
+    fdc_results(fdc, result, 7);
+}
+
+// The execution phase is over.
+static void fdc_execute(struct bus* bus, void* device)
+{
+    struct fdc* fdc = device;
+    const uint8_t* command = fdc->command;
+    switch (command[0] & 0x1F)
+    {
+        case 0x05: case 0x09:
+            fdc_transfer(bus, fdc, true);
+            break;
+        case 0x06: case 0x0C:
+            fdc_transfer(bus, fdc, false);
+            break;
+        case 0x07: case 0x0F:
+        {
+            // RECALIBRATE and SEEK end without a result phase; the interrupt
+            // is sensed instead.
+            unsigned index = command[1] & 3;
+            if (index < FDC_DRIVES)
+            {
+                struct fdc_drive* drive = &fdc->drives[index];
+                drive->cylinder = ((command[0] & 0x1F) == 0x07) ? 0 : command[2];
+                drive->st0 = FDC_ST0_SEEK_END | (command[1] & 7);
+                drive->sense = true;
+            }
+            fdc->phase = FDC_PHASE_COMMAND;
+            break;
+        }
+        case 0x0A:
+        {
+            struct fdc_drive* drive = fdc_drive(fdc);
+            uint8_t st0 = command[1] & 7;
+            if (!drive)
+                st0 |= FDC_ST0_ABNORMAL | FDC_ST0_NOT_READY;
+            uint8_t result[7] = { st0, 0, 0, drive ? drive->cylinder : 0, (command[1] >> 2) & 1, 1, 2 };
+            fdc_results(fdc, result, 7);
+            break;
+        }
+        case 0x0D:
+            fdc_format(bus, fdc);
+            break;
+    }
+    fdc_irq(bus, fdc);
+}
+
+// A command has been written in full.
+static void fdc_command(struct bus* bus, struct fdc* fdc)
+{
+    const uint8_t* command = fdc->command;
+    fdc->command_length = 0;
+    switch (command[0] & 0x1F)
+    {
+        case 0x03:
+            // SPECIFY: step rate and head timings, which do not matter here.
+            break;
+        case 0x04:
+        {
+            // SENSE DRIVE STATUS: ST3.
+            unsigned index = command[1] & 3;
+            const struct fdc_drive* drive = (index < FDC_DRIVES) ? &fdc->drives[index] : NULL;
+            uint8_t st3 = command[1] & 7;
+            if (drive && drive->disk.image)
+                st3 |= 0x20 | (drive->cylinder == 0 ? 0x10 : 0) | (drive->heads > 1 ? 0x08 : 0);
+            fdc_results(fdc, &st3, 1);
+            break;
+        }
+        case 0x08:
+        {
+            // SENSE INTERRUPT STATUS.
+            uint8_t result[2] = { FDC_ST0_INVALID, 0 };
+            if (fdc->reset_senses)
+            {
+                result[0] = FDC_ST0_READY_CHANGED | (4 - fdc->reset_senses);
+                fdc->reset_senses--;
+                fdc_results(fdc, result, 2);
+                break;
+            }
+            for (unsigned i = 0; i < FDC_DRIVES; i++)
+            {
+                if (fdc->drives[i].sense)
+                {
+                    fdc->drives[i].sense = false;
+                    result[0] = fdc->drives[i].st0;
+                    result[1] = fdc->drives[i].cylinder;
+                    fdc_results(fdc, result, 2);
+                    return;
+                }
+            }
+            fdc_results(fdc, result, 1);
+            break;
+        }
+        default:
+        {
+            fdc->phase = FDC_PHASE_EXECUTION;
+            bus_schedule(bus, fdc->timer, bus->clock + FDC_EXECUTE_CLOCKS);
+            break;
+        }
+    }
+}
+
+static void fdc_reset(struct bus* bus, struct fdc* fdc)
+{
+    bus_schedule(bus, fdc->timer, BUS_NEVER);
+    fdc->phase = FDC_PHASE_COMMAND;
+    fdc->command_length = 0;
+    fdc->reset_senses = 4;
+    for (unsigned i = 0; i < FDC_DRIVES; i++)
+        fdc->drives[i].sense = false;
+}
+
+static uint8_t fdc_in(struct bus* bus, void* device, uint16_t port)
+{
+    struct fdc* fdc = device;
+    switch (port - FDC_PORTS)
+    {
+        case 0x2:
+            return fdc->dor;
+        case 0x4:
+        {
+            switch (fdc->phase)
+            {
+                case FDC_PHASE_EXECUTION:
+                    return FDC_MSR_BUSY;
+                case FDC_PHASE_RESULT:
+                    return FDC_MSR_RQM | FDC_MSR_DIO | FDC_MSR_BUSY;
+                default:
+                    return FDC_MSR_RQM | (fdc->command_length ? FDC_MSR_BUSY : 0);
+            }
+        }
+        case 0x5:
+        {
+            if (fdc->phase != FDC_PHASE_RESULT)
+                return 0xFF;
+            uint8_t data = fdc->result[fdc->result_read++];
+            if (fdc->result_read == fdc->result_length)
+                fdc->phase = FDC_PHASE_COMMAND;
+            return data;
+        }
+        default:
+            return 0xFF;
+    }
+}
+
+static void fdc_out(struct bus* bus, void* device, uint16_t port, uint8_t data)
+{
+    struct fdc* fdc = device;
+    switch (port - FDC_PORTS)
+    {
+        case 0x2:
+        {
+            // Leaving reset interrupts once, for the four drives' ready lines.
+            uint8_t old = fdc->dor;
+            fdc->dor = data;
+            if (!(data & FDC_DOR_RESET))
+                fdc_reset(bus, fdc);
+            else if (!(old & FDC_DOR_RESET))
+                fdc_irq(bus, fdc);
+            break;
+        }
+        case 0x5:
+        {
+            if (fdc->phase != FDC_PHASE_COMMAND || !(fdc->dor & FDC_DOR_RESET))
+                break;
+            if (fdc->command_length == 0 && !fdc_command_length(data))
+            {
+                uint8_t st0 = FDC_ST0_INVALID;
+                fdc_results(fdc, &st0, 1);
+                break;
+            }
+            fdc->command[fdc->command_length++] = data;
+            if (fdc->command_length == fdc_command_length(fdc->command[0]))
+                fdc_command(bus, fdc);
+            break;
+        }
+    }
+}
+
+// Attach a floppy controller with two empty drives.
+// Returns NULL if its ports cannot be mapped (see bus_map_ports()).
+struct fdc* fdc_new(struct bus* bus)
+{
+    assert(bus);
+
+    struct fdc* fdc = arena_alloc(bus->arena, sizeof(struct fdc));
+    fdc->dor = FDC_DOR_RESET | FDC_DOR_DMA;
+
+    if (!bus_map_ports(bus, FDC_PORTS, 8, fdc, fdc_in, fdc_out))
+        return NULL;
+    fdc->timer = bus_add_timer(bus, fdc, fdc_execute);
+    return fdc;
+}
+
+// Insert a disk image into a drive (NULL to eject it). Returns false if the
+// image is not one of the standard formats.
+bool fdc_insert(struct fdc* fdc, unsigned drive, const struct disk* image)
+{
+    assert(drive < FDC_DRIVES);
+    struct fdc_drive* d = &fdc->drives[drive];
+    if (!image)
+    {
+        disk_insert(&d->disk, NULL);
+        return true;
+    }
+
+    for (size_t i = 0; i < sizeof(fdc_formats) / sizeof(fdc_formats[0]); i++)
+    {
+        if (fdc_formats[i].size == disk_size(image))
+        {
+            d->cylinders = fdc_formats[i].cylinders;
+            d->heads = fdc_formats[i].heads;
+            d->sectors = fdc_formats[i].sectors;
+            disk_insert(&d->disk, image);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,75 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// NEC uPD765 floppy disk controller, as on the PC's diskette adapter (ports
+// 0x3F0-0x3F7, DMA channel 2, IRQ 6).
+//
+// Disks are images mapped by the host (see disk.h). A read command moves its
+// sectors with one DMA request per sector, straight out of the image's
+// mapping into guest memory, and a write lands in the drive's dirty-block
+// cache. Execution completes a millisecond of emulated time after the
+// command is written, whatever the seek distance; the controller is busy
+// until then.
+//
+// Only 512-byte sectors in the standard PC formats from 160 KB to 2.88 MB
+// are supported, from the image's size. Deleted data marks, gaps, and the
+// scan and read track commands are not modelled, and the disk is never
+// reported as changed.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bus.h"
+#include "disk.h"
+
+#define FDC_PORTS               0x3F0
+#define FDC_DMA                 2
+#define FDC_IRQ                 6
+#define FDC_DRIVES              2
+#define FDC_EXECUTE_CLOCKS      (BUS_MASTER_CLOCK / 1000)
+
+// Digital output register (0x3F2).
+#define FDC_DOR_RESET           (1 << 2) // Clear to hold the controller in reset.
+#define FDC_DOR_DMA             (1 << 3) // DMA and IRQ enable.
+
+// Main status register (0x3F4).
+#define FDC_MSR_BUSY            (1 << 4)
+#define FDC_MSR_DIO             (1 << 6) // Data goes to the host.
+#define FDC_MSR_RQM             (1 << 7) // Ready for a data byte.
+
+enum fdc_phase
+{
+    FDC_PHASE_COMMAND,
+    FDC_PHASE_EXECUTION,
+    FDC_PHASE_RESULT
+};
+
+struct fdc_drive
+{
+    uint8_t cylinders;
+    uint8_t heads;
+    uint8_t sectors;                // Per track.
+    uint8_t cylinder;               // Where the head is.
+    uint8_t st0;                    // Status for the next SENSE INTERRUPT STATUS.
+    bool sense;                     // Is there an interrupt to sense?
+    struct disk_drive disk;
+};
+
+struct fdc
+{
+    uint8_t dor;
+    uint8_t phase;                  // enum fdc_phase.
+    uint8_t command[9];
+    unsigned command_length;        // Bytes written so far.
+    uint8_t result[7];
+    unsigned result_length;
+    unsigned result_read;
+    unsigned reset_senses;          // Interrupts left to sense after a reset, one per drive.
+    unsigned timer;                 // Ends the execution phase.
+    struct fdc_drive drives[FDC_DRIVES];
+};
+
+struct fdc* fdc_new(struct bus* bus);
+bool fdc_insert(struct fdc* fdc, unsigned drive, const struct disk* image);
@@ -0,0 +1,132 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Merges copy-on-write disk overlays (see disk.h).
+//
+//   flexdisk merge <base> <output> [overlay...]
+//       Write a new overlay of the blocks the overlays changed, later ones
+//       taking precedence. Blocks are stored in block order, and those that
+//       match the base again are dropped, so merging a single overlay
+//       compacts (or just copies) it.
+//
+//   flexdisk flatten <base> <output> [overlay...]
+//       Write a full image: the base with the overlays applied.
+//
+// The output must not exist already.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "disk.h"
+#include "util.h"
+
+static int usage(void)
+{
+    fprintf(stderr, "usage: flexdisk merge <base> <output> [overlay...]\n"
+                    "       flexdisk flatten <base> <output> [overlay...]\n");
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+        return usage();
+    bool flatten = strcmp(argv[1], "flatten") == 0;
+    if (!flatten && strcmp(argv[1], "merge") != 0)
+        return usage();
+
+    struct disk* base = disk_open(argv[2]);
+    if (!base)
+    {
+        fprintf(stderr, "flexdisk: cannot open %s\n", argv[2]);
+        return 1;
+    }
+
+    int count = argc - 4;
+    struct disk** overlays = quick_calloc(count ? count : 1, sizeof(struct disk*));
+    for (int i = 0; i < count; i++)
+    {
+        // Opening an overlay that does not exist would create it.
+        FILE* file = fopen(argv[4 + i], "rb");
+        if (file)
+        {
+            fclose(file);
+            overlays[i] = disk_overlay_open(base, argv[4 + i]);
+        }
+        if (!overlays[i])
+        {
+            fprintf(stderr, "flexdisk: %s is not an overlay of %s\n", argv[4 + i], argv[2]);
+            return 1;
+        }
+    }
+
+    FILE* file = fopen(argv[3], "rb");
+    if (file)
+    {
+        fclose(file);
+        fprintf(stderr, "flexdisk: %s already exists\n", argv[3]);
+        return 1;
+    }
+    struct disk* merged = NULL;
+    if (flatten)
+        file = fopen(argv[3], "wb");
+    else
+        merged = disk_overlay_open(base, argv[3]);
+    if (!file && !merged)
+    {
+        fprintf(stderr, "flexdisk: cannot create %s\n", argv[3]);
+        return 1;
+    }
+
+    static uint8_t data[DISK_BLOCK], original[DISK_BLOCK];
+    uint32_t blocks = disk_blocks(base), changed = 0;
+    bool ok = true;
+    for (uint32_t block = 0; ok && block < blocks; block++)
+    {
+        // The last overlay to change a block has it as the guest last saw it.
+        const struct disk* from = base;
+        for (int i = count - 1; i >= 0 && from == base; i--)
+        {
+            if (disk_block_stored(overlays[i], block))
+                from = overlays[i];
+        }
+        ok = disk_block_load(from, block, data);
+
+        if (flatten)
+        {
+            size_t length = disk_size(base) - (size_t)block * DISK_BLOCK;
+            if (length > DISK_BLOCK)
+                length = DISK_BLOCK;
+            ok = ok && fwrite(data, 1, length, file) == length;
+        }
+        else if (ok && from != base)
+        {
+            disk_block_load(base, block, original);
+            if (memcmp(data, original, DISK_BLOCK) != 0)
+            {
+                ok = disk_block_store(merged, block, data);
+                changed++;
+            }
+        }
+    }
+
+    if (flatten)
+        ok = (fclose(file) == 0) && ok;
+    else
+        ok = disk_close(merged) && ok;
+    for (int i = 0; i < count; i++)
+        disk_close(overlays[i]);
+    free(overlays);
+    disk_close(base);
+
+    if (!ok)
+    {
+        fprintf(stderr, "flexdisk: cannot write %s\n", argv[3]);
+        remove(argv[3]);
+        return 1;
+    }
+    if (!flatten)
+        printf("%s: %u of %u blocks changed\n", argv[3], changed, blocks);
+    return 0;
+}
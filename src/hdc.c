@@ -0,0 +1,323 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <assert.h>
+#include <string.h>
+
+#include "dma.h"
+#include "hdc.h"
+
+// Error codes, as REQUEST SENSE reports them.
+#define HDC_ERROR_NOT_READY     0x04
+#define HDC_ERROR_WRITE_FAULT   0x03
+#define HDC_ERROR_DATA          0x11
+#define HDC_ERROR_INVALID       0x20
+#define HDC_ERROR_ADDRESS       0x21
+
+// The XT BIOS's drive types.
+static const struct
+{
+    uint16_t cylinders;
+    uint8_t heads;
+} hdc_types[4] = { { 306, 2 }, { 375, 8 }, { 306, 6 }, { 306, 4 } };
+
+// Enter the status phase, interrupting if the host asked for that.
+static void hdc_finish(struct bus* bus, struct hdc* hdc, uint8_t error)
+{
+    const uint8_t* command = hdc->command;
+    unsigned drive = (command[1] >> 5) & 1;
+    uint16_t cylinder = (uint16_t)((command[2] & 0xC0) << 2 | command[3]);
+
+    // REQUEST SENSE reports on the command before it.
+    if (command[0] != 0x03)
+    {
+        hdc->sense[0] = error ? 0x80 | error : 0x00;
+        hdc->sense[1] = (uint8_t)(drive << 5 | (command[1] & 0x1F));
+        hdc->sense[2] = (uint8_t)((cylinder >> 2) & 0xC0) | (command[2] & 0x3F);
+        hdc->sense[3] = (uint8_t)cylinder;
+    }
+
+    hdc->completion = (uint8_t)(drive << 5 | (error ? 0x02 : 0x00));
+    hdc->phase = HDC_PHASE_STATUS;
+    if (hdc->mask & HDC_MASK_IRQ)
+    {
+        hdc->irq = true;
+        bus_irq(bus, HDC_IRQ);
+    }
+}
+
+// Move count sectors from an address, one DMA request each: into guest
+// memory (READ), out of it (WRITE), or zeroes onto the disk (FORMAT).
+static uint8_t hdc_transfer(struct bus* bus, struct hdc* hdc, struct hdc_drive* drive, unsigned count)
+{
+    const uint8_t* command = hdc->command;
+    unsigned head = command[1] & 0x1F, sector = command[2] & 0x3F;
+    unsigned cylinder = (command[2] & 0xC0) << 2 | command[3];
+    if (head >= drive->heads || sector >= HDC_SECTORS || cylinder >= drive->cylinders)
+        return HDC_ERROR_ADDRESS;
+
+    uint32_t lba = ((uint32_t)cylinder * drive->heads + head) * HDC_SECTORS + sector;
+    if (lba + count > drive->disk.sectors)
+        return HDC_ERROR_ADDRESS;
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (command[0] == 0x08)
+        {
+            const uint8_t* data = disk_read(&drive->disk, lba + i);
+            if (!data)
+                return HDC_ERROR_DATA;
+            dma_write(bus, HDC_DMA, data, DISK_SECTOR);
+            continue;
+        }
+
+        uint8_t* data = disk_write(&drive->disk, lba + i);
+        if (!data)
+            return HDC_ERROR_WRITE_FAULT;
+        if (command[0] == 0x0A)
+            dma_read(bus, HDC_DMA, data, DISK_SECTOR);
+        else
+            memset(data, 0, DISK_SECTOR);
+    }
+    return 0;
+}
+
+// The execution phase is over.
+static void hdc_execute(struct bus* bus, void* device)
+{
+    struct hdc* hdc = device;
+    const uint8_t* command = hdc->command;
+    struct hdc_drive* drive = &hdc->drives[(command[1] >> 5) & 1];
+    uint8_t error = 0;
+    if (!drive->disk.image)
+        error = HDC_ERROR_NOT_READY;
+    else
+    {
+        switch (command[0])
+        {
+            case 0x00: case 0x01: case 0x0B: case 0x0E: case 0x0F:
+            case 0xE0: case 0xE3: case 0xE4:
+                // TEST DRIVE READY, RECALIBRATE, SEEK, the sector buffer
+                // and the diagnostics: nothing to do.
+                break;
+            case 0x04:
+            {
+                // FORMAT DRIVE, from the given address to the end.
+                uint32_t start = ((uint32_t)((command[2] & 0xC0) << 2 | command[3]) * drive->heads
+                                  + (command[1] & 0x1F)) * HDC_SECTORS;
+                error = (start < drive->disk.sectors) ? hdc_transfer(bus, hdc, drive, drive->disk.sectors - start)
+                                                      : HDC_ERROR_ADDRESS;
+                break;
+            }
+            case 0x05:
+            case 0x06:
+            case 0x07:
+            case 0x08:
+            case 0x0A:
+            {
+                // VERIFY only checks the address; formatting a track covers
+                // all of it.
+                unsigned count = (command[0] == 0x06 || command[0] == 0x07) ? HDC_SECTORS
+                               : command[4] ? command[4] : 256;
+                if (command[0] == 0x05)
+                {
+                    unsigned head = command[1] & 0x1F, sector = command[2] & 0x3F;
+                    unsigned cylinder = (command[2] & 0xC0) << 2 | command[3];
+                    uint32_t lba = ((uint32_t)cylinder * drive->heads + head) * HDC_SECTORS + sector;
+                    if (head >= drive->heads || sector >= HDC_SECTORS || lba + count > drive->disk.sectors)
+                        error = HDC_ERROR_ADDRESS;
+                    break;
+                }
+                error = hdc_transfer(bus, hdc, drive, count);
+                break;
+            }
+            case 0x0C:
+            {
+                // INITIALIZE DRIVE CHARACTERISTICS, from the data phase.
+                uint16_t cylinders = (uint16_t)(hdc->data[0] << 8 | hdc->data[1]);
+                if (cylinders && hdc->data[2] && (uint32_t)cylinders * hdc->data[2] * HDC_SECTORS <= drive->disk.sectors)
+                {
+                    drive->cylinders = cylinders;
+                    drive->heads = hdc->data[2];
+                }
+                break;
+            }
+            default:
+                error = HDC_ERROR_INVALID;
+                break;
+        }
+    }
+    hdc_finish(bus, hdc, error);
+}
+
+static void hdc_execution(struct bus* bus, struct hdc* hdc)
+{
+    hdc->phase = HDC_PHASE_EXECUTION;
+    bus_schedule(bus, hdc->timer, bus->clock + HDC_EXECUTE_CLOCKS);
+}
+
+// The command block has been written in full.
+static void hdc_command(struct bus* bus, struct hdc* hdc)
+{
+    hdc->length = 0;
+    switch (hdc->command[0])
+    {
+        case 0x03:
+            // REQUEST SENSE.
+            memcpy(hdc->data, hdc->sense, 4);
+            hdc->data_length = 4;
+            hdc->phase = HDC_PHASE_DATA_IN;
+            break;
+        case 0x0C:
+            hdc->data_length = 8;
+            hdc->phase = HDC_PHASE_DATA_OUT;
+            break;
+        case 0x0D:
+            // READ ECC BURST LENGTH.
+            hdc->data[0] = 0;
+            hdc->data_length = 1;
+            hdc->phase = HDC_PHASE_DATA_IN;
+            break;
+        default:
+            hdc_execution(bus, hdc);
+            break;
+    }
+}
+
+static uint8_t hdc_in(struct bus* bus, void* device, uint16_t port)
+{
+    struct hdc* hdc = device;
+    switch (port - HDC_PORTS)
+    {
+        case 0x0:
+        {
+            if (hdc->phase == HDC_PHASE_DATA_IN)
+            {
+                uint8_t data = hdc->data[hdc->length++];
+                if (hdc->length == hdc->data_length)
+                    hdc_finish(bus, hdc, 0);
+                return data;
+            }
+            if (hdc->phase == HDC_PHASE_STATUS)
+            {
+                hdc->phase = HDC_PHASE_IDLE;
+                hdc->irq = false;
+                return hdc->completion;
+            }
+            return 0xFF;
+        }
+        case 0x1:
+        {
+            static const uint8_t status[] =
+            {
+                [HDC_PHASE_IDLE] = 0,
+                [HDC_PHASE_COMMAND] = HDC_STATUS_BUSY | HDC_STATUS_CD | HDC_STATUS_REQ,
+                [HDC_PHASE_DATA_OUT] = HDC_STATUS_BUSY | HDC_STATUS_REQ,
+                [HDC_PHASE_DATA_IN] = HDC_STATUS_BUSY | HDC_STATUS_IO | HDC_STATUS_REQ,
+                [HDC_PHASE_EXECUTION] = HDC_STATUS_BUSY,
+                [HDC_PHASE_STATUS] = HDC_STATUS_BUSY | HDC_STATUS_CD | HDC_STATUS_IO | HDC_STATUS_REQ
+            };
+            return status[hdc->phase] | (hdc->irq ? HDC_STATUS_IRQ : 0);
+        }
+        case 0x2:
+            // Drive type switches, as the XT BIOS reads them: drive 0 in
+            // bits 2-3, drive 1 in bits 0-1.
+            return (uint8_t)(hdc->drives[0].type << 2 | hdc->drives[1].type);
+        default:
+            return 0xFF;
+    }
+}
+
+static void hdc_out(struct bus* bus, void* device, uint16_t port, uint8_t data)
+{
+    struct hdc* hdc = device;
+    switch (port - HDC_PORTS)
+    {
+        case 0x0:
+        {
+            if (hdc->phase == HDC_PHASE_COMMAND)
+            {
+                hdc->command[hdc->length++] = data;
+                if (hdc->length == sizeof(hdc->command))
+                    hdc_command(bus, hdc);
+            }
+            else if (hdc->phase == HDC_PHASE_DATA_OUT)
+            {
+                hdc->data[hdc->length++] = data;
+                if (hdc->length == hdc->data_length)
+                    hdc_execution(bus, hdc);
+            }
+            break;
+        }
+        case 0x1:
+        {
+            // Controller reset.
+            bus_schedule(bus, hdc->timer, BUS_NEVER);
+            hdc->phase = HDC_PHASE_IDLE;
+            hdc->irq = false;
+            break;
+        }
+        case 0x2:
+        {
+            // Controller select: a new command follows.
+            bus_schedule(bus, hdc->timer, BUS_NEVER);
+            hdc->phase = HDC_PHASE_COMMAND;
+            hdc->length = 0;
+            hdc->irq = false;
+            break;
+        }
+        case 0x3:
+        {
+            hdc->mask = data;
+            break;
+        }
+    }
+}
+
+// Attach a fixed disk adapter with two empty drives.
+// Returns NULL if its ports cannot be mapped (see bus_map_ports()).
+struct hdc* hdc_new(struct bus* bus)
+{
+    assert(bus);
+
+    struct hdc* hdc = arena_alloc(bus->arena, sizeof(struct hdc));
+    for (unsigned i = 0; i < HDC_DRIVES; i++)
+        hdc->drives[i].type = 3;
+
+    if (!bus_map_ports(bus, HDC_PORTS, 4, hdc, hdc_in, hdc_out))
+        return NULL;
+    hdc->timer = bus_add_timer(bus, hdc, hdc_execute);
+    return hdc;
+}
+
+// Attach a disk image to a drive (NULL to remove it). Returns false if it is
+// smaller than a cylinder or larger than a drive can hold.
+bool hdc_insert(struct hdc* hdc, unsigned drive, const struct disk* image)
+{
+    assert(drive < HDC_DRIVES);
+    struct hdc_drive* d = &hdc->drives[drive];
+    if (!image)
+    {
+        disk_insert(&d->disk, NULL);
+        return true;
+    }
+
+    size_t sectors = disk_size(image) / DISK_SECTOR;
+    if (sectors > (size_t)DISK_MAX_BLOCKS * DISK_BLOCK_SECTORS || sectors < 4 * HDC_SECTORS)
+        return false;
+
+    d->type = 3;
+    d->heads = 4;
+    d->cylinders = (uint16_t)(sectors / (4 * HDC_SECTORS));
+    for (uint8_t type = 0; type < 4; type++)
+    {
+        if ((size_t)hdc_types[type].cylinders * hdc_types[type].heads * HDC_SECTORS == sectors)
+        {
+            d->type = type;
+            d->heads = hdc_types[type].heads;
+            d->cylinders = hdc_types[type].cylinders;
+        }
+    }
+    disk_insert(&d->disk, image);
+    return true;
+}
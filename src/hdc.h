@@ -0,0 +1,80 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// IBM fixed disk adapter (Xebec S1410 controller) for the XT, at ports
+// 0x320-0x323 on DMA channel 3 and IRQ 5.
+//
+// As with the floppy controller, images are mapped by the host (see
+// disk.h): reads are DMA'd straight from the mapping into guest memory, and
+// writes land in the drive's dirty-block cache. A command's whole transfer
+// happens when its execution phase ends, a millisecond of emulated time
+// after the command block was written, followed by the status phase and
+// the interrupt.
+//
+// The geometry is taken from the image's size: one of the four drive types
+// the XT BIOS knows if it matches, and otherwise 4 heads of 17 sectors.
+// Sector numbers count from 0, as the controller's do. Formatting fills
+// sectors with zeroes, so formatting more than the cache holds fails unless
+// the image is an overlay.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bus.h"
+#include "disk.h"
+
+#define HDC_PORTS               0x320
+#define HDC_DMA                 3
+#define HDC_IRQ                 5
+#define HDC_DRIVES              2
+#define HDC_SECTORS             17      // Per track.
+#define HDC_EXECUTE_CLOCKS      (BUS_MASTER_CLOCK / 1000)
+
+// Status register (0x321).
+#define HDC_STATUS_REQ          (1 << 0) // Ready for a byte.
+#define HDC_STATUS_IO           (1 << 1) // The byte goes to the host.
+#define HDC_STATUS_CD           (1 << 2) // Command or status, rather than data.
+#define HDC_STATUS_BUSY         (1 << 3)
+#define HDC_STATUS_IRQ          (1 << 5)
+
+// DMA and interrupt mask register (0x323).
+#define HDC_MASK_DMA            (1 << 0)
+#define HDC_MASK_IRQ            (1 << 1)
+
+enum hdc_phase
+{
+    HDC_PHASE_IDLE,
+    HDC_PHASE_COMMAND,
+    HDC_PHASE_DATA_OUT,             // Parameters from the host, by PIO.
+    HDC_PHASE_DATA_IN,              // Sense bytes to the host, by PIO.
+    HDC_PHASE_EXECUTION,
+    HDC_PHASE_STATUS
+};
+
+struct hdc_drive
+{
+    uint16_t cylinders;
+    uint8_t heads;
+    uint8_t type;                   // XT BIOS drive type, for the switches.
+    struct disk_drive disk;
+};
+
+struct hdc
+{
+    uint8_t mask;
+    uint8_t phase;                  // enum hdc_phase.
+    bool irq;                       // Interrupt latched, until the status byte is read.
+    uint8_t command[6];
+    uint8_t data[8];                // PIO data phase bytes.
+    unsigned length;                // Bytes of the current phase transferred.
+    unsigned data_length;
+    uint8_t completion;             // Status byte.
+    uint8_t sense[4];               // For REQUEST SENSE.
+    unsigned timer;                 // Ends the execution phase.
+    struct hdc_drive drives[HDC_DRIVES];
+};
+
+struct hdc* hdc_new(struct bus* bus);
+bool hdc_insert(struct hdc* hdc, unsigned drive, const struct disk* image);
@@ -11,7 +11,7 @@ int main()
 {
     printf("this processor makes my brain hurt!!!!!!!!!!!!\n%ld\n%s\n%d.%d.%d\n", 
         __STDC_VERSION__, GIT_HASH, MAJOR, MINOR, PATCH);
-    struct bus* pc = bus_new(0x100000);
+    struct bus* pc = bus_new(0x100000, false);
 
     /*
     // IBM PC/XT May 1986 BIOS FFFF:0000 paragraph
@@ -0,0 +1,321 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <assert.h>
+#include <string.h>
+
+#include "mda.h"
+#include "util.h"
+#include "video.h"
+
+// CRTC values for 80x25 text, as the BIOS programs them for mode 7.
+static const uint8_t mda_crtc_default[16] =
+{
+    0x61, 0x50, 0x52, 0x0F, 0x19, 0x06, 0x19, 0x19,
+    0x02, 0x0D, 0x0B, 0x0C, 0x00, 0x00, 0x00, 0x00
+};
+
+// Shades of an IBM 5151.
+#define MDA_BLACK   0x000000
+#define MDA_NORMAL  0xAAAAAA
+#define MDA_BRIGHT  0xFFFFFF
+
+static inline void mda_mark(struct mda* mda, unsigned word)
+{
+    video_mark(mda->dirty, word & (MDA_VRAM_SIZE / 2 - 1));
+    mda->dirty_any = true;
+}
+
+static inline bool mda_graphics(struct mda* mda)
+{
+    return (mda->mode & MDA_MODE_GRAPHICS) && (mda->config & MDA_CONFIG_GRAPHICS);
+}
+
+// Rebuild the attribute tables for the current mode and blink phase. The
+// MDA only distinguishes a handful of attributes: 00h and 70h (ignoring the
+// intensity and blink bits) are invisible and reverse video, a foreground of
+// 1 is underlined, and anything else is normal. Bit 3 selects the bright
+// foreground, and bit 7 the bright background of reverse video when it
+// does not mean blink.
+static void mda_attributes(struct mda* mda)
+{
+    for (unsigned attr = 0; attr < 256; attr++)
+    {
+        bool blink = (mda->mode & MDA_MODE_BLINK) && (attr & 0x80);
+        uint32_t fg = (attr & 0x08) ? MDA_BRIGHT : MDA_NORMAL;
+        uint32_t bg = MDA_BLACK;
+        bool underline = false;
+        switch (attr & 0x77)
+        {
+            case 0x00:
+                fg = MDA_BLACK;
+                break;
+            case 0x70:
+                fg = MDA_BLACK;
+                bg = ((attr & 0x80) && !(mda->mode & MDA_MODE_BLINK)) ? MDA_BRIGHT : MDA_NORMAL;
+                break;
+            default:
+                underline = (attr & 0x07) == 0x01;
+                break;
+        }
+        if (blink && !mda->blink_on)
+        {
+            fg = bg;
+            underline = false;
+        }
+        mda->attributes.fg[attr] = fg;
+        mda->attributes.bg[attr] = bg;
+        mda->attributes.underline[attr] = underline;
+    }
+}
+
+// Describe the text screen as the CRTC has it set up, for reading it back.
+// Returns false when the adapter is not showing text.
+bool mda_text(struct bus* bus, struct mda* mda, struct video_text* text)
+{
+    text->vram = &bus->memory[MDA_VRAM];
+    text->words = MDA_TEXT_SIZE / 2;
+    text->cols = 80;
+    text->height = (mda->crtc[9] & 0x1F) + 1;
+    text->rows = mda->crtc[6] & 0x7F;
+    if (text->rows * text->height > MDA_HEIGHT)
+        text->rows = (MDA_HEIGHT + text->height - 1) / text->height;
+    text->start = ((mda->crtc[12] << 8) | mda->crtc[13]) & (MDA_TEXT_SIZE / 2 - 1);
+    text->cursor_lines = 0;
+    text->cursor = ((mda->crtc[14] << 8) | mda->crtc[15]) & (MDA_TEXT_SIZE / 2 - 1);
+    text->atlas = &mda->atlas;
+    text->attributes = &mda->attributes;
+    text->pixels = mda->pixels;
+    text->pitch = MDA_WIDTH;
+    text->lines = MDA_HEIGHT;
+    text->underline_lines = (uint32_t)1 << MDA_UNDERLINE_LINE;
+    text->matches = &mda->matches;
+    return (mda->mode & MDA_MODE_ENABLE) && !mda_graphics(mda);
+}
+
+static void mda_compose_text(struct bus* bus, struct mda* mda, bool cursor_phase, bool blink_phase)
+{
+    struct video_text text;
+    mda_text(bus, mda, &text);
+    text.cursor_lines = cursor_phase ? video_cursor_lines(mda->crtc[10], mda->crtc[11]) : 0;
+
+    if (text.cursor_lines != mda->cursor_lines || text.cursor != mda->cursor_at)
+    {
+        mda_mark(mda, mda->cursor_at);
+        mda_mark(mda, text.cursor);
+    }
+    mda->cursor_lines = text.cursor_lines;
+    mda->cursor_at = text.cursor;
+
+    bool blink_on = (mda->mode & MDA_MODE_BLINK) ? blink_phase : true;
+    if (blink_on != mda->blink_on)
+    {
+        mda->blink_on = blink_on;
+        mda_attributes(mda);
+        video_text_blinking(&text, mda->dirty);
+        mda->dirty_any = true;
+    }
+
+    if (mda->redraw)
+        video_fill(mda->pixels, MDA_WIDTH * MDA_HEIGHT, MDA_BLACK);
+    else if (!mda->dirty_any && !mda->matches.rescan)
+        return;
+    if (video_text_compose(&text, mda->dirty, mda->redraw))
+        mda->changed = true;
+}
+
+static void mda_draw_line(struct mda* mda, const uint8_t* vram, unsigned start, unsigned y)
+{
+    // Scanlines are interleaved across four 8 KB banks.
+    const uint8_t* bank = vram + ((y & 3) << 13);
+    unsigned offset = start + (y >> 2) * 90;
+    uint32_t* dst = &mda->pixels[y * MDA_WIDTH];
+    for (unsigned i = 0; i < 90; i++)
+        video_expand8(dst + i * 8, bank[(offset + i) & 0x1FFF], MDA_NORMAL, MDA_BLACK);
+}
+
+static void mda_compose_graphics(struct bus* bus, struct mda* mda)
+{
+    const uint8_t* vram = &bus->memory[MDA_VRAM];
+    unsigned start = (((mda->crtc[12] << 8) | mda->crtc[13]) * 2) & 0x1FFF;
+    if (mda->redraw)
+    {
+        video_fill(mda->pixels, MDA_WIDTH * MDA_HEIGHT, MDA_BLACK);
+        for (unsigned y = 0; y < MDA_GRAPHICS_HEIGHT; y++)
+            mda_draw_line(mda, vram, start, y);
+    }
+    else
+    {
+        if (!mda->dirty_any)
+            return;
+
+        // Work out which scanlines the written words belong to.
+        bool lines[MDA_GRAPHICS_HEIGHT] = { false };
+        for (unsigned i = 0; i < MDA_VRAM_SIZE / 2 / 64; i++)
+        {
+            for (uint64_t bits = mda->dirty[i]; bits; bits &= bits - 1)
+            {
+                unsigned address = (i * 64 + quick_ctz64(bits)) * 2;
+                for (unsigned byte = address; byte < address + 2; byte++)
+                {
+                    unsigned row = (((byte & 0x1FFF) - start) & 0x1FFF) / 90;
+                    if (row < MDA_GRAPHICS_HEIGHT / 4)
+                        lines[row * 4 + (byte >> 13)] = true;
+                }
+            }
+        }
+        for (unsigned y = 0; y < MDA_GRAPHICS_HEIGHT; y++)
+            if (lines[y])
+                mda_draw_line(mda, vram, start, y);
+    }
+    mda->changed = true;
+}
+
+// Compose a frame from whatever changed since the last one. This normally
+// runs at the start of every vertical sync.
+void mda_compose(struct bus* bus, struct mda* mda)
+{
+    bool cursor_phase = !((mda->frames >> 3) & 1);    // 8 frames on, 8 off.
+    bool blink_phase = !((mda->frames >> 4) & 1);     // 16 frames on, 16 off.
+    mda->frames++;
+    mda->changed = false;
+
+    if (!(mda->mode & MDA_MODE_ENABLE))
+    {
+        if (mda->redraw)
+        {
+            video_fill(mda->pixels, MDA_WIDTH * MDA_HEIGHT, MDA_BLACK);
+            mda->changed = true;
+        }
+    }
+    else if (mda_graphics(mda))
+        mda_compose_graphics(bus, mda);
+    else
+        mda_compose_text(bus, mda, cursor_phase, blink_phase);
+
+    if (mda->changed)
+        mda->updates++;
+    if (mda->dirty_any)
+        memset(mda->dirty, 0, sizeof(mda->dirty));
+    mda->dirty_any = false;
+    mda->redraw = false;
+}
+
+static void mda_written(struct bus* bus, void* device, uint32_t address, size_t length)
+{
+    struct mda* mda = device;
+    unsigned first = (address - MDA_VRAM) / 2;
+    unsigned last = (address + length - 1 - MDA_VRAM) / 2;
+    for (unsigned word = first; word <= last; word++)
+        mda_mark(mda, word);
+}
+
+static uint8_t mda_in(struct bus* bus, void* device, uint16_t port)
+{
+    struct mda* mda = device;
+    switch (port - MDA_PORTS)
+    {
+        // Only the cursor and light pen registers can be read back.
+        case 0x1: case 0x3: case 0x5: case 0x7:
+            return (mda->crtc_index >= 14 && mda->crtc_index < 18) ? mda->crtc[mda->crtc_index] : 0x00;
+        case 0xA:
+        {
+            unsigned position = bus->clock % MDA_FRAME_CLOCKS;
+            unsigned line = position / MDA_LINE_CLOCKS;
+            unsigned dot = position % MDA_LINE_CLOCKS;
+            uint8_t status = 0x70;
+            if (dot >= MDA_DISPLAY_CLOCKS)
+                status |= MDA_STATUS_HSYNC;
+            if (!(line >= MDA_VSYNC_LINE && line < MDA_VSYNC_LINE + MDA_VSYNC_LINES))
+                status |= MDA_STATUS_NOT_VSYNC;
+            return status;
+        }
+        default:
+            return 0xFF;
+    }
+}
+
+static void mda_out(struct bus* bus, void* device, uint16_t port, uint8_t data)
+{
+    struct mda* mda = device;
+    switch (port - MDA_PORTS)
+    {
+        case 0x0: case 0x2: case 0x4: case 0x6:
+        {
+            mda->crtc_index = data & 0x1F;
+            break;
+        }
+        case 0x1: case 0x3: case 0x5: case 0x7:
+        {
+            // R16/R17 (light pen) are read-only. The cursor registers are
+            // picked up by the next frame without a full redraw.
+            if (mda->crtc_index >= 16 || mda->crtc[mda->crtc_index] == data)
+                break;
+            mda->crtc[mda->crtc_index] = data;
+            if (mda->crtc_index != 10 && mda->crtc_index != 11
+                && mda->crtc_index != 14 && mda->crtc_index != 15)
+                mda->redraw = true;
+            break;
+        }
+        case 0x8:
+        case MDA_CONFIG_PORT - MDA_PORTS:
+        {
+            uint8_t* reg = (port - MDA_PORTS == 0x8) ? &mda->mode : &mda->config;
+            if (*reg == data)
+                break;
+            *reg = data;
+            mda_attributes(mda);
+            mda->redraw = true;
+            break;
+        }
+    }
+}
+
+static void mda_schedule(struct bus* bus, struct mda* mda)
+{
+    uint64_t deadline = bus->clock / MDA_FRAME_CLOCKS * MDA_FRAME_CLOCKS
+                      + MDA_VSYNC_LINE * MDA_LINE_CLOCKS;
+    if (deadline <= bus->clock)
+        deadline += MDA_FRAME_CLOCKS;
+    bus_schedule(bus, mda->timer, deadline);
+}
+
+static void mda_vsync(struct bus* bus, void* device)
+{
+    struct mda* mda = device;
+    mda_compose(bus, mda);
+    mda_schedule(bus, mda);
+}
+
+// Attach an MDA (or Hercules card) to the bus. The font holds MDA_FONT_HEIGHT
+// bytes per glyph, one per scanline; the real ROM splits each glyph into an
+// 8 and a 6 scanline half 2 KB apart, which callers must join. Without a
+// font, text is drawn blank.
+// Returns NULL if its ports or VRAM cannot be mapped (see bus_map_ports() and
+// bus_watch()).
+struct mda* mda_new(struct bus* bus, const uint8_t* font)
+{
+    assert(bus);
+    assert(bus->memory_size >= MDA_VRAM + MDA_VRAM_SIZE);
+
+    struct mda* mda = arena_alloc(bus->arena, sizeof(struct mda));
+    memcpy(mda->crtc, mda_crtc_default, sizeof(mda_crtc_default));
+    mda->mode = MDA_MODE_HIRES | MDA_MODE_ENABLE | MDA_MODE_BLINK;
+    mda->blink_on = true;
+    mda->redraw = true;
+    if (font)
+        memcpy(mda->font, font, MDA_FONT_SIZE);
+    mda_attributes(mda);
+    video_atlas_build(&mda->atlas, mda->font, MDA_FONT_HEIGHT, MDA_FONT_HEIGHT, 9);
+
+    if (!bus_map_ports(bus, MDA_PORTS, 12, mda, mda_in, mda_out)
+        || !bus_map_ports(bus, MDA_CONFIG_PORT, 1, mda, mda_in, mda_out)
+        || !bus_watch(bus, MDA_VRAM, MDA_VRAM_SIZE, mda, mda_written))
+    {
+        bus_unmap_ports(bus, mda);
+        return NULL;
+    }
+    mda->timer = bus_add_timer(bus, mda, mda_vsync);
+    mda_schedule(bus, mda);
+    return mda;
+}
@@ -0,0 +1,90 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// IBM Monochrome Display Adapter, with the Hercules Graphics Card's 720x348
+// graphics mode.
+//
+// Works like the CGA (see cga.h): VRAM at 0xB0000 is plain RAM watched by the
+// bus, and a frame is composed at each vertical sync from the character rows
+// or scanlines whose words were written since the last one. Text goes through
+// the shared glyph atlas renderer in video.h with 9-dot cells.
+//
+// Graphics mode is only available once enabled through the configuration
+// port, as on a real card. Only the first 32 KB page is emulated: the second
+// one overlaps a CGA at 0xB8000, so page select is ignored.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bus.h"
+#include "video.h"
+
+#define MDA_VRAM                0xB0000
+#define MDA_VRAM_SIZE           0x8000      // One Hercules page; the MDA decodes 4 KB of it.
+#define MDA_TEXT_SIZE           0x1000
+#define MDA_PORTS               0x3B0
+#define MDA_CONFIG_PORT         0x3BF
+#define MDA_WIDTH               720
+#define MDA_HEIGHT              350
+#define MDA_GRAPHICS_HEIGHT     348
+#define MDA_FONT_HEIGHT         14
+#define MDA_FONT_SIZE           (256 * MDA_FONT_HEIGHT)
+#define MDA_UNDERLINE_LINE      12
+
+// The MDA's 16.257 MHz dot clock gives 18.432 kHz lines (882 dots), which is
+// close enough to 777 master clocks, and 370 lines per frame.
+#define MDA_LINE_CLOCKS         777
+#define MDA_DISPLAY_CLOCKS      634         // 720 dots of each line.
+#define MDA_FRAME_LINES         370
+#define MDA_FRAME_CLOCKS        (MDA_LINE_CLOCKS * MDA_FRAME_LINES)
+#define MDA_VSYNC_LINE          350
+#define MDA_VSYNC_LINES         16
+
+// Mode control register (0x3B8).
+#define MDA_MODE_HIRES          (1 << 0)
+#define MDA_MODE_GRAPHICS       (1 << 1)    // Hercules.
+#define MDA_MODE_ENABLE         (1 << 3)
+#define MDA_MODE_BLINK          (1 << 5)
+#define MDA_MODE_PAGE           (1 << 7)    // Hercules.
+
+// Hercules configuration switch (0x3BF).
+#define MDA_CONFIG_GRAPHICS     (1 << 0)
+#define MDA_CONFIG_PAGE         (1 << 1)
+
+// Status register (0x3BA).
+#define MDA_STATUS_HSYNC        (1 << 0)
+#define MDA_STATUS_VIDEO        (1 << 3)
+#define MDA_STATUS_NOT_VSYNC    (1 << 7)    // Hercules.
+
+struct mda
+{
+    // Registers.
+    uint8_t crtc[18];               // 6845 CRTC registers R0-R17.
+    uint8_t crtc_index;             // Selected CRTC register.
+    uint8_t mode;                   // Mode control register.
+    uint8_t config;                 // Hercules configuration switch.
+
+    // Composition state.
+    unsigned timer;                 // Vertical sync timer.
+    uint64_t frames;                // Frames composed so far.
+    bool changed;                   // Did the last frame differ from the one before?
+    uint64_t updates;               // Frames composed that differed from the one before.
+    bool redraw;                    // Must the next frame be composed in full?
+    bool dirty_any;                 // Is any bit in dirty set?
+    bool blink_on;                  // Blinking characters shown in the last frame?
+    uint32_t cursor_lines;          // Cursor scanlines shown in the last frame.
+    uint16_t cursor_at;             // Word the cursor was last drawn at.
+    uint64_t dirty[MDA_VRAM_SIZE / 2 / 64]; // One bit per VRAM word written since the last frame.
+
+    uint8_t font[MDA_FONT_SIZE];    // Character generator ROM (9x14 cells, 8x14 glyphs).
+    struct video_attributes attributes;
+    struct video_matches matches;   // Text automation is waiting for.
+    struct video_atlas atlas;
+    uint32_t pixels[MDA_WIDTH * MDA_HEIGHT];
+};
+
+struct mda* mda_new(struct bus* bus, const uint8_t* font);
+void mda_compose(struct bus* bus, struct mda* mda);
+bool mda_text(struct bus* bus, struct mda* mda, struct video_text* text);
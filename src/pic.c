@@ -0,0 +1,141 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <assert.h>
+
+#include "pic.h"
+
+// The highest priority line set in bits, or PIC_LINES if none are.
+static inline unsigned pic_highest(uint8_t bits)
+{
+    for (unsigned line = 0; line < PIC_LINES; line++)
+        if (bits & (1 << line))
+            return line;
+    return PIC_LINES;
+}
+
+// The line the CPU would be handed if it acknowledged now, or PIC_LINES.
+static unsigned pic_pending(const struct pic* pic)
+{
+    unsigned line = pic_highest(pic->irr & ~pic->imr);
+    return (line < pic_highest(pic->isr)) ? line : PIC_LINES;
+}
+
+// Drive the CPU's INTR pin from the controller's state.
+static void pic_update(struct bus* bus, struct pic* pic)
+{
+    unsigned line = pic_pending(pic);
+    bus->cpu->intr = line < PIC_LINES;
+    if (line < PIC_LINES)
+        bus->cpu->intr_vector = (uint8_t)(pic->vector + line);
+}
+
+static uint8_t pic_in(struct bus* bus, void* device, uint16_t port)
+{
+    struct pic* pic = device;
+    if (port == PIC_PORTS + 1)
+        return pic->imr;
+    return pic->read_isr ? pic->isr : pic->irr;
+}
+
+static void pic_out(struct bus* bus, void* device, uint16_t port, uint8_t data)
+{
+    struct pic* pic = device;
+    if (port == PIC_PORTS + 1)
+    {
+        switch (pic->init)
+        {
+            case 2:
+            {
+                pic->vector = data & 0xF8;
+                pic->init = !pic->single ? 3 : pic->icw4 ? 4 : 0;
+                break;
+            }
+            case 3:
+            {
+                pic->init = pic->icw4 ? 4 : 0;
+                break;
+            }
+            case 4:
+            {
+                pic->init = 0;
+                break;
+            }
+            default:
+            {
+                pic->imr = data;
+                break;
+            }
+        }
+    }
+    else if (data & PIC_ICW1)
+    {
+        // Initialisation clears the mask and everything in service, and
+        // reads return requests again.
+        pic->irr = 0;
+        pic->isr = 0;
+        pic->imr = 0;
+        pic->read_isr = false;
+        pic->icw4 = data & PIC_ICW1_ICW4;
+        pic->single = data & PIC_ICW1_SINGLE;
+        pic->init = 2;
+    }
+    else if (data & PIC_OCW3)
+    {
+        if (data & PIC_OCW3_READ)
+            pic->read_isr = data & PIC_OCW3_READ_ISR;
+    }
+    else if ((data & 0xE0) == PIC_OCW2_EOI)
+    {
+        unsigned line = pic_highest(pic->isr);
+        if (line < PIC_LINES)
+            pic->isr &= ~(1 << line);
+    }
+    else if ((data & 0xE0) == PIC_OCW2_SPECIFIC_EOI)
+    {
+        pic->isr &= ~(1 << (data & 7));
+    }
+    pic_update(bus, pic);
+}
+
+// Attach the interrupt controller to the bus, set up as the BIOS leaves it:
+// IRQ 0 at vector 8, with no lines masked. Returns NULL if its ports cannot
+// be mapped (see bus_map_ports()).
+struct pic* pic_new(struct bus* bus)
+{
+    assert(bus && !bus->pic);
+
+    struct pic* pic = arena_alloc(bus->arena, sizeof(struct pic));
+    pic->vector = 0x08;
+
+    if (!bus_map_ports(bus, PIC_PORTS, 2, pic, pic_in, pic_out))
+        return NULL;
+    bus->pic = pic;
+    return pic;
+}
+
+// Latch a request on a line (see bus_irq()).
+void pic_request(struct bus* bus, unsigned line)
+{
+    struct pic* pic = bus->pic;
+    assert(pic && line < PIC_LINES);
+    pic->irr |= 1 << line;
+    pic_update(bus, pic);
+}
+
+// The CPU's interrupt acknowledge: put the pending request in service and
+// return its vector. If the request has gone, the vector of IRQ 7 is
+// returned, as on the real chip, without putting anything in service.
+uint8_t pic_acknowledge(struct bus* bus)
+{
+    struct pic* pic = bus->pic;
+    assert(pic);
+    unsigned line = pic_pending(pic);
+    if (line == PIC_LINES)
+        return (uint8_t)(pic->vector + 7);
+
+    pic->irr &= ~(1 << line);
+    pic->isr |= 1 << line;
+    pic_update(bus, pic);
+    return (uint8_t)(pic->vector + line);
+}
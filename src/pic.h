@@ -0,0 +1,55 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Intel 8259A interrupt controller (the PC/XT's single controller, IRQ 0-7).
+//
+// Devices raise a line with bus_irq(), which latches it in the request
+// register. The CPU's INTR pin is asserted while a request is unmasked and
+// of higher priority than every interrupt in service; acknowledging it moves
+// the request into service and hands the CPU its vector (bus_acknowledge()).
+// It stays in service, holding off lower priority lines, until the handler
+// writes an end of interrupt.
+//
+// The controller is reached through bus->pic. Only what the BIOS and DOS
+// programs use is modelled: edge triggered requests at fixed priority (IRQ 0
+// highest), specific and non-specific EOI, the mask register, and reading
+// the request or in-service register. Cascading, priority rotation, special
+// mask mode, polling and automatic EOI are not.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bus.h"
+
+#define PIC_PORTS               0x20
+#define PIC_LINES               8
+
+// Initialisation command word 1 (written to 0x20 with bit 4 set).
+#define PIC_ICW1                (1 << 4)
+#define PIC_ICW1_ICW4           (1 << 0)    // ICW4 follows.
+#define PIC_ICW1_SINGLE         (1 << 1)    // No ICW3, as there is no cascade.
+
+// Operation command words 2 and 3 (written to 0x20).
+#define PIC_OCW3                (1 << 3)
+#define PIC_OCW3_READ           (1 << 1)    // Select the register read from 0x20...
+#define PIC_OCW3_READ_ISR       (1 << 0)    // ...the in-service register rather than requests.
+#define PIC_OCW2_EOI            0x20        // Non-specific EOI.
+#define PIC_OCW2_SPECIFIC_EOI   0x60        // Plus the line.
+
+struct pic
+{
+    uint8_t irr;                    // Requests latched and not yet acknowledged.
+    uint8_t isr;                    // Interrupts in service, until their EOI.
+    uint8_t imr;                    // Masked lines.
+    uint8_t vector;                 // Vector of IRQ 0 (ICW2).
+    uint8_t init;                   // Initialisation command word expected next, or 0.
+    bool icw4;                      // Does ICW4 follow?
+    bool single;                    // Is ICW3 skipped?
+    bool read_isr;                  // Does 0x20 read the in-service register?
+};
+
+struct pic* pic_new(struct bus* bus);
+void pic_request(struct bus* bus, unsigned line);
+uint8_t pic_acknowledge(struct bus* bus);
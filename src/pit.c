@@ -0,0 +1,319 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <assert.h>
+
+#include "pit.h"
+
+// Ticks per period of a channel's count (0 counts 65536).
+static inline uint32_t pit_period(const struct pit_channel* channel)
+{
+    return channel->reload ? channel->reload : 0x10000;
+}
+
+// The channel's output at a given tick.
+bool pit_output(const struct pit_channel* channel, uint64_t tick)
+{
+    if (!channel->counting)
+        return channel->mode != 0 && channel->mode != 1;
+    if ((channel->mode == 2 || channel->mode == 3) && !channel->gate)
+        return true;
+
+    uint64_t elapsed = (tick > channel->start) ? tick - channel->start : 0;
+    uint32_t period = pit_period(channel);
+    switch (channel->mode)
+    {
+        case 0:
+        case 1:
+            return elapsed >= period;
+        case 2:
+            return elapsed % period != period - 1;
+        case 3:
+            return elapsed % period < (period + 1) / 2;
+        default:
+            return elapsed != period;
+    }
+}
+
+// The channel's count at a given tick, as a read would see it.
+uint16_t pit_count(const struct pit_channel* channel, uint64_t tick)
+{
+    if (!channel->counting)
+        return channel->reload;
+
+    uint64_t elapsed = (tick > channel->start) ? tick - channel->start : 0;
+    uint32_t period = pit_period(channel);
+    switch (channel->mode)
+    {
+        case 2:
+            return (uint16_t)(period - elapsed % period);
+        case 3:
+        {
+            // Counts down by two, once for each half of the wave.
+            uint32_t phase = (uint32_t)(elapsed % period);
+            uint32_t half = (period + 1) / 2;
+            return (uint16_t)((period - 2 * (phase < half ? phase : phase - half)) & ~1u);
+        }
+        default:
+            return (uint16_t)(period - elapsed);
+    }
+}
+
+// The first tick after a given one at which the channel's output changes, or
+// PIT_NEVER.
+uint64_t pit_next_edge(const struct pit_channel* channel, uint64_t tick)
+{
+    if (!channel->counting)
+        return PIT_NEVER;
+    if ((channel->mode == 2 || channel->mode == 3) && !channel->gate)
+        return PIT_NEVER;
+
+    // The output holds its initial level until the count starts.
+    if (tick < channel->start)
+        tick = channel->start;
+    uint64_t elapsed = tick - channel->start;
+    uint32_t period = pit_period(channel);
+    switch (channel->mode)
+    {
+        case 0:
+        case 1:
+            return (elapsed < period) ? channel->start + period : PIT_NEVER;
+        case 2:
+        {
+            if (period < 2)
+                return PIT_NEVER;
+            uint32_t phase = (uint32_t)(elapsed % period);
+            return (phase < period - 1) ? tick + (period - 1 - phase) : tick + 1;
+        }
+        case 3:
+        {
+            if (period < 2)
+                return PIT_NEVER;
+            uint32_t phase = (uint32_t)(elapsed % period);
+            uint32_t half = (period + 1) / 2;
+            return (phase < half) ? tick + (half - phase) : tick + (period - phase);
+        }
+        default:
+            if (elapsed < period)
+                return channel->start + period;
+            return (elapsed == period) ? tick + 1 : PIT_NEVER;
+    }
+}
+
+// Channel 2 in mode 2 or 3 at a frequency above Nyquist?
+static bool pit_ultrasonic(const struct pit* pit, const struct pit_channel* channel)
+{
+    return channel->counting && channel->gate && (channel->mode == 2 || channel->mode == 3)
+        && pit_period(channel) < 2 * PIT_CLOCK / pit->blip.rate;
+}
+
+// The speaker's level at a given tick, from 0 to 1.
+static float pit_speaker_level(const struct pit* pit, uint64_t tick)
+{
+    const struct pit_channel* channel = &pit->channels[2];
+    if (!(pit->ppi & PIT_PPI_SPEAKER))
+        return 0.0f;
+    if (pit_ultrasonic(pit, channel))
+    {
+        float period = (float)pit_period(channel);
+        return (channel->mode == 3) ? (float)((pit_period(channel) + 1) / 2) / period : (period - 1.0f) / period;
+    }
+    return pit_output(channel, tick) ? 1.0f : 0.0f;
+}
+
+// Add the speaker edges up to a given tick to the synthesiser.
+static void pit_render(struct pit* pit, uint64_t tick)
+{
+    if (!pit->blip.rate || tick <= pit->rendered)
+        return;
+
+    const struct pit_channel* channel = &pit->channels[2];
+    if ((pit->ppi & PIT_PPI_SPEAKER) && !pit_ultrasonic(pit, channel))
+    {
+        for (uint64_t edge = pit_next_edge(channel, pit->rendered); edge <= tick;
+             edge = pit_next_edge(channel, edge))
+        {
+            float level = pit_output(channel, edge) ? 1.0f : 0.0f;
+            audio_blip_step(&pit->blip, edge * PIT_CLOCK_DIVISOR, (level - pit->level) * PIT_SPEAKER_VOLUME);
+            pit->level = level;
+        }
+    }
+    pit->rendered = tick;
+}
+
+// Step the speaker to its level after channel 2 or port 0x61 changed. The
+// edges before the change must have been rendered already.
+static void pit_speaker_changed(struct pit* pit, uint64_t tick)
+{
+    if (!pit->blip.rate)
+        return;
+    float level = pit_speaker_level(pit, tick);
+    if (level != pit->level)
+    {
+        audio_blip_step(&pit->blip, tick * PIT_CLOCK_DIVISOR, (level - pit->level) * PIT_SPEAKER_VOLUME);
+        pit->level = level;
+    }
+}
+
+// A count has been written in full.
+static void pit_load(struct pit_channel* channel, uint64_t tick)
+{
+    channel->loaded = true;
+
+    // Modes 1 and 5 wait for the gate to trigger them.
+    if (channel->mode == 1 || channel->mode == 5)
+        return;
+    channel->counting = true;
+    channel->start = tick + 1;
+}
+
+static void pit_gate(struct pit_channel* channel, bool gate, uint64_t tick)
+{
+    bool rising = gate && !channel->gate;
+    channel->gate = gate;
+    if (rising && channel->loaded && channel->mode != 0 && channel->mode != 4)
+    {
+        channel->counting = true;
+        channel->start = tick + 1;
+    }
+}
+
+static uint8_t pit_in(struct bus* bus, void* device, uint16_t port)
+{
+    struct pit* pit = device;
+    if (port == PIT_PPI_PORT)
+        return pit->ppi;
+    if (port - PIT_PORTS == 3)
+        return 0xFF;
+
+    struct pit_channel* channel = &pit->channels[port - PIT_PORTS];
+    uint16_t value = channel->latched ? channel->latch : pit_count(channel, bus->clock / PIT_CLOCK_DIVISOR);
+    switch (channel->access)
+    {
+        case PIT_ACCESS_LOW:
+            channel->latched = false;
+            return (uint8_t)value;
+        case PIT_ACCESS_HIGH:
+            channel->latched = false;
+            return (uint8_t)(value >> 8);
+        default:
+            channel->read_high = !channel->read_high;
+            if (channel->read_high)
+                return (uint8_t)value;
+            channel->latched = false;
+            return (uint8_t)(value >> 8);
+    }
+}
+
+static void pit_out(struct bus* bus, void* device, uint16_t port, uint8_t data)
+{
+    struct pit* pit = device;
+    uint64_t tick = bus->clock / PIT_CLOCK_DIVISOR;
+
+    // Anything that can change the speaker first renders it up to now.
+    unsigned index = (port == PIT_PPI_PORT) ? 2 : (port - PIT_PORTS == 3) ? data >> 6 : port - PIT_PORTS;
+    if (index == 2)
+        pit_render(pit, tick);
+
+    if (port == PIT_PPI_PORT)
+    {
+        pit->ppi = data;
+        pit_gate(&pit->channels[2], data & PIT_PPI_GATE, tick);
+    }
+    else if (port - PIT_PORTS == 3)
+    {
+        // The 8254's read-back command (channel 3) is not supported.
+        if (index == 3)
+            return;
+
+        struct pit_channel* channel = &pit->channels[index];
+        uint8_t access = (data >> 4) & 3;
+        if (access == PIT_ACCESS_LATCH)
+        {
+            if (!channel->latched)
+            {
+                channel->latch = pit_count(channel, tick);
+                channel->latched = true;
+            }
+            return;
+        }
+
+        channel->access = access;
+        channel->mode = (data >> 1) & 7;
+        if (channel->mode >= 6)
+            channel->mode -= 4;
+        channel->loaded = false;
+        channel->counting = false;
+        channel->write_high = false;
+        channel->read_high = false;
+        channel->latched = false;
+    }
+    else
+    {
+        struct pit_channel* channel = &pit->channels[index];
+        switch (channel->access)
+        {
+            case PIT_ACCESS_LOW:
+                channel->reload = data;
+                pit_load(channel, tick);
+                break;
+            case PIT_ACCESS_HIGH:
+                channel->reload = (uint16_t)(data << 8);
+                pit_load(channel, tick);
+                break;
+            default:
+                if (!channel->write_high)
+                {
+                    // Mode 0 stops counting (and drops its output) until
+                    // the high byte arrives.
+                    channel->reload = (channel->reload & 0xFF00) | data;
+                    channel->write_high = true;
+                    if (channel->mode == 0)
+                        channel->counting = false;
+                    break;
+                }
+                channel->reload = (uint16_t)((channel->reload & 0x00FF) | (data << 8));
+                channel->write_high = false;
+                pit_load(channel, tick);
+                break;
+        }
+    }
+
+    if (index == 2)
+        pit_speaker_changed(pit, tick);
+}
+
+// Create the PIT and speaker, rendering the speaker at rate samples
+// per second (none if 0).
+// Returns NULL if its ports cannot be mapped (see bus_map_ports()).
+struct pit* pit_new(struct bus* bus, unsigned rate)
+{
+    assert(bus);
+
+    struct pit* pit = arena_alloc(bus->arena, sizeof(struct pit));
+    pit->channels[0].gate = true;
+    pit->channels[1].gate = true;
+    pit->rendered = bus->clock / PIT_CLOCK_DIVISOR;
+    if (rate)
+        audio_blip_init(&pit->blip, rate, bus->clock);
+
+    if (!bus_map_ports(bus, PIT_PORTS, 4, pit, pit_in, pit_out)
+        || !bus_map_ports(bus, PIT_PPI_PORT, 1, pit, pit_in, pit_out))
+    {
+        bus_unmap_ports(bus, pit);
+        return NULL;
+    }
+    return pit;
+}
+
+// Render the speaker up to the bus's clock and read up to max of
+// the samples that are complete. Meant to be called at frame or buffer
+// boundaries; anything left unread for longer than AUDIO_BLIP_SIZE samples
+// is skipped.
+size_t pit_audio(struct bus* bus, struct pit* pit, int16_t* samples, size_t max)
+{
+    if (!pit->blip.rate)
+        return 0;
+    pit_render(pit, bus->clock / PIT_CLOCK_DIVISOR);
+    return audio_blip_read(&pit->blip, bus->clock, samples, max);
+}
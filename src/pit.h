@@ -0,0 +1,86 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Intel 8253 programmable interval timer, and the PC speaker it drives.
+//
+// The PIT is not clocked. Each channel remembers the tick it started counting
+// at, and its count and output at any later tick are worked out from the
+// elapsed ticks and its mode, so an idle timer (or a square wave) costs
+// nothing while the CPU runs.
+//
+// The speaker is channel 2's output, gated by port 0x61 (8255 port B): bit 0
+// is channel 2's gate and bit 1 lets the output through. It is rendered
+// lazily: whenever channel 2 or port 0x61 is written, and whenever the host
+// reads a batch of samples (at a frame or buffer boundary), the edges since
+// the last render are derived from the channel's state and added to a
+// band-limited synthesiser (see audio.h). Tones above Nyquist cannot be heard
+// as tones, only as their average level, so they contribute a single step at
+// that level instead of an edge every few samples.
+//
+// Port 0x61's other bits read back as written. Channel 0 does not raise
+// IRQ 0 on the interrupt controller yet. BCD counting is not supported, and
+// reloading a counting channel in mode 2 or 3 takes effect at once rather
+// than at the end of the current period.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "audio.h"
+#include "bus.h"
+
+#define PIT_PORTS               0x40
+#define PIT_PPI_PORT            0x61
+
+// The PIT is clocked at a third of the 4.77 MHz CPU clock.
+#define PIT_CLOCK_DIVISOR       12
+#define PIT_CLOCK               (BUS_MASTER_CLOCK / PIT_CLOCK_DIVISOR)
+
+// Port 0x61.
+#define PIT_PPI_GATE            (1 << 0)
+#define PIT_PPI_SPEAKER         (1 << 1)
+
+// Control word access modes.
+#define PIT_ACCESS_LATCH        0
+#define PIT_ACCESS_LOW          1
+#define PIT_ACCESS_HIGH         2
+#define PIT_ACCESS_WORD         3
+
+// Full scale of the speaker, as a fraction of the output's.
+#define PIT_SPEAKER_VOLUME      0.25f
+
+#define PIT_NEVER               UINT64_MAX
+
+struct pit_channel
+{
+    uint16_t reload;                // Count written (0 counts 65536).
+    uint16_t latch;                 // Count latched by the control word.
+    uint8_t mode;                   // 0-5.
+    uint8_t access;                 // PIT_ACCESS_*.
+    bool write_high;                // Is the next write the high byte of a word?
+    bool read_high;                 // Is the next read the high byte of a word?
+    bool latched;                   // Is latch waiting to be read?
+    bool gate;
+    bool loaded;                    // Has a count been written since the control word?
+    bool counting;                  // Loaded and, in modes 1 and 5, triggered.
+    uint64_t start;                 // Tick the count started at.
+};
+
+struct pit
+{
+    struct pit_channel channels[3];
+    uint8_t ppi;                    // Port 0x61.
+
+    // Speaker.
+    uint64_t rendered;              // Tick the speaker has been rendered up to.
+    float level;                    // Speaker level there, from 0 to 1.
+    struct audio_blip blip;         // Only used if blip.rate is not 0.
+};
+
+struct pit* pit_new(struct bus* bus, unsigned rate);
+bool pit_output(const struct pit_channel* channel, uint64_t tick);
+uint16_t pit_count(const struct pit_channel* channel, uint64_t tick);
+uint64_t pit_next_edge(const struct pit_channel* channel, uint64_t tick);
+size_t pit_audio(struct bus* bus, struct pit* pit, int16_t* samples, size_t max);
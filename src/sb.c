@@ -0,0 +1,309 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <assert.h>
+#include <string.h>
+
+#include "dma.h"
+#include "sb.h"
+
+// Master clock a sample of the current block plays at.
+static inline uint64_t sb_sample_clock(const struct sb* sb, uint32_t sample)
+{
+    return sb->block_start + (uint64_t)sample * (256 - sb->time_constant) * BUS_MASTER_CLOCK / 1000000;
+}
+
+// Samples of the current block that have started playing by a master clock.
+static uint32_t sb_played(const struct sb* sb, uint64_t clock)
+{
+    if (clock < sb->block_start)
+        return 0;
+    uint64_t played = (clock - sb->block_start) * 1000000 / ((uint64_t)(256 - sb->time_constant) * BUS_MASTER_CLOCK) + 1;
+    return (played < sb->block_length) ? (uint32_t)played : sb->block_length;
+}
+
+// Bring the output in line with the DAC and speaker as of a master clock.
+static void sb_update(struct sb* sb, uint64_t clock)
+{
+    float heard = sb->speaker ? sb->level * SB_VOLUME : 0.0f;
+    if (heard != sb->heard && sb->blip.rate)
+        audio_blip_step(&sb->blip, clock, heard - sb->heard);
+    sb->heard = heard;
+}
+
+static void sb_level(struct sb* sb, uint64_t clock, uint8_t sample)
+{
+    if (sample == sb->dac)
+        return;
+    sb->dac = sample;
+    sb->level = (float)(sample - 128) / 128.0f;
+    sb_update(sb, clock);
+}
+
+// Move the samples of the current block played by a master clock between the
+// DSP and guest memory, a batch at a time.
+static void sb_fetch(struct bus* bus, struct sb* sb, uint64_t clock)
+{
+    if (!sb->active || sb->paused)
+        return;
+
+    uint32_t played = sb_played(sb, clock);
+    if (sb->silence)
+    {
+        sb->fetched = played;
+        return;
+    }
+
+    while (sb->fetched < played)
+    {
+        uint8_t data[256];
+        uint32_t count = played - sb->fetched;
+        if (count > sizeof(data))
+            count = sizeof(data);
+
+        if (sb->recording)
+        {
+            memset(data, 0x80, count);
+            dma_write(bus, SB_DMA, data, count);
+        }
+        else
+        {
+            // A starved transfer leaves the DAC where it was.
+            size_t got = dma_read(bus, SB_DMA, data, count);
+            for (size_t i = 0; i < got; i++)
+                sb_level(sb, sb_sample_clock(sb, sb->fetched + (uint32_t)i), data[i]);
+        }
+        sb->fetched += count;
+    }
+}
+
+static void sb_push(struct sb* sb, uint8_t data)
+{
+    if (sb->output_count == SB_OUTPUT)
+        return;
+    sb->output[(sb->output_head + sb->output_count++) % SB_OUTPUT] = data;
+}
+
+// Start a block of length samples from now.
+static void sb_start(struct bus* bus, struct sb* sb, uint32_t length, bool auto_init, bool recording)
+{
+    sb_fetch(bus, sb, bus->clock);
+    sb->active = true;
+    sb->auto_init = auto_init;
+    sb->exit_auto_init = false;
+    sb->silence = false;
+    sb->recording = recording;
+    sb->paused = false;
+    sb->block_start = bus->clock;
+    sb->block_length = length;
+    sb->fetched = 0;
+    bus_schedule(bus, sb->timer, sb_sample_clock(sb, length));
+}
+
+// The current block has played: finish it, raise the IRQ, and carry on with
+// the next one in auto-init mode.
+static void sb_block_end(struct bus* bus, void* device)
+{
+    struct sb* sb = device;
+    uint64_t end = sb_sample_clock(sb, sb->block_length);
+    sb_fetch(bus, sb, end);
+    bus_irq(bus, sb->irq);
+
+    if (sb->auto_init && !sb->exit_auto_init)
+    {
+        sb->block_start = end;
+        sb->fetched = 0;
+        bus_schedule(bus, sb->timer, sb_sample_clock(sb, sb->block_length));
+    }
+    else
+        sb->active = false;
+}
+
+static unsigned sb_arguments(uint8_t command)
+{
+    switch (command)
+    {
+        case 0x10: case 0x38: case 0x40: case 0xE0: case 0xE4:
+            return 1;
+        case 0x14: case 0x24: case 0x48: case 0x80:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+static void sb_command(struct bus* bus, struct sb* sb)
+{
+    uint16_t length = (uint16_t)(sb->args[0] | sb->args[1] << 8);
+    switch (sb->command)
+    {
+        case 0x10:
+        {
+            // Direct output.
+            sb_fetch(bus, sb, bus->clock);
+            sb_level(sb, bus->clock, sb->args[0]);
+            break;
+        }
+        case 0x14: sb_start(bus, sb, length + 1u, false, false); break;
+        case 0x1C: sb_start(bus, sb, sb->block_size + 1u, true, false); break;
+        case 0x20: sb_push(sb, 0x80); break;
+        case 0x24: sb_start(bus, sb, length + 1u, false, true); break;
+        case 0x2C: sb_start(bus, sb, sb->block_size + 1u, true, true); break;
+        case 0x40: sb->time_constant = sb->args[0]; break;
+        case 0x48: sb->block_size = length; break;
+        case 0x80:
+        {
+            // Silence: a block that plays nothing but still ends in an IRQ.
+            sb_start(bus, sb, length + 1u, false, false);
+            sb->silence = true;
+            sb_level(sb, bus->clock, 0x80);
+            break;
+        }
+        case 0x90: sb_start(bus, sb, sb->block_size + 1u, true, false); break;
+        case 0x91: sb_start(bus, sb, sb->block_size + 1u, false, false); break;
+        case 0x98: sb_start(bus, sb, sb->block_size + 1u, true, true); break;
+        case 0x99: sb_start(bus, sb, sb->block_size + 1u, false, true); break;
+        case 0xD0:
+        {
+            if (!sb->active || sb->paused)
+                break;
+            sb_fetch(bus, sb, bus->clock);
+            sb->paused = true;
+            sb->paused_at = bus->clock;
+            bus_schedule(bus, sb->timer, BUS_NEVER);
+            break;
+        }
+        case 0xD1:
+        case 0xD3:
+        {
+            sb_fetch(bus, sb, bus->clock);
+            sb->speaker = sb->command == 0xD1;
+            sb_update(sb, bus->clock);
+            break;
+        }
+        case 0xD4:
+        {
+            // The block resumes where it paused, so its timing moves along.
+            if (!sb->paused)
+                break;
+            sb->paused = false;
+            sb->block_start += bus->clock - sb->paused_at;
+            bus_schedule(bus, sb->timer, sb_sample_clock(sb, sb->block_length));
+            break;
+        }
+        case 0xD8: sb_push(sb, sb->speaker ? 0xFF : 0x00); break;
+        case 0xDA: sb->exit_auto_init = true; break;
+        case 0xE0: sb_push(sb, (uint8_t)~sb->args[0]); break;
+        case 0xE1: sb_push(sb, 2); sb_push(sb, 1); break;
+        case 0xE4: sb->test = sb->args[0]; break;
+        case 0xE8: sb_push(sb, sb->test); break;
+        case 0xF2: bus_irq(bus, sb->irq); break;
+    }
+}
+
+static void sb_reset(struct bus* bus, struct sb* sb)
+{
+    sb_fetch(bus, sb, bus->clock);
+    sb->active = false;
+    sb->paused = false;
+    bus_schedule(bus, sb->timer, BUS_NEVER);
+    sb->args_needed = 0;
+    sb->arg_count = 0;
+    sb->output_count = 0;
+    sb->speaker = false;
+    sb_level(sb, bus->clock, 0x80);
+    sb_update(sb, bus->clock);
+    sb_push(sb, 0xAA);
+}
+
+static uint8_t sb_in(struct bus* bus, void* device, uint16_t port)
+{
+    struct sb* sb = device;
+    switch (port - SB_PORTS)
+    {
+        case 0xA:
+        {
+            if (sb->output_count)
+            {
+                sb->last_read = sb->output[sb->output_head];
+                sb->output_head = (sb->output_head + 1) % SB_OUTPUT;
+                sb->output_count--;
+            }
+            return sb->last_read;
+        }
+        case 0xC:
+            // The DSP is always ready for another write.
+            return 0x7F;
+        case 0xE:
+            // Also acknowledges the IRQ on the card.
+            return sb->output_count ? 0xFF : 0x7F;
+        default:
+            return 0xFF;
+    }
+}
+
+static void sb_out(struct bus* bus, void* device, uint16_t port, uint8_t data)
+{
+    struct sb* sb = device;
+    switch (port - SB_PORTS)
+    {
+        case 0x6:
+        {
+            if (data & 1)
+                sb->resetting = true;
+            else if (sb->resetting)
+            {
+                sb->resetting = false;
+                sb_reset(bus, sb);
+            }
+            break;
+        }
+        case 0xC:
+        {
+            if (sb->arg_count < sb->args_needed)
+            {
+                sb->args[sb->arg_count++] = data;
+                if (sb->arg_count == sb->args_needed)
+                    sb_command(bus, sb);
+                break;
+            }
+            sb->command = data;
+            sb->arg_count = 0;
+            sb->args_needed = sb_arguments(data);
+            if (!sb->args_needed)
+                sb_command(bus, sb);
+            break;
+        }
+    }
+}
+
+// Attach a Sound Blaster at port 0x220 on DMA channel 1 and the given IRQ,
+// rendering at rate samples per second (none if 0). DMA transfers need the
+// controller from dma_new().
+// Returns NULL if its ports cannot be mapped (see bus_map_ports()).
+struct sb* sb_new(struct bus* bus, unsigned irq, unsigned rate)
+{
+    assert(bus && irq < 8);
+
+    struct sb* sb = arena_alloc(bus->arena, sizeof(struct sb));
+    sb->irq = irq;
+    sb->dac = 0x80;
+    if (rate)
+        audio_blip_init(&sb->blip, rate, bus->clock);
+
+    if (!bus_map_ports(bus, SB_PORTS, 16, sb, sb_in, sb_out))
+        return NULL;
+    sb->timer = bus_add_timer(bus, sb, sb_block_end);
+    return sb;
+}
+
+// Fetch what the DSP has played up to the bus's clock and read up to max of
+// the samples that are complete, resampled to the host's rate. Meant to be
+// called at frame or buffer boundaries.
+size_t sb_audio(struct bus* bus, struct sb* sb, int16_t* samples, size_t max)
+{
+    if (!sb->blip.rate)
+        return 0;
+    sb_fetch(bus, sb, bus->clock);
+    return audio_blip_read(&sb->blip, bus->clock, samples, max);
+}
@@ -0,0 +1,79 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Creative Sound Blaster (1.x/2.0 DSP, version 2.01), 8-bit output.
+//
+// DMA playback is driven by emulated time, not by the CPU. Starting a block
+// only notes the clock it started at and schedules a bus timer for when its
+// last sample has played; that timer raises the completion IRQ and, in
+// auto-init mode, starts the next block. The bytes a block has played by any
+// point are fetched from guest memory with one DMA request per batch, at the
+// block's end or when the host asks for audio (sb_audio()), whichever comes
+// first, and never ahead of time, so guests refilling a buffer behind the
+// DSP are heard as on the real card.
+//
+// Each fetched sample is a step at the master clock it plays at, fed to the
+// band-limited synthesiser in audio.h. That resamples any DSP rate to the
+// host's in one batch per read, and the DSP's direct mode (command 0x10)
+// comes for free.
+//
+// Recording runs on the same timing, writing silence from the ADC to guest
+// memory. The mixer of later cards and MIDI are not implemented.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "audio.h"
+#include "bus.h"
+
+#define SB_PORTS                0x220
+#define SB_DMA                  1
+#define SB_OUTPUT               16      // Bytes the DSP can have waiting to be read.
+
+// Full scale of the DAC, as a fraction of the output's.
+#define SB_VOLUME               0.5f
+
+struct sb
+{
+    unsigned irq;                   // 5 or 7.
+
+    // DSP.
+    uint8_t command;                // Command waiting for its arguments.
+    uint8_t args[2];
+    unsigned arg_count;
+    unsigned args_needed;
+    uint8_t output[SB_OUTPUT];      // Bytes waiting to be read from the read data port.
+    unsigned output_head;
+    unsigned output_count;
+    uint8_t last_read;
+    uint8_t test;                   // Test register (commands 0xE4/0xE8).
+    bool resetting;                 // Was 1 written to the reset port?
+    bool speaker;
+    uint8_t time_constant;          // Sample period is 256 - time_constant microseconds.
+    uint16_t block_size;            // For auto-init and high-speed transfers, minus one.
+
+    // The block being played.
+    bool active;
+    bool auto_init;
+    bool exit_auto_init;            // Stop at the end of the current block?
+    bool silence;                   // Command 0x80: time passes, no DMA.
+    bool recording;                 // DMA to memory rather than from it.
+    bool paused;
+    uint64_t paused_at;
+    uint64_t block_start;           // Master clock the block's first sample plays at.
+    uint32_t block_length;          // Samples.
+    uint32_t fetched;               // Samples fetched so far.
+    unsigned timer;                 // Fires when the block has played.
+
+    // Output.
+    uint8_t dac;                    // Last sample played (0x80 is silence).
+    float level;                    // The same, from -1 to 1.
+    float heard;                    // Level reaching the output (0 with the speaker off).
+    struct audio_blip blip;         // Only used if blip.rate is not 0.
+};
+
+struct sb* sb_new(struct bus* bus, unsigned irq, unsigned rate);
+size_t sb_audio(struct bus* bus, struct sb* sb, int16_t* samples, size_t max);
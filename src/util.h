@@ -3,9 +3,10 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <stdlib.h>
 
-inline void* quick_calloc(size_t count, size_t size)
+static inline void* quick_calloc(size_t count, size_t size)
 {
     void* ptr = calloc(count, size);
     if (!ptr)
@@ -13,7 +14,39 @@ inline void* quick_calloc(size_t count, size_t size)
     return ptr;
 }
 
-inline void* quick_malloc(size_t size)
+static inline void* quick_malloc(size_t size)
 {
     return quick_calloc(1, size);
-}
\ No newline at end of file
+}
+
+// Index of the lowest set bit (value must not be 0).
+static inline unsigned quick_ctz64(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctzll(value);
+#else
+    unsigned index = 0;
+    while (!(value & 1))
+    {
+        value >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+// Number of zero bits above the highest set bit (value must not be 0).
+static inline unsigned quick_clz64(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_clzll(value);
+#else
+    unsigned count = 0;
+    while (!(value & 0x8000000000000000ull))
+    {
+        value <<= 1;
+        count++;
+    }
+    return count;
+#endif
+}
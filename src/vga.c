@@ -0,0 +1,515 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <assert.h>
+#include <string.h>
+
+#include "util.h"
+#include "vga.h"
+#include "video.h"
+
+// Registers as the BIOS programs them for mode 12h (640x480, 16 colours).
+static const uint8_t vga_seq_default[5] = { 0x03, 0x01, 0x0F, 0x00, 0x06 };
+static const uint8_t vga_gc_default[9] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x0F, 0xFF };
+static const uint8_t vga_crtc_default[25] =
+{
+    0x5F, 0x4F, 0x50, 0x82, 0x54, 0x80, 0x0B, 0x3E, 0x00, 0x40, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x59, 0xEA, 0x8C, 0xDF, 0x28, 0x00, 0xE7, 0x04, 0xE3, 0xFF
+};
+static const uint8_t vga_attr_default[21] =
+{
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x14, 0x07, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F,
+    0x01, 0x00, 0x0F, 0x00, 0x00
+};
+
+// A mask with a byte of ones for every plane set in a 4-bit plane mask.
+static const uint32_t vga_planes[16] =
+{
+    0x00000000, 0x000000FF, 0x0000FF00, 0x0000FFFF, 0x00FF0000, 0x00FF00FF, 0x00FFFF00, 0x00FFFFFF,
+    0xFF000000, 0xFF0000FF, 0xFF00FF00, 0xFF00FFFF, 0xFFFF0000, 0xFFFF00FF, 0xFFFFFF00, 0xFFFFFFFF
+};
+
+// Planar to chunky: spread a plane byte so that byte n of the result is bit
+// 7 - n, the plane's bit of the nth pixel from the left. The byte is copied
+// into every lane, each lane keeps its own bit, and adding 7Fh carries any
+// set bit into the top of its lane without crossing into the next one.
+static inline uint64_t vga_spread(uint8_t plane)
+{
+    uint64_t lanes = (plane * UINT64_C(0x0101010101010101)) & UINT64_C(0x0102040810204080);
+    return ((lanes + UINT64_C(0x7F7F7F7F7F7F7F7F)) >> 7) & UINT64_C(0x0101010101010101);
+}
+
+static inline uint32_t vga_rgb(const uint8_t* entry)
+{
+    // Widen 6-bit components to 8 bits.
+    uint32_t r = (entry[0] << 2) | (entry[0] >> 4);
+    uint32_t g = (entry[1] << 2) | (entry[1] >> 4);
+    uint32_t b = (entry[2] << 2) | (entry[2] >> 4);
+    return (r << 16) | (g << 8) | b;
+}
+
+static inline bool vga_256_colour(struct vga* vga)
+{
+    return vga->attr[0x10] & 0x40;
+}
+
+// Rebuild the pixel value to colour table. In 16-colour modes a pixel goes
+// through the attribute palette (and colour plane enable) to select a DAC
+// entry, in 256-colour modes it selects one directly.
+static void vga_palette(struct vga* vga)
+{
+    if (vga_256_colour(vga))
+    {
+        for (unsigned i = 0; i < 256; i++)
+            vga->palette[i] = vga_rgb(vga->dac[i & vga->dac_mask]);
+        return;
+    }
+
+    uint8_t colour_select = vga->attr[0x14];
+    for (unsigned i = 0; i < 16; i++)
+    {
+        uint8_t entry = vga->attr[i & vga->attr[0x12] & 0xF];
+        if (vga->attr[0x10] & 0x80)
+            entry = (entry & 0x0F) | ((colour_select & 0x03) << 4);
+        else
+            entry &= 0x3F;
+        entry |= (colour_select & 0x0C) << 4;
+        vga->palette[i] = vga_rgb(vga->dac[entry & vga->dac_mask]);
+    }
+}
+
+// Work out the memory access state from the sequencer and graphics
+// controller registers.
+static void vga_access(struct vga* vga)
+{
+    vga->map_mask = vga_planes[vga->seq[2] & 0xF];
+    vga->chain4 = vga->seq[4] & 0x08;
+    vga->set_reset = vga_planes[vga->gc[0] & 0xF];
+    vga->enable_set_reset = vga_planes[vga->gc[1] & 0xF];
+    vga->colour_compare = vga_planes[vga->gc[2] & 0xF];
+    vga->rotate = vga->gc[3] & 0x07;
+    vga->function = (vga->gc[3] >> 3) & 0x03;
+    vga->read_plane = vga->gc[4] & 0x03;
+    vga->write_mode = vga->gc[5] & 0x03;
+    vga->read_mode = (vga->gc[5] >> 3) & 0x01;
+    vga->decoded = ((vga->gc[6] >> 2) & 0x03) <= 1;
+    vga->colour_dont_care = vga_planes[vga->gc[7] & 0xF];
+    vga->bit_mask = (vga->gc[8] & 0xFFu) * 0x01010101u;
+    vga->plain = vga->write_mode == 0 && vga->rotate == 0 && vga->function == 0
+              && vga->enable_set_reset == 0 && vga->gc[8] == 0xFF;
+}
+
+static inline void vga_mark(struct vga* vga, uint32_t offset)
+{
+    video_mark(vga->dirty, offset);
+    vga->dirty_any = true;
+}
+
+// What a write stores to each plane, before the map mask picks the planes.
+static uint32_t vga_write_value(struct vga* vga, uint8_t data)
+{
+    uint8_t rotated = (uint8_t)((data >> vga->rotate) | (data << (8 - vga->rotate)));
+    uint32_t bit_mask = vga->bit_mask;
+    uint32_t value;
+    switch (vga->write_mode)
+    {
+        case 0:
+            value = (rotated * 0x01010101u & ~vga->enable_set_reset)
+                  | (vga->set_reset & vga->enable_set_reset);
+            break;
+        case 1:
+            return vga->latch;
+        case 2:
+            value = vga_planes[data & 0xF];
+            break;
+        default:
+            value = vga->set_reset;
+            bit_mask &= rotated * 0x01010101u;
+            break;
+    }
+
+    switch (vga->function)
+    {
+        case 1: value &= vga->latch; break;
+        case 2: value |= vga->latch; break;
+        case 3: value ^= vga->latch; break;
+    }
+    return (value & bit_mask) | (vga->latch & ~bit_mask);
+}
+
+static void vga_write(struct bus* bus, void* device, uint32_t address, uint8_t data)
+{
+    struct vga* vga = device;
+    if (!vga->decoded)
+        return;
+
+    uint32_t offset = address - VGA_MEMORY;
+    uint32_t mask = vga->map_mask;
+    if (vga->chain4)
+    {
+        mask &= 0xFFu << ((offset & 3) * 8);
+        offset >>= 2;
+    }
+
+    uint32_t value = vga->plain ? data * 0x01010101u : vga_write_value(vga, data);
+    uint32_t* planes = &vga->planes[offset];
+    *planes = (*planes & ~mask) | (value & mask);
+    vga_mark(vga, offset);
+}
+
+static uint8_t vga_read(struct bus* bus, void* device, uint32_t address)
+{
+    struct vga* vga = device;
+    if (!vga->decoded)
+        return 0xFF;
+
+    uint32_t offset = address - VGA_MEMORY;
+    unsigned plane = vga->read_plane;
+    if (vga->chain4)
+    {
+        plane = offset & 3;
+        offset >>= 2;
+    }
+    vga->latch = vga->planes[offset];
+    if (vga->read_mode == 0 || vga->chain4)
+        return (uint8_t)(vga->latch >> (plane * 8));
+
+    // Colour compare: a bit is set for each pixel whose colour matches in
+    // every plane that is cared about.
+    uint32_t differ = (vga->latch ^ vga->colour_compare) & vga->colour_dont_care;
+    differ |= differ >> 16;
+    differ |= differ >> 8;
+    return (uint8_t)~differ;
+}
+
+// Frame geometry from the CRTC: the pixel size and, in plane offsets, the
+// start of the frame and the distance between scanlines.
+struct vga_geometry
+{
+    unsigned width;
+    unsigned height;
+    unsigned start;
+    unsigned pitch;
+    unsigned offsets;               // Plane offsets displayed on each scanline.
+};
+
+static void vga_geometry(struct vga* vga, struct vga_geometry* geometry)
+{
+    unsigned chars = vga->crtc[0x01] + 1;
+    unsigned lines = (vga->crtc[0x12] | ((vga->crtc[0x07] & 0x02) << 7) | ((vga->crtc[0x07] & 0x40) << 3)) + 1;
+    unsigned scan = (vga->crtc[0x09] & 0x1F) + 1;
+    if (vga->crtc[0x09] & 0x80)
+        scan *= 2;
+
+    // 256-colour modes take two dot clocks per pixel.
+    geometry->width = vga_256_colour(vga) ? chars * 4 : chars * 8;
+    geometry->height = lines / scan;
+    if (geometry->width > VGA_MAX_WIDTH)
+        geometry->width = VGA_MAX_WIDTH;
+    if (geometry->height > VGA_MAX_HEIGHT)
+        geometry->height = VGA_MAX_HEIGHT;
+    geometry->offsets = vga_256_colour(vga) ? geometry->width / 4 : geometry->width / 8;
+    geometry->start = (vga->crtc[0x0C] << 8) | vga->crtc[0x0D];
+    geometry->pitch = vga->crtc[0x13] * 2;
+}
+
+static void vga_draw_line(struct vga* vga, const struct vga_geometry* geometry, unsigned y)
+{
+    uint32_t* dst = &vga->pixels[y * geometry->width];
+    unsigned offset = geometry->start + y * geometry->pitch;
+    if (vga_256_colour(vga))
+    {
+        for (unsigned i = 0; i < geometry->offsets; i++, dst += 4)
+        {
+            uint32_t planes = vga->planes[(offset + i) & (VGA_PLANE_SIZE - 1)];
+            dst[0] = vga->palette[planes & 0xFF];
+            dst[1] = vga->palette[(planes >> 8) & 0xFF];
+            dst[2] = vga->palette[(planes >> 16) & 0xFF];
+            dst[3] = vga->palette[planes >> 24];
+        }
+        return;
+    }
+
+    for (unsigned i = 0; i < geometry->offsets; i++, dst += 8)
+    {
+        uint32_t planes = vga->planes[(offset + i) & (VGA_PLANE_SIZE - 1)];
+        uint64_t pixels = vga_spread(planes & 0xFF)
+                        | (vga_spread((planes >> 8) & 0xFF) << 1)
+                        | (vga_spread((planes >> 16) & 0xFF) << 2)
+                        | (vga_spread(planes >> 24) << 3);
+        for (unsigned pixel = 0; pixel < 8; pixel++)
+            dst[pixel] = vga->palette[(pixels >> (pixel * 8)) & 0xF];
+    }
+}
+
+static void vga_compose_graphics(struct vga* vga)
+{
+    struct vga_geometry geometry;
+    vga_geometry(vga, &geometry);
+    if (geometry.width != vga->width || geometry.height != vga->height)
+    {
+        vga->width = geometry.width;
+        vga->height = geometry.height;
+        vga->redraw = true;
+    }
+
+    if (vga->redraw)
+    {
+        for (unsigned y = 0; y < geometry.height; y++)
+            vga_draw_line(vga, &geometry, y);
+    }
+    else
+    {
+        if (!vga->dirty_any || geometry.pitch == 0)
+            return;
+
+        // Work out which scanlines the written offsets belong to.
+        bool lines[VGA_MAX_HEIGHT] = { false };
+        for (unsigned i = 0; i < VGA_PLANE_SIZE / 64; i++)
+        {
+            for (uint64_t bits = vga->dirty[i]; bits; bits &= bits - 1)
+            {
+                unsigned relative = (i * 64 + quick_ctz64(bits) - geometry.start) & (VGA_PLANE_SIZE - 1);
+                unsigned y = relative / geometry.pitch;
+                if (y < geometry.height && relative % geometry.pitch < geometry.offsets)
+                    lines[y] = true;
+            }
+        }
+        for (unsigned y = 0; y < geometry.height; y++)
+            if (lines[y])
+                vga_draw_line(vga, &geometry, y);
+    }
+    vga->changed = true;
+}
+
+// Compose a frame from whatever changed since the last one. This normally
+// runs at the start of every vertical sync.
+void vga_compose(struct bus* bus, struct vga* vga)
+{
+    (void)bus;
+    vga->frames++;
+    vga->changed = false;
+
+    // Screen off, or a text mode.
+    if ((vga->seq[1] & 0x20) || !(vga->gc[6] & 0x01))
+    {
+        if (vga->redraw)
+        {
+            video_fill(vga->pixels, (size_t)vga->width * vga->height, 0);
+            vga->changed = true;
+        }
+    }
+    else
+        vga_compose_graphics(vga);
+
+    if (vga->changed)
+        vga->updates++;
+    if (vga->dirty_any)
+        memset(vga->dirty, 0, sizeof(vga->dirty));
+    vga->dirty_any = false;
+    vga->redraw = false;
+}
+
+static uint8_t vga_in(struct bus* bus, void* device, uint16_t port)
+{
+    struct vga* vga = device;
+    switch (port)
+    {
+        case 0x3C0:
+            return vga->attr_index;
+        case 0x3C1:
+            return (vga->attr_index & 0x1F) < sizeof(vga->attr) ? vga->attr[vga->attr_index & 0x1F] : 0xFF;
+        case 0x3C5:
+            return vga->seq_index < sizeof(vga->seq) ? vga->seq[vga->seq_index] : 0xFF;
+        case 0x3C6:
+            return vga->dac_mask;
+        case 0x3C8:
+            return vga->dac_write;
+        case 0x3C9:
+        {
+            uint8_t data = vga->dac[vga->dac_read][vga->dac_read_component];
+            if (++vga->dac_read_component == 3)
+            {
+                vga->dac_read_component = 0;
+                vga->dac_read++;
+            }
+            return data;
+        }
+        case 0x3CC:
+            return vga->misc;
+        case 0x3CF:
+            return vga->gc_index < sizeof(vga->gc) ? vga->gc[vga->gc_index] : 0xFF;
+        case 0x3D5:
+            return vga->crtc_index < sizeof(vga->crtc) ? vga->crtc[vga->crtc_index] : 0xFF;
+        case 0x3DA:
+        {
+            // Reading the status register also resets the attribute
+            // controller's index/data flip-flop.
+            vga->attr_data = false;
+            unsigned position = bus->clock % VGA_FRAME_CLOCKS;
+            unsigned line = position / VGA_LINE_CLOCKS;
+            unsigned dot = position % VGA_LINE_CLOCKS;
+            uint8_t status = 0x00;
+            if (line >= VGA_MAX_HEIGHT || dot >= VGA_DISPLAY_CLOCKS)
+                status |= VGA_STATUS_DISPLAY_OFF;
+            if (line >= VGA_VSYNC_LINE && line < VGA_VSYNC_LINE + VGA_VSYNC_LINES)
+                status |= VGA_STATUS_VSYNC;
+            return status;
+        }
+        default:
+            return 0xFF;
+    }
+}
+
+static void vga_out(struct bus* bus, void* device, uint16_t port, uint8_t data)
+{
+    struct vga* vga = device;
+    switch (port)
+    {
+        case 0x3C0:
+        {
+            if (!vga->attr_data)
+                vga->attr_index = data;
+            else if ((vga->attr_index & 0x1F) < sizeof(vga->attr))
+            {
+                vga->attr[vga->attr_index & 0x1F] = data;
+                vga_palette(vga);
+                vga->redraw = true;
+            }
+            vga->attr_data = !vga->attr_data;
+            break;
+        }
+        case 0x3C2:
+        {
+            vga->misc = data;
+            break;
+        }
+        case 0x3C4:
+        {
+            vga->seq_index = data;
+            break;
+        }
+        case 0x3C5:
+        {
+            if (vga->seq_index >= sizeof(vga->seq))
+                break;
+            vga->seq[vga->seq_index] = data;
+            vga_access(vga);
+            if (vga->seq_index == 1)
+                vga->redraw = true;
+            break;
+        }
+        case 0x3C6:
+        {
+            vga->dac_mask = data;
+            vga_palette(vga);
+            vga->redraw = true;
+            break;
+        }
+        case 0x3C7:
+        {
+            vga->dac_read = data;
+            vga->dac_read_component = 0;
+            break;
+        }
+        case 0x3C8:
+        {
+            vga->dac_write = data;
+            vga->dac_write_component = 0;
+            break;
+        }
+        case 0x3C9:
+        {
+            vga->dac[vga->dac_write][vga->dac_write_component] = data & 0x3F;
+            if (++vga->dac_write_component == 3)
+            {
+                vga->dac_write_component = 0;
+                vga->dac_write++;
+                vga_palette(vga);
+                vga->redraw = true;
+            }
+            break;
+        }
+        case 0x3CE:
+        {
+            vga->gc_index = data;
+            break;
+        }
+        case 0x3CF:
+        {
+            if (vga->gc_index >= sizeof(vga->gc))
+                break;
+            vga->gc[vga->gc_index] = data;
+            vga_access(vga);
+            if (vga->gc_index == 6)
+                vga->redraw = true;
+            break;
+        }
+        case 0x3D4:
+        {
+            vga->crtc_index = data;
+            break;
+        }
+        case 0x3D5:
+        {
+            if (vga->crtc_index >= sizeof(vga->crtc) || vga->crtc[vga->crtc_index] == data)
+                break;
+            vga->crtc[vga->crtc_index] = data;
+            vga->redraw = true;
+            break;
+        }
+    }
+}
+
+static void vga_schedule(struct bus* bus, struct vga* vga)
+{
+    uint64_t deadline = bus->clock / VGA_FRAME_CLOCKS * VGA_FRAME_CLOCKS
+                      + VGA_VSYNC_LINE * VGA_LINE_CLOCKS;
+    if (deadline <= bus->clock)
+        deadline += VGA_FRAME_CLOCKS;
+    bus_schedule(bus, vga->timer, deadline);
+}
+
+static void vga_vsync(struct bus* bus, void* device)
+{
+    struct vga* vga = device;
+    vga_compose(bus, vga);
+    vga_schedule(bus, vga);
+}
+
+// Attach a VGA to the bus, programmed for mode 12h. The DAC starts out with
+// the EGA's 64 colours.
+// Returns NULL if its ports or memory cannot be mapped (see bus_map_ports()
+// and bus_map_memory()).
+struct vga* vga_new(struct bus* bus)
+{
+    assert(bus);
+
+    struct vga* vga = arena_alloc(bus->arena, sizeof(struct vga));
+    memcpy(vga->seq, vga_seq_default, sizeof(vga_seq_default));
+    memcpy(vga->gc, vga_gc_default, sizeof(vga_gc_default));
+    memcpy(vga->crtc, vga_crtc_default, sizeof(vga_crtc_default));
+    memcpy(vga->attr, vga_attr_default, sizeof(vga_attr_default));
+    vga->misc = 0xE3;
+    vga->dac_mask = 0xFF;
+    for (unsigned i = 0; i < 64; i++)
+    {
+        vga->dac[i][0] = ((i >> 2) & 1) * 42 + ((i >> 5) & 1) * 21;
+        vga->dac[i][1] = ((i >> 1) & 1) * 42 + ((i >> 4) & 1) * 21;
+        vga->dac[i][2] = (i & 1) * 42 + ((i >> 3) & 1) * 21;
+    }
+    vga->redraw = true;
+    vga_access(vga);
+    vga_palette(vga);
+
+    if (!bus_map_ports(bus, VGA_PORTS, 16, vga, vga_in, vga_out)
+        || !bus_map_ports(bus, VGA_CRTC_PORTS, 7, vga, vga_in, vga_out)
+        || !bus_map_memory(bus, VGA_MEMORY, VGA_MEMORY_SIZE, vga, vga_read, vga_write))
+    {
+        bus_unmap_ports(bus, vga);
+        return NULL;
+    }
+    vga->timer = bus_add_timer(bus, vga, vga_vsync);
+    vga_schedule(bus, vga);
+    return vga;
+}
@@ -0,0 +1,107 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// VGA (and, through the same registers, EGA) graphics adapter.
+//
+// Unlike the CGA and MDA, the VGA's memory is not a frame buffer the CPU can
+// write directly: writes pass through the graphics controller's write modes,
+// latches, map mask and bit mask, and reads through its read modes. The
+// adapter therefore decodes 0xA0000-0xAFFFF itself. The four planes are
+// stored interleaved, one 32-bit word per plane offset with plane n in bits
+// 8n..8n+7, so every write mode is a handful of 32-bit operations covering
+// all four planes at once (each plane byte being a SIMD lane), and a plain
+// write with the default registers is a single masked store.
+//
+// Chain-4 (mode 13h) addresses plane (address & 3) at offset (address >> 2),
+// which is the layout unchained "mode X" code sees as well.
+//
+// Frames are composed at each vertical sync from the scanlines whose plane
+// offsets were written since the last one, at the mode's native resolution
+// (up to 640x480). 16-colour modes are converted from planar to chunky eight
+// pixels at a time. Text modes, odd/even addressing, pixel panning, the line
+// compare split and the 0xB0000/0xB8000 memory windows are not emulated.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bus.h"
+
+#define VGA_MEMORY              0xA0000
+#define VGA_MEMORY_SIZE         0x10000
+#define VGA_PLANE_SIZE          0x10000
+#define VGA_MAX_WIDTH           640
+#define VGA_MAX_HEIGHT          480
+
+// The 25.175 MHz dot clock gives 800 dot lines of close to 455 master clocks,
+// and 525 lines per frame. 70 Hz modes are timed like 60 Hz ones.
+#define VGA_LINE_CLOCKS         455
+#define VGA_DISPLAY_CLOCKS      364         // 640 dots of each line.
+#define VGA_FRAME_LINES         525
+#define VGA_FRAME_CLOCKS        (VGA_LINE_CLOCKS * VGA_FRAME_LINES)
+#define VGA_VSYNC_LINE          490
+#define VGA_VSYNC_LINES         2
+
+#define VGA_PORTS               0x3C0
+#define VGA_CRTC_PORTS          0x3D4
+
+// Status register (0x3DA).
+#define VGA_STATUS_DISPLAY_OFF  (1 << 0)
+#define VGA_STATUS_VSYNC        (1 << 3)
+
+struct vga
+{
+    // Registers.
+    uint8_t misc;                   // Miscellaneous output register.
+    uint8_t seq[5];                 // Sequencer registers.
+    uint8_t gc[9];                  // Graphics controller registers.
+    uint8_t crtc[25];               // CRT controller registers.
+    uint8_t attr[21];               // Attribute controller registers.
+    uint8_t dac[256][3];            // DAC palette, 6 bits per component.
+    uint8_t seq_index;
+    uint8_t gc_index;
+    uint8_t crtc_index;
+    uint8_t attr_index;
+    bool attr_data;                 // Is the next 0x3C0 write data rather than an index?
+    uint8_t dac_mask;
+    uint8_t dac_write;              // DAC entry written through 0x3C9.
+    uint8_t dac_read;               // DAC entry read through 0x3C9.
+    uint8_t dac_write_component;
+    uint8_t dac_read_component;
+
+    // Memory access, derived from the registers above. The masks have a
+    // byte per plane.
+    uint32_t latch;                 // Latches, one byte per plane.
+    uint32_t map_mask;              // Planes written.
+    uint32_t set_reset;
+    uint32_t enable_set_reset;
+    uint32_t colour_compare;
+    uint32_t colour_dont_care;      // Planes colour compare looks at.
+    uint32_t bit_mask;              // Bits taken from the ALU rather than the latches.
+    uint8_t write_mode;
+    uint8_t read_mode;
+    uint8_t rotate;
+    uint8_t function;               // ALU function: none, AND, OR, XOR.
+    uint8_t read_plane;
+    bool chain4;
+    bool decoded;                   // Is 0xA0000 mapped by the graphics controller?
+    bool plain;                     // Do writes store the CPU data unchanged?
+
+    // Composition state.
+    unsigned timer;                 // Vertical sync timer.
+    uint64_t frames;                // Frames composed so far.
+    bool changed;                   // Did the last frame differ from the one before?
+    uint64_t updates;               // Frames composed that differed from the one before.
+    bool redraw;                    // Must the next frame be composed in full?
+    bool dirty_any;                 // Is any bit in dirty set?
+    unsigned width;                 // Size of the last frame.
+    unsigned height;
+    uint64_t dirty[VGA_PLANE_SIZE / 64]; // One bit per plane offset written since the last frame.
+    uint32_t palette[256];          // Pixel values to colours, through the attribute controller and DAC.
+    uint32_t planes[VGA_PLANE_SIZE];
+    uint32_t pixels[VGA_MAX_WIDTH * VGA_MAX_HEIGHT];
+};
+
+struct vga* vga_new(struct bus* bus);
+void vga_compose(struct bus* bus, struct vga* vga);
@@ -0,0 +1,363 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <assert.h>
+#include <string.h>
+
+#include "util.h"
+#include "video.h"
+
+// Code page 437 as Unicode, with the control characters shown as the glyphs
+// the PC's font has for them, and NUL as a space.
+static const uint16_t video_cp437[256] =
+{
+    0x0020, 0x263A, 0x263B, 0x2665, 0x2666, 0x2663, 0x2660, 0x2022,
+    0x25D8, 0x25CB, 0x25D9, 0x2642, 0x2640, 0x266A, 0x266B, 0x263C,
+    0x25BA, 0x25C4, 0x2195, 0x203C, 0x00B6, 0x00A7, 0x25AC, 0x21A8,
+    0x2191, 0x2193, 0x2192, 0x2190, 0x221F, 0x2194, 0x25B2, 0x25BC,
+    0x0020, 0x0021, 0x0022, 0x0023, 0x0024, 0x0025, 0x0026, 0x0027,
+    0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
+    0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037,
+    0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
+    0x0040, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047,
+    0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
+    0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057,
+    0x0058, 0x0059, 0x005A, 0x005B, 0x005C, 0x005D, 0x005E, 0x005F,
+    0x0060, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067,
+    0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+    0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077,
+    0x0078, 0x0079, 0x007A, 0x007B, 0x007C, 0x007D, 0x007E, 0x2302,
+    0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7,
+    0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+    0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9,
+    0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+    0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA,
+    0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+    0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,
+    0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+    0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F,
+    0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+    0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B,
+    0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+    0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4,
+    0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+    0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248,
+    0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
+};
+
+// Expand a font of stride bytes per glyph (one byte per scanline, MSB
+// leftmost) into an atlas of cells width pixels wide. Widths that are a
+// multiple of 8 scale each glyph up; a width of 9 adds the MDA's ninth
+// column, which repeats the eighth for the line drawing characters
+// C0h-DFh and is blank otherwise.
+void video_atlas_build(struct video_atlas* atlas, const uint8_t* font, unsigned stride,
+                       unsigned height, unsigned width)
+{
+    assert(atlas);
+    assert(font);
+    assert(height <= VIDEO_GLYPH_MAX_HEIGHT);
+    assert(width <= VIDEO_GLYPH_MAX_WIDTH && (width % 8 == 0 || width == 9));
+
+    atlas->width = width;
+    atlas->height = height;
+    for (unsigned ch = 0; ch < 256; ch++)
+    {
+        for (unsigned line = 0; line < height; line++)
+        {
+            uint8_t bits = font[ch * stride + line];
+            uint32_t* mask = atlas->mask[ch][line];
+            for (unsigned x = 0; x < width; x++)
+            {
+                unsigned column = (width == 9) ? x : x * 8 / width;
+                if (column == 8)
+                    column = (ch >= 0xC0 && ch <= 0xDF) ? 7 : 8;
+                mask[x] = (column < 8 && (bits & (0x80 >> column))) ? 0xFFFFFFFF : 0;
+            }
+        }
+    }
+}
+
+// Scanlines covered by a 6845 cursor, from the cursor start (R10) and end
+// (R11) registers. A start below the end wraps around the cell, and a
+// disabled cursor covers nothing.
+uint32_t video_cursor_lines(uint8_t start, uint8_t end)
+{
+    if ((start & 0x60) == 0x20)
+        return 0;
+    start &= 0x1F;
+    end &= 0x1F;
+
+    uint32_t from_start = (uint32_t)(UINT64_C(0xFFFFFFFF) << start);
+    uint32_t to_end = (uint32_t)((UINT64_C(2) << end) - 1);
+    return (start <= end) ? (from_start & to_end) : (from_start | to_end);
+}
+
+// Mark every visible cell with a blinking attribute, for when the blink
+// phase flips.
+void video_text_blinking(const struct video_text* text, uint64_t* dirty)
+{
+    for (unsigned cell = 0; cell < text->rows * text->cols; cell++)
+    {
+        unsigned word = (text->start + cell) & (text->words - 1);
+        if (text->vram[word * 2 + 1] & 0x80)
+            video_mark(dirty, word);
+    }
+}
+
+static void video_text_row(const struct video_text* text, unsigned row)
+{
+    const struct video_atlas* atlas = text->atlas;
+    const struct video_attributes* attributes = text->attributes;
+
+    // Decode the row's cells once, rather than on every scanline.
+    const uint32_t* masks[VIDEO_TEXT_MAX_COLS];
+    uint32_t fg[VIDEO_TEXT_MAX_COLS];
+    uint32_t bg[VIDEO_TEXT_MAX_COLS];
+    uint32_t solid[VIDEO_TEXT_MAX_COLS];
+    for (unsigned col = 0; col < text->cols; col++)
+    {
+        unsigned word = (text->start + row * text->cols + col) & (text->words - 1);
+        uint8_t ch = text->vram[word * 2];
+        uint8_t attr = text->vram[word * 2 + 1];
+        masks[col] = atlas->mask[ch][0];
+        fg[col] = attributes->fg[attr];
+        bg[col] = attributes->bg[attr];
+        solid[col] = (attributes->underline[attr] ? text->underline_lines : 0)
+                   | ((word == text->cursor) ? text->cursor_lines : 0);
+    }
+
+    unsigned top = row * text->height;
+    for (unsigned line = 0; line < text->height && top + line < text->lines; line++)
+    {
+        uint32_t bit = (line < 32) ? (uint32_t)1 << line : 0;
+        uint32_t* dst = text->pixels + (size_t)(top + line) * text->pitch;
+        for (unsigned col = 0; col < text->cols; col++, dst += atlas->width)
+        {
+            if (solid[col] & bit)
+                video_fill(dst, atlas->width, fg[col]);
+            else if (line < atlas->height)
+                video_blit(dst, masks[col] + line * VIDEO_GLYPH_MAX_WIDTH, atlas->width, fg[col], bg[col]);
+            else
+                video_fill(dst, atlas->width, bg[col]);
+        }
+    }
+}
+
+// Look for the text of every match in the given rows, or all of them. After
+// a redraw, what the screen showed before no longer counts.
+static void video_text_match(const struct video_text* text, const bool* rows, bool all, bool redraw)
+{
+    struct video_matches* matches = text->matches;
+    for (unsigned i = 0; i < VIDEO_MAX_MATCHES; i++)
+        if (redraw && matches->match[i].length)
+            memset(matches->match[i].rows, 0, sizeof(matches->match[i].rows));
+    matches->rescan = false;
+
+    for (unsigned row = 0; row < text->rows; row++)
+    {
+        if (!all && !rows[row])
+            continue;
+
+        // Blank cells are often NULs rather than spaces.
+        uint8_t line[VIDEO_TEXT_MAX_COLS];
+        for (unsigned col = 0; col < text->cols; col++)
+        {
+            uint8_t ch = text->vram[((text->start + row * text->cols + col) & (text->words - 1)) * 2];
+            line[col] = ch ? ch : ' ';
+        }
+
+        for (unsigned i = 0; i < VIDEO_MAX_MATCHES; i++)
+        {
+            struct video_match* match = &matches->match[i];
+            if (!match->length || match->length > text->cols)
+                continue;
+
+            unsigned col = 0;
+            while (col + match->length <= text->cols && memcmp(&line[col], match->text, match->length))
+                col++;
+            bool present = col + match->length <= text->cols;
+            uint64_t bit = (uint64_t)1 << (row % 64);
+            bool was_present = match->rows[row / 64] & bit;
+            if (present)
+                match->rows[row / 64] |= bit;
+            else
+                match->rows[row / 64] &= ~bit;
+            if (present && !was_present)
+                match->found(match->context, row, col);
+        }
+    }
+}
+
+// Redraw the character rows holding any word marked in dirty (which covers
+// text->words words), or every row if redraw is set. Returns whether
+// anything was drawn.
+bool video_text_compose(const struct video_text* text, const uint64_t* dirty, bool redraw)
+{
+    assert(text->rows <= VIDEO_TEXT_MAX_ROWS);
+    assert(text->cols <= VIDEO_TEXT_MAX_COLS);
+    assert(text->cols * text->atlas->width <= text->pitch);
+
+    bool rows[VIDEO_TEXT_MAX_ROWS] = { false };
+    bool any = redraw;
+    if (!redraw)
+    {
+        unsigned cells = text->rows * text->cols;
+        for (unsigned i = 0; i < text->words / 64; i++)
+        {
+            for (uint64_t bits = dirty[i]; bits; bits &= bits - 1)
+            {
+                unsigned cell = (i * 64 + quick_ctz64(bits) - text->start) & (text->words - 1);
+                if (cell < cells)
+                    rows[cell / text->cols] = any = true;
+            }
+        }
+    }
+
+    if (any)
+    {
+        for (unsigned row = 0; row < text->rows; row++)
+            if (redraw || rows[row])
+                video_text_row(text, row);
+    }
+    if (text->matches && (any || text->matches->rescan))
+        video_text_match(text, rows, redraw || text->matches->rescan, redraw);
+    return any;
+}
+
+static size_t video_utf8(uint16_t code, char* out)
+{
+    if (code < 0x80)
+    {
+        out[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800)
+    {
+        out[0] = (char)(0xC0 | (code >> 6));
+        out[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+    out[0] = (char)(0xE0 | (code >> 12));
+    out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+    out[2] = (char)(0x80 | (code & 0x3F));
+    return 3;
+}
+
+// Write a text screen to buffer as UTF-8, a line per row with trailing
+// spaces removed, and NUL-terminate it (unless size is 0). Output that does
+// not fit is cut off before the first character that would not fit whole.
+// Returns the length of the whole screen (not counting the terminator), which
+// may be more than was written; rows * (cols * 3 + 1) + 1 bytes is always
+// enough.
+size_t video_text_utf8(const struct video_text* text, char* buffer, size_t size)
+{
+    size_t length = 0;
+    size_t written = 0;
+    for (unsigned row = 0; row < text->rows; row++)
+    {
+        unsigned cols = text->cols;
+        while (cols)
+        {
+            uint8_t ch = text->vram[((text->start + row * text->cols + cols - 1) & (text->words - 1)) * 2];
+            if (ch != 0x00 && ch != ' ')
+                break;
+            cols--;
+        }
+
+        for (unsigned col = 0; col <= cols; col++)
+        {
+            char utf8[3];
+            size_t n = 1;
+            if (col == cols)
+                utf8[0] = '\n';
+            else
+                n = video_utf8(video_cp437[text->vram[((text->start + row * text->cols + col) & (text->words - 1)) * 2]], utf8);
+            if (written == length && length + n < size)
+            {
+                memcpy(buffer + written, utf8, n);
+                written += n;
+            }
+            length += n;
+        }
+    }
+    if (size)
+        buffer[written] = '\0';
+    return length;
+}
+
+// Decode one code point from UTF-8, advancing text. Returns 0xFFFF for
+// anything malformed or outside the BMP, which code page 437 lacks anyway.
+static uint16_t video_decode_utf8(const char** text)
+{
+    const uint8_t* p = (const uint8_t*)*text;
+    if (p[0] < 0x80)
+    {
+        *text += 1;
+        return p[0];
+    }
+    if ((p[0] & 0xE0) == 0xC0 && (p[1] & 0xC0) == 0x80)
+    {
+        *text += 2;
+        return (uint16_t)(((p[0] & 0x1F) << 6) | (p[1] & 0x3F));
+    }
+    if ((p[0] & 0xF0) == 0xE0 && (p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80)
+    {
+        *text += 3;
+        return (uint16_t)(((p[0] & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F));
+    }
+    return 0xFFFF;
+}
+
+// Start looking for text (UTF-8) on a screen; found is called with the row
+// and column it shows up at. Text already on screen is found at the next
+// frame. Returns the match's index for video_match_remove(), or -1 if the
+// text is empty, too long, not in code page 437, or there is no room left.
+int video_match_add(struct video_matches* matches, const char* text,
+                    void (*found)(void*, unsigned, unsigned), void* context)
+{
+    assert(matches && text && found);
+
+    uint8_t cp437[VIDEO_TEXT_MAX_COLS];
+    unsigned length = 0;
+    while (*text)
+    {
+        if (length == VIDEO_TEXT_MAX_COLS)
+            return -1;
+        uint16_t code = video_decode_utf8(&text);
+        if (code == 0xFFFF)
+            return -1;
+
+        unsigned ch = 1;
+        if (code >= 0x20 && code < 0x7F)
+            ch = code;
+        else
+            while (ch < 256 && video_cp437[ch] != code)
+                ch++;
+        if (ch == 256)
+            return -1;
+        cp437[length++] = (uint8_t)ch;
+    }
+    if (!length)
+        return -1;
+
+    for (int i = 0; i < VIDEO_MAX_MATCHES; i++)
+    {
+        struct video_match* match = &matches->match[i];
+        if (match->length)
+            continue;
+        memcpy(match->text, cp437, length);
+        match->length = length;
+        memset(match->rows, 0, sizeof(match->rows));
+        match->found = found;
+        match->context = context;
+        matches->rescan = true;
+        return i;
+    }
+    return -1;
+}
+
+void video_match_remove(struct video_matches* matches, int index)
+{
+    assert(index >= 0 && index < VIDEO_MAX_MATCHES);
+    matches->match[index].length = 0;
+}
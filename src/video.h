@@ -0,0 +1,176 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Pixel kernels and the text renderer shared by the video adapters.
+//
+// Frames are composed into 32-bit 0x00RRGGBB pixels. Expanding 1bpp data
+// (monochrome graphics) is done four pixels at a time with SSE2 where
+// available: the source byte is broadcast, each lane tests its own bit, and
+// the resulting mask selects between the two colours.
+//
+// Text is drawn from a glyph atlas: the font expanded once into per-pixel
+// masks at the width a mode displays a cell (8, 9 or doubled to 16), so a
+// glyph row is blitted with a few wide stores and no bit tests at all.
+// Attribute bytes are decoded through per-adapter tables, and a screen is
+// redrawn a whole character row at a time, for the rows whose VRAM words
+// were written since the last frame. The same rows are searched for any
+// text automation is waiting for, so that costs nothing while the screen is
+// idle.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define VIDEO_GLYPH_MAX_WIDTH   16
+#define VIDEO_GLYPH_MAX_HEIGHT  16
+#define VIDEO_TEXT_MAX_COLS     128
+#define VIDEO_TEXT_MAX_ROWS     128
+#define VIDEO_MAX_MATCHES       8
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define VIDEO_SSE2
+#   include <emmintrin.h>
+#endif
+
+// The 16 RGBI colours, as displayed by an IBM 5153 (with dark yellow shown as
+// brown).
+static const uint32_t video_rgbi[16] =
+{
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF
+};
+
+#ifdef VIDEO_SSE2
+static inline __m128i video_select(__m128i bits, __m128i mask, __m128i fg, __m128i bg)
+{
+    __m128i set = _mm_cmpeq_epi32(_mm_and_si128(bits, mask), mask);
+    return _mm_or_si128(_mm_and_si128(set, fg), _mm_andnot_si128(set, bg));
+}
+#endif
+
+// Expand 8 pixels (MSB first) to fg/bg.
+static inline void video_expand8(uint32_t* dst, uint8_t bits, uint32_t fg, uint32_t bg)
+{
+#ifdef VIDEO_SSE2
+    __m128i b = _mm_set1_epi32(bits);
+    __m128i f = _mm_set1_epi32((int)fg);
+    __m128i g = _mm_set1_epi32((int)bg);
+    _mm_storeu_si128((__m128i*)dst + 0, video_select(b, _mm_setr_epi32(0x80, 0x40, 0x20, 0x10), f, g));
+    _mm_storeu_si128((__m128i*)dst + 1, video_select(b, _mm_setr_epi32(0x08, 0x04, 0x02, 0x01), f, g));
+#else
+    for (unsigned i = 0; i < 8; i++)
+        dst[i] = (bits & (0x80 >> i)) ? fg : bg;
+#endif
+}
+
+// Likewise, but with every pixel doubled horizontally (16 pixels out), for
+// 40-column text and other low resolution modes.
+static inline void video_expand8x2(uint32_t* dst, uint8_t bits, uint32_t fg, uint32_t bg)
+{
+#ifdef VIDEO_SSE2
+    __m128i b = _mm_set1_epi32(bits);
+    __m128i f = _mm_set1_epi32((int)fg);
+    __m128i g = _mm_set1_epi32((int)bg);
+    _mm_storeu_si128((__m128i*)dst + 0, video_select(b, _mm_setr_epi32(0x80, 0x80, 0x40, 0x40), f, g));
+    _mm_storeu_si128((__m128i*)dst + 1, video_select(b, _mm_setr_epi32(0x20, 0x20, 0x10, 0x10), f, g));
+    _mm_storeu_si128((__m128i*)dst + 2, video_select(b, _mm_setr_epi32(0x08, 0x08, 0x04, 0x04), f, g));
+    _mm_storeu_si128((__m128i*)dst + 3, video_select(b, _mm_setr_epi32(0x02, 0x02, 0x01, 0x01), f, g));
+#else
+    for (unsigned i = 0; i < 16; i++)
+        dst[i] = (bits & (0x80 >> (i / 2))) ? fg : bg;
+#endif
+}
+
+static inline void video_fill(uint32_t* dst, size_t count, uint32_t colour)
+{
+    for (size_t i = 0; i < count; i++)
+        dst[i] = colour;
+}
+
+// Blit one glyph row: each mask is all ones where the pixel is lit.
+static inline void video_blit(uint32_t* dst, const uint32_t* mask, unsigned width, uint32_t fg, uint32_t bg)
+{
+    unsigned x = 0;
+#ifdef VIDEO_SSE2
+    __m128i b = _mm_set1_epi32((int)bg);
+    __m128i d = _mm_set1_epi32((int)(fg ^ bg));
+    for (; x + 4 <= width; x += 4)
+        _mm_storeu_si128((__m128i*)(dst + x),
+                         _mm_xor_si128(b, _mm_and_si128(_mm_loadu_si128((const __m128i*)(mask + x)), d)));
+#endif
+    for (; x < width; x++)
+        dst[x] = bg ^ (mask[x] & (fg ^ bg));
+}
+
+// Note that a VRAM word was written, in a bitmap of one bit per word.
+static inline void video_mark(uint64_t* dirty, unsigned word)
+{
+    dirty[word / 64] |= (uint64_t)1 << (word % 64);
+}
+
+// A font expanded for one cell width.
+struct video_atlas
+{
+    unsigned width;                 // Pixels per cell.
+    unsigned height;                // Scanlines per glyph.
+    uint32_t mask[256][VIDEO_GLYPH_MAX_HEIGHT][VIDEO_GLYPH_MAX_WIDTH];
+};
+
+// How a text mode displays each attribute byte. Adapters rebuild this when
+// their mode or palette registers change and when the blink phase flips.
+struct video_attributes
+{
+    uint32_t fg[256];
+    uint32_t bg[256];
+    bool underline[256];
+};
+
+// Text to look for on a text screen, for automation. found is called from
+// the adapter's vertical sync whenever a row that was written since the last
+// frame shows the text where it did not before. Matches do not span rows.
+struct video_match
+{
+    uint8_t text[VIDEO_TEXT_MAX_COLS]; // In code page 437.
+    unsigned length;                // 0 if the entry is free.
+    uint64_t rows[VIDEO_TEXT_MAX_ROWS / 64]; // Rows the text was on at the last check.
+    void (*found)(void* context, unsigned row, unsigned col);
+    void* context;
+};
+
+struct video_matches
+{
+    struct video_match match[VIDEO_MAX_MATCHES];
+    bool rescan;                    // Check every row at the next frame, not just the written ones.
+};
+
+// A text screen, as the adapter's CRTC describes it, and where to draw it.
+struct video_text
+{
+    const uint8_t* vram;            // Character/attribute pairs.
+    unsigned words;                 // Words of VRAM the screen wraps within (a power of two).
+    unsigned cols;
+    unsigned rows;
+    unsigned height;                // Scanlines per character row.
+    unsigned start;                 // Word of the top left cell.
+    unsigned cursor;                // Word the cursor is on.
+    uint32_t cursor_lines;          // Scanlines of that cell the cursor covers, one bit each.
+    uint32_t underline_lines;       // Scanlines underlined attributes cover, one bit each.
+    const struct video_atlas* atlas;
+    const struct video_attributes* attributes;
+    struct video_matches* matches;  // Text to look for in the rows drawn, if not NULL.
+    uint32_t* pixels;
+    unsigned pitch;                 // Pixels per frame scanline.
+    unsigned lines;                 // Scanlines in the frame.
+};
+
+void video_atlas_build(struct video_atlas* atlas, const uint8_t* font, unsigned stride,
+                       unsigned height, unsigned width);
+uint32_t video_cursor_lines(uint8_t start, uint8_t end);
+void video_text_blinking(const struct video_text* text, uint64_t* dirty);
+bool video_text_compose(const struct video_text* text, const uint64_t* dirty, bool redraw);
+size_t video_text_utf8(const struct video_text* text, char* buffer, size_t size);
+int video_match_add(struct video_matches* matches, const char* text,
+                    void (*found)(void*, unsigned, unsigned), void* context);
+void video_match_remove(struct video_matches* matches, int index);
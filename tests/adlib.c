@@ -0,0 +1,99 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// AdLib: the timer detection sequence guests use, a sine carrier coming out
+// at the pitch and level its registers ask for, starting on the sample its
+// key-on was written at, and releasing to silence.
+
+#include <math.h>
+
+#include "test.h"
+#include "adlib.h"
+
+#define RATE 48000
+
+static int16_t samples[RATE * 2];
+
+static void adlib_write(struct bus* bus, uint8_t reg, uint8_t data)
+{
+    bus_out_byte(bus, ADLIB_PORTS, reg);
+    bus_out_byte(bus, ADLIB_PORTS + 1, data);
+}
+
+// Advance the bus by the given time, reading audio at 60 Hz. Returns how many
+// samples were read.
+static size_t render(struct bus* bus, struct adlib* adlib, double seconds)
+{
+    size_t count = 0;
+    uint64_t end = bus->clock + (uint64_t)(seconds * BUS_MASTER_CLOCK);
+    while (bus->clock < end)
+    {
+        bus->clock += BUS_MASTER_CLOCK / 60;
+        if (bus->clock > end)
+            bus->clock = end;
+        count += adlib_audio(bus, adlib, samples + count, sizeof(samples) / sizeof(*samples) - count);
+    }
+    return count;
+}
+
+int main(void)
+{
+    struct bus* bus = bus_new(0x100000, false);
+    struct adlib* adlib = adlib_new(bus, RATE);
+    CHECK(adlib != NULL);
+
+    // Reset the timers, start timer 1 at its shortest period and check that
+    // it expires.
+    adlib_write(bus, 0x04, 0x60);
+    adlib_write(bus, 0x04, 0x80);
+    CHECK((bus_in_byte(bus, ADLIB_PORTS) & 0xE0) == 0);
+    adlib_write(bus, 0x02, 0xFF);
+    adlib_write(bus, 0x04, 0x21);
+    bus->clock += BUS_MASTER_CLOCK / 10000;
+    CHECK((bus_in_byte(bus, ADLIB_PORTS) & 0xE0) == (ADLIB_STATUS_IRQ | ADLIB_STATUS_TIMER1));
+    adlib_write(bus, 0x04, 0x60);
+    adlib_write(bus, 0x04, 0x80);
+
+    // A440 on channel 0: a silent modulator and a full volume sine carrier,
+    // keyed on 10 ms (480 samples) into the next batch read.
+    static const uint8_t voice[][2] =
+    {
+        { 0x20, 0x21 }, { 0x40, 0x3F }, { 0x60, 0xF0 }, { 0x80, 0x0F },
+        { 0x23, 0x21 }, { 0x43, 0x00 }, { 0x63, 0xF0 }, { 0x83, 0x0F },
+        { 0xC0, 0x00 }, { 0xA0, 580 & 0xFF },
+    };
+    for (unsigned i = 0; i < sizeof(voice) / sizeof(*voice); i++)
+        adlib_write(bus, voice[i][0], voice[i][1]);
+    render(bus, adlib, 0.1);
+    bus->clock += BUS_MASTER_CLOCK / 100;
+    adlib_write(bus, 0xB0, 0x20 | (4 << 2) | (580 >> 8));
+    bus->clock -= BUS_MASTER_CLOCK / 100;
+
+    size_t count = render(bus, adlib, 1.0);
+    size_t first = 0;
+    while (first < count && abs(samples[first]) <= 50)
+        first++;
+    CHECK(first >= 478 && first <= 500);
+
+    unsigned crossings = 0;
+    int peak = 0;
+    for (size_t i = RATE / 2; i < count; i++)
+    {
+        crossings += (samples[i - 1] < 0) != (samples[i] < 0);
+        peak = (abs(samples[i]) > peak) ? abs(samples[i]) : peak;
+    }
+    double pitch = crossings / 2.0 / ((double)(count - RATE / 2) / RATE);
+    CHECK(fabs(pitch - 440.0) < 3.0);
+    CHECK(peak > 0.9f * ADLIB_CHANNEL_VOLUME * 32767 && peak < 1.1f * ADLIB_CHANNEL_VOLUME * 32767);
+
+    // Key off: the carrier releases at the fastest rate.
+    adlib_write(bus, 0xB0, (4 << 2) | (580 >> 8));
+    count = render(bus, adlib, 0.5);
+    peak = 0;
+    for (size_t i = count / 2; i < count; i++)
+        peak = (abs(samples[i]) > peak) ? abs(samples[i]) : peak;
+    CHECK(peak < 20);
+
+    bus_free(bus);
+    return test_result();
+}
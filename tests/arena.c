@@ -0,0 +1,75 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Arenas, with and without huge pages: regions are 2 MB aligned and sized,
+// allocations are zeroed and cache-line aligned, clones copy everything
+// and keep the backing that was asked for, and a machine runs the same on
+// either.
+
+#include <stdint.h>
+
+#include "test.h"
+#include "arena.h"
+
+int main(void)
+{
+    for (unsigned huge = 0; huge < 2; huge++)
+    {
+        struct arena* arenas[8];
+        size_t colours[8];
+        for (unsigned i = 0; i < 8; i++)
+        {
+            struct arena* arena = arenas[i] = arena_new(3 * 1024 * 1024, huge);
+            CHECK(((uintptr_t)arena->base % ARENA_GRANULE) == 0);
+            CHECK((arena->size % ARENA_GRANULE) == 0);
+            CHECK(arena->huge_pages == (bool)huge);
+            if (!huge)
+                CHECK(arena->pages == ARENA_PAGES_NORMAL);
+            colours[i] = arena->used;
+
+            uint8_t* small = arena_alloc(arena, 1);
+            uint8_t* large = arena_alloc(arena, 3 * 1024 * 1024 - 64);
+            CHECK(((uintptr_t)small % ARENA_ALIGNMENT) == 0);
+            CHECK(((uintptr_t)large % ARENA_ALIGNMENT) == 0);
+            CHECK(large - small == ARENA_ALIGNMENT);
+            CHECK(small[0] == 0 && large[0] == 0 && large[3 * 1024 * 1024 - 65] == 0);
+            small[0] = 0x5A;
+            large[12345] = 0xA5;
+
+            struct arena* clone = arena_clone(arena);
+            CHECK(clone->base != arena->base && clone->used == arena->used);
+            CHECK(clone->huge_pages == arena->huge_pages);
+            uint8_t* copy = arena_relocate(clone, arena, large);
+            CHECK(copy[12345] == 0xA5 && *(uint8_t*)arena_relocate(clone, arena, small) == 0x5A);
+            copy[12345] = 0;
+            CHECK(large[12345] == 0xA5);
+            arena_free(clone);
+        }
+
+        // Arenas next to each other start at different colours.
+        unsigned distinct = 0;
+        for (unsigned i = 0; i < 8; i++)
+        {
+            bool seen = false;
+            for (unsigned j = 0; j < i; j++)
+                seen |= colours[j] == colours[i];
+            distinct += !seen;
+        }
+        CHECK(distinct > 1);
+        for (unsigned i = 0; i < 8; i++)
+            arena_free(arenas[i]);
+
+        // A machine, and its clone, on the arena.
+        static const uint8_t code[] = { 0x05, 0x34, 0x12 };     // ADD AX, 1234h
+        struct bus* bus = bus_new(0x100000, huge);
+        bus->cpu->ax = 0x1111;
+        test_run(bus, code, sizeof(code));
+        CHECK(bus->cpu->ax == 0x2345);
+        struct bus* clone = bus_clone(bus);
+        test_run(clone, code, sizeof(code));
+        CHECK(clone->cpu->ax == 0x3579 && bus->cpu->ax == 0x2345);
+        bus_free(clone);
+        bus_free(bus);
+    }
+    return test_result();
+}
@@ -0,0 +1,83 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Band-limited steps: a step that lands beyond the buffer, or one the host
+// left unread past the end of it, still moves the level, so the speaker is
+// not left off by the steps that were skipped.
+
+#include <math.h>
+
+#include "test.h"
+#include "audio.h"
+#include "pit.h"
+
+#define RATE 48000
+
+// The master clock at which a sample falls.
+static uint64_t clock_of(uint64_t sample)
+{
+    return sample * BUS_MASTER_CLOCK / RATE + 1;
+}
+
+static int16_t samples[AUDIO_BLIP_SIZE];
+
+// Read everything complete at the given clock, returning the lowest sample.
+static int lowest(struct audio_blip* blip, uint64_t clock)
+{
+    int low = 32767;
+    size_t count;
+    while ((count = audio_blip_read(blip, clock, samples, AUDIO_BLIP_SIZE)))
+    {
+        for (size_t i = 0; i < count; i++)
+            low = (samples[i] < low) ? samples[i] : low;
+    }
+    return low;
+}
+
+int main(void)
+{
+    static struct audio_blip blip;
+
+    // A step far past the buffer.
+    audio_blip_init(&blip, RATE, 0);
+    audio_blip_step(&blip, clock_of(100000), 0.5f);
+    lowest(&blip, clock_of(100000 + 2 * AUDIO_BLIP_TAPS));
+    CHECK(fabsf(blip.integrator - 0.5f) < 1e-4f);
+
+    // Steps left unread for longer than the buffer, then one past it.
+    audio_blip_init(&blip, RATE, 0);
+    audio_blip_step(&blip, clock_of(100), 0.5f);
+    audio_blip_step(&blip, clock_of(200), -0.25f);
+    lowest(&blip, clock_of(50000));
+    CHECK(fabsf(blip.integrator - 0.25f) < 1e-4f);
+    audio_blip_step(&blip, clock_of(50000 + 3 * AUDIO_BLIP_SIZE), -0.25f);
+    lowest(&blip, clock_of(50000 + 4 * AUDIO_BLIP_SIZE));
+    CHECK(fabsf(blip.integrator) < 1e-4f);
+
+    // The high-pass has settled on the level over a long skip.
+    CHECK(fabsf(blip.integrator - blip.dc) < 1e-3f);
+
+    // Turn the speaker on (channel 2 idles high in mode 3), leave it unread
+    // for a second and turn it off: the step down is heard when the host
+    // catches up.
+    struct bus* bus = bus_new(0x100000, false);
+    struct pit* pit = pit_new(bus, RATE);
+    bus_out_byte(bus, 0x43, 0xB6);
+    bus_out_byte(bus, PIT_PPI_PORT, PIT_PPI_SPEAKER);
+    bus->clock += BUS_MASTER_CLOCK / 10;
+    while (pit_audio(bus, pit, samples, AUDIO_BLIP_SIZE));
+    bus->clock += BUS_MASTER_CLOCK;
+    bus_out_byte(bus, PIT_PPI_PORT, 0);
+    bus->clock += BUS_MASTER_CLOCK / 10;
+    int low = 32767;
+    size_t count;
+    while ((count = pit_audio(bus, pit, samples, AUDIO_BLIP_SIZE)))
+    {
+        for (size_t i = 0; i < count; i++)
+            low = (samples[i] < low) ? samples[i] : low;
+    }
+    CHECK(low < -0.8f * PIT_SPEAKER_VOLUME * 32767.0f);
+    bus_free(bus);
+
+    return test_result();
+}
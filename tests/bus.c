@@ -0,0 +1,106 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Port and memory mapping: a range that overlaps one already mapped (or, for
+// memory, watched) is refused rather than shadowed, as is one past the end of
+// the table, and a device whose ports or memory are taken fails to attach
+// without leaving any of its ports behind.
+
+#include "test.h"
+#include "cga.h"
+#include "mda.h"
+#include "vga.h"
+
+static uint8_t memory_read(struct bus* bus, void* device, uint32_t address)
+{
+    (void)bus;
+    (void)address;
+    return (uint8_t)(uintptr_t)device;
+}
+
+static void memory_written(struct bus* bus, void* device, uint32_t address, size_t length)
+{
+    (void)bus;
+    (void)device;
+    (void)address;
+    (void)length;
+}
+
+static uint8_t port_in(struct bus* bus, void* device, uint16_t port)
+{
+    (void)bus;
+    (void)port;
+    return (uint8_t)(uintptr_t)device;
+}
+
+int main(void)
+{
+    struct bus* bus = bus_new(0x100000, false);
+    CHECK(bus_map_ports(bus, 0x100, 8, (void*)1, port_in, NULL));
+    CHECK(!bus_map_ports(bus, 0x100, 8, (void*)2, port_in, NULL));
+    CHECK(!bus_map_ports(bus, 0x0FC, 5, (void*)2, port_in, NULL));
+    CHECK(!bus_map_ports(bus, 0x107, 1, (void*)2, port_in, NULL));
+    CHECK(!bus_map_ports(bus, 0x0F0, 0x20, (void*)2, port_in, NULL));
+    CHECK(bus_map_ports(bus, 0x0F8, 8, (void*)2, port_in, NULL));
+    CHECK(bus_map_ports(bus, 0x108, 8, (void*)3, port_in, NULL));
+    CHECK(bus_in_byte(bus, 0x0FF) == 2 && bus_in_byte(bus, 0x100) == 1);
+    CHECK(bus_in_byte(bus, 0x107) == 1 && bus_in_byte(bus, 0x108) == 3);
+
+    // Fill the table.
+    for (unsigned i = bus->port_count; i < BUS_MAX_PORTS; i++)
+        CHECK(bus_map_ports(bus, (uint16_t)(0x200 + i), 1, (void*)4, port_in, NULL));
+    CHECK(!bus_map_ports(bus, 0x400, 1, (void*)5, port_in, NULL));
+    CHECK(bus->port_count == BUS_MAX_PORTS);
+
+    bus_unmap_ports(bus, (void*)4);
+    CHECK(bus->port_count == 3);
+    CHECK(bus_in_byte(bus, 0x0FF) == 2 && bus_in_byte(bus, 0x108) == 3);
+    CHECK(bus_in_byte(bus, 0x204) == 0xFF);
+    bus_free(bus);
+
+    // The VGA's CRTC ports are the CGA's, so only one of them attaches.
+    bus = bus_new(0x100000, false);
+    CHECK(cga_new(bus, NULL) != NULL);
+    unsigned ports = bus->port_count;
+    CHECK(vga_new(bus) == NULL);
+    CHECK(bus->port_count == ports);
+    CHECK(bus->mapping_count == 0);
+    bus_free(bus);
+
+    // Memory mappings and watches share the pages between them.
+    bus = bus_new(0x100000, false);
+    CHECK(bus_map_memory(bus, 0xC0000, 0x2000, (void*)1, memory_read, NULL));
+    CHECK(!bus_map_memory(bus, 0xC1000, 0x2000, (void*)2, memory_read, NULL));
+    CHECK(!bus_map_memory(bus, 0xBF000, 0x2000, (void*)2, memory_read, NULL));
+    CHECK(!bus_watch(bus, 0xC1000, 0x1000, (void*)2, memory_written));
+    CHECK(bus_watch(bus, 0xC2000, 0x1000, (void*)2, memory_written));
+    CHECK(!bus_watch(bus, 0xC2000, 0x1000, (void*)3, memory_written));
+    CHECK(!bus_map_memory(bus, 0xC2000, 0x1000, (void*)3, memory_read, NULL));
+    CHECK(bus_map_memory(bus, 0xBF000, 0x1000, (void*)3, memory_read, NULL));
+    CHECK(bus->mapping_count == 2 && bus->watch_count == 1);
+    CHECK(bus_read_byte(bus, 0xBFFFF) == 3 && bus_read_byte(bus, 0xC1FFF) == 1);
+    CHECK(bus_read_byte(bus, 0xC2000) == 0);
+
+    // Fill the tables.
+    for (unsigned i = bus->mapping_count; i < BUS_MAX_MAPPINGS; i++)
+        CHECK(bus_map_memory(bus, 0xD0000 + i * 0x1000, 0x1000, (void*)4, memory_read, NULL));
+    CHECK(!bus_map_memory(bus, 0xE0000, 0x1000, (void*)5, memory_read, NULL));
+    for (unsigned i = bus->watch_count; i < BUS_MAX_WATCHES; i++)
+        CHECK(bus_watch(bus, 0x10000 + i * 0x1000, 0x1000, (void*)4, memory_written));
+    CHECK(!bus_watch(bus, 0xE0000, 0x1000, (void*)5, memory_written));
+    CHECK(bus->mapping_count == BUS_MAX_MAPPINGS && bus->watch_count == BUS_MAX_WATCHES);
+    bus_free(bus);
+
+    // Devices whose memory is taken attach nothing either.
+    bus = bus_new(0x100000, false);
+    CHECK(bus_map_memory(bus, 0xA8000, 0x1000, NULL, memory_read, NULL));
+    CHECK(bus_map_memory(bus, 0xBB000, 0x1000, NULL, memory_read, NULL));
+    CHECK(bus_watch(bus, 0xB7000, 0x1000, NULL, memory_written));
+    CHECK(vga_new(bus) == NULL);
+    CHECK(cga_new(bus, NULL) == NULL);
+    CHECK(mda_new(bus, NULL) == NULL);
+    CHECK(bus->port_count == 0 && bus->mapping_count == 2 && bus->watch_count == 1);
+    bus_free(bus);
+
+    return test_result();
+}
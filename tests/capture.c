@@ -0,0 +1,113 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Frame capture, end to end: frames offered at the capture rate, some
+// changed and some not, some late and one early, come out as a Y4M stream
+// with a frame for every interval (repeats included) or as PPM images of only
+// the changed frames, each numbered. Smaller frames are centred on black.
+
+#include "test.h"
+#include "capture.h"
+
+#define Y4M         "test_capture.y4m"
+#define PPM         "test_capture.ppm"
+#define WIDTH       8
+#define HEIGHT      4
+#define RATE        10
+#define FRAMES      6
+
+#define RED         0xFF0000
+#define BLUE        0x0000FF
+
+static uint32_t red[WIDTH * HEIGHT];
+static uint32_t blue[(WIDTH / 2) * (HEIGHT / 2)];
+
+// The master clock frame n is due at.
+static uint64_t due(uint64_t n)
+{
+    return (n * BUS_MASTER_CLOCK + RATE - 1) / RATE;
+}
+
+// Red (update 1) for frames 0 and 1, then a smaller blue frame (update 2)
+// for frame 2, then nothing until frame 5, which is unchanged. The blue frame
+// is offered early first, which must be ignored.
+static bool feed(const char* path, enum capture_format format)
+{
+    struct capture* capture = capture_open(path, format, WIDTH, HEIGHT, RATE);
+    if (!capture)
+        return false;
+    capture_frame(capture, due(0), red, WIDTH, HEIGHT, 1);
+    capture_frame(capture, due(1), red, WIDTH, HEIGHT, 1);
+    capture_frame(capture, due(2) - 1, blue, WIDTH / 2, HEIGHT / 2, 2);
+    capture_frame(capture, due(2), blue, WIDTH / 2, HEIGHT / 2, 2);
+    capture_frame(capture, due(5), blue, WIDTH / 2, HEIGHT / 2, 2);
+    CHECK(capture_dropped(capture) == 0);
+    return capture_close(capture);
+}
+
+static long read_file(const char* path, uint8_t* buffer, size_t size)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return -1;
+    size_t length = fread(buffer, 1, size, file);
+    fclose(file);
+    return (long)length;
+}
+
+int main(void)
+{
+    for (unsigned i = 0; i < WIDTH * HEIGHT; i++)
+        red[i] = RED;
+    for (unsigned i = 0; i < (WIDTH / 2) * (HEIGHT / 2); i++)
+        blue[i] = BLUE;
+    static uint8_t data[4096];
+
+    // Y4M: a stream header, then a frame for every interval. Luma of red,
+    // black and blue is 82, 16 and 41; the blue frame sits in the middle.
+    CHECK(feed(Y4M, CAPTURE_FORMAT_Y4M));
+    long length = read_file(Y4M, data, sizeof(data));
+    static const char header[] = "YUV4MPEG2 W8 H4 F10:1 Ip A1:1 C420jpeg\n";
+    size_t frame_size = 6 + WIDTH * HEIGHT * 3 / 2;
+    CHECK(length == (long)(strlen(header) + FRAMES * frame_size));
+    CHECK(length > 0 && memcmp(data, header, strlen(header)) == 0);
+    for (unsigned frame = 0; frame < FRAMES && length == (long)(strlen(header) + FRAMES * frame_size); frame++)
+    {
+        const uint8_t* p = data + strlen(header) + frame * frame_size;
+        CHECK(memcmp(p, "FRAME\n", 6) == 0);
+        for (unsigned y = 0; y < HEIGHT; y++)
+        {
+            for (unsigned x = 0; x < WIDTH; x++)
+            {
+                bool inside = x >= WIDTH / 4 && x < WIDTH * 3 / 4 && y >= HEIGHT / 4 && y < HEIGHT * 3 / 4;
+                uint8_t luma = (frame < 2) ? 82 : inside ? 41 : 16;
+                if (p[6 + y * WIDTH + x] != luma && test_failures++ < 20)
+                    fprintf(stderr, "frame %u: luma at %u,%u is %u, not %u\n", frame, x, y,
+                            p[6 + y * WIDTH + x], luma);
+            }
+        }
+    }
+    remove(Y4M);
+
+    // PPM: an image for each of the two changed frames only.
+    CHECK(feed(PPM, CAPTURE_FORMAT_PPM));
+    length = read_file(PPM, data, sizeof(data));
+    static const char* headers[2] = { "P6\n# frame 0\n8 4\n255\n", "P6\n# frame 2\n8 4\n255\n" };
+    size_t image_size = WIDTH * HEIGHT * 3;
+    CHECK(length == (long)(strlen(headers[0]) + strlen(headers[1]) + 2 * image_size));
+    if (length == (long)(strlen(headers[0]) + strlen(headers[1]) + 2 * image_size))
+    {
+        const uint8_t* p = data;
+        for (unsigned image = 0; image < 2; image++)
+        {
+            CHECK(memcmp(p, headers[image], strlen(headers[image])) == 0);
+            p += strlen(headers[image]);
+            CHECK(image == 0 ? (p[0] == 0xFF && p[1] == 0 && p[2] == 0)
+                             : (p[0] == 0 && p[(HEIGHT / 2 * WIDTH + WIDTH / 2) * 3 + 2] == 0xFF));
+            p += image_size;
+        }
+    }
+    remove(PPM);
+
+    return test_result();
+}
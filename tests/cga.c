@@ -0,0 +1,132 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// CGA composition: text cells and both graphics modes against a plain
+// reference, and frames redrawn from dirty cells and scanlines matching a
+// full redraw.
+
+#include "test.h"
+#include "cga.h"
+
+static uint8_t font[CGA_FONT_SIZE];
+static uint32_t expect[CGA_WIDTH * CGA_HEIGHT];
+
+// What a graphics frame should look like, straight from the spec.
+static void reference_graphics(const struct bus* bus, const struct cga* cga)
+{
+    static const uint8_t sets[3][3] = { { 2, 4, 6 }, { 3, 5, 7 }, { 3, 4, 7 } };
+    unsigned start = (((cga->crtc[12] << 8) | cga->crtc[13]) * 2) & 0x1FFF;
+    for (unsigned y = 0; y < CGA_HEIGHT; y++)
+    {
+        const uint8_t* bank = &bus->memory[CGA_VRAM + (y & 1) * 0x2000];
+        for (unsigned x = 0; x < CGA_WIDTH; x++)
+        {
+            uint8_t byte = bank[(start + (y / 2) * 80 + x / 8) & 0x1FFF];
+            uint32_t colour;
+            if (cga->mode & CGA_MODE_HIRES_GRAPHICS)
+                colour = (byte & (0x80 >> (x % 8))) ? video_rgbi[cga->colour & 0xF] : 0;
+            else
+            {
+                unsigned pixel = (byte >> (6 - (x % 8) / 2 * 2)) & 3;
+                const uint8_t* set = sets[(cga->mode & CGA_MODE_BW) ? 2 : (cga->colour >> 5) & 1];
+                colour = pixel ? video_rgbi[set[pixel - 1] | ((cga->colour & 0x10) ? 8 : 0)]
+                               : video_rgbi[cga->colour & 0xF];
+            }
+            expect[y * CGA_WIDTH + x] = colour;
+        }
+    }
+}
+
+static void check_frame(const struct cga* cga, const char* what)
+{
+    for (unsigned i = 0; i < CGA_WIDTH * CGA_HEIGHT; i++)
+    {
+        if (cga->pixels[i] != expect[i])
+        {
+            fprintf(stderr, "%s: pixel %u,%u is %06X, not %06X\n", what, i % CGA_WIDTH, i / CGA_WIDTH,
+                    cga->pixels[i], expect[i]);
+            test_failures++;
+            return;
+        }
+    }
+}
+
+int main(void)
+{
+    for (unsigned i = 0; i < CGA_FONT_SIZE; i++)
+        font[i] = (uint8_t)(i * 37 + (i >> 8));
+    struct bus* bus = bus_new(0x100000, false);
+    struct cga* cga = cga_new(bus, font);
+
+    // A text cell, then a frame without writes.
+    cga_compose(bus, cga);
+    bus_write_byte(bus, CGA_VRAM + (2 * 80 + 3) * 2, 'A');
+    bus_write_byte(bus, CGA_VRAM + (2 * 80 + 3) * 2 + 1, 0x1E);     // Yellow on blue.
+    cga_compose(bus, cga);
+    CHECK(cga->changed);
+    for (unsigned line = 0; line < 8; line++)
+    {
+        for (unsigned x = 0; x < 8; x++)
+        {
+            uint32_t colour = (font['A' * 8 + line] & (0x80 >> x)) ? video_rgbi[0xE] : video_rgbi[0x1];
+            CHECK(cga->pixels[(16 + line) * CGA_WIDTH + 24 + x] == colour);
+        }
+    }
+    cga_compose(bus, cga);
+    CHECK(!cga->changed);
+
+    // Every palette of both graphics modes, with and without a start
+    // address, on random VRAM.
+    uint32_t seed = 1;
+    for (unsigned i = 0; i < CGA_VRAM_SIZE; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        bus->memory[CGA_VRAM + i] = (uint8_t)(seed >> 16);
+    }
+    static const uint8_t modes[] =
+    {
+        CGA_MODE_GRAPHICS | CGA_MODE_ENABLE,
+        CGA_MODE_GRAPHICS | CGA_MODE_ENABLE | CGA_MODE_BW,
+        CGA_MODE_GRAPHICS | CGA_MODE_ENABLE | CGA_MODE_HIRES_GRAPHICS,
+    };
+    for (unsigned i = 0; i < sizeof(modes); i++)
+    {
+        for (unsigned colour = 0; colour < 0x40; colour += 0x07)
+        {
+            for (unsigned start = 0; start < 2; start++)
+            {
+                bus_out_byte(bus, CGA_PORTS + 0x4, 13);
+                bus_out_byte(bus, CGA_PORTS + 0x5, start ? 40 : 0);
+                bus_out_byte(bus, CGA_PORTS + 0x8, modes[i]);
+                bus_out_byte(bus, CGA_PORTS + 0x9, (uint8_t)colour);
+                CHECK(cga->crtc[13] == (start ? 40 : 0));
+                cga->redraw = true;
+                cga_compose(bus, cga);
+                reference_graphics(bus, cga);
+                check_frame(cga, "full redraw");
+            }
+        }
+    }
+
+    // Scattered writes, in both banks, redraw only what they touched.
+    for (unsigned i = 0; i < sizeof(modes); i++)
+    {
+        bus_out_byte(bus, CGA_PORTS + 0x8, modes[i]);
+        cga_compose(bus, cga);
+        for (unsigned frame = 0; frame < 20; frame++)
+        {
+            for (unsigned j = 0; j < 5; j++)
+            {
+                seed = seed * 1103515245 + 12345;
+                bus_write_byte(bus, CGA_VRAM + (seed >> 8) % CGA_VRAM_SIZE, (uint8_t)(seed >> 20));
+            }
+            cga_compose(bus, cga);
+            CHECK(cga->changed);
+            reference_graphics(bus, cga);
+            check_frame(cga, "dirty redraw");
+        }
+    }
+
+    bus_free(bus);
+    return test_result();
+}
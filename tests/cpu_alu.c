@@ -0,0 +1,116 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Byte ALU tables: every byte ALU and decimal adjust instruction gives the
+// same result and flags with the tables as without, for every pair of
+// operands and carry-in. Also switches the tables on and off from several
+// threads at once, as machines on different threads share them.
+
+#include "test.h"
+
+#ifndef _WIN32
+#   include <pthread.h>
+#endif
+
+#define THREADS         4
+#define THREAD_TOGGLES  20
+
+// <op> AL, BL, in the order of the tables.
+static const uint8_t binary[] = { 0x00, 0x10, 0x28, 0x18, 0x38, 0x20, 0x08, 0x30 };
+
+// DAA, DAS, AAA, AAS.
+static const uint8_t adjust[] = { 0x27, 0x2F, 0x37, 0x3F };
+
+// Run code on a CPU without the tables and one with, and check that they
+// agree.
+static void compare(struct bus** buses, const uint8_t* code, size_t length, uint16_t ax, uint8_t bl,
+                    uint16_t flags)
+{
+    uint16_t results[2][2];
+    for (unsigned tables = 0; tables < 2; tables++)
+    {
+        struct cpu8086* cpu = buses[tables]->cpu;
+        cpu->ax = ax;
+        cpu->bl = bl;
+        cpu8086_set_flags(cpu, flags);
+        test_run(buses[tables], code, length);
+        results[tables][0] = cpu->ax;
+        results[tables][1] = cpu8086_get_flags(cpu);
+    }
+    if (results[0][0] != results[1][0] || results[0][1] != results[1][1])
+    {
+        if (test_failures++ < 10)
+            fprintf(stderr, "%02X, AX %04X BL %02X flags %04X: %04X %04X without tables, %04X %04X with\n",
+                    code[0], ax, bl, flags, results[0][0], results[0][1], results[1][0], results[1][1]);
+    }
+}
+
+#ifndef _WIN32
+// Returns non-NULL if a result was wrong.
+static void* toggle(void* arg)
+{
+    static const uint8_t code[] = { 0x10, 0xD8 };     // ADC AL, BL
+    struct bus* bus = bus_new(0x100000, false);
+    struct cpu8086* cpu = bus->cpu;
+    void* failed = NULL;
+    for (unsigned i = 0; i < THREAD_TOGGLES; i++)
+    {
+        cpu8086_set_alu_tables(cpu, true);
+        cpu->al = (uint8_t)i;
+        cpu->bl = 0x7F;
+        cpu8086_set_flags(cpu, FLAG_CARRY);
+        test_run(bus, code, sizeof(code));
+        if (cpu->al != (uint8_t)(i + 0x80))
+            failed = arg;
+        cpu8086_set_alu_tables(cpu, false);
+    }
+    bus_free(bus);
+    return failed;
+}
+#endif
+
+int main(void)
+{
+    struct bus* buses[2] = { bus_new(0x100000, false), bus_new(0x100000, false) };
+    cpu8086_set_alu_tables(buses[1]->cpu, true);
+    for (unsigned i = 0; i < sizeof(binary); i++)
+    {
+        uint8_t code[] = { binary[i], 0xD8 };   // <op> AL, BL
+        for (unsigned a = 0; a < 256; a++)
+        {
+            for (unsigned b = 0; b < 256; b++)
+            {
+                compare(buses, code, sizeof(code), (uint16_t)(0x4200 | a), (uint8_t)b, 0);
+                compare(buses, code, sizeof(code), (uint16_t)(0x4200 | a), (uint8_t)b, FLAG_CARRY);
+            }
+        }
+    }
+
+    // AAA and AAS carry into AH.
+    static const uint8_t high[] = { 0x00, 0x7F, 0xFF };
+    for (unsigned i = 0; i < sizeof(adjust); i++)
+    {
+        for (unsigned ax = 0; ax < sizeof(high) * 256; ax++)
+        {
+            for (unsigned flags = 0; flags < 4; flags++)
+                compare(buses, &adjust[i], 1, (uint16_t)((high[ax >> 8] << 8) | (ax & 0xFF)), 0,
+                        ((flags & 1) ? FLAG_CARRY : 0) | ((flags & 2) ? FLAG_AUXILIARY : 0));
+        }
+    }
+    bus_free(buses[0]);
+    bus_free(buses[1]);
+
+#ifndef _WIN32
+    static int failed;
+    pthread_t threads[THREADS];
+    for (unsigned i = 0; i < THREADS; i++)
+        CHECK(pthread_create(&threads[i], NULL, toggle, &failed) == 0);
+    for (unsigned i = 0; i < THREADS; i++)
+    {
+        void* result;
+        pthread_join(threads[i], &result);
+        CHECK(result == NULL);
+    }
+#endif
+    return test_result();
+}
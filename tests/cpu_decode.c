@@ -0,0 +1,74 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Decoding: every combination of displacement and immediate bytes, including
+// the segment:offset of a far call, is put back together correctly. Each
+// instruction starts with an empty queue, so decoding stalls on every byte.
+
+#include "test.h"
+
+int main(void)
+{
+    struct bus* bus = bus_new(0x100000, false);
+    struct cpu8086* cpu = bus->cpu;
+    cpu->ds = 0x1000;
+    cpu->ss = 0x2000;
+    cpu->sp = 0x0100;
+    cpu->bx = 0x0200;
+
+    // MOV WORD [BX+disp8], imm16, with a negative displacement.
+    static const uint8_t mov_disp8[] = { 0xC7, 0x47, 0xFE, 0xCD, 0xAB };
+    test_run(bus, mov_disp8, sizeof(mov_disp8));
+    CHECK(bus->memory[0x101FE] == 0xCD && bus->memory[0x101FF] == 0xAB);
+
+    // MOV WORD [BX+disp16], imm16.
+    static const uint8_t mov_disp16[] = { 0xC7, 0x87, 0x34, 0x12, 0x78, 0x56 };
+    test_run(bus, mov_disp16, sizeof(mov_disp16));
+    CHECK(bus->memory[0x11434] == 0x78 && bus->memory[0x11435] == 0x56);
+
+    // MOV WORD [disp16], imm16: direct addressing.
+    static const uint8_t mov_direct[] = { 0xC7, 0x06, 0xF0, 0xFF, 0xEF, 0xBE };
+    test_run(bus, mov_direct, sizeof(mov_direct));
+    CHECK(bus->memory[0x1FFF0] == 0xEF && bus->memory[0x1FFF1] == 0xBE);
+
+    // MOV AX, [addr] and ADD AX, imm16 with the top bit of each byte set.
+    static const uint8_t mov_addr[] = { 0xA1, 0xF0, 0xFF };
+    test_run(bus, mov_addr, sizeof(mov_addr));
+    CHECK(cpu->ax == 0xBEEF);
+    static const uint8_t add_imm16[] = { 0x05, 0x81, 0x80 };
+    test_run(bus, add_imm16, sizeof(add_imm16));
+    CHECK(cpu->ax == (uint16_t)(0xBEEF + 0x8081));
+
+    // ADD BYTE [BX+disp8], imm8 and ADD WORD [BX], sign-extended imm8.
+    static const uint8_t add_imm8[] = { 0x80, 0x47, 0xFE, 0x80 };
+    test_run(bus, add_imm8, sizeof(add_imm8));
+    CHECK(bus->memory[0x101FE] == (uint8_t)(0xCD + 0x80));
+    static const uint8_t add_simm8[] = { 0x83, 0x07, 0xFF };
+    bus->memory[0x10200] = 0x00;
+    bus->memory[0x10201] = 0x01;
+    test_run(bus, add_simm8, sizeof(add_simm8));
+    CHECK(bus->memory[0x10200] == 0xFF && bus->memory[0x10201] == 0x00);
+
+    // CALL F00D:C0DE, which pushes the return address past its five bytes.
+    static const uint8_t call_far[] = { 0x9A, 0xDE, 0xC0, 0x0D, 0xF0 };
+    test_run(bus, call_far, sizeof(call_far));
+    CHECK(cpu->cs == 0xF00D && cpu->current_ip == 0xC0DE);
+    CHECK(cpu->sp == 0x00FC);
+    CHECK(bus->memory[0x200FC] == 0x05 && bus->memory[0x200FD] == 0x01);
+    CHECK(bus->memory[0x200FE] == 0x00 && bus->memory[0x200FF] == 0x00);
+
+    // MOV ES, AX and MOV CX, DS spelt with reg 4 and 7, which the 8086 reads
+    // as ES and DS, leaving the other segments alone.
+    cpu->ax = 0x3000;
+    static const uint8_t mov_es_alias[] = { 0x8E, 0xE0 };
+    test_run(bus, mov_es_alias, sizeof(mov_es_alias));
+    CHECK(cpu->es == 0x3000 && cpu->es_base == 0x30000);
+    CHECK(cpu->ds == 0x1000 && cpu->ss == 0x2000);
+    CHECK(cpu->ds_base == 0x10000 && cpu->ss_base == 0x20000);
+    static const uint8_t mov_ds_alias[] = { 0x8C, 0xF9 };
+    test_run(bus, mov_ds_alias, sizeof(mov_ds_alias));
+    CHECK(cpu->cx == 0x1000);
+
+    bus_free(bus);
+    return test_result();
+}
@@ -0,0 +1,105 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Unpacked flags: packing and unpacking round-trip every FLAGS value, with
+// the reserved bits read as the 8086 has them, and the instructions that see
+// the packed layout (PUSHF, POPF, LAHF, SAHF) and the branches that read the
+// flags agree with it.
+
+#include "test.h"
+
+// Bits that exist in FLAGS; bit 1 and bits 12 to 15 always read as 1.
+#define FLAGS_DEFINED   0x0FD5
+#define FLAGS_RESERVED  0xF002
+
+int main(void)
+{
+    struct bus* bus = bus_new(0x100000, false);
+    struct cpu8086* cpu = bus->cpu;
+
+    for (unsigned flags = 0; flags < 0x10000; flags++)
+    {
+        cpu8086_set_flags(cpu, (uint16_t)flags);
+        if (cpu8086_get_flags(cpu) != ((flags & FLAGS_DEFINED) | FLAGS_RESERVED))
+        {
+            if (test_failures++ < 10)
+                fprintf(stderr, "%04X packs back as %04X\n", flags, cpu8086_get_flags(cpu));
+        }
+    }
+
+    // PUSHF then POP AX, and PUSH BX then POPF.
+    static const uint8_t pushf[] = { 0x9C };
+    static const uint8_t pop_ax[] = { 0x58 };
+    static const uint8_t push_bx[] = { 0x53 };
+    static const uint8_t popf[] = { 0x9D };
+    cpu->ss = 0;
+    cpu->sp = 0x8000;
+    for (unsigned flags = 0; flags < 0x1000; flags += 0x0F)
+    {
+        uint16_t expect = (uint16_t)((flags & FLAGS_DEFINED & ~FLAG_TRAP) | FLAGS_RESERVED);
+        cpu8086_set_flags(cpu, (uint16_t)(flags & ~FLAG_TRAP));
+        test_run(bus, pushf, sizeof(pushf));
+        test_run(bus, pop_ax, sizeof(pop_ax));
+        CHECK(cpu->ax == expect);
+
+        cpu->bx = (uint16_t)(flags & ~FLAG_TRAP);
+        cpu8086_set_flags(cpu, 0);
+        test_run(bus, push_bx, sizeof(push_bx));
+        test_run(bus, popf, sizeof(popf));
+        CHECK(cpu8086_get_flags(cpu) == expect);
+        CHECK(cpu->sp == 0x8000);
+    }
+
+    // LAHF and SAHF only see SF, ZF, AF, PF and CF, in the low byte.
+    static const uint8_t lahf[] = { 0x9F };
+    static const uint8_t sahf[] = { 0x9E };
+    for (unsigned flags = 0; flags < 0x1000; flags += 0x0F)
+    {
+        cpu8086_set_flags(cpu, (uint16_t)(flags & ~FLAG_TRAP));
+        test_run(bus, lahf, sizeof(lahf));
+        CHECK(cpu->ah == ((flags & 0xD5) | 0x02));
+
+        cpu->ah = (uint8_t)~flags;
+        cpu8086_set_flags(cpu, (uint16_t)(flags & ~FLAG_TRAP));
+        test_run(bus, sahf, sizeof(sahf));
+        CHECK(cpu8086_get_flags(cpu) == ((((flags & ~FLAG_TRAP & 0xFF00) | (~flags & 0xD5)) & FLAGS_DEFINED)
+                                         | FLAGS_RESERVED));
+    }
+
+    // Each Jcc against its condition, for every combination of the flags it
+    // can read. The branch skips two bytes.
+    for (unsigned condition = 0; condition < 16; condition++)
+    {
+        const uint8_t code[] = { (uint8_t)(0x70 + condition), 0x02 };
+        for (unsigned bits = 0; bits < 32; bits++)
+        {
+            bool cf = bits & 1, pf = bits & 2, zf = bits & 4, sf = bits & 8, of = bits & 16;
+            bool expect;
+            switch (condition >> 1)
+            {
+                case 0:     expect = of; break;
+                case 1:     expect = cf; break;
+                case 2:     expect = zf; break;
+                case 3:     expect = cf || zf; break;
+                case 4:     expect = sf; break;
+                case 5:     expect = pf; break;
+                case 6:     expect = sf != of; break;
+                default:    expect = zf || sf != of; break;
+            }
+            expect ^= condition & 1;
+
+            cpu8086_set_flags(cpu, (cf ? FLAG_CARRY : 0) | (pf ? FLAG_PARITY : 0) | (zf ? FLAG_ZERO : 0)
+                                 | (sf ? FLAG_SIGN : 0) | (of ? FLAG_OVERFLOW : 0));
+            test_run(bus, code, sizeof(code));
+            if (cpu->current_ip != (expect ? 0x104 : 0x102))
+            {
+                if (test_failures++ < 10)
+                    fprintf(stderr, "J%X with flags %02X: %s\n", 0x70 + condition, bits,
+                            expect ? "not taken" : "taken");
+            }
+        }
+    }
+
+    bus_free(bus);
+    return test_result();
+}
@@ -0,0 +1,105 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Conditional jumps: the 16 Jcc conditions (0x70 to 0x7F) for every
+// combination of CF, PF, ZF, SF and OF, and LOOPNZ/LOOPZ/LOOP/JCXZ (0xE0 to
+// 0xE3) for CX and ZF, against the conditions written out by hand. Checks
+// where each one ends up, CX, and the documented taken/not taken cycles.
+
+#include "test.h"
+
+// Jump 0x10 bytes past the end of the instruction if taken.
+#define OFFSET 0x10
+
+static bool condition(unsigned jcc, bool c, bool p, bool z, bool s, bool o)
+{
+    switch (jcc)
+    {
+        case 0x0: return o;                     // JO
+        case 0x1: return !o;                    // JNO
+        case 0x2: return c;                     // JB
+        case 0x3: return !c;                    // JAE
+        case 0x4: return z;                     // JE
+        case 0x5: return !z;                    // JNE
+        case 0x6: return c || z;                // JBE
+        case 0x7: return !c && !z;              // JA
+        case 0x8: return s;                     // JS
+        case 0x9: return !s;                    // JNS
+        case 0xA: return p;                     // JP
+        case 0xB: return !p;                    // JNP
+        case 0xC: return s != o;                // JL
+        case 0xD: return s == o;                // JGE
+        case 0xE: return z || s != o;           // JLE
+        default:  return !z && s == o;          // JG
+    }
+}
+
+int main(void)
+{
+    struct bus* bus = bus_new(0x100000, false);
+    struct cpu8086* cpu = bus->cpu;
+
+    // The clocks spent fetching a 2-byte instruction from an empty queue,
+    // from MOV AX, BX (2 cycles).
+    const uint8_t mov[2] = { 0x8B, 0xC3 };
+    unsigned overhead = test_run(bus, mov, 2) - 2;
+
+    for (unsigned jcc = 0; jcc < 16; jcc++)
+    {
+        for (unsigned flags = 0; flags < 32; flags++)
+        {
+            bool c = flags & 1, p = flags & 2, z = flags & 4, s = flags & 8, o = flags & 16;
+            const uint8_t code[2] = { (uint8_t)(0x70 | jcc), OFFSET };
+            cpu->cx = 1;
+            cpu8086_set_flags(cpu, (c ? FLAG_CARRY : 0) | (p ? FLAG_PARITY : 0) | (z ? FLAG_ZERO : 0)
+                                 | (s ? FLAG_SIGN : 0) | (o ? FLAG_OVERFLOW : 0));
+            unsigned clocks = test_run(bus, code, 2) - overhead;
+
+            bool taken = condition(jcc, c, p, z, s, o);
+            uint16_t ip = (uint16_t)(0x102 + (taken ? OFFSET : 0));
+            if (cpu->current_ip != ip || clocks != (taken ? 16u : 4u) || cpu->cx != 1)
+            {
+                if (test_failures++ < 20)
+                    fprintf(stderr, "%02X, flags %02X: ip %04X after %u cycles, expected %04X after %u\n",
+                            code[0], flags, cpu->current_ip, clocks, ip, taken ? 16 : 4);
+            }
+        }
+    }
+
+    // LOOPNZ, LOOPZ, LOOP, JCXZ: cycles when not taken/taken.
+    static const unsigned loop_cycles[4][2] = { { 5, 19 }, { 6, 18 }, { 5, 17 }, { 6, 18 } };
+    static const uint16_t counts[] = { 0, 1, 2, 0xFFFF };
+    for (unsigned loop = 0; loop < 4; loop++)
+    {
+        for (unsigned i = 0; i < sizeof(counts) / sizeof(*counts); i++)
+        {
+            for (unsigned z = 0; z < 2; z++)
+            {
+                const uint8_t code[2] = { (uint8_t)(0xE0 | loop), (uint8_t)-OFFSET };
+                cpu->cx = counts[i];
+                cpu8086_set_flags(cpu, z ? FLAG_ZERO : 0);
+                unsigned clocks = test_run(bus, code, 2) - overhead;
+
+                // Everything but JCXZ decrements CX first (without touching
+                // the flags), and checks the result.
+                uint16_t cx = (loop == 3) ? counts[i] : (uint16_t)(counts[i] - 1);
+                bool taken = (loop == 3) ? cx == 0
+                           : (loop == 2) ? cx != 0
+                           : (loop == 1) ? cx != 0 && z
+                           : cx != 0 && !z;
+                uint16_t ip = (uint16_t)(0x102 - (taken ? OFFSET : 0));
+                if (cpu->current_ip != ip || cpu->cx != cx || clocks != loop_cycles[loop][taken]
+                    || cpu8086_get_flags(cpu) != (0xF002 | (z ? FLAG_ZERO : 0)))
+                {
+                    if (test_failures++ < 20)
+                        fprintf(stderr, "%02X, CX %04X ZF %u: ip %04X CX %04X after %u cycles, "
+                                "expected %04X CX %04X after %u\n", code[0], counts[i], z, cpu->current_ip,
+                                cpu->cx, clocks, ip, cx, loop_cycles[loop][taken]);
+                }
+            }
+        }
+    }
+
+    bus_free(bus);
+    return test_result();
+}
@@ -0,0 +1,144 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Group 3 multiplies and divides: results and divide errors against a C
+// reference for random operands, and cycle counts within Intel's documented
+// ranges for the register forms.
+
+#include "test.h"
+
+// Documented cycle ranges (register operand), by [is_word][MUL/IMUL/DIV/IDIV].
+static const unsigned documented[2][4][2] =
+{
+    { { 70, 77 }, { 80, 98 }, { 80, 90 }, { 101, 112 } },
+    { { 118, 133 }, { 128, 154 }, { 144, 162 }, { 165, 184 } }
+};
+
+// What the CPU should leave in AX/DX, or false for a divide error.
+static bool reference(unsigned sub, bool word, uint16_t ax, uint16_t dx, uint16_t src,
+                      uint16_t* out_ax, uint16_t* out_dx)
+{
+    *out_ax = ax;
+    *out_dx = dx;
+    if (!word)
+        src &= 0xFF;
+    switch (sub)
+    {
+        case 4:
+        {
+            uint32_t r = word ? (uint32_t)ax * src : (uint32_t)(ax & 0xFF) * src;
+            *out_ax = (uint16_t)r;
+            if (word)
+                *out_dx = (uint16_t)(r >> 16);
+            return true;
+        }
+        case 5:
+        {
+            int32_t r = word ? (int32_t)(int16_t)ax * (int16_t)src : (int32_t)(int8_t)ax * (int8_t)src;
+            *out_ax = (uint16_t)r;
+            if (word)
+                *out_dx = (uint16_t)((uint32_t)r >> 16);
+            return true;
+        }
+        case 6:
+        {
+            if (!src)
+                return false;
+            uint32_t d = word ? ((uint32_t)dx << 16) | ax : ax;
+            if (d / src > (word ? 0xFFFFu : 0xFFu))
+                return false;
+            if (word)
+            {
+                *out_ax = (uint16_t)(d / src);
+                *out_dx = (uint16_t)(d % src);
+            }
+            else
+                *out_ax = (uint16_t)((d / src) | ((d % src) << 8));
+            return true;
+        }
+        default:
+        {
+            int32_t s = word ? (int16_t)src : (int8_t)src;
+            if (!s)
+                return false;
+            int64_t d = word ? (int32_t)(((uint32_t)dx << 16) | ax) : (int16_t)ax;
+            int64_t q = d / s, r = d % s;
+            int64_t limit = word ? 32767 : 127;
+            if (q > limit || q < -limit)
+                return false;
+            if (word)
+            {
+                *out_ax = (uint16_t)q;
+                *out_dx = (uint16_t)r;
+            }
+            else
+                *out_ax = (uint16_t)((q & 0xFF) | ((r & 0xFF) << 8));
+            return true;
+        }
+    }
+}
+
+int main(void)
+{
+    struct bus* bus = bus_new(0x100000, false);
+    struct cpu8086* cpu = bus->cpu;
+
+    // INT 0 goes to 0000:2000, with the stack out of the way.
+    bus->memory[0] = 0x00;
+    bus->memory[1] = 0x20;
+    bus->memory[2] = bus->memory[3] = 0x00;
+    cpu->ss = 0;
+    cpu->sp = 0x8000;
+
+    // The clocks spent fetching a 2-byte instruction from an empty queue,
+    // from MOV AX, BX (2 cycles).
+    const uint8_t mov[2] = { 0x8B, 0xC3 };
+    unsigned overhead = test_run(bus, mov, 2) - 2;
+
+    unsigned seen[2][4][2] = { 0 };
+    srand(1);
+    for (unsigned i = 0; i < 100000; i++)
+    {
+        bool word = rand() & 1;
+        unsigned sub = 4 + (rand() & 3);
+        uint16_t ax = (uint16_t)rand(), dx = (uint16_t)rand();
+        uint16_t bx = (uint16_t)(rand() & ((rand() & 1) ? 0xFFFF : 0xF));
+        cpu->ax = ax;
+        cpu->dx = dx;
+        cpu->bx = bx;
+        cpu->sp = 0x8000;
+
+        const uint8_t code[2] = { (uint8_t)(0xF6 | word), (uint8_t)(0xC0 | (sub << 3) | BX) };
+        unsigned clocks = test_run(bus, code, 2) - overhead;
+
+        uint16_t expect_ax, expect_dx;
+        if (!reference(sub, word, ax, dx, bx, &expect_ax, &expect_dx))
+        {
+            CHECK(cpu->cs == 0 && cpu->current_ip == 0x2000);
+            CHECK(bus_read_short(bus, 0x7FFA) == 0x102);    // The 8086 returns past the instruction.
+            continue;
+        }
+        CHECK(cpu->ax == expect_ax && cpu->dx == expect_dx);
+
+        unsigned* range = seen[word][sub - 4];
+        if (!range[0] || clocks < range[0])
+            range[0] = clocks;
+        if (clocks > range[1])
+            range[1] = clocks;
+    }
+
+    static const char* names[4] = { "MUL", "IMUL", "DIV", "IDIV" };
+    for (unsigned word = 0; word < 2; word++)
+    {
+        for (unsigned sub = 0; sub < 4; sub++)
+        {
+            const unsigned* range = seen[word][sub];
+            printf("%-4s r%-2u %3u-%3u cycles (documented %3u-%3u)\n", names[sub], word ? 16 : 8,
+                   range[0], range[1], documented[word][sub][0], documented[word][sub][1]);
+            CHECK(range[0] >= documented[word][sub][0] && range[1] <= documented[word][sub][1]);
+        }
+    }
+
+    bus_free(bus);
+    return test_result();
+}
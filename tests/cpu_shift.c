@@ -0,0 +1,158 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Shift and rotate group (0xD0 to 0xD3): results and flags against a
+// reference that shifts one bit at a time, for counts of 0, 1, the operand
+// width (plus one, for RCL/RCR) and beyond 31, which the 8086 does not mask.
+// Register forms take 2 cycles by 1, and 8 + 4 per bit by CL.
+
+#include "test.h"
+
+// The flags each operation defines. AF is left undefined by all of them, and
+// rotates leave PF, ZF and SF alone.
+#define ROTATE_FLAGS    (FLAG_CARRY | FLAG_OVERFLOW)
+#define SHIFT_FLAGS     (FLAG_CARRY | FLAG_PARITY | FLAG_ZERO | FLAG_SIGN | FLAG_OVERFLOW)
+
+static bool parity(uint16_t value)
+{
+    unsigned bits = 0;
+    for (unsigned i = 0; i < 8; i++)
+        bits += (value >> i) & 1;
+    return (bits & 1) == 0;
+}
+
+// Shift value by count one bit at a time, starting from flags, and return the
+// result. flags gets the flags afterwards.
+static uint16_t reference(unsigned sub, bool word, uint16_t value, unsigned count, uint16_t* flags)
+{
+    unsigned width = word ? 16 : 8;
+    uint16_t mask = word ? 0xFFFF : 0xFF;
+    uint16_t msb = (uint16_t)(1 << (width - 1));
+    bool carry = *flags & FLAG_CARRY;
+    bool overflow = *flags & FLAG_OVERFLOW;
+    value &= mask;
+    if (count == 0)
+        return value;
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        bool in;
+        switch (sub)
+        {
+            case 0:     // ROL
+                carry = value & msb;
+                value = (uint16_t)(((value << 1) | carry) & mask);
+                break;
+            case 1:     // ROR
+                carry = value & 1;
+                value = (uint16_t)((value >> 1) | (carry ? msb : 0));
+                break;
+            case 2:     // RCL
+                in = carry;
+                carry = value & msb;
+                value = (uint16_t)(((value << 1) | in) & mask);
+                break;
+            case 3:     // RCR
+                in = carry;
+                carry = value & 1;
+                value = (uint16_t)((value >> 1) | (in ? msb : 0));
+                break;
+            case 4:     // SHL
+                carry = value & msb;
+                value = (uint16_t)((value << 1) & mask);
+                break;
+            case 5:     // SHR
+                carry = value & 1;
+                value >>= 1;
+                break;
+            default:    // SAR
+                carry = value & 1;
+                value = (uint16_t)((value >> 1) | (value & msb));
+                break;
+        }
+
+        // Every step recomputes OF, so only the last one counts.
+        if (sub == 0 || sub == 2 || sub == 4)
+            overflow = ((value & msb) != 0) ^ carry;
+        else
+            overflow = ((value >> (width - 1)) ^ (value >> (width - 2))) & 1;
+    }
+
+    *flags &= ~(FLAG_CARRY | FLAG_OVERFLOW);
+    *flags |= (carry ? FLAG_CARRY : 0) | (overflow ? FLAG_OVERFLOW : 0);
+    if (sub >= 4)
+    {
+        *flags &= ~(FLAG_PARITY | FLAG_ZERO | FLAG_SIGN);
+        *flags |= (parity(value) ? FLAG_PARITY : 0)
+                | (value == 0 ? FLAG_ZERO : 0)
+                | ((value & msb) ? FLAG_SIGN : 0);
+    }
+    return value;
+}
+
+int main(void)
+{
+    struct bus* bus = bus_new(0x100000, false);
+    struct cpu8086* cpu = bus->cpu;
+
+    // The clocks spent fetching a 2-byte instruction from an empty queue,
+    // from MOV AX, BX (2 cycles).
+    const uint8_t mov[2] = { 0x8B, 0xC3 };
+    unsigned overhead = test_run(bus, mov, 2) - 2;
+
+    static const unsigned counts[] = { 0, 1, 2, 3, 7, 8, 9, 15, 16, 17, 18, 31, 32, 33, 100, 255 };
+    static const uint16_t values[] = { 0x0000, 0x0001, 0x8000, 0x0080, 0x00FF, 0xFFFF, 0x1234, 0x8421, 0x5AA5, 0x7F80 };
+    static const char* names[8] = { "ROL", "ROR", "RCL", "RCR", "SHL", "SHR", "SETMO", "SAR" };
+    for (unsigned sub = 0; sub < 8; sub++)
+    {
+        if (sub == 6)
+            continue;
+        uint16_t defined = (sub < 4) ? ROTATE_FLAGS : SHIFT_FLAGS;
+        for (unsigned word = 0; word < 2; word++)
+        {
+            for (unsigned by_cl = 0; by_cl < 2; by_cl++)
+            {
+                for (unsigned c = 0; c < (by_cl ? sizeof(counts) / sizeof(*counts) : 1); c++)
+                {
+                    unsigned count = by_cl ? counts[c] : 1;
+                    for (unsigned v = 0; v < sizeof(values) / sizeof(*values); v++)
+                    {
+                        for (unsigned in = 0; in < 4; in++)
+                        {
+                            // <op> BL/BX, 1 or CL.
+                            const uint8_t code[2] = { (uint8_t)(0xD0 | (by_cl << 1) | word),
+                                                      (uint8_t)(0xC0 | (sub << 3) | BX) };
+                            uint16_t flags = ((in & 1) ? FLAG_CARRY : 0) | ((in & 2) ? FLAG_OVERFLOW | FLAG_ZERO : 0);
+                            cpu->bx = values[v];
+                            cpu->cx = (uint16_t)(0xAA00 | count);
+                            cpu8086_set_flags(cpu, flags);
+                            unsigned clocks = test_run(bus, code, 2) - overhead;
+
+                            uint16_t expect_flags = flags;
+                            uint16_t expect = reference(sub, word, values[v], count, &expect_flags);
+                            uint16_t result = word ? cpu->bx : cpu->bl;
+                            uint16_t got_flags = cpu8086_get_flags(cpu);
+                            unsigned expect_clocks = by_cl ? 8 + 4 * count : 2;
+                            if (result != expect || (got_flags & defined) != (expect_flags & defined)
+                                || (!word && cpu->bh != (values[v] >> 8)) || clocks != expect_clocks)
+                            {
+                                if (test_failures++ < 20)
+                                    fprintf(stderr, "%s %s %04X by %u, flags %04X: %04X flags %04X %u cycles, "
+                                            "expected %04X flags %04X %u cycles\n", names[sub], word ? "r16" : "r8",
+                                            values[v], count, flags, result, got_flags & defined, clocks,
+                                            expect, expect_flags & defined, expect_clocks);
+                            }
+
+                            // A count of 0 changes nothing at all.
+                            if (count == 0)
+                                CHECK((got_flags & ~0xF002) == flags);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    bus_free(bus);
+    return test_result();
+}
@@ -0,0 +1,294 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Repeated string instructions: the bulk paths must leave memory, the
+// registers and the flags exactly as running them an element at a time (which
+// is what bus micro-op mode does), and take the same cycles per element. CMPS
+// and SCAS must stop on the same element, and an interrupted instruction must
+// resume where it left off.
+
+#include "test.h"
+
+// Page aligned memory decoded by a device rather than RAM, which a string
+// instruction can only ever step through an element at a time.
+#define MAPPED_BASE     0x28000
+#define MAPPED_SIZE     0x1000
+
+static uint8_t mapped[MAPPED_SIZE];
+static unsigned mapped_writes;
+
+static uint8_t mapped_read(struct bus* bus, void* device, uint32_t address)
+{
+    (void)bus;
+    (void)device;
+    return mapped[address - MAPPED_BASE];
+}
+
+static void mapped_write(struct bus* bus, void* device, uint32_t address, uint8_t data)
+{
+    (void)bus;
+    (void)device;
+    mapped[address - MAPPED_BASE] = data;
+    mapped_writes++;
+}
+
+struct layout
+{
+    uint16_t ds, si, es, di, cx;
+    uint32_t mark;      // A byte that differs from the pattern, or 0.
+};
+
+static const struct layout layouts[] =
+{
+    { 0x1000, 0x0000, 0x2000, 0x0000, 100, 0 },
+    { 0x1000, 0x0000, 0x2000, 0x0000, 100, 0x20031 },
+    { 0x1000, 0x0000, 0x2000, 0x0000, 100, 0x10030 },
+    { 0x1000, 0x0100, 0x2000, 0x0100, 300, 0x20100 },
+    { 0x1000, 0x0101, 0x2000, 0x0101, 300, 0x20050 },
+    { 0x1000, 0xFFF0, 0x2000, 0xFFF0, 100, 0x20020 },   // DI wraps.
+    { 0x1000, 0x0010, 0x2000, 0x0011, 100, 0 },
+    { 0x1000, 0x0000, 0x2000, 0x0000, 0, 0 },
+    { 0x1000, 0x0200, 0x2000, 0x0200, 300, 0x20150 },   // Found going down...
+    { 0x1000, 0x0200, 0x2000, 0x0200, 300, 0x201F0 },
+    { 0x1000, 0x0200, 0x2000, 0x0200, 300, 0x201FF },   // ...at once.
+    { 0x1000, 0x0200, 0x2000, 0x0200, 300, 0x20200 },   // At once going up.
+    { 0x1000, 0x0200, 0x2000, 0x0201, 300, 0x1020F },   // In the source, with DI odd.
+    { 0x1000, 0x0200, 0x2000, 0x0200, 37, 0x20224 },    // Past the last 16 bytes...
+    { 0x1000, 0x0200, 0x2000, 0x0200, 37, 0x201DC },    // ...either way.
+};
+
+// MOVS and STOS (which only use ES:DI) layouts.
+static const struct layout copies[] =
+{
+    { 0x1000, 0x0000, 0x2000, 0x0000, 100, 0 },
+    { 0x1000, 0x0000, 0x2000, 0x0000, 0, 0 },
+    { 0x1000, 0x0011, 0x2000, 0x0020, 100, 0 },         // Odd SI.
+    { 0x1000, 0x0020, 0x2000, 0x0011, 100, 0 },         // Odd DI.
+    { 0x1000, 0x0100, 0x1000, 0x0101, 200, 0x10100 },   // Overlaps, 1 byte apart.
+    { 0x1000, 0x0101, 0x1000, 0x0100, 200, 0x10140 },
+    { 0x1000, 0x0100, 0x1000, 0x0102, 200, 0x10101 },   // 2 bytes apart.
+    { 0x1000, 0x0102, 0x1000, 0x0100, 200, 0x10101 },
+    { 0x1000, 0x0100, 0x1000, 0x0103, 200, 0x10102 },   // 3 bytes apart.
+    { 0x1000, 0x0103, 0x1000, 0x0100, 200, 0x10102 },
+    { 0x1000, 0x0100, 0x1000, 0x0107, 200, 0x10103 },   // 7 bytes apart.
+    { 0x1000, 0xFFF0, 0x2000, 0x0100, 100, 0x1FFF3 },   // SI wraps.
+    { 0x1000, 0x0100, 0x2000, 0xFFF0, 100, 0 },         // DI wraps.
+    { 0x1000, 0xFFFF, 0x2000, 0xFFFF, 100, 0x1FFFF },   // Both wrap mid-word.
+    { 0x1000, 0x0010, 0x2000, 0x0020, 100, 0x10005 },   // Wrap going down.
+    { 0x1000, 0x0010, 0x1000, 0x0011, 100, 0x10008 },   // Overlap, then wrap.
+    { 0x1000, 0x0100, 0x2000, 0x7F80, 0x100, 0x10110 }, // Into the mapped range...
+    { 0x1000, 0x0100, 0x2000, 0x8080, 0x100, 0x10110 }, // ...or out of it going down.
+    { 0x2000, 0x7F80, 0x1000, 0x0100, 0x100, 0x28010 }, // From it.
+};
+
+static unsigned run(struct bus* bus, const struct layout* layout, const uint8_t* code, size_t length,
+                bool down, bool bus_uops)
+{
+    struct cpu8086* cpu = bus->cpu;
+    for (uint32_t i = 0x10000; i < 0x30000; i++)
+        bus->memory[i] = (i & 1) ? 0xA5 : 0x5A;
+    for (uint32_t i = 0; i < MAPPED_SIZE; i++)
+        mapped[i] = (uint8_t)(i * 7);
+    mapped_writes = 0;
+    if (layout->mark)
+        bus_write_byte(bus, layout->mark, 0x77);
+    cpu->ds = layout->ds;
+    cpu->es = layout->es;
+    cpu->si = layout->si;
+    cpu->di = layout->di;
+    cpu->cx = layout->cx;
+    cpu->ax = 0xA55A;
+    cpu8086_set_flags(cpu, down ? FLAG_DIRECTION : 0);
+    cpu8086_set_bus_uops(cpu, bus_uops);
+    return test_run(bus, code, length);
+}
+
+// Interrupt ES: REP MOVSB (after STI, if sti) partway through, with the
+// string instruction run in small chunks. It has to resume from the REP
+// prefix with CX, SI and DI where it left off, which (as on the real thing)
+// loses the segment override for the rest of the copy.
+static void rep_interrupt(struct bus* bus, bool bus_uops, bool sti)
+{
+    struct cpu8086* cpu = bus->cpu;
+    static const uint8_t code[] = { 0xFB, 0x26, 0xF3, 0xA4, 0x90, 0x90, 0x90, 0x90 };
+    const uint8_t* start = sti ? code : code + 1;
+    uint16_t prefix_ip = (uint16_t)(0x100 + (sti ? 2 : 1));
+    memcpy(&bus->memory[0x100], start, sizeof(code) - (start - code));
+
+    // Vector 0x20 goes to 0040:0000, with the stack out of the way.
+    bus->memory[0x80] = bus->memory[0x81] = 0x00;
+    bus->memory[0x82] = 0x40;
+    bus->memory[0x83] = 0x00;
+    for (unsigned i = 0; i < 0x100; i++)
+    {
+        bus->memory[0x10000 + i] = (uint8_t)(i * 5 + 2);
+        bus->memory[0x30000 + i] = (uint8_t)(i * 3 + 1);
+        bus->memory[0x31000 + i] = 0;
+    }
+
+    cpu->ss = 0;
+    cpu->ds = 0x1000;
+    cpu->es = 0x3000;
+    test_jump(cpu, 0x0000, 0x100);
+    cpu->sp = 0x8000;
+    cpu->si = 0;
+    cpu->di = 0x1000;
+    cpu->cx = 100;
+    cpu8086_set_flags(cpu, sti ? 0 : FLAG_INTENABLE);
+    cpu8086_set_bus_uops(cpu, bus_uops);
+    cpu->rep_quantum = 40;
+    cpu->intr_vector = 0x20;
+
+    // Request the interrupt from the start after STI, which must still let
+    // the string instruction get going. Otherwise, once it has.
+    cpu->intr = sti;
+    unsigned clocks = 0;
+    while (cpu->cs != 0x0040 && clocks++ < 100000)
+    {
+        cpu8086_clock(cpu);
+        if (cpu->cx < 100)
+            cpu->intr = true;
+    }
+    CHECK(cpu->cs == 0x0040 && cpu->ip == 0);
+
+    // The interrupt pushed FLAGS, CS and the IP of the REP prefix.
+    CHECK(bus_read_short(bus, 0x7FFA) == prefix_ip);
+    CHECK(bus_read_short(bus, 0x7FFC) == 0x0000);
+    CHECK(bus_read_short(bus, 0x7FFE) & FLAG_INTENABLE);
+    unsigned done = 100 - cpu->cx;
+    CHECK(done > 0 && done < 100);
+    CHECK(cpu->si == done && cpu->di == 0x1000 + done);
+    for (unsigned i = 0; i < done; i++)
+        CHECK(bus->memory[0x31000 + i] == (uint8_t)(i * 3 + 1));
+    CHECK(bus->memory[0x31000 + done] == 0);
+
+    // Return to it (as IRET would) and let it finish.
+    cpu->sp = 0x8000;
+    test_jump(cpu, 0x0000, prefix_ip);
+    cpu8086_set_flags(cpu, FLAG_INTENABLE);
+    cpu->rep_quantum = CPU8086_REP_QUANTUM;
+    clocks = 0;
+    do
+        cpu8086_clock(cpu);
+    while (!(test_idle(cpu) && cpu->current_ip > prefix_ip + 1) && clocks++ < 100000);
+    CHECK(cpu->cx == 0 && cpu->si == 100 && cpu->di == 0x1000 + 100);
+    for (unsigned i = done; i < 100; i++)
+        CHECK(bus->memory[0x31000 + i] == (uint8_t)(i * 5 + 2));
+    CHECK(bus->memory[0x31000 + 100] == 0);
+}
+
+int main(void)
+{
+    struct bus* bus = bus_new(0x100000, false);
+    struct cpu8086* cpu = bus->cpu;
+    CHECK(bus_map_memory(bus, MAPPED_BASE, MAPPED_SIZE, NULL, mapped_read, mapped_write));
+
+    static const uint8_t prefixes[] = { 0xF3, 0xF2 };
+    static const uint8_t opcodes[] = { 0xA6, 0xA7, 0xAE, 0xAF };
+    for (unsigned i = 0; i < sizeof(layouts) / sizeof(*layouts); i++)
+    {
+        for (unsigned j = 0; j < 2 * 4 * 2; j++)
+        {
+            uint8_t code[] = { prefixes[j & 1], opcodes[(j >> 1) & 3] };
+            bool down = j >> 3;
+
+            run(bus, &layouts[i], code, sizeof(code), down, true);
+            struct cpu8086 expect = *cpu;
+            run(bus, &layouts[i], code, sizeof(code), down, false);
+            if (cpu->si != expect.si || cpu->di != expect.di || cpu->cx != expect.cx
+                || cpu8086_get_flags(cpu) != cpu8086_get_flags(&expect))
+            {
+                fprintf(stderr, "layout %u, %02X %02X%s: si %04X/%04X di %04X/%04X cx %u/%u\n", i,
+                        code[0], code[1], down ? " down" : "", cpu->si, expect.si, cpu->di, expect.di,
+                        cpu->cx, expect.cx);
+                test_failures++;
+            }
+        }
+    }
+
+    // REP MOVSB/MOVSW/STOSB/STOSW, going up and down. Each element takes the
+    // same cycles either way (plus a bus cycle per misaligned word access),
+    // so the bulk path must take the time of an empty REP plus CX of them.
+    uint8_t* expect_memory = malloc(0x20000);
+    uint8_t expect_mapped[MAPPED_SIZE];
+    static const uint8_t copy_opcodes[] = { 0xA4, 0xA5, 0xAA, 0xAB };
+    static const unsigned element_cycles[] = { 17, 17, 10, 10 };
+    for (unsigned i = 0; i < sizeof(copies) / sizeof(*copies); i++)
+    {
+        for (unsigned j = 0; j < 4 * 2; j++)
+        {
+            const struct layout* layout = &copies[i];
+            struct layout empty = *layout;
+            empty.cx = 0;
+            uint8_t code[] = { 0xF3, copy_opcodes[j & 3] };
+            bool word = j & 1, stos = j & 2, down = j >> 2;
+
+            unsigned uops_clocks = run(bus, layout, code, sizeof(code), down, true);
+            struct cpu8086 expect = *cpu;
+            unsigned expect_writes = mapped_writes;
+            memcpy(expect_memory, &bus->memory[0x10000], 0x20000);
+            memcpy(expect_mapped, mapped, MAPPED_SIZE);
+
+            unsigned base = run(bus, &empty, code, sizeof(code), down, false);
+            unsigned clocks = run(bus, layout, code, sizeof(code), down, false);
+            unsigned misaligned = word ? (layout->di & 1) + (!stos && (layout->si & 1)) : 0;
+            unsigned expect_clocks = base + layout->cx * (element_cycles[j & 3] + 4 * misaligned);
+            if (cpu->si != expect.si || cpu->di != expect.di || cpu->cx != expect.cx
+                || memcmp(expect_memory, &bus->memory[0x10000], 0x20000) != 0
+                || memcmp(expect_mapped, mapped, MAPPED_SIZE) != 0 || mapped_writes != expect_writes
+                || clocks != expect_clocks || uops_clocks < clocks)
+            {
+                fprintf(stderr, "copy layout %u, %02X %02X%s: si %04X/%04X di %04X/%04X cx %u/%u, "
+                        "%u mapped writes/%u, %u cycles/%u (%u in bus micro-op mode)%s\n", i,
+                        code[0], code[1], down ? " down" : "", cpu->si, expect.si, cpu->di, expect.di,
+                        cpu->cx, expect.cx, mapped_writes, expect_writes, clocks, expect_clocks, uops_clocks,
+                        memcmp(expect_memory, &bus->memory[0x10000], 0x20000) ? ", memory differs" : "");
+                test_failures++;
+            }
+        }
+    }
+    free(expect_memory);
+
+    // The mapped range really is written to an element at a time.
+    {
+        static const uint8_t code[] = { 0xF3, 0xA4 };
+        run(bus, &copies[16], code, sizeof(code), false, false);
+        CHECK(mapped_writes == 0x80);
+        CHECK(mapped[0] == bus->memory[0x10180] && mapped[0x7F] == bus->memory[0x101FF]
+              && mapped[0x80] == (uint8_t)(0x80 * 7));
+    }
+    {
+        static const uint8_t code[] = { 0xF3, 0xAB };
+        run(bus, &copies[16], code, sizeof(code), false, false);
+        CHECK(mapped_writes == 0x180);
+        CHECK(mapped[0] == 0x5A && mapped[1] == 0xA5 && mapped[0x17F] == 0xA5
+              && mapped[0x180] == (uint8_t)(0x180 * 7));
+    }
+
+    for (unsigned bus_uops = 0; bus_uops < 2; bus_uops++)
+    {
+        rep_interrupt(bus, bus_uops, false);
+        rep_interrupt(bus, bus_uops, true);
+    }
+
+    // REPNZ SCASW compares all of AX: words whose low byte matches AL do not
+    // stop it.
+    for (unsigned bus_uops = 0; bus_uops < 2; bus_uops++)
+    {
+        static const uint8_t code[] = { 0xF2, 0xAF };
+        static const struct layout layout = { 0, 0, 0x2000, 0, 100, 0 };
+        run(bus, &layout, code, sizeof(code), false, bus_uops);
+        bus->memory[0x20020] = 0x34;
+        bus->memory[0x20040] = 0x34;
+        bus->memory[0x20041] = 0x12;
+        cpu->di = 0;
+        cpu->cx = 100;
+        cpu->ax = 0x1234;
+        test_run(bus, code, sizeof(code));
+        CHECK(cpu->di == 0x42 && cpu->cx == 100 - 0x21);
+        CHECK(cpu8086_get_flags(cpu) & FLAG_ZERO);
+    }
+
+    bus_free(bus);
+    return test_result();
+}
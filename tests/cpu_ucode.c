@@ -0,0 +1,173 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Bus micro-op mode: the sequences add up to their totals, the mode does not
+// change what instructions do, and it only moves their timing by the
+// contention between EU memory operands and prefetches. Instructions that
+// never use the bus take exactly as long either way, and data-dependent
+// loops run between reading an operand and writing it back.
+
+#include "test.h"
+#include "cpu8086_ucode.h"
+
+// Instructions with memory operands, on [BX+SI] unless they say otherwise,
+// and ones that only use registers (which name no bus cycles).
+static const struct
+{
+    const char* name;
+    uint8_t code[6];
+    size_t length;
+    bool registers_only;
+} programs[] =
+{
+    { "ADD [BX+SI], AX",    { 0x01, 0x00 }, 2 },
+    { "ADD AX, [BX+SI]",    { 0x03, 0x00 }, 2 },
+    { "ADD [BX+SI], 1234h", { 0x81, 0x00, 0x34, 0x12 }, 4 },
+    { "CMP [BX+SI], 12h",   { 0x80, 0x38, 0x12 }, 3 },
+    { "NOT WORD [BX+SI]",   { 0xF7, 0x10 }, 2 },
+    { "SHL WORD [BX+SI], 1", { 0xD1, 0x20 }, 2 },
+    { "MOV AX, [BX+SI]",    { 0x8B, 0x00 }, 2 },
+    { "MOV [BX+SI], AX",    { 0x89, 0x00 }, 2 },
+    { "MOV [BX+SI], 1234h", { 0xC7, 0x00, 0x34, 0x12 }, 4 },
+    { "XCHG [BX+SI], AX",   { 0x87, 0x00 }, 2 },
+    { "MUL WORD [BX+SI]",   { 0xF7, 0x20 }, 2 },
+    { "PUSH AX",            { 0x50 }, 1 },
+    { "POP CX",             { 0x59 }, 1 },
+    { "MOVSW",              { 0xA5 }, 1 },
+    { "LODSB",              { 0xAC }, 1 },
+    { "REP STOSW",          { 0xF3, 0xAB }, 2 },
+    { "ADD AX, [BP+DI+12h]", { 0x03, 0x43, 0x12 }, 3 },
+    { "ADD AX, [BX+1234h]", { 0x03, 0x87, 0x34, 0x12 }, 4 },
+    { "MOV AX, [1234h]",    { 0x8B, 0x06, 0x34, 0x12 }, 4 },
+    { "SHL WORD [BX+SI], CL", { 0xD3, 0x20 }, 2 },
+    { "ADD AX, BX",         { 0x01, 0xD8 }, 2, true },
+    { "ADD AX, 1234h",      { 0x05, 0x34, 0x12 }, 3, true },
+    { "INC CX",             { 0x41 }, 1, true },
+    { "XCHG CX, DX",        { 0x87, 0xCA }, 2, true },
+    { "SHL BX, CL",         { 0xD3, 0xE3 }, 2, true },
+    { "MUL BX",             { 0xF7, 0xE3 }, 2, true },
+    { "DIV CX",             { 0xF7, 0xF1 }, 2, true },
+    { "LOOP $",             { 0xE2, 0xFE }, 2, true },
+    { "JCXZ $+2",           { 0xE3, 0x00 }, 2, true },
+    { "CBW",                { 0x98 }, 1, true },
+    { "DAA",                { 0x27 }, 1, true },
+};
+
+static void setup(struct bus* bus, bool bus_uops)
+{
+    struct cpu8086* cpu = bus->cpu;
+    memset(bus->memory, 0, 0x10000);
+    for (unsigned i = 0; i < 0x100; i++)
+        bus->memory[0x2000 + i] = (uint8_t)(i * 7 + 3);
+    cpu->ds = cpu->es = cpu->ss = 0;
+    cpu->ax = 0x1234;
+    cpu->bx = 0x2000;
+    cpu->si = 0x0010;
+    cpu->di = 0x3000;
+    cpu->cx = 5;
+    cpu->dx = 0;
+    cpu->sp = 0x8000;
+    cpu8086_set_flags(cpu, 0);
+    cpu8086_set_bus_uops(cpu, bus_uops);
+}
+
+int main(void)
+{
+    CHECK(ucode_validate());
+
+    struct bus* bus = bus_new(0x100000, false);
+    struct cpu8086* cpu = bus->cpu;
+    for (unsigned i = 0; i < sizeof(programs) / sizeof(*programs); i++)
+    {
+        // Same results either way.
+        setup(bus, false);
+        unsigned countdown = test_run(bus, programs[i].code, programs[i].length);
+        struct cpu8086 expect = *cpu;
+        uint8_t expect_memory[0x100];
+        memcpy(expect_memory, &bus->memory[0x2000], sizeof(expect_memory));
+        uint16_t expect_stack = (uint16_t)(bus->memory[0x7FFE] | (bus->memory[0x7FFF] << 8));
+
+        setup(bus, true);
+        unsigned uops = test_run(bus, programs[i].code, programs[i].length);
+        CHECK(memcmp(cpu->regs, expect.regs, sizeof(expect.regs)) == 0);
+        CHECK(cpu8086_get_flags(cpu) == cpu8086_get_flags(&expect));
+        CHECK(memcmp(&bus->memory[0x2000], expect_memory, sizeof(expect_memory)) == 0);
+        CHECK((uint16_t)(bus->memory[0x7FFE] | (bus->memory[0x7FFF] << 8)) == expect_stack);
+        CHECK(cpu->uop_r == 0 && cpu->uop_w == 0);
+
+        // Waiting for the BIU costs at most a bus cycle per EU bus cycle
+        // (there are at most 5 here), and never saves any.
+        int difference = (int)uops - (int)countdown;
+        printf("%-20s %4u cycles, %4u with bus micro-ops\n", programs[i].name, countdown, uops);
+        if (difference < 0 || difference > UOP_BUS_CYCLES * 5 || (programs[i].registers_only && difference))
+        {
+            fprintf(stderr, "%s: %u vs %u cycles\n", programs[i].name, countdown, uops);
+            test_failures++;
+        }
+    }
+
+    // A memory shift by CL queues its EA routine, then reads the operand,
+    // shifts it a bit at a time and writes it back.
+    for (unsigned count = 0; count < 256; count += 51)
+    {
+        static const uint8_t code[] = { 0xD3, 0x20 };     // SHL WORD [BX+SI], CL
+        setup(bus, true);
+        cpu->cx = count;
+        memcpy(&bus->memory[0x100], code, sizeof(code));
+        memset(&bus->memory[0x100 + sizeof(code)], 0x90, 16);
+        test_jump(cpu, 0, 0x100);
+        while (cpu->stage != CPU8086_EXECUTING)
+            cpu8086_clock(cpu);
+
+        // The EA routine has already had a cycle, as the instruction started.
+        unsigned before = 1, loop = 0, total = 1, reads = 0, writes = 0;
+        for (unsigned j = cpu->uop_r; j < cpu->uop_w; j++)
+        {
+            uint8_t uop = cpu->uops[j];
+            unsigned cycles = (j == cpu->uop_r && cpu->uop_t) ? cpu->uop_t
+                            : (UOP_KIND(uop) == UOP_IDLE) ? UOP_ARG(uop) : UOP_BUS_CYCLES;
+            total += cycles;
+            reads += UOP_KIND(uop) == UOP_READ;
+            writes += UOP_KIND(uop) == UOP_WRITE;
+            if (UOP_KIND(uop) == UOP_IDLE)
+                *(reads ? &loop : &before) += cycles;
+        }
+        CHECK(reads == 1 && writes == 1 && UOP_KIND(cpu->uops[cpu->uop_w - 1]) == UOP_WRITE);
+        CHECK(before == ucode_ea[0].cycles);
+        CHECK(loop == ucode_shift_mem_cl.cycles - 2 * UOP_BUS_CYCLES + UCODE_SHIFT_BIT_CYCLES * count);
+        CHECK(total == ucode_ea[0].cycles + ucode_shift_mem_cl.cycles + UCODE_SHIFT_BIT_CYCLES * count);
+    }
+
+    // Switching the mode off part way through an instruction keeps the
+    // cycles it had left.
+    for (unsigned stop = 1; stop < 30; stop++)
+    {
+        static const uint8_t code[] = { 0x01, 0x00 };     // ADD [BX+SI], AX
+        setup(bus, false);
+        unsigned countdown = test_run(bus, code, sizeof(code));
+
+        setup(bus, true);
+        memcpy(&bus->memory[0x100], code, sizeof(code));
+        memset(&bus->memory[0x100 + sizeof(code)], 0x90, 16);
+        test_jump(cpu, 0, 0x100);
+        unsigned clocks = 0;
+        for (; clocks < stop; clocks++)
+            cpu8086_clock(cpu);
+        cpu8086_set_bus_uops(cpu, false);
+        while (!test_idle(cpu))
+        {
+            cpu8086_clock(cpu);
+            clocks++;
+        }
+        CHECK(cpu->uop_r == cpu->uop_w && !cpu->eu_bus);
+        CHECK(bus->memory[0x2010] == (uint8_t)(0x10 * 7 + 3 + 0x34));
+        if (clocks + 8 < countdown || clocks > countdown + 8)
+        {
+            fprintf(stderr, "switched off after %u: %u vs %u cycles\n", stop, clocks, countdown);
+            test_failures++;
+        }
+    }
+
+    bus_free(bus);
+    return test_result();
+}
@@ -0,0 +1,95 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Drives over a plain image: reads come from the image, writes land in the
+// drive's cache without reaching the file, the cache refuses new blocks once
+// it is full, and an empty drive can be flushed.
+
+#include "test.h"
+#include "disk.h"
+
+#define IMAGE       "test_disk.img"
+#define SECTORS     2880
+
+// Each sector is filled with the low byte of its number, and starts with the
+// high byte.
+static bool sector_is(const uint8_t* data, uint32_t sector)
+{
+    return data && data[0] == (uint8_t)(sector >> 8) && data[1] == (uint8_t)sector
+        && data[DISK_SECTOR - 1] == (uint8_t)sector;
+}
+
+static void write_image(const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    for (uint32_t sector = 0; file && sector < SECTORS; sector++)
+    {
+        uint8_t data[DISK_SECTOR];
+        memset(data, (uint8_t)sector, sizeof(data));
+        data[0] = (uint8_t)(sector >> 8);
+        fwrite(data, 1, sizeof(data), file);
+    }
+    if (file)
+        fclose(file);
+}
+
+static struct disk_drive drive;
+
+int main(void)
+{
+    write_image(IMAGE);
+    struct disk* image = disk_open(IMAGE);
+    if (!image)
+    {
+        fprintf(stderr, "could not open %s\n", IMAGE);
+        return TEST_SKIP;
+    }
+    CHECK(disk_size(image) == SECTORS * DISK_SECTOR);
+
+    disk_insert(&drive, image);
+    CHECK(drive.sectors == SECTORS);
+    CHECK(sector_is(disk_read(&drive, 0), 0));
+    CHECK(sector_is(disk_read(&drive, SECTORS - 1), SECTORS - 1));
+
+    // A write brings in the rest of its block, and is read back.
+    uint8_t* data = disk_write(&drive, 1000);
+    CHECK(data != NULL);
+    if (data)
+        memset(data, 0xEE, DISK_SECTOR);
+    const uint8_t* read = disk_read(&drive, 1000);
+    CHECK(read && read[0] == 0xEE && read[DISK_SECTOR - 1] == 0xEE);
+    CHECK(sector_is(disk_read(&drive, 1001), 1001));
+    CHECK(sector_is(disk_read(&drive, 999), 999));
+
+    // The file is untouched.
+    FILE* file = fopen(IMAGE, "rb");
+    uint8_t sector[DISK_SECTOR] = { 0 };
+    CHECK(file && fseek(file, 1000L * DISK_SECTOR, SEEK_SET) == 0
+          && fread(sector, 1, sizeof(sector), file) == sizeof(sector));
+    CHECK(sector_is(sector, 1000));
+    if (file)
+        fclose(file);
+
+    // Fill the cache with a block each; one more does not fit, but the
+    // blocks already in it can still be written.
+    for (uint32_t block = 1; block < DISK_CACHE_BLOCKS; block++)
+        CHECK(disk_write(&drive, block * DISK_BLOCK_SECTORS) != NULL);
+    CHECK(drive.cached == DISK_CACHE_BLOCKS);
+    CHECK(disk_write(&drive, DISK_CACHE_BLOCKS * DISK_BLOCK_SECTORS) == NULL);
+    CHECK(disk_write(&drive, 1001) != NULL);
+
+    // There is no overlay to flush to.
+    CHECK(!disk_flush(&drive));
+
+    // Emptying the drive forgets the writes, and an empty drive flushes.
+    disk_insert(&drive, NULL);
+    CHECK(drive.sectors == 0 && drive.cached == 0);
+    CHECK(disk_flush(&drive));
+    disk_insert(&drive, image);
+    CHECK(sector_is(disk_read(&drive, 1000), 1000));
+    disk_insert(&drive, NULL);
+
+    disk_close(image);
+    remove(IMAGE);
+    return test_result();
+}
@@ -0,0 +1,218 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// The floppy and fixed disk controllers: sectors read by DMA into guest
+// memory and written from it, each command ending in its IRQ, and written
+// sectors reaching the drive but not the image file.
+
+#include "test.h"
+#include "dma.h"
+#include "fdc.h"
+#include "hdc.h"
+#include "pic.h"
+
+#define FLOPPY          "test_disk_dma_floppy.img"
+#define FLOPPY_SECTORS  2880                // 1.44 MB: 80 cylinders, 2 heads, 18 sectors.
+#define FIXED           "test_disk_dma_fixed.img"
+#define FIXED_SECTORS   (306 * 4 * 17)      // XT drive type 3.
+
+// Each sector is filled with the low byte of its number, and starts with the
+// high byte.
+static bool sector_is(const uint8_t* data, uint32_t sector)
+{
+    return data[0] == (uint8_t)(sector >> 8) && data[1] == (uint8_t)sector
+        && data[DISK_SECTOR - 1] == (uint8_t)sector;
+}
+
+static struct disk* make_image(const char* path, uint32_t sectors)
+{
+    FILE* file = fopen(path, "wb");
+    for (uint32_t sector = 0; file && sector < sectors; sector++)
+    {
+        uint8_t data[DISK_SECTOR];
+        memset(data, (uint8_t)sector, sizeof(data));
+        data[0] = (uint8_t)(sector >> 8);
+        fwrite(data, 1, sizeof(data), file);
+    }
+    if (file)
+        fclose(file);
+    return disk_open(path);
+}
+
+// Run the machine for a while, with the CPU in a loop (XOR AX, AX / JZ back).
+static void run(struct bus* bus, uint64_t clocks)
+{
+    uint64_t end = bus->clock + clocks;
+    while (bus->clock < end)
+        bus_clock(bus);
+}
+
+// Was an IRQ raised since last asked? The CPU runs with interrupts off, so
+// requests are just cleared.
+static bool irq_raised(struct bus* bus, unsigned line)
+{
+    bool raised = bus->pic->irr & (1 << line);
+    bus->pic->irr &= ~(1 << line);
+    return raised;
+}
+
+// Program a DMA channel for a single transfer of length bytes at address.
+static void dma_setup(struct bus* bus, unsigned channel, unsigned type, uint32_t address, unsigned length)
+{
+    static const uint16_t page[DMA_CHANNELS] = { 0x87, 0x83, 0x81, 0x82 };
+    bus_out_byte(bus, 0x0A, (uint8_t)(4 | channel));
+    bus_out_byte(bus, 0x0B, (uint8_t)(0x40 | type << 2 | channel));
+    bus_out_byte(bus, 0x0C, 0);
+    bus_out_byte(bus, (uint16_t)(channel * 2), (uint8_t)address);
+    bus_out_byte(bus, (uint16_t)(channel * 2), (uint8_t)(address >> 8));
+    bus_out_byte(bus, (uint16_t)(channel * 2 + 1), (uint8_t)(length - 1));
+    bus_out_byte(bus, (uint16_t)(channel * 2 + 1), (uint8_t)((length - 1) >> 8));
+    bus_out_byte(bus, page[channel], (uint8_t)(address >> 16));
+    bus_out_byte(bus, 0x0A, (uint8_t)channel);
+}
+
+static void fdc_command(struct bus* bus, const uint8_t* command, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        CHECK((bus_in_byte(bus, FDC_PORTS + 4) & (FDC_MSR_RQM | FDC_MSR_DIO)) == FDC_MSR_RQM);
+        bus_out_byte(bus, FDC_PORTS + 5, command[i]);
+    }
+}
+
+// Read the result phase. Returns how many bytes it had.
+static unsigned fdc_result(struct bus* bus, uint8_t* result)
+{
+    unsigned length = 0;
+    uint8_t ready = FDC_MSR_RQM | FDC_MSR_DIO | FDC_MSR_BUSY;
+    while (length < 7 && (bus_in_byte(bus, FDC_PORTS + 4) & ready) == ready)
+        result[length++] = bus_in_byte(bus, FDC_PORTS + 5);
+    return length;
+}
+
+static void hdc_command(struct bus* bus, const uint8_t* command)
+{
+    bus_out_byte(bus, HDC_PORTS + 2, 0);
+    for (unsigned i = 0; i < 6; i++)
+    {
+        CHECK((bus_in_byte(bus, HDC_PORTS + 1) & 0x0F) == (HDC_STATUS_REQ | HDC_STATUS_CD | HDC_STATUS_BUSY));
+        bus_out_byte(bus, HDC_PORTS, command[i]);
+    }
+}
+
+// Wait for the command to finish and return its status byte.
+static uint8_t hdc_status(struct bus* bus)
+{
+    run(bus, 2 * HDC_EXECUTE_CLOCKS);
+    CHECK((bus_in_byte(bus, HDC_PORTS + 1) & 0x0F)
+          == (HDC_STATUS_REQ | HDC_STATUS_IO | HDC_STATUS_CD | HDC_STATUS_BUSY));
+    return bus_in_byte(bus, HDC_PORTS);
+}
+
+int main(void)
+{
+    struct disk* floppy = make_image(FLOPPY, FLOPPY_SECTORS);
+    struct disk* fixed = make_image(FIXED, FIXED_SECTORS);
+    if (!floppy || !fixed)
+    {
+        fprintf(stderr, "could not create the images\n");
+        return TEST_SKIP;
+    }
+
+    struct bus* bus = bus_new(0x100000, false);
+    static const uint8_t loop[] = { 0x31, 0xC0, 0x74, 0xFC };
+    memcpy(&bus->memory[0x100], loop, sizeof(loop));
+    test_jump(bus->cpu, 0, 0x100);
+    CHECK(pic_new(bus) && dma_new(bus));
+    struct fdc* fdc = fdc_new(bus);
+    struct hdc* hdc = hdc_new(bus);
+    CHECK(fdc && hdc);
+    CHECK(fdc_insert(fdc, 0, floppy) && hdc_insert(hdc, 0, fixed));
+
+    // Reset the floppy controller and sense the interrupt of each drive.
+    uint8_t result[7];
+    bus_out_byte(bus, FDC_PORTS + 2, FDC_DOR_DMA);
+    bus_out_byte(bus, FDC_PORTS + 2, FDC_DOR_DMA | FDC_DOR_RESET | 0x10);
+    run(bus, 2 * FDC_EXECUTE_CLOCKS);
+    CHECK(irq_raised(bus, FDC_IRQ));
+    for (unsigned drive = 0; drive < 4; drive++)
+    {
+        fdc_command(bus, (const uint8_t[]){ 0x08 }, 1);
+        CHECK(fdc_result(bus, result) == 2 && result[0] == (0xC0 | drive));
+    }
+
+    // Seek to cylinder 5, then read three sectors across the heads, from
+    // head 0 sector 17.
+    fdc_command(bus, (const uint8_t[]){ 0x0F, 0x00, 5 }, 3);
+    run(bus, 2 * FDC_EXECUTE_CLOCKS);
+    CHECK(irq_raised(bus, FDC_IRQ));
+    fdc_command(bus, (const uint8_t[]){ 0x08 }, 1);
+    CHECK(fdc_result(bus, result) == 2 && result[0] == 0x20 && result[1] == 5);
+
+    dma_setup(bus, FDC_DMA, DMA_TYPE_WRITE, 0x20000, 3 * DISK_SECTOR);
+    fdc_command(bus, (const uint8_t[]){ 0xE6, 0x00, 5, 0, 17, 2, 18, 0x1B, 0xFF }, 9);
+    run(bus, 2 * FDC_EXECUTE_CLOCKS);
+    CHECK(irq_raised(bus, FDC_IRQ));
+    CHECK(fdc_result(bus, result) == 7 && (result[0] & 0xC0) == 0);
+    uint32_t lba = 5 * 2 * 18 + 16;
+    for (unsigned i = 0; i < 3; i++)
+        CHECK(sector_is(&bus->memory[0x20000 + i * DISK_SECTOR], lba + i));
+
+    // Write the first sector from memory and read it back elsewhere.
+    memset(&bus->memory[0x30000], 0xAB, DISK_SECTOR);
+    dma_setup(bus, FDC_DMA, DMA_TYPE_READ, 0x30000, DISK_SECTOR);
+    fdc_command(bus, (const uint8_t[]){ 0x45, 0x00, 0, 0, 1, 2, 1, 0x1B, 0xFF }, 9);
+    run(bus, 2 * FDC_EXECUTE_CLOCKS);
+    CHECK(irq_raised(bus, FDC_IRQ));
+    CHECK(fdc_result(bus, result) == 7 && (result[0] & 0xC0) == 0);
+    dma_setup(bus, FDC_DMA, DMA_TYPE_WRITE, 0x40000, DISK_SECTOR);
+    fdc_command(bus, (const uint8_t[]){ 0x46, 0x00, 0, 0, 1, 2, 1, 0x1B, 0xFF }, 9);
+    run(bus, 2 * FDC_EXECUTE_CLOCKS);
+    CHECK(fdc_result(bus, result) == 7 && (result[0] & 0xC0) == 0);
+    CHECK(bus->memory[0x40000] == 0xAB && bus->memory[0x401FF] == 0xAB);
+
+    // The fixed disk: reset, then read two sectors from cylinder 300, head 3,
+    // sector 16 (the last of the track, so the second is on the next head).
+    bus_out_byte(bus, HDC_PORTS + 1, 0);
+    bus_out_byte(bus, HDC_PORTS + 3, HDC_MASK_DMA | HDC_MASK_IRQ);
+    hdc_command(bus, (const uint8_t[]){ 0x00, 0, 0, 0, 0, 0 });
+    CHECK(hdc_status(bus) == 0);
+    CHECK(irq_raised(bus, HDC_IRQ));
+
+    dma_setup(bus, HDC_DMA, DMA_TYPE_WRITE, 0x50000, 2 * DISK_SECTOR);
+    hdc_command(bus, (const uint8_t[]){ 0x08, 3, (300 >> 8) << 6 | 16, 300 & 0xFF, 2, 0 });
+    CHECK(hdc_status(bus) == 0);
+    CHECK(irq_raised(bus, HDC_IRQ));
+    lba = (300 * 4 + 3) * 17 + 16;
+    CHECK(sector_is(&bus->memory[0x50000], lba));
+    CHECK(sector_is(&bus->memory[0x50000 + DISK_SECTOR], lba + 1));
+
+    // Write sector 0 and read it back.
+    memset(&bus->memory[0x60000], 0x5A, DISK_SECTOR);
+    dma_setup(bus, HDC_DMA, DMA_TYPE_READ, 0x60000, DISK_SECTOR);
+    hdc_command(bus, (const uint8_t[]){ 0x0A, 0, 0, 0, 1, 0 });
+    CHECK(hdc_status(bus) == 0);
+    dma_setup(bus, HDC_DMA, DMA_TYPE_WRITE, 0x70000, DISK_SECTOR);
+    hdc_command(bus, (const uint8_t[]){ 0x08, 0, 0, 0, 1, 0 });
+    CHECK(hdc_status(bus) == 0);
+    CHECK(bus->memory[0x70000] == 0x5A && bus->memory[0x701FF] == 0x5A);
+
+    // Neither write reached the files.
+    uint8_t sector[DISK_SECTOR] = { 0 };
+    const char* paths[] = { FLOPPY, FIXED };
+    for (unsigned i = 0; i < 2; i++)
+    {
+        FILE* file = fopen(paths[i], "rb");
+        CHECK(file && fread(sector, 1, sizeof(sector), file) == sizeof(sector));
+        CHECK(sector_is(sector, 0));
+        if (file)
+            fclose(file);
+    }
+
+    bus_free(bus);
+    disk_close(floppy);
+    disk_close(fixed);
+    remove(FLOPPY);
+    remove(FIXED);
+    return test_result();
+}
@@ -0,0 +1,217 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Overlays, end to end: a drive writes more blocks than its cache holds and
+// reads them back through the overlay, a copy made with flexdisk merge
+// carries on separately from the original, everything survives reopening,
+// and flexdisk merge and flatten agree on the result. Takes the path of
+// flexdisk as its argument.
+
+#include "test.h"
+#include "disk.h"
+
+#define BASE        "test_overlay_base.img"
+#define FIRST       "test_overlay_first.cow"
+#define SECOND      "test_overlay_second.cow"
+#define COPY        "test_overlay_copy.cow"
+#define MERGED      "test_overlay_merged.cow"
+#define FLAT        "test_overlay_flat.img"
+#define SECTORS     2880
+#define WRITTEN     200                 // Blocks written, a sector in each.
+#define UNTOUCHED   (220 * DISK_BLOCK_SECTORS + 1) // A sector only the second overlay writes.
+
+#ifdef _WIN32
+#   define NULL_DEVICE "NUL"
+#else
+#   define NULL_DEVICE "/dev/null"
+#endif
+
+static const char* flexdisk;
+
+// Each sector of the base is filled with the low byte of its number, and
+// starts with the high byte.
+static bool sector_is(const uint8_t* data, uint32_t sector)
+{
+    return data && data[0] == (uint8_t)(sector >> 8) && data[1] == (uint8_t)sector
+        && data[DISK_SECTOR - 1] == (uint8_t)sector;
+}
+
+static bool sector_filled(const uint8_t* data, uint8_t value)
+{
+    return data && data[0] == value && data[DISK_SECTOR - 1] == value;
+}
+
+static bool fill(struct disk_drive* drive, uint32_t sector, uint8_t value)
+{
+    uint8_t* data = disk_write(drive, sector);
+    if (data)
+        memset(data, value, DISK_SECTOR);
+    return data != NULL;
+}
+
+// Load the sector of an image without going through a drive.
+static const uint8_t* image_sector(const struct disk* image, uint32_t sector)
+{
+    static uint8_t block[DISK_BLOCK];
+    if (!disk_block_load(image, sector / DISK_BLOCK_SECTORS, block))
+        return NULL;
+    return block + (sector % DISK_BLOCK_SECTORS) * DISK_SECTOR;
+}
+
+static long file_size(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return -1;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+// Run flexdisk with the given arguments. Returns its exit status.
+static int run_flexdisk(const char* command, const char* output, const char* first, const char* second)
+{
+    char line[1024];
+    snprintf(line, sizeof(line), "\"%s\" %s %s %s %s %s > %s 2>&1", flexdisk, command, BASE, output, first,
+             second ? second : "", NULL_DEVICE);
+    return system(line);
+}
+
+static void remove_all(void)
+{
+    const char* paths[] = { BASE, FIRST, SECOND, COPY, MERGED, FLAT };
+    for (unsigned i = 0; i < sizeof(paths) / sizeof(*paths); i++)
+        remove(paths[i]);
+}
+
+static struct disk_drive drive, copy;
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || !*argv[1])
+        return TEST_SKIP;
+    flexdisk = argv[1];
+
+    remove_all();
+    FILE* file = fopen(BASE, "wb");
+    for (uint32_t sector = 0; file && sector < SECTORS; sector++)
+    {
+        uint8_t data[DISK_SECTOR];
+        memset(data, (uint8_t)sector, sizeof(data));
+        data[0] = (uint8_t)(sector >> 8);
+        fwrite(data, 1, sizeof(data), file);
+    }
+    if (file)
+        fclose(file);
+    struct disk* base = disk_open(BASE);
+    struct disk* first = base ? disk_overlay_open(base, FIRST) : NULL;
+    if (!first)
+    {
+        fprintf(stderr, "could not create the images\n");
+        return TEST_SKIP;
+    }
+
+    // Write far more blocks than the cache holds, so that most are evicted
+    // into the overlay, and read them back.
+    disk_insert(&drive, first);
+    for (uint32_t i = 0; i < WRITTEN; i++)
+        CHECK(fill(&drive, i * DISK_BLOCK_SECTORS, (uint8_t)(0x40 + i)));
+    for (uint32_t i = 0; i < WRITTEN; i++)
+        CHECK(sector_filled(disk_read(&drive, i * DISK_BLOCK_SECTORS), (uint8_t)(0x40 + i)));
+    CHECK(sector_is(disk_read(&drive, 1), 1));
+    CHECK(sector_is(disk_read(&drive, SECTORS - 1), SECTORS - 1));
+
+    // The overlay holds a block for each, after the header and map (one block
+    // here), and the base is untouched.
+    CHECK(disk_flush(&drive));
+    CHECK(file_size(FIRST) == (1 + WRITTEN) * DISK_BLOCK);
+    CHECK(sector_is(image_sector(base, 0), 0));
+
+    // Copy the overlay and move a copy of the drive onto it, as for a cloned
+    // machine. Each then writes the same sector differently, and pushes it
+    // out of its cache.
+    CHECK(run_flexdisk("merge", COPY, FIRST, NULL) == 0);
+    struct disk* copied = disk_overlay_open(base, COPY);
+    CHECK(copied != NULL);
+    if (!copied)
+        return test_result();
+    copy = drive;
+    disk_attach(&copy, copied);
+    CHECK(fill(&drive, 7, 0x11) && fill(&copy, 7, 0x22));
+    for (uint32_t i = 0; i < 2 * DISK_CACHE_BLOCKS; i++)
+    {
+        uint32_t sector = (250 + i % 100) * DISK_BLOCK_SECTORS;
+        CHECK(fill(&drive, sector, 0x33) && fill(&copy, sector, 0x44));
+    }
+    CHECK(sector_filled(disk_read(&drive, 7), 0x11));
+    CHECK(sector_filled(disk_read(&copy, 7), 0x22));
+    disk_insert(&drive, NULL);
+    disk_insert(&copy, NULL);
+    CHECK(disk_close(first));
+    CHECK(disk_close(copied));
+
+    // Both survive reopening.
+    first = disk_overlay_open(base, FIRST);
+    copied = disk_overlay_open(base, COPY);
+    CHECK(first && copied);
+    if (!first || !copied)
+        return test_result();
+    disk_insert(&drive, first);
+    disk_insert(&copy, copied);
+    for (uint32_t i = 1; i < WRITTEN; i++)
+        CHECK(sector_filled(disk_read(&drive, i * DISK_BLOCK_SECTORS), (uint8_t)(0x40 + i)));
+    CHECK(sector_filled(disk_read(&drive, 7), 0x11) && sector_filled(disk_read(&copy, 7), 0x22));
+    CHECK(sector_filled(disk_read(&drive, 250 * DISK_BLOCK_SECTORS), 0x33));
+    CHECK(sector_filled(disk_read(&copy, 250 * DISK_BLOCK_SECTORS), 0x44));
+    disk_insert(&drive, NULL);
+    disk_insert(&copy, NULL);
+    CHECK(disk_close(copied));
+
+    // A second overlay puts block 5 back as the base has it and changes a
+    // block the first never wrote. Merging drops block 5, and flattening
+    // gives the same sectors as the merged overlay.
+    struct disk* second = disk_overlay_open(base, SECOND);
+    CHECK(second != NULL);
+    if (!second)
+        return test_result();
+    disk_insert(&copy, second);
+    for (uint32_t sector = 5 * DISK_BLOCK_SECTORS; sector < 6 * DISK_BLOCK_SECTORS; sector++)
+    {
+        uint8_t* data = disk_write(&copy, sector);
+        CHECK(data != NULL);
+        if (data)
+            memcpy(data, image_sector(base, sector), DISK_SECTOR);
+    }
+    CHECK(fill(&copy, UNTOUCHED, 0x77));
+    disk_insert(&copy, NULL);
+    CHECK(disk_close(second));
+    CHECK(disk_close(first));
+
+    CHECK(run_flexdisk("merge", MERGED, FIRST, SECOND) == 0);
+    CHECK(run_flexdisk("flatten", FLAT, FIRST, SECOND) == 0);
+    CHECK(run_flexdisk("merge", MERGED, FIRST, SECOND) != 0);
+    CHECK(file_size(FLAT) == SECTORS * DISK_SECTOR);
+
+    struct disk* merged = disk_overlay_open(base, MERGED);
+    struct disk* flat = disk_open(FLAT);
+    CHECK(merged && flat);
+    if (!merged || !flat)
+        return test_result();
+    CHECK(!disk_block_stored(merged, 5) && disk_block_stored(merged, 0));
+    disk_insert(&drive, merged);
+    unsigned differ = 0;
+    for (uint32_t sector = 0; sector < SECTORS; sector++)
+        differ += memcmp(disk_read(&drive, sector), image_sector(flat, sector), DISK_SECTOR) != 0;
+    CHECK(differ == 0);
+    CHECK(sector_filled(disk_read(&drive, UNTOUCHED), 0x77));
+    CHECK(sector_filled(disk_read(&drive, 7), 0x11));
+    CHECK(sector_is(disk_read(&drive, 5 * DISK_BLOCK_SECTORS + 1), 5 * DISK_BLOCK_SECTORS + 1));
+    disk_insert(&drive, NULL);
+
+    CHECK(disk_close(merged));
+    CHECK(disk_close(flat));
+    CHECK(disk_close(base));
+    remove_all();
+    return test_result();
+}
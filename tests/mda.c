@@ -0,0 +1,199 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// MDA and Hercules composition: text cells and the interleaved graphics
+// banks against a plain reference, and frames redrawn from dirty rows and
+// scanlines matching a full redraw.
+
+#include "test.h"
+#include "mda.h"
+
+// Shades of an IBM 5151.
+#define BLACK   0x000000
+#define NORMAL  0xAAAAAA
+#define BRIGHT  0xFFFFFF
+
+static uint8_t font[MDA_FONT_SIZE];
+static uint32_t expect[MDA_WIDTH * MDA_HEIGHT];
+
+// What 80x25 text should look like with blinking off and no cursor, straight
+// from the spec.
+static void reference_text(const struct bus* bus, const struct mda* mda)
+{
+    unsigned start = (mda->crtc[12] << 8) | mda->crtc[13];
+    for (unsigned y = 0; y < MDA_HEIGHT; y++)
+    {
+        for (unsigned x = 0; x < MDA_WIDTH; x++)
+        {
+            unsigned word = (start + (y / MDA_FONT_HEIGHT) * 80 + x / 9) & (MDA_TEXT_SIZE / 2 - 1);
+            uint8_t ch = bus->memory[MDA_VRAM + word * 2];
+            uint8_t attr = bus->memory[MDA_VRAM + word * 2 + 1];
+            unsigned line = y % MDA_FONT_HEIGHT, column = x % 9;
+
+            // The ninth column repeats the eighth for the line drawing
+            // characters, and is blank otherwise.
+            if (column == 8)
+                column = (ch >= 0xC0 && ch <= 0xDF) ? 7 : 8;
+            bool set = column < 8 && (font[ch * MDA_FONT_HEIGHT + line] & (0x80 >> column));
+
+            uint32_t fg = (attr & 0x08) ? BRIGHT : NORMAL, bg = BLACK;
+            if ((attr & 0x77) == 0x00)
+                fg = BLACK;
+            else if ((attr & 0x77) == 0x70)
+            {
+                fg = BLACK;
+                bg = (attr & 0x80) ? BRIGHT : NORMAL;
+            }
+            else if ((attr & 0x07) == 0x01 && line == MDA_UNDERLINE_LINE)
+                set = true;
+            expect[y * MDA_WIDTH + x] = set ? fg : bg;
+        }
+    }
+}
+
+// What a Hercules graphics frame should look like: 348 scanlines of 90
+// bytes, interleaved across four 8 KB banks.
+static void reference_graphics(const struct bus* bus, const struct mda* mda)
+{
+    unsigned start = (((mda->crtc[12] << 8) | mda->crtc[13]) * 2) & 0x1FFF;
+    for (unsigned y = 0; y < MDA_HEIGHT; y++)
+    {
+        const uint8_t* bank = &bus->memory[MDA_VRAM + (y & 3) * 0x2000];
+        for (unsigned x = 0; x < MDA_WIDTH; x++)
+        {
+            uint8_t byte = bank[(start + (y / 4) * 90 + x / 8) & 0x1FFF];
+            bool set = y < MDA_GRAPHICS_HEIGHT && (byte & (0x80 >> (x % 8)));
+            expect[y * MDA_WIDTH + x] = set ? NORMAL : BLACK;
+        }
+    }
+}
+
+static void check_frame(const struct mda* mda, const char* what)
+{
+    for (unsigned i = 0; i < MDA_WIDTH * MDA_HEIGHT; i++)
+    {
+        if (mda->pixels[i] != expect[i])
+        {
+            fprintf(stderr, "%s: pixel %u,%u is %06X, not %06X\n", what, i % MDA_WIDTH, i / MDA_WIDTH,
+                    mda->pixels[i], expect[i]);
+            test_failures++;
+            return;
+        }
+    }
+}
+
+static void set_crtc(struct bus* bus, uint8_t index, uint8_t value)
+{
+    bus_out_byte(bus, MDA_PORTS + 0x4, index);
+    bus_out_byte(bus, MDA_PORTS + 0x5, value);
+}
+
+int main(void)
+{
+    for (unsigned i = 0; i < MDA_FONT_SIZE; i++)
+        font[i] = (uint8_t)(i * 37 + (i >> 8));
+    struct bus* bus = bus_new(0x100000, false);
+    struct mda* mda = mda_new(bus, font);
+    CHECK(mda);
+
+    // Text with blinking and the cursor off, so that frames only change
+    // where VRAM does.
+    bus_out_byte(bus, MDA_PORTS + 0x8, MDA_MODE_HIRES | MDA_MODE_ENABLE);
+    set_crtc(bus, 10, 0x20);
+    uint32_t seed = 1;
+    for (unsigned i = 0; i < MDA_TEXT_SIZE; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        bus->memory[MDA_VRAM + i] = (uint8_t)(seed >> 16);
+    }
+    for (unsigned start = 0; start < 2; start++)
+    {
+        set_crtc(bus, 13, start ? 80 * 3 + 7 : 0);
+        mda_compose(bus, mda);
+        CHECK(mda->changed);
+        reference_text(bus, mda);
+        check_frame(mda, "text redraw");
+    }
+    mda_compose(bus, mda);
+    CHECK(!mda->changed);
+
+    // Cells written through the bus redraw their row, and nothing else: a
+    // pixel scribbled on another row survives until the next full redraw.
+    unsigned start = 80 * 3 + 7;
+    mda->pixels[20 * MDA_FONT_HEIGHT * MDA_WIDTH + 5] = 0x123456;
+    for (unsigned frame = 0; frame < 20; frame++)
+    {
+        for (unsigned j = 0; j < 5; j++)
+        {
+            seed = seed * 1103515245 + 12345;
+            unsigned row = (seed >> 8) % 25;
+            if (row == 20)
+                continue;
+            unsigned word = (start + row * 80 + (seed >> 16) % 80) & (MDA_TEXT_SIZE / 2 - 1);
+            bus_write_byte(bus, MDA_VRAM + word * 2 + ((seed >> 24) & 1), (uint8_t)(seed >> 12));
+        }
+        mda_compose(bus, mda);
+        CHECK(mda->changed);
+        reference_text(bus, mda);
+        expect[20 * MDA_FONT_HEIGHT * MDA_WIDTH + 5] = 0x123456;
+        check_frame(mda, "dirty text");
+    }
+    mda->redraw = true;
+    mda_compose(bus, mda);
+    reference_text(bus, mda);
+    check_frame(mda, "text redraw");
+
+    // Underlined, bright, reverse and invisible cells.
+    static const uint8_t attrs[] = { 0x01, 0x09, 0x0F, 0x70, 0xF0, 0x00, 0x88, 0x07 };
+    for (unsigned i = 0; i < sizeof(attrs); i++)
+    {
+        bus_write_byte(bus, MDA_VRAM + (start + i) * 2, (uint8_t)(0xC0 + i * 5));
+        bus_write_byte(bus, MDA_VRAM + (start + i) * 2 + 1, attrs[i]);
+    }
+    mda_compose(bus, mda);
+    reference_text(bus, mda);
+    check_frame(mda, "attributes");
+    CHECK(mda->pixels[MDA_UNDERLINE_LINE * MDA_WIDTH + 8] == NORMAL);
+
+    // Hercules graphics needs the configuration switch as well as the mode.
+    bus_out_byte(bus, MDA_PORTS + 0x8, MDA_MODE_GRAPHICS | MDA_MODE_ENABLE);
+    struct video_text text;
+    CHECK(mda_text(bus, mda, &text));
+    bus_out_byte(bus, MDA_CONFIG_PORT, MDA_CONFIG_GRAPHICS);
+    CHECK(!mda_text(bus, mda, &text));
+
+    for (unsigned i = 0; i < MDA_VRAM_SIZE; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        bus->memory[MDA_VRAM + i] = (uint8_t)(seed >> 16);
+    }
+    for (unsigned i = 0; i < 3; i++)
+    {
+        set_crtc(bus, 12, 0);
+        set_crtc(bus, 13, (uint8_t)(i * 45));
+        mda->redraw = true;
+        mda_compose(bus, mda);
+        CHECK(mda->changed);
+        reference_graphics(bus, mda);
+        check_frame(mda, "graphics redraw");
+    }
+
+    // Scattered writes, in every bank, redraw only the scanlines they touched.
+    for (unsigned frame = 0; frame < 20; frame++)
+    {
+        for (unsigned j = 0; j < 5; j++)
+        {
+            seed = seed * 1103515245 + 12345;
+            bus_write_byte(bus, MDA_VRAM + (seed >> 8) % MDA_VRAM_SIZE, (uint8_t)(seed >> 20));
+        }
+        mda_compose(bus, mda);
+        CHECK(mda->changed);
+        reference_graphics(bus, mda);
+        check_frame(mda, "dirty graphics");
+    }
+    mda_compose(bus, mda);
+    CHECK(!mda->changed);
+
+    bus_free(bus);
+    return test_result();
+}
@@ -0,0 +1,119 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Interrupts: the 8259's priorities, mask and end of interrupt, a device's
+// IRQ reaching the CPU through it, and the CPU taking the interrupt after
+// STI and the instruction that follows it, then returning with IRET.
+
+#include "test.h"
+#include "pic.h"
+#include "sb.h"
+
+// The handler for IRQ 5: MOV AL, 20h / OUT 20h, AL / IRET.
+static const uint8_t handler[] = { 0xB0, 0x20, 0xE6, 0x20, 0xCF };
+
+// Clock the CPU until it has nothing left to do before running cs:ip, which
+// after an interrupt is taken is in the ready rather than executing stage.
+// Returns false if it does not get there in a reasonable time.
+static bool run_to(struct cpu8086* cpu, uint16_t cs, uint16_t ip)
+{
+    for (unsigned clocks = 0; clocks < 10000; clocks++)
+    {
+        cpu8086_clock(cpu);
+        if (cpu->cs == cs && cpu->current_ip == ip && cpu->cycles == 0 && cpu->uop_r == cpu->uop_w)
+            return true;
+    }
+    return false;
+}
+
+int main(void)
+{
+    // Without a controller, lines are not connected.
+    struct bus* bus = bus_new(0x100000, false);
+    struct cpu8086* cpu = bus->cpu;
+    bus_irq(bus, 6);
+    CHECK(!cpu->intr);
+
+    struct pic* pic = pic_new(bus);
+    CHECK(pic != NULL && bus->pic == pic);
+
+    // A lower priority line waits while a higher one is in service, a higher
+    // one does not, and a non-specific EOI ends the highest in service.
+    bus_irq(bus, 6);
+    CHECK(cpu->intr && cpu->intr_vector == 0x0E);
+    CHECK(bus_acknowledge(bus) == 0x0E && pic->isr == 0x40 && !cpu->intr);
+    bus_irq(bus, 7);
+    CHECK(!cpu->intr);
+    bus_irq(bus, 5);
+    CHECK(cpu->intr && cpu->intr_vector == 0x0D);
+    CHECK(bus_acknowledge(bus) == 0x0D && pic->isr == 0x60);
+    bus_out_byte(bus, PIC_PORTS, PIC_OCW2_EOI);
+    CHECK(pic->isr == 0x40 && !cpu->intr);
+    bus_out_byte(bus, PIC_PORTS, PIC_OCW2_EOI);
+    CHECK(pic->isr == 0 && cpu->intr && cpu->intr_vector == 0x0F);
+
+    // The mask holds a request back without losing it, and OCW3 selects
+    // which register port 0x20 reads.
+    bus_out_byte(bus, PIC_PORTS + 1, 0x80);
+    CHECK(!cpu->intr && bus_in_byte(bus, PIC_PORTS + 1) == 0x80);
+    CHECK(bus_in_byte(bus, PIC_PORTS) == 0x80);
+    bus_out_byte(bus, PIC_PORTS + 1, 0x00);
+    CHECK(cpu->intr && bus_acknowledge(bus) == 0x0F);
+    bus_out_byte(bus, PIC_PORTS, PIC_OCW3 | PIC_OCW3_READ | PIC_OCW3_READ_ISR);
+    CHECK(bus_in_byte(bus, PIC_PORTS) == 0x80);
+    bus_out_byte(bus, PIC_PORTS, PIC_OCW2_SPECIFIC_EOI | 7);
+    CHECK(bus_in_byte(bus, PIC_PORTS) == 0);
+
+    // With nothing pending, the acknowledge gets IRQ 7's vector.
+    CHECK(bus_acknowledge(bus) == 0x0F && pic->isr == 0);
+
+    // Reprogram it as the BIOS does, with IRQ 0 at vector 50h.
+    bus_out_byte(bus, PIC_PORTS, PIC_ICW1 | PIC_ICW1_SINGLE | PIC_ICW1_ICW4);
+    bus_out_byte(bus, PIC_PORTS + 1, 0x50);
+    bus_out_byte(bus, PIC_PORTS + 1, 0x09);
+    bus_out_byte(bus, PIC_PORTS + 1, 0xFD);
+    CHECK(pic->imr == 0xFD && pic->init == 0);
+    bus_irq(bus, 0);
+    CHECK(!cpu->intr);
+    bus_irq(bus, 1);
+    CHECK(cpu->intr && bus_acknowledge(bus) == 0x51);
+    bus_free(bus);
+
+    // A Sound Blaster's IRQ, through the controller, interrupts the CPU once
+    // it has run STI and the instruction after it. The handler ends the
+    // interrupt and returns.
+    bus = bus_new(0x100000, false);
+    cpu = bus->cpu;
+    pic_new(bus);
+    CHECK(sb_new(bus, 5, 0) != NULL);
+    memcpy(&bus->memory[0x500], handler, sizeof(handler));
+    bus->memory[0x0D * 4] = 0x00;
+    bus->memory[0x0D * 4 + 1] = 0x05;
+    bus->memory[0x0D * 4 + 2] = 0x00;
+    bus->memory[0x0D * 4 + 3] = 0x00;
+
+    static const uint8_t code[] = { 0xFB, 0x90, 0x90, 0x90 };   // STI / NOP / NOP / NOP
+    memcpy(&bus->memory[0x100], code, sizeof(code));
+    cpu->ss = 0;
+    cpu->sp = 0x8000;
+    test_jump(cpu, 0, 0x100);
+    cpu8086_set_flags(cpu, FLAG_CARRY);
+    bus_out_byte(bus, SB_PORTS + 0xC, 0xF2);    // Have the DSP raise its IRQ.
+    CHECK(cpu->intr);
+
+    CHECK(run_to(cpu, 0, 0x500));
+    CHECK(cpu->sp == 0x7FFA);
+    CHECK(bus->memory[0x7FFA] == 0x02 && bus->memory[0x7FFB] == 0x01);
+    CHECK(bus->memory[0x7FFE] == (uint8_t)(FLAG_CARRY | 0x02));
+    CHECK(bus->memory[0x7FFF] == ((FLAG_INTENABLE >> 8) | 0xF0));
+    CHECK(!cpu->ief);
+    CHECK(bus->pic->isr == 0x20);
+
+    CHECK(run_to(cpu, 0, 0x102));
+    CHECK(bus->pic->isr == 0 && !cpu->intr);
+    CHECK(cpu->sp == 0x8000);
+    CHECK(cpu8086_get_flags(cpu) == (FLAG_INTENABLE | FLAG_CARRY | 0xF002));
+    bus_free(bus);
+
+    return test_result();
+}
@@ -0,0 +1,607 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Runs SingleStepTests vectors (https://github.com/SingleStepTests): each
+// test gives the registers and RAM before and after one instruction, and a
+// trace of every bus cycle it took.
+//
+//   test_singlestep [--tolerance N] <directory | file.json[.gz]>...
+//
+// Given a directory, the group 3 multiply and divide files (F6.4 to F7.7)
+// are run from it, which is what ctest does with tests/singlestep (or
+// FLEX_SINGLESTEP_DIR). Gzipped files are read through gzip. Finding no
+// files is a failure, not a skip.
+//
+// The files in tests/singlestep are written by tests/singlestep/generate.py,
+// not captured from hardware: they check results, and have no cycle traces.
+// The real files drop in over them and add the cycle comparison below.
+//
+// The final registers, flags (less the ones the instruction leaves
+// undefined) and RAM must match. Cycle counts are compared per instruction
+// form (opcode, /reg and register or memory operand): the emulator counts
+// from an empty queue until the instruction has finished executing, which is
+// a fixed number of cycles off from where a trace ends, so within each form
+// the difference has to stay within the tolerance (default 0). The offset
+// and spread of each form are printed, along with how many of its tests are
+// at its most common offset, which is what the cycle constants in cpu8086.c
+// are tuned against.
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L     // popen()
+#endif
+
+#include <ctype.h>
+#include <stdint.h>
+
+#include "test.h"
+#include "util.h"
+
+// A parsed JSON value. Objects keep their keys in keys, alongside items.
+enum json_type
+{
+    JSON_NULL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+};
+
+struct json
+{
+    enum json_type type;
+    double number;
+    char* string;
+    size_t count;
+    struct json* items;
+    char** keys;
+};
+
+struct parser
+{
+    const char* p;
+    const char* end;
+};
+
+static void json_skip(struct parser* parser)
+{
+    while (parser->p < parser->end && isspace((unsigned char)*parser->p))
+        parser->p++;
+}
+
+static bool json_parse(struct parser* parser, struct json* value);
+
+static char* json_string(struct parser* parser)
+{
+    // Only plain strings (names and hashes) appear, so escapes are copied
+    // through as they are.
+    const char* start = ++parser->p;
+    while (parser->p < parser->end && *parser->p != '"')
+        parser->p += (*parser->p == '\\') ? 2 : 1;
+    if (parser->p >= parser->end)
+        return NULL;
+    size_t length = (size_t)(parser->p - start);
+    char* string = quick_malloc(length + 1);
+    memcpy(string, start, length);
+    parser->p++;
+    return string;
+}
+
+static bool json_parse(struct parser* parser, struct json* value)
+{
+    memset(value, 0, sizeof(*value));
+    json_skip(parser);
+    if (parser->p >= parser->end)
+        return false;
+
+    char c = *parser->p;
+    if (c == '"')
+    {
+        value->type = JSON_STRING;
+        value->string = json_string(parser);
+        return value->string != NULL;
+    }
+    if (c == '[' || c == '{')
+    {
+        bool object = c == '{';
+        value->type = object ? JSON_OBJECT : JSON_ARRAY;
+        parser->p++;
+        size_t capacity = 0;
+        for (;;)
+        {
+            json_skip(parser);
+            if (parser->p >= parser->end)
+                return false;
+            if (*parser->p == (object ? '}' : ']'))
+            {
+                parser->p++;
+                return true;
+            }
+            if (*parser->p == ',')
+            {
+                parser->p++;
+                continue;
+            }
+
+            if (value->count == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 8;
+                value->items = realloc(value->items, capacity * sizeof(struct json));
+                if (object)
+                    value->keys = realloc(value->keys, capacity * sizeof(char*));
+                if (!value->items || (object && !value->keys))
+                    abort();
+            }
+            if (object)
+            {
+                if (*parser->p != '"')
+                    return false;
+                value->keys[value->count] = json_string(parser);
+                json_skip(parser);
+                if (!value->keys[value->count] || parser->p >= parser->end || *parser->p != ':')
+                    return false;
+                parser->p++;
+            }
+            if (!json_parse(parser, &value->items[value->count++]))
+                return false;
+        }
+    }
+    if (c == 'n' || c == 't' || c == 'f')
+    {
+        // null, true, false: only ever metadata.
+        while (parser->p < parser->end && isalpha((unsigned char)*parser->p))
+            parser->p++;
+        value->type = JSON_NULL;
+        return true;
+    }
+
+    char* end;
+    value->type = JSON_NUMBER;
+    value->number = strtod(parser->p, &end);
+    if (end == parser->p)
+        return false;
+    parser->p = end;
+    return true;
+}
+
+static void json_free(struct json* value)
+{
+    for (size_t i = 0; i < value->count; i++)
+    {
+        json_free(&value->items[i]);
+        if (value->keys)
+            free(value->keys[i]);
+    }
+    free(value->items);
+    free(value->keys);
+    free(value->string);
+}
+
+static const struct json* json_get(const struct json* object, const char* key)
+{
+    if (!object || object->type != JSON_OBJECT)
+        return NULL;
+    for (size_t i = 0; i < object->count; i++)
+    {
+        if (strcmp(object->keys[i], key) == 0)
+            return &object->items[i];
+    }
+    return NULL;
+}
+
+static bool json_number(const struct json* object, const char* key, unsigned* number)
+{
+    const struct json* value = json_get(object, key);
+    if (!value || value->type != JSON_NUMBER)
+        return false;
+    *number = (unsigned)value->number;
+    return true;
+}
+
+// Read a whole file, through gzip if it is compressed.
+static char* read_file(const char* path, size_t* size)
+{
+    size_t length = strlen(path);
+    bool gzipped = length > 3 && strcmp(path + length - 3, ".gz") == 0;
+    FILE* file;
+    if (gzipped)
+    {
+#ifdef _WIN32
+        fprintf(stderr, "%s: decompress it first\n", path);
+        return NULL;
+#else
+        char command[4096];
+        snprintf(command, sizeof(command), "gzip -dc '%s'", path);
+        file = popen(command, "r");
+#endif
+    }
+    else
+        file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+
+    size_t capacity = 1 << 20;
+    char* data = quick_malloc(capacity);
+    *size = 0;
+    for (;;)
+    {
+        if (*size == capacity)
+        {
+            capacity *= 2;
+            data = realloc(data, capacity);
+            if (!data)
+                abort();
+        }
+        size_t got = fread(data + *size, 1, capacity - *size, file);
+        if (!got)
+            break;
+        *size += got;
+    }
+#ifndef _WIN32
+    if (gzipped)
+        pclose(file);
+    else
+#endif
+        fclose(file);
+    return data;
+}
+
+static const char* const reg_names[] = { "ax", "cx", "dx", "bx", "sp", "bp", "si", "di", "es", "cs", "ss", "ds" };
+
+// FLAGS bits an instruction leaves undefined, which are not compared.
+static uint16_t undefined_flags(const uint8_t* bytes, size_t length)
+{
+    const uint16_t arithmetic = FLAG_CARRY | FLAG_PARITY | FLAG_AUXILIARY | FLAG_ZERO | FLAG_SIGN | FLAG_OVERFLOW;
+    size_t i = 0;
+    while (i < length && (bytes[i] == 0x26 || bytes[i] == 0x2E || bytes[i] == 0x36 || bytes[i] == 0x3E
+                          || bytes[i] == 0xF0 || bytes[i] == 0xF2 || bytes[i] == 0xF3))
+        i++;
+    if (i + 1 >= length || (bytes[i] & 0xFE) != 0xF6)
+        return 0;
+    switch ((bytes[i + 1] >> 3) & 7)
+    {
+        case 4:
+        case 5:
+            return FLAG_PARITY | FLAG_AUXILIARY | FLAG_ZERO | FLAG_SIGN;
+        case 6:
+        case 7:
+            return arithmetic;
+        default:
+            return 0;
+    }
+}
+
+// Cycle differences seen for one instruction form, within FORM_SPREAD of
+// the first one seen.
+#define FORM_SPREAD 64
+
+struct form
+{
+    char name[32];
+    long first;
+    long min;
+    long max;
+    unsigned tests;
+    unsigned deltas[2 * FORM_SPREAD + 1];
+};
+
+static struct form forms[256];
+static unsigned form_count;
+
+static void form_add(const char* name, long delta)
+{
+    struct form* form = NULL;
+    for (unsigned i = 0; i < form_count && !form; i++)
+    {
+        if (strcmp(forms[i].name, name) == 0)
+            form = &forms[i];
+    }
+    if (!form)
+    {
+        if (form_count == sizeof(forms) / sizeof(*forms))
+            return;
+        form = &forms[form_count++];
+        snprintf(form->name, sizeof(form->name), "%s", name);
+        form->first = form->min = form->max = delta;
+    }
+    if (delta < form->min)
+        form->min = delta;
+    if (delta > form->max)
+        form->max = delta;
+    if (delta >= form->first - FORM_SPREAD && delta <= form->first + FORM_SPREAD)
+        form->deltas[delta - form->first + FORM_SPREAD]++;
+    form->tests++;
+}
+
+// How many tests of a form are off by its most common difference, i.e. would
+// be cycle-exact if the form's offset was accounted for.
+static unsigned form_exact(const struct form* form, long* offset)
+{
+    unsigned best = 0;
+    *offset = form->first;
+    for (long i = 0; i <= 2 * FORM_SPREAD; i++)
+    {
+        if (form->deltas[i] > best)
+        {
+            best = form->deltas[i];
+            *offset = form->first + i - FORM_SPREAD;
+        }
+    }
+    return best;
+}
+
+// Run one test. Returns false if the final state did not match.
+static bool run_test(struct bus* bus, const struct json* test)
+{
+    struct cpu8086* cpu = bus->cpu;
+    const struct json* initial = json_get(test, "initial");
+    const struct json* final = json_get(test, "final");
+    const struct json* bytes = json_get(test, "bytes");
+    const struct json* name = json_get(test, "name");
+    const struct json* regs = json_get(initial, "regs");
+    if (!regs || !final || !bytes || bytes->type != JSON_ARRAY)
+        return false;
+
+    uint8_t code[16] = { 0 };
+    size_t length = 0;
+    while (length < sizeof(code) && length < bytes->count)
+    {
+        code[length] = (uint8_t)bytes->items[length].number;
+        length++;
+    }
+
+    const struct json* ram = json_get(initial, "ram");
+    for (size_t i = 0; ram && i < ram->count; i++)
+    {
+        const struct json* pair = &ram->items[i];
+        if (pair->count == 2)
+            bus->memory[(uint32_t)pair->items[0].number & 0xFFFFF] = (uint8_t)pair->items[1].number;
+    }
+
+    unsigned value;
+    for (unsigned i = 0; i < REGISTER_COUNT; i++)
+    {
+        if (json_number(regs, reg_names[i], &value))
+            cpu->regs[i] = (uint16_t)value;
+    }
+    unsigned ip = 0, flags = 0;
+    json_number(regs, "ip", &ip);
+    json_number(regs, "flags", &flags);
+
+    // This always starts with an empty queue, so tests that start with a
+    // full one only have their final state compared.
+    const struct json* queue = json_get(initial, "queue");
+    bool queued = queue && queue->count;
+    test_jump(cpu, cpu->cs, (uint16_t)ip);
+    cpu8086_set_flags(cpu, (uint16_t)flags);
+
+    long clocks = 0;
+    do
+    {
+        cpu8086_clock(cpu);
+        if (++clocks > 100000)
+            break;
+    } while (!test_idle(cpu));
+
+    // Compare what the test says changed; anything it leaves out must not
+    // have changed either.
+    bool ok = true;
+    const struct json* expect = json_get(final, "regs");
+    uint16_t mask = ~undefined_flags(code, length);
+    for (unsigned i = 0; i < REGISTER_COUNT; i++)
+    {
+        unsigned before = 0;
+        json_number(regs, reg_names[i], &before);
+        if (!json_number(expect, reg_names[i], &value))
+            value = before;
+        if (cpu->regs[i] != (uint16_t)value)
+        {
+            fprintf(stderr, "%s: %s is %04X, not %04X\n", name ? name->string : "?", reg_names[i],
+                    cpu->regs[i], value);
+            ok = false;
+        }
+    }
+    if (!json_number(expect, "ip", &value))
+        value = ip;
+    if (cpu->current_ip != (uint16_t)value)
+    {
+        fprintf(stderr, "%s: ip is %04X, not %04X\n", name ? name->string : "?", cpu->current_ip, value);
+        ok = false;
+    }
+    if (!json_number(expect, "flags", &value))
+        value = flags;
+    if ((cpu8086_get_flags(cpu) & mask) != (value & mask))
+    {
+        fprintf(stderr, "%s: flags are %04X, not %04X\n", name ? name->string : "?",
+                cpu8086_get_flags(cpu), value);
+        ok = false;
+    }
+
+    // A divide error pushes FLAGS with the undefined flags as they were
+    // left, so that word is masked like the register.
+    uint32_t pushed_flags = ((uint32_t)cpu->ss << 4) + (uint16_t)(cpu->sp + 4);
+    const struct json* final_ram = json_get(final, "ram");
+    for (size_t i = 0; final_ram && i < final_ram->count; i++)
+    {
+        const struct json* pair = &final_ram->items[i];
+        if (pair->count != 2)
+            continue;
+        uint32_t address = (uint32_t)pair->items[0].number & 0xFFFFF;
+        uint8_t byte_mask = (address == (pushed_flags & 0xFFFFF)) ? (uint8_t)mask
+                          : (address == ((pushed_flags + 1) & 0xFFFFF)) ? (uint8_t)(mask >> 8) : 0xFF;
+        if ((bus->memory[address] & byte_mask) != ((uint8_t)pair->items[1].number & byte_mask))
+        {
+            fprintf(stderr, "%s: [%05X] is %02X, not %02X\n", name ? name->string : "?", address,
+                    bus->memory[address], (unsigned)pair->items[1].number);
+            ok = false;
+        }
+    }
+
+    // Leave RAM as it was for the next test.
+    for (size_t i = 0; ram && i < ram->count; i++)
+    {
+        const struct json* pair = &ram->items[i];
+        if (pair->count == 2)
+            bus->memory[(uint32_t)pair->items[0].number & 0xFFFFF] = 0;
+    }
+    for (size_t i = 0; final_ram && i < final_ram->count; i++)
+    {
+        const struct json* pair = &final_ram->items[i];
+        if (pair->count == 2)
+            bus->memory[(uint32_t)pair->items[0].number & 0xFFFFF] = 0;
+    }
+
+    const struct json* cycles = json_get(test, "cycles");
+    if (ok && cycles && cycles->type == JSON_ARRAY && !queued)
+    {
+        // The form: opcode, /reg for the groups, and whether the operand is
+        // a register.
+        size_t i = 0;
+        while (i + 1 < length
+               && (code[i] == 0x26 || code[i] == 0x2E || code[i] == 0x36 || code[i] == 0x3E
+                   || code[i] == 0xF0 || code[i] == 0xF2 || code[i] == 0xF3))
+            i++;
+        char form[32];
+        snprintf(form, sizeof(form), "%02X.%u %s", code[i], (code[i + 1] >> 3) & 7,
+                 ((code[i + 1] >> 6) == 3) ? "reg" : "mem");
+        form_add(form, clocks - (long)cycles->count);
+    }
+    return ok;
+}
+
+// Run every test in a file. Returns how many failed, or -1 if it could not
+// be read.
+static long run_file(struct bus* bus, const char* path)
+{
+    size_t size;
+    char* data = read_file(path, &size);
+    if (!data)
+        return -1;
+
+    struct parser parser = { data, data + size };
+    json_skip(&parser);
+    if (parser.p >= parser.end || *parser.p != '[')
+    {
+        free(data);
+        return -1;
+    }
+    parser.p++;
+
+    // One test at a time, rather than the whole file at once.
+    long failed = 0, run = 0;
+    for (;;)
+    {
+        json_skip(&parser);
+        if (parser.p >= parser.end || *parser.p == ']')
+            break;
+        if (*parser.p == ',')
+        {
+            parser.p++;
+            continue;
+        }
+
+        struct json test;
+        if (!json_parse(&parser, &test))
+        {
+            json_free(&test);
+            free(data);
+            return -1;
+        }
+        if (!run_test(bus, &test))
+            failed++;
+        run++;
+        json_free(&test);
+    }
+    printf("%s: %ld of %ld passed\n", path, run - failed, run);
+    free(data);
+    return failed;
+}
+
+int main(int argc, char** argv)
+{
+    long tolerance = 0;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "--tolerance") == 0)
+    {
+        tolerance = strtol(argv[2], NULL, 10);
+        first = 3;
+    }
+    if (first >= argc || !argv[first][0])
+    {
+        fprintf(stderr, "usage: test_singlestep [--tolerance N] <directory | file.json[.gz]>...\n");
+        return 1;
+    }
+
+    struct bus* bus = bus_new(0x100000, false);
+    long failed = 0;
+    unsigned files = 0;
+    for (int i = first; i < argc; i++)
+    {
+        // A directory: the multiply and divide files in it.
+        static const char* const muldiv[] = { "F6.4", "F6.5", "F6.6", "F6.7", "F7.4", "F7.5", "F7.6", "F7.7" };
+        static const char* const suffixes[] = { ".json", ".json.gz" };
+        bool directory = false;
+        for (unsigned j = 0; j < sizeof(muldiv) / sizeof(*muldiv); j++)
+        {
+            for (unsigned k = 0; k < 2; k++)
+            {
+                char path[4096];
+                snprintf(path, sizeof(path), "%s/%s%s", argv[i], muldiv[j], suffixes[k]);
+                FILE* file = fopen(path, "rb");
+                if (!file)
+                    continue;
+                fclose(file);
+                directory = true;
+
+                long result = run_file(bus, path);
+                if (result < 0)
+                {
+                    fprintf(stderr, "%s: cannot be read\n", path);
+                    failed++;
+                }
+                else
+                    failed += result;
+                files++;
+                break;
+            }
+        }
+        if (directory)
+            continue;
+
+        long result = run_file(bus, argv[i]);
+        if (result < 0)
+        {
+            fprintf(stderr, "%s: cannot be read\n", argv[i]);
+            failed++;
+        }
+        else
+        {
+            failed += result;
+            files++;
+        }
+    }
+    bus_free(bus);
+    if (!files)
+    {
+        fprintf(stderr, "no test files found\n");
+        return 1;
+    }
+
+    unsigned tests = 0, exact = 0;
+    for (unsigned i = 0; i < form_count; i++)
+    {
+        const struct form* form = &forms[i];
+        long offset;
+        unsigned matched = form_exact(form, &offset);
+        printf("%-12s %6u tests, emulator - trace %+ld to %+ld cycles, %u at %+ld\n", form->name,
+               form->tests, form->min, form->max, matched, offset);
+        tests += form->tests;
+        exact += matched;
+        if (form->max - form->min > tolerance)
+            failed++;
+    }
+    if (tests)
+        printf("cycle counts: %u of %u (%.2f%%) exact\n", exact, tests, 100.0 * exact / tests);
+    else
+        printf("cycle counts: no traces to compare\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,269 @@
+#!/usr/bin/env python3
+# floason (C) 2025
+# Licensed under the MIT License.
+
+# Writes F6.4.json to F7.7.json in the SingleStepTests layout: MUL, IMUL,
+# DIV and IDIV on byte and word operands, in registers and in memory, with
+# the final registers, FLAGS and RAM worked out here from the 8086's
+# documented behaviour rather than by the emulator. Divide errors push FLAGS,
+# CS and the IP of the next instruction, and an IDIV quotient of -128 or
+# -32768 is a divide error too. FLAGS the instruction leaves undefined keep
+# their initial value, since the harness does not compare them.
+#
+# There are no "cycles" traces: these are not hardware captures, so they
+# check results but not timing. The real files replace them as they are.
+
+import json
+import random
+import sys
+
+FLAGS_FIXED = 0xF002
+FLAG_CARRY, FLAG_OVERFLOW = 0x0001, 0x0800
+FLAG_TRAP, FLAG_INTENABLE = 0x0100, 0x0200
+FLAGS_RANDOM = 0x0001 | 0x0004 | 0x0010 | 0x0040 | 0x0080 | 0x0200 | 0x0400 | 0x0800
+
+REGS = ["ax", "cx", "dx", "bx", "sp", "bp", "si", "di"]
+SEGS = ["es", "cs", "ss", "ds"]
+BYTE_NAMES = ["al", "cl", "dl", "bl", "ah", "ch", "dh", "bh"]
+WORD_NAMES = ["ax", "cx", "dx", "bx", "sp", "bp", "si", "di"]
+MNEMONICS = {4: "mul", 5: "imul", 6: "div", 7: "idiv"}
+
+# The addressing forms used: (mod, rm), with disp8, disp16 and direct.
+EA_FORMS = [(0, 0), (0, 7), (0, 6), (1, 6), (1, 2), (2, 4), (2, 1)]
+EA_NAMES = ["bx+si", "bx+di", "bp+si", "bp+di", "si", "di", "bp", "bx"]
+
+
+def signed(value, bits):
+    return value - (1 << bits) if value & (1 << (bits - 1)) else value
+
+
+def get_reg(regs, index, word):
+    if word:
+        return regs[REGS[index]]
+    value = regs[REGS[index & 3]]
+    return (value >> 8) & 0xFF if index & 4 else value & 0xFF
+
+
+def set_reg(regs, index, word, value):
+    if word:
+        regs[REGS[index]] = value & 0xFFFF
+        return
+    name = REGS[index & 3]
+    if index & 4:
+        regs[name] = (regs[name] & 0x00FF) | ((value & 0xFF) << 8)
+    else:
+        regs[name] = (regs[name] & 0xFF00) | (value & 0xFF)
+
+
+def effective_address(regs, mod, rm, disp):
+    if mod == 0 and rm == 6:
+        return disp, "ds"
+    base = {0: regs["bx"] + regs["si"], 1: regs["bx"] + regs["di"], 2: regs["bp"] + regs["si"],
+            3: regs["bp"] + regs["di"], 4: regs["si"], 5: regs["di"], 6: regs["bp"], 7: regs["bx"]}[rm]
+    segment = "ss" if rm in (2, 3, 6) else "ds"
+    return (base + disp) & 0xFFFF, segment
+
+
+# The result of the operation, or None for a divide error.
+def operate(op, word, acc, operand):
+    bits = 16 if word else 8
+    mask = (1 << bits) - 1
+    if op == 4:
+        product = acc & mask
+        product *= operand
+        return product, (product >> bits) != 0
+    if op == 5:
+        product = signed(acc & mask, bits) * signed(operand, bits)
+        overflow = product != signed(product & mask, bits)
+        return product & ((1 << (2 * bits)) - 1), overflow
+    if operand == 0:
+        return None
+    if op == 6:
+        quotient, remainder = divmod(acc, operand)
+        if quotient > mask:
+            return None
+        return (remainder << bits) | quotient, None
+    dividend, divisor = signed(acc, 2 * bits), signed(operand, bits)
+    quotient = abs(dividend) // abs(divisor)
+    if (dividend < 0) != (divisor < 0):
+        quotient = -quotient
+    remainder = dividend - quotient * divisor
+    limit = (1 << (bits - 1)) - 1
+    if quotient > limit or quotient < -limit:
+        return None
+    return ((remainder & mask) << bits) | (quotient & mask), None
+
+
+def interesting(bits):
+    top = 1 << (bits - 1)
+    return [0, 1, 2, top - 1, top, top + 1, (1 << bits) - 1, (1 << bits) - 2]
+
+
+def make_test(rng, opcode, op, index):
+    word = opcode == 0xF7
+    bits = 16 if word else 8
+    while True:
+        regs = {name: rng.randrange(0x10000) for name in REGS + SEGS}
+        regs["ip"] = rng.randrange(0x10000)
+        regs["flags"] = FLAGS_FIXED | (rng.randrange(0x10000) & FLAGS_RANDOM)
+        ram = {}
+
+        # Edge cases for the first part of each file, random after that.
+        edges = interesting(bits)
+        if op >= 6 and index >= 64 and index < 96:
+            # Quotients either side of the largest one that fits.
+            top = (1 << bits) - 1 if op == 6 else (1 << (bits - 1)) - 1
+            quotient = [top, top + 1, -top, -top - 1][index % 4] if op == 7 else [top, top + 1][index % 2]
+            divisor = rng.randrange(1, 1 << (bits - 1))
+            if op == 7 and rng.randrange(2):
+                divisor = -divisor
+            remainder = rng.randrange(divisor if divisor > 0 else -divisor)
+            if quotient * divisor < 0 or (quotient == 0 and divisor < 0):
+                remainder = -remainder
+            operand = divisor & ((1 << bits) - 1)
+            acc = (quotient * divisor + remainder) & ((1 << (2 * bits)) - 1)
+        elif index < 64:
+            operand = edges[index % len(edges)]
+            acc_edges = interesting(2 * bits if op >= 6 else bits)
+            acc = acc_edges[(index // len(edges)) % len(acc_edges)]
+            if rng.randrange(2):
+                acc ^= rng.randrange(1 << bits) << (bits if op >= 6 else 0)
+        else:
+            operand = rng.randrange(1 << bits)
+            acc = rng.randrange(1 << (2 * bits if op >= 6 else bits))
+            # Divides that mostly fit, so that results are checked, not
+            # just divide errors.
+            if op >= 6 and operand and rng.randrange(4):
+                acc = (rng.randrange(operand << (bits - 1)) if op == 7 else rng.randrange(operand << bits))
+                if op == 7 and rng.randrange(2):
+                    acc = (-acc) & ((1 << (2 * bits)) - 1)
+                if op == 7 and rng.randrange(2):
+                    operand = (-operand) & ((1 << bits) - 1)
+
+        if word:
+            regs["ax"] = acc & 0xFFFF
+            if op >= 6:
+                regs["dx"] = acc >> 16
+        else:
+            regs["ax"] = (regs["ax"] & 0xFF00) | (acc & 0xFF) if op < 6 else acc
+
+        # The operand, in a register or in memory.
+        memory = rng.randrange(2)
+        if memory:
+            mod, rm = rng.choice(EA_FORMS)
+            disp = rng.randrange(0x100) if mod == 1 else rng.randrange(0x10000) if mod == 2 or (mod == 0 and rm == 6) else 0
+            disp_bytes = [disp] if mod == 1 else [disp & 0xFF, disp >> 8] if mod == 2 or (mod == 0 and rm == 6) else []
+            if mod == 1:
+                disp = signed(disp, 8)
+            offset, segment = effective_address(regs, mod, rm, disp)
+            base = regs[segment] << 4
+            addresses = [(base + offset) & 0xFFFFF, (base + ((offset + 1) & 0xFFFF)) & 0xFFFFF]
+            ram[addresses[0]] = operand & 0xFF
+            if word:
+                ram[addresses[1]] = operand >> 8
+            name = EA_NAMES[rm] if not (mod == 0 and rm == 6) else ""
+            if mod == 0 and rm == 6:
+                name = "%04Xh" % (disp & 0xFFFF)
+            elif disp:
+                name += "%s%Xh" % ("-" if disp < 0 else "+", abs(disp) & 0xFFFF)
+            operand_name = "%s [%s]" % ("word" if word else "byte", name)
+        else:
+            mod, rm = 3, rng.randrange(8)
+            disp_bytes = []
+            # The operand register may be the accumulator itself.
+            if word:
+                if rm == 0:
+                    operand = regs["ax"]
+                elif rm == 2 and op >= 6:
+                    operand = regs["dx"]
+                else:
+                    regs[REGS[rm]] = operand
+            else:
+                if rm in (0, 4):
+                    operand = get_reg(regs, rm, False)
+                else:
+                    set_reg(regs, rm, False, operand)
+            operand_name = (WORD_NAMES if word else BYTE_NAMES)[rm]
+
+        code = [opcode, (mod << 6) | (op << 3) | rm] + disp_bytes
+        code_base = regs["cs"] << 4
+        code_addresses = [(code_base + ((regs["ip"] + i) & 0xFFFF)) & 0xFFFFF for i in range(len(code))]
+        stack_addresses = [((regs["ss"] << 4) + ((regs["sp"] - 6 + i) & 0xFFFF)) & 0xFFFFF for i in range(6)]
+        vector = [rng.randrange(0x100) for _ in range(4)]
+
+        # Keep the code, the operand, the stack and the vector apart.
+        used = list(code_addresses) + stack_addresses + [0, 1, 2, 3]
+        if memory:
+            used += addresses[:2 if word else 1]
+        if len(set(used)) != len(used):
+            continue
+        for address, value in zip(code_addresses, code):
+            ram[address] = value
+        break
+
+    initial_regs = dict(regs)
+    if word:
+        acc = regs["ax"] | ((regs["dx"] << 16) if op >= 6 else 0)
+    else:
+        acc = regs["ax"] if op >= 6 else regs["ax"] & 0xFF
+    result = operate(op, word, acc, operand)
+    next_ip = (regs["ip"] + len(code)) & 0xFFFF
+    final_ram = dict(ram)
+    if result is None:
+        for i in range(4):
+            ram[i] = vector[i]
+            final_ram[i] = vector[i]
+        for address in stack_addresses:
+            ram[address] = 0
+        pushed = [next_ip, regs["cs"], regs["flags"]]
+        for i, value in enumerate(pushed):
+            final_ram[stack_addresses[2 * i]] = value & 0xFF
+            final_ram[stack_addresses[2 * i + 1]] = value >> 8
+        regs["sp"] = (regs["sp"] - 6) & 0xFFFF
+        regs["flags"] &= ~(FLAG_TRAP | FLAG_INTENABLE)
+        regs["cs"] = vector[2] | (vector[3] << 8)
+        regs["ip"] = vector[0] | (vector[1] << 8)
+    else:
+        value, overflow = result
+        if word:
+            regs["ax"] = value & 0xFFFF
+            regs["dx"] = value >> 16
+        else:
+            regs["ax"] = value & 0xFFFF
+        if overflow is not None:
+            regs["flags"] &= ~(FLAG_CARRY | FLAG_OVERFLOW)
+            if overflow:
+                regs["flags"] |= FLAG_CARRY | FLAG_OVERFLOW
+        regs["ip"] = next_ip
+
+    return {
+        "name": "%s %s" % (MNEMONICS[op], operand_name),
+        "bytes": code,
+        "initial": {
+            "regs": initial_regs,
+            "ram": sorted([address, value] for address, value in ram.items()),
+            "queue": [],
+        },
+        "final": {
+            "regs": {name: value for name, value in regs.items() if initial_regs[name] != value},
+            "ram": sorted([address, value] for address, value in final_ram.items()),
+            "queue": [],
+        },
+    }
+
+
+def main():
+    directory = sys.argv[1] if len(sys.argv) > 1 else "."
+    count = int(sys.argv[2]) if len(sys.argv) > 2 else 256
+    for opcode in (0xF6, 0xF7):
+        for op in range(4, 8):
+            rng = random.Random("%02X.%u" % (opcode, op))
+            tests = [make_test(rng, opcode, op, i) for i in range(count)]
+            with open("%s/%02X.%u.json" % (directory, opcode, op), "w") as file:
+                file.write("[\n")
+                file.write(",\n".join(json.dumps(test, separators=(",", ":")) for test in tests))
+                file.write("\n]\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,82 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Helpers shared by the tests. Each test is its own program: it returns 0 if
+// every check passed, 1 if any failed, and TEST_SKIP if it could not run at
+// all (see tests/CMakeLists.txt).
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bus.h"
+#include "cpu8086.h"
+
+#define TEST_SKIP 77
+
+static unsigned test_failures;
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            test_failures++; \
+        } \
+    } while (0)
+
+static inline int test_result(void)
+{
+    if (test_failures)
+        fprintf(stderr, "%u check(s) failed\n", test_failures);
+    return test_failures ? 1 : 0;
+}
+
+// Point the CPU at cs:ip with an empty prefetch queue, between instructions.
+// The general purpose registers are left alone.
+static inline void test_jump(struct cpu8086* cpu, uint16_t cs, uint16_t ip)
+{
+    uint16_t segments[3] = { cpu->es, cpu->ss, cpu->ds };
+    cpu8086_reset(cpu);
+    cpu->es = segments[0];
+    cpu->ss = segments[1];
+    cpu->ds = segments[2];
+    cpu->cs = cs;
+    cpu->ip = cpu->current_ip = ip;
+    cpu8086_update_segments(cpu);
+}
+
+// Has the CPU finished the instruction it was executing, with nothing left
+// to wait for?
+static inline bool test_idle(const struct cpu8086* cpu)
+{
+    return cpu->stage == CPU8086_EXECUTING && cpu->cycles == 0 && cpu->uop_r == cpu->uop_w;
+}
+
+// Run one instruction at 0000:0100 (followed by NOPs), and return how many
+// clocks it took from an empty queue until it had fully executed.
+static inline unsigned test_run(struct bus* bus, const uint8_t* code, size_t length)
+{
+    struct cpu8086* cpu = bus->cpu;
+    uint16_t flags = cpu8086_get_flags(cpu);
+    memcpy(&bus->memory[0x100], code, length);
+    memset(&bus->memory[0x100 + length], 0x90, 16);
+    test_jump(cpu, 0x0000, 0x100);
+    cpu8086_set_flags(cpu, flags);
+
+    unsigned clocks = 0;
+    do
+    {
+        cpu8086_clock(cpu);
+        clocks++;
+        if (clocks > 1000000)
+        {
+            fprintf(stderr, "instruction did not finish\n");
+            exit(1);
+        }
+    } while (!test_idle(cpu));
+    return clocks;
+}
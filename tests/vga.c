@@ -0,0 +1,178 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// VGA memory access through the bus: write modes 0-3 with every ALU
+// function, rotate count, set/reset, bit mask and map mask, and read modes 0
+// and 1 (colour compare), against a plane at a time reference, checking the
+// planes, the latches and what reads return. Chain-4 addresses one plane per
+// byte.
+
+#include "test.h"
+#include "vga.h"
+
+#define OFFSETS 64
+
+static uint8_t planes[4][OFFSETS];
+static uint8_t latch[4];
+
+static uint8_t gc[9] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x0F, 0xFF };
+static uint8_t map_mask = 0x0F;
+
+static void set_gc(struct bus* bus, uint8_t index, uint8_t value)
+{
+    bus_out_byte(bus, 0x3CE, index);
+    bus_out_byte(bus, 0x3CF, value);
+    gc[index] = value;
+}
+
+static void set_seq(struct bus* bus, uint8_t index, uint8_t value)
+{
+    bus_out_byte(bus, 0x3C4, index);
+    bus_out_byte(bus, 0x3C5, value);
+}
+
+static uint8_t expand(unsigned bit)
+{
+    return bit ? 0xFF : 0x00;
+}
+
+// What a read returns, straight from the spec. It loads the latches too.
+static uint8_t reference_read(unsigned offset)
+{
+    for (unsigned plane = 0; plane < 4; plane++)
+        latch[plane] = planes[plane][offset];
+    if (!(gc[5] & 0x08))
+        return latch[gc[4] & 3];
+
+    // A bit is set where every plane cared about matches the colour compare.
+    uint8_t result = 0xFF;
+    for (unsigned plane = 0; plane < 4; plane++)
+        if (gc[7] & (1 << plane))
+            result &= ~(latch[plane] ^ expand(gc[2] & (1 << plane)));
+    return result;
+}
+
+static void reference_write(unsigned offset, uint8_t data)
+{
+    unsigned rotate = gc[3] & 7, function = (gc[3] >> 3) & 3;
+    uint8_t rotated = (uint8_t)((data >> rotate) | (data << (8 - rotate)));
+    for (unsigned plane = 0; plane < 4; plane++)
+    {
+        uint8_t value, mask = gc[8];
+        switch (gc[5] & 3)
+        {
+            case 0:
+                value = (gc[1] & (1 << plane)) ? expand(gc[0] & (1 << plane)) : rotated;
+                break;
+            case 1:
+                value = latch[plane];
+                mask = 0xFF;
+                break;
+            case 2:
+                value = expand(data & (1 << plane));
+                break;
+            default:
+                value = expand(gc[0] & (1 << plane));
+                mask &= rotated;
+                break;
+        }
+        if ((gc[5] & 3) != 1)
+        {
+            switch (function)
+            {
+                case 1: value &= latch[plane]; break;
+                case 2: value |= latch[plane]; break;
+                case 3: value ^= latch[plane]; break;
+            }
+        }
+        if (map_mask & (1 << plane))
+            planes[plane][offset] = (uint8_t)((value & mask) | (latch[plane] & ~mask));
+    }
+}
+
+static uint32_t packed(const uint8_t* bytes)
+{
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+int main(void)
+{
+    struct bus* bus = bus_new(0x100000, false);
+    struct vga* vga = vga_new(bus);
+    CHECK(vga);
+
+    // A plain write with the default registers stores to every plane.
+    bus_write_byte(bus, VGA_MEMORY, 0xA5);
+    CHECK(vga->planes[0] == 0xA5A5A5A5);
+    CHECK(bus->memory[VGA_MEMORY] == 0);
+    CHECK(bus_read_byte(bus, VGA_MEMORY) == 0xA5 && vga->latch == 0xA5A5A5A5);
+    for (unsigned plane = 0; plane < 4; plane++)
+        planes[plane][0] = 0xA5;
+
+    uint32_t seed = 1;
+    for (unsigned i = 0; i < 200000; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        uint32_t r = seed >> 8;
+
+        // Change a register now and then, mostly to the interesting values.
+        switch (r % 16)
+        {
+            case 0: set_gc(bus, 0, (uint8_t)(r >> 4)); break;                // Set/reset.
+            case 1: set_gc(bus, 1, (uint8_t)(r >> 4)); break;                // Enable set/reset.
+            case 2: set_gc(bus, 2, (uint8_t)(r >> 4)); break;                // Colour compare.
+            case 3: set_gc(bus, 3, (uint8_t)(r >> 4) & 0x1F); break;         // Rotate and function.
+            case 4: set_gc(bus, 4, (uint8_t)(r >> 4) & 0x03); break;         // Read plane.
+            case 5: set_gc(bus, 5, (uint8_t)(r >> 4) & 0x0B); break;         // Write and read mode.
+            case 6: set_gc(bus, 7, (uint8_t)(r >> 4)); break;                // Colour don't care.
+            case 7: set_gc(bus, 8, ((r >> 4) & 1) ? 0xFF : (uint8_t)(r >> 5)); break; // Bit mask.
+            case 8:
+                map_mask = ((r >> 4) & 1) ? 0x0F : (uint8_t)(r >> 5) & 0x0F;
+                set_seq(bus, 2, map_mask);
+                break;
+        }
+
+        // Read somewhere, which loads the latches, then write somewhere.
+        seed = seed * 1103515245 + 12345;
+        unsigned offset = (seed >> 8) % OFFSETS;
+        uint8_t expect = reference_read(offset);
+        uint8_t got = bus_read_byte(bus, VGA_MEMORY + offset);
+        if (got != expect || vga->latch != packed(latch))
+        {
+            if (test_failures++ < 20)
+                fprintf(stderr, "read %u (mode %u): %02X, latches %08X, expected %02X, %08X\n",
+                        offset, (gc[5] >> 3) & 1, got, vga->latch, expect, packed(latch));
+        }
+
+        seed = seed * 1103515245 + 12345;
+        offset = (seed >> 8) % OFFSETS;
+        uint8_t data = (uint8_t)(seed >> 16);
+        reference_write(offset, data);
+        bus_write_byte(bus, VGA_MEMORY + offset, data);
+        uint8_t bytes[4] = { planes[0][offset], planes[1][offset], planes[2][offset], planes[3][offset] };
+        if (vga->planes[offset] != packed(bytes))
+        {
+            if (test_failures++ < 20)
+                fprintf(stderr, "write %02X to %u (mode %u, gc %02X %02X %02X, mask %02X/%X): %08X, expected %08X\n",
+                        data, offset, gc[5] & 3, gc[0], gc[1], gc[3], gc[8], map_mask,
+                        vga->planes[offset], packed(bytes));
+        }
+    }
+
+    // Chain-4 picks the plane from the low 2 bits of the address, for both
+    // writes and reads.
+    set_gc(bus, 5, 0x40);
+    set_gc(bus, 3, 0x00);
+    set_gc(bus, 1, 0x00);
+    set_gc(bus, 8, 0xFF);
+    set_seq(bus, 2, 0x0F);
+    set_seq(bus, 4, 0x0E);
+    for (unsigned address = 0; address < 16; address++)
+        bus_write_byte(bus, VGA_MEMORY + 0x1000 + address, (uint8_t)(0x10 + address));
+    for (unsigned offset = 0; offset < 4; offset++)
+        CHECK(vga->planes[0x400 + offset] == 0x13121110 + offset * 0x04040404);
+    CHECK(bus_read_byte(bus, VGA_MEMORY + 0x1006) == 0x16 && vga->latch == 0x17161514);
+
+    bus_free(bus);
+    return test_result();
+}
@@ -0,0 +1,112 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// Text screens read back: code page 437 cells written through the bus come
+// out as UTF-8, cut off at a whole character and terminated right after it
+// when the buffer is short, and text matches fire when their text appears on
+// a written row (or, once added, wherever it already is), and not again
+// while it stays there.
+
+#include "test.h"
+#include "cga.h"
+
+struct hits
+{
+    unsigned count;
+    unsigned row;
+    unsigned col;
+};
+
+static void found(void* context, unsigned row, unsigned col)
+{
+    struct hits* hits = context;
+    hits->count++;
+    hits->row = row;
+    hits->col = col;
+}
+
+static void put(struct bus* bus, unsigned row, unsigned col, const char* cells)
+{
+    for (unsigned i = 0; cells[i]; i++)
+    {
+        bus_write_byte(bus, CGA_VRAM + (row * 80 + col + i) * 2, (uint8_t)cells[i]);
+        bus_write_byte(bus, CGA_VRAM + (row * 80 + col + i) * 2 + 1, 0x07);
+    }
+}
+
+int main(void)
+{
+    struct bus* bus = bus_new(0x100000, false);
+    struct cga* cga = cga_new(bus, NULL);
+    CHECK(cga);
+    struct video_text text;
+    CHECK(cga_text(bus, cga, &text));
+
+    // "Hi", e acute, a double box corner and a smiley; a blank row; a row
+    // with leading and trailing spaces. Blank cells are NULs.
+    put(bus, 0, 0, "Hi\x82\xC9\x01");
+    put(bus, 2, 0, "  x   ");
+    static const char expect[] = "Hi\xC3\xA9\xE2\x95\x94\xE2\x98\xBA\n\n  x\n"
+                                 "\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n";
+    size_t length = strlen(expect);
+
+    char buffer[sizeof(expect) + 16];
+    CHECK(video_text_utf8(&text, buffer, sizeof(buffer)) == length);
+    CHECK(strcmp(buffer, expect) == 0);
+
+    // Short buffers hold as many whole characters as fit, terminated
+    // straight after them.
+    for (size_t size = 0; size <= length + 1; size++)
+    {
+        size_t fits = 0;
+        for (size_t i = 1; i <= length && i < size; i++)
+            if ((expect[i] & 0xC0) != 0x80)
+                fits = i;
+        memset(buffer, 0x55, sizeof(buffer));
+        size_t got = video_text_utf8(&text, buffer, size);
+        bool ok = got == length;
+        if (size)
+            ok = ok && strlen(buffer) == fits && memcmp(buffer, expect, fits) == 0;
+        ok = ok && (unsigned char)buffer[size] == 0x55;
+        if (!ok && test_failures++ < 20)
+            fprintf(stderr, "%zu byte buffer: returned %zu, wrote %zu bytes, expected %zu of %zu\n",
+                    size, got, size ? strlen(buffer) : 0, fits, length);
+    }
+
+    // Text already on screen is found at the next frame, without any writes,
+    // and only once.
+    struct hits hits = { 0 };
+    cga_compose(bus, cga);
+    int index = video_match_add(&cga->matches, "\xC3\xA9\xE2\x95\x94\xE2\x98\xBA", found, &hits);
+    CHECK(index >= 0);
+    cga_compose(bus, cga);
+    CHECK(hits.count == 1 && hits.row == 0 && hits.col == 2);
+    CHECK(!cga->matches.rescan);
+    for (unsigned frame = 0; frame < 20; frame++)
+        cga_compose(bus, cga);
+    CHECK(hits.count == 1);
+
+    // Written elsewhere, it is found there.
+    put(bus, 5, 10, "\x82\xC9\x01");
+    cga_compose(bus, cga);
+    CHECK(hits.count == 2 && hits.row == 5 && hits.col == 10);
+
+    // Taken away and put back.
+    put(bus, 0, 2, "e");
+    cga_compose(bus, cga);
+    CHECK(hits.count == 2);
+    put(bus, 0, 2, "\x82");
+    cga_compose(bus, cga);
+    CHECK(hits.count == 3 && hits.row == 0 && hits.col == 2);
+
+    // Text code page 437 cannot show is refused, and a removed match stays
+    // quiet.
+    CHECK(video_match_add(&cga->matches, "\xE2\x82\xAC", found, &hits) == -1);
+    video_match_remove(&cga->matches, index);
+    put(bus, 7, 0, "\x82\xC9\x01");
+    cga_compose(bus, cga);
+    CHECK(hits.count == 3);
+
+    bus_free(bus);
+    return test_result();
+}